@@ -23,13 +23,25 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <gst/gst.h>
+#include <gst/allocators/allocators.h>
 #include "gstaja.h"
 #include "gstajavideosrc.h"
 #include "gstajavideosink.h"
 #include "gstajaaudiosrc.h"
 #include "gstajaaudiosink.h"
+#include "gstajashmsrc.h"
 #include "gstajadeviceprovider.h"
+#include "gstntv2scheduler.h"
+#include "gstntv2arena.h"
+#include "gstntv2copy.h"
+#include "gstntv2export.h"
+#include "gstntv2realtime.h"
+#include "gstntv2topology.h"
 
 #include "ajabase/system/memory.h"
 
@@ -46,28 +58,41 @@ struct _Device
 {
   GstAjaOutput output[NTV2_MAX_NUM_CHANNELS];
   GstAjaInput input[NTV2_MAX_NUM_CHANNELS];
+  NTV2GstScheduler *scheduler;
+  NTV2GstArena *arena;
 };
 
 G_LOCK_DEFINE_STATIC (devices);
 static GHashTable *devices;
 
-GstAjaInput *
-gst_aja_acquire_input (const gchar * inDeviceSpecifier, gint channel,
-    GstElement * src, gboolean is_audio)
+// Entry of a device, created on first use. Called with the devices lock held.
+static Device *
+_aja_get_device (const gchar * inDeviceSpecifier)
 {
-  GstAjaInput *input;
-
-  g_return_val_if_fail (channel >= 0 && channel < NTV2_MAX_NUM_CHANNELS, NULL);
+  Device *device;
 
-  G_LOCK (devices);
   if (!devices)
     devices = g_hash_table_new (g_str_hash, g_str_equal);
-  Device *device = (Device *) g_hash_table_lookup (devices, inDeviceSpecifier);
+  device = (Device *) g_hash_table_lookup (devices, inDeviceSpecifier);
   if (!device) {
     device = g_new0 (Device, 1);
     g_hash_table_insert (devices, g_strdup (inDeviceSpecifier),
         (gpointer) device);
   }
+
+  return device;
+}
+
+GstAjaInput *
+gst_aja_acquire_input (const gchar * inDeviceSpecifier, gint channel,
+    GstElement * src, gboolean is_audio)
+{
+  GstAjaInput *input;
+
+  g_return_val_if_fail (channel >= 0 && channel < NTV2_MAX_NUM_CHANNELS, NULL);
+
+  G_LOCK (devices);
+  Device *device = _aja_get_device (inDeviceSpecifier);
   input = &device->input[channel];
 
   g_mutex_lock (&input->lock);
@@ -78,23 +103,257 @@ gst_aja_acquire_input (const gchar * inDeviceSpecifier, gint channel,
         new NTV2GstAV (std::string (inDeviceSpecifier), (NTV2Channel) channel);
   }
 
-  if (is_audio && !input->audiosrc) {
-    input->audiosrc = GST_ELEMENT_CAST (gst_object_ref (src));
-    g_mutex_unlock (&input->lock);
-    G_UNLOCK (devices);
-    return input;
-  } else if (!input->videosrc) {
-    input->videosrc = GST_ELEMENT_CAST (gst_object_ref (src));
-    g_mutex_unlock (&input->lock);
-    G_UNLOCK (devices);
-    return input;
+  // Any number of sources share the input, the first one of a kind
+  // configures it
+  src = GST_ELEMENT_CAST (gst_object_ref (src));
+  if (is_audio) {
+    if (!input->audiosrc)
+      input->audiosrc = GST_ELEMENT_CAST (gst_object_ref (src));
+    input->audiosrcs = g_list_append (input->audiosrcs, src);
+  } else {
+    if (!input->videosrc)
+      input->videosrc = GST_ELEMENT_CAST (gst_object_ref (src));
+    input->videosrcs = g_list_append (input->videosrcs, src);
   }
+  g_atomic_int_inc (&input->num_srcs);
   g_mutex_unlock (&input->lock);
   G_UNLOCK (devices);
 
-  GST_ERROR ("Input device %s (audio: %d) in use already", inDeviceSpecifier,
-      is_audio);
-  return NULL;
+  return input;
+}
+
+// Detaches a source from the input, with the input's lock held. If it was the
+// one that configured the input, the next one that attached takes its place.
+// Returns TRUE if it was the last source of its kind.
+gboolean
+gst_aja_release_input (GstAjaInput * input, GstElement * src,
+    gboolean is_audio)
+{
+  GList **srcs = is_audio ? &input->audiosrcs : &input->videosrcs;
+  GstElement **first = is_audio ? &input->audiosrc : &input->videosrc;
+  GList *link = g_list_find (*srcs, src);
+
+  if (link) {
+    *srcs = g_list_delete_link (*srcs, link);
+    g_atomic_int_add (&input->num_srcs, -1);
+    gst_object_unref (src);
+  }
+
+  if (*first == src) {
+    gst_object_unref (*first);
+    *first = *srcs ? GST_ELEMENT_CAST (gst_object_ref ((*srcs)->data)) : NULL;
+  }
+
+  return *srcs == NULL;
+}
+
+// Whether more than one source takes the frames of the input, and with them
+// its delivery thread. Safe without the input's lock.
+gboolean
+gst_aja_input_is_shared (GstAjaInput * input)
+{
+  return g_atomic_int_get (&input->num_srcs) > 1;
+}
+
+// Blocking holds up the delivery thread, and with it every other source of
+// the input. Unless the input is ours alone the oldest queued are dropped.
+GstAjaQueuePolicy
+gst_aja_queue_get_policy (GstAjaInput * input, GstAjaQueuePolicy policy)
+{
+  if (policy == GST_AJA_QUEUE_POLICY_BLOCK && gst_aja_input_is_shared (input))
+    return GST_AJA_QUEUE_POLICY_DROP_OLDEST;
+
+  return policy;
+}
+
+// Items the queue holds at most, queue-size or less within max-latency
+guint
+gst_aja_queue_get_limit (NTV2GstLeakyRingBase * ring, guint queue_size,
+    GstClockTime max_latency, gint * depth)
+{
+  guint limit = queue_size;
+
+  if (max_latency > 0)
+    limit = MIN (limit, (guint) g_atomic_int_get (depth));
+
+  return MIN (limit, ring->GetCapacity ());
+}
+
+// An item would only be dropped again unless there is room for it or we'd
+// wait for that
+static gint
+gst_aja_queue_get_room (GstAjaInput * input, NTV2GstLeakyRingBase * ring,
+    GstAjaQueuePolicy policy, guint queue_size, GstClockTime max_latency,
+    gint * depth)
+{
+  if (gst_aja_queue_get_policy (input, policy) == GST_AJA_QUEUE_POLICY_BLOCK)
+    return G_MAXINT;
+
+  return MAX ((gint) gst_aja_queue_get_limit (ring, queue_size, max_latency,
+          depth) - (gint) ring->GetLength (), 0);
+}
+
+// Publishes the room for the capture thread, called by whichever thread
+// changed the queue or its limit. Checks again after publishing, so that a
+// value another thread computed earlier but published later doesn't stick.
+void
+gst_aja_queue_update_room (GstAjaInput * input, NTV2GstLeakyRingBase * ring,
+    GstAjaQueuePolicy policy, guint queue_size, GstClockTime max_latency,
+    gint * depth, gint * room)
+{
+  gint value;
+
+  do {
+    value = gst_aja_queue_get_room (input, ring, policy, queue_size,
+        max_latency, depth);
+    g_atomic_int_set (room, value);
+  } while (gst_aja_queue_get_room (input, ring, policy, queue_size,
+          max_latency, depth) != value);
+}
+
+// Capture thread only, for blocking. Downstream has until the item would be
+// over budget to make room, a frame if there is none. FALSE if it didn't.
+gboolean
+gst_aja_queue_wait_room (GstAjaInput * input, NTV2GstLeakyRingBase * ring,
+    guint limit, GstClockTime max_latency)
+{
+  GstClockTime timeout = max_latency;
+
+  if (timeout == 0)
+    timeout = gst_util_uint64_scale_ceil (GST_SECOND, input->mode->fps_d,
+        input->mode->fps_n);
+
+  return ring->WaitLength (limit, timeout);
+}
+
+// Streaming thread only, whenever downstream is back for the next item.
+// Sizes the queue within max-latency, if any.
+void
+gst_aja_queue_tune (GstElement * element, GstAjaQueueTuner * tuner,
+    GstClockTime frame_duration, GstClockTime max_latency, guint queue_size,
+    gint * depth)
+{
+  if (max_latency == 0)
+    return;
+
+  g_atomic_int_set (depth, gst_aja_queue_tuner_update (tuner,
+          gst_aja_get_running_time (element), frame_duration, max_latency,
+          queue_size));
+}
+
+void
+gst_aja_queue_tuner_reset (GstAjaQueueTuner * tuner)
+{
+  tuner->last_take = GST_CLOCK_TIME_NONE;
+  tuner->jitter = 0;
+}
+
+// Called for every frame taken, returns the queue depth to use from now on.
+// Enough frames to ride out the worst recent stall downstream plus one, but
+// never more than the budget can hold, older ones would be dropped anyway.
+guint
+gst_aja_queue_tuner_update (GstAjaQueueTuner * tuner, GstClockTime now,
+    GstClockTime frame_duration, GstClockTime max_latency, guint max_depth)
+{
+  guint depth, budget_depth;
+
+  if (!GST_CLOCK_TIME_IS_VALID (frame_duration) || frame_duration == 0)
+    return max_depth;
+
+  if (GST_CLOCK_TIME_IS_VALID (now)) {
+    if (GST_CLOCK_TIME_IS_VALID (tuner->last_take) && now > tuner->last_take) {
+      GstClockTime interval = now - tuner->last_take;
+      GstClockTime late = interval > frame_duration ? interval - frame_duration : 0;
+
+      // Follows a stall right away, forgets it over a few dozen frames
+      tuner->jitter = MAX (late, tuner->jitter - tuner->jitter / 16);
+    }
+    tuner->last_take = now;
+  }
+
+  depth = 2 + (guint) ((tuner->jitter + frame_duration - 1) / frame_duration);
+  budget_depth = (guint) MIN (max_latency / frame_duration, (GstClockTime) G_MAXUINT);
+
+  return CLAMP (depth, 1, MAX (MIN (budget_depth, max_depth), 1));
+}
+
+// Running time of the element's clock now, NONE if it has no clock yet
+GstClockTime
+gst_aja_get_running_time (GstElement * element)
+{
+  GstClock *clock = gst_element_get_clock (element);
+  GstClockTime now, base_time;
+
+  if (!clock)
+    return GST_CLOCK_TIME_NONE;
+
+  now = gst_clock_get_time (clock);
+  base_time = gst_element_get_base_time (element);
+  gst_object_unref (clock);
+
+  return now > base_time ? now - base_time : 0;
+}
+
+// Running time at which the device captured a buffer, from its time stamp in
+// 100 ns units of the real time clock
+GstClockTime
+gst_aja_get_capture_running_time (GstElement * element, guint64 timeStamp)
+{
+  GstClockTime now = gst_aja_get_running_time (element);
+  gint64 now_sys = g_get_real_time ();
+  gint64 capture_sys = (gint64) (timeStamp / 10);
+  GstClockTime delay = 0;
+
+  if (!GST_CLOCK_TIME_IS_VALID (now))
+    return GST_CLOCK_TIME_NONE;
+
+  if (now_sys >= capture_sys && now_sys - capture_sys < 1000000 /* 1s */ )
+    delay = (now_sys - capture_sys) * GST_USECOND;
+
+  return now > delay ? now - delay : 0;
+}
+
+NTV2GstScheduler *
+gst_aja_acquire_scheduler (const gchar * inDeviceSpecifier, guint numThreads)
+{
+  NTV2GstScheduler *scheduler;
+
+  g_return_val_if_fail (numThreads > 0, NULL);
+
+  G_LOCK (devices);
+  Device *device = _aja_get_device (inDeviceSpecifier);
+
+  // Created by the first source asking for it and shared by all channels of
+  // the device from then on
+  if (!device->scheduler) {
+    device->scheduler =
+        new NTV2GstScheduler (std::string (inDeviceSpecifier), numThreads);
+  } else if (device->scheduler->GetNumThreads () != numThreads) {
+    GST_WARNING ("Capture scheduler of device %s already running with %u threads",
+        inDeviceSpecifier, device->scheduler->GetNumThreads ());
+  }
+  scheduler = device->scheduler;
+  G_UNLOCK (devices);
+
+  return scheduler;
+}
+
+NTV2GstArena *
+gst_aja_acquire_arena (const gchar * inDeviceSpecifier)
+{
+  NTV2GstArena *arena;
+
+  G_LOCK (devices);
+  Device *device = _aja_get_device (inDeviceSpecifier);
+
+  // Like the scheduler, lives as long as the process so that its memory
+  // survives the sources using it
+  if (!device->arena)
+    device->arena = new NTV2GstArena (std::string (inDeviceSpecifier));
+  arena = device->arena;
+  G_UNLOCK (devices);
+
+  return arena;
 }
 
 // *INDENT-OFF*
@@ -630,6 +889,111 @@ gst_aja_timecode_mode_get_type (void)
     return (GType) id;
 }
 
+GType
+gst_aja_realtime_policy_get_type (void)
+{
+    static gsize id = 0;
+    static const GEnumValue policies[] =
+    {
+        {NTV2_REALTIME_POLICY_NONE,   "none",   "Default priority"},
+        {NTV2_REALTIME_POLICY_FIFO,   "fifo",   "SCHED_FIFO"},
+        {NTV2_REALTIME_POLICY_RR,     "rr",     "SCHED_RR"},
+        {0,                           NULL,     NULL}
+    };
+    
+    if (g_once_init_enter (&id))
+    {
+        GType tmp = g_enum_register_static ("GstAjaRealtimePolicy", policies);
+        g_once_init_leave (&id, tmp);
+    }
+    
+    return (GType) id;
+}
+
+GType
+gst_aja_queue_policy_get_type (void)
+{
+    static gsize id = 0;
+    static const GEnumValue policies[] =
+    {
+        {GST_AJA_QUEUE_POLICY_DROP_OLDEST, "drop-oldest", "Drop the oldest queued frame"},
+        {GST_AJA_QUEUE_POLICY_DROP_NEWEST, "drop-newest", "Drop the frame just captured"},
+        {GST_AJA_QUEUE_POLICY_BLOCK,       "block",       "Hold up the capture thread until there is room, within max-latency"},
+        {0,                                NULL,          NULL}
+    };
+    
+    if (g_once_init_enter (&id))
+    {
+        GType tmp = g_enum_register_static ("GstAjaQueuePolicy", policies);
+        g_once_init_leave (&id, tmp);
+    }
+    
+    return (GType) id;
+}
+
+GType
+gst_aja_exhaustion_policy_get_type (void)
+{
+    static gsize id = 0;
+    static const GEnumValue policies[] =
+    {
+        {NTV2_EXHAUSTION_POLICY_GROW,     "grow",     "Allocate more buffers on the capture thread"},
+        {NTV2_EXHAUSTION_POLICY_COPY_OUT, "copy-out", "Copy held buffers out of DMA memory, drop frames if that's not enough"},
+        {NTV2_EXHAUSTION_POLICY_DROP,     "drop",     "Drop frames"},
+        {0,                               NULL,       NULL}
+    };
+    
+    if (g_once_init_enter (&id))
+    {
+        GType tmp = g_enum_register_static ("GstAjaExhaustionPolicy", policies);
+        g_once_init_leave (&id, tmp);
+    }
+    
+    return (GType) id;
+}
+
+GType
+gst_aja_export_mode_get_type (void)
+{
+    static gsize id = 0;
+    static const GEnumValue modes[] =
+    {
+        {NTV2_EXPORT_MODE_NONE,   "none",   "System memory of this process"},
+        {NTV2_EXPORT_MODE_MEMFD,  "memfd",  "Memfd backed file descriptor memory"},
+        {NTV2_EXPORT_MODE_DMABUF, "dmabuf", "DMABufs made by udmabuf, memfds if unavailable"},
+        {0,                       NULL,     NULL}
+    };
+    
+    if (g_once_init_enter (&id))
+    {
+        GType tmp = g_enum_register_static ("GstAjaExportMode", modes);
+        g_once_init_leave (&id, tmp);
+    }
+    
+    return (GType) id;
+}
+
+GType
+gst_aja_huge_pages_get_type (void)
+{
+    static gsize id = 0;
+    static const GEnumValue sizes[] =
+    {
+        {GST_AJA_HUGE_PAGES_NONE,   "none",   "Regular pages"},
+        {GST_AJA_HUGE_PAGES_2MB,    "2mb",    "2 MiB huge pages"},
+        {GST_AJA_HUGE_PAGES_1GB,    "1gb",    "1 GiB huge pages, 2 MiB for small pools"},
+        {0,                         NULL,     NULL}
+    };
+    
+    if (g_once_init_enter (&id))
+    {
+        GType tmp = g_enum_register_static ("GstAjaHugePages", sizes);
+        g_once_init_leave (&id, tmp);
+    }
+    
+    return (GType) id;
+}
+
 GType
 gst_aja_audio_input_mode_get_type (void)
 {
@@ -745,7 +1109,40 @@ gst_aja_clock_get_internal_time (GstClock * clock)
 
 G_DEFINE_TYPE (GstAjaBufferPool, gst_aja_buffer_pool, GST_TYPE_BUFFER_POOL);
 
-static GQuark video_buffer_quark, audio_buffer_quark;
+static GQuark video_buffer_quark, audio_buffer_quark, held_buffer_quark;
+
+static gboolean _aja_allocator_copy_out (GstMemory * mem);
+
+// An outstanding buffer of a pool. Holds its own reference to the buffer's
+// memory, the buffer itself is downstream's and might change at any time.
+// Allocated with the buffer and kept in its qdata, so that acquiring and
+// releasing it neither allocates nor searches.
+typedef struct
+{
+  GList link;                               // In the pool's held queue while queued
+  gboolean queued;
+  GstBuffer *buffer;
+  GstMemory *memory;
+  gboolean delivered;                       // Handed downstream, nothing of the capture side still points into it
+  gboolean copying;
+  gboolean copied_out;
+  guint pass;                               // Last gst_aja_buffer_pool_copy_out that tried it
+} GstAjaHeldBuffer;
+
+static void
+_aja_held_buffer_free (GstAjaHeldBuffer * held)
+{
+  if (held->memory)
+    gst_memory_unref (held->memory);
+  g_slice_free (GstAjaHeldBuffer, held);
+}
+
+static GstAjaHeldBuffer *
+_aja_buffer_pool_get_held (GstBuffer * buffer)
+{
+  return (GstAjaHeldBuffer *) gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST
+      (buffer), held_buffer_quark);
+}
 
 static gboolean
 gst_aja_buffer_pool_set_config (GstBufferPool * pool, GstStructure * config)
@@ -762,6 +1159,10 @@ gst_aja_buffer_pool_set_config (GstBufferPool * pool, GstStructure * config)
           NULL))
     return FALSE;
 
+  GstAllocator *allocator = NULL;
+  gst_buffer_pool_config_get_allocator (config, &allocator, NULL);
+  aja_pool->allocator = allocator && GST_IS_Aja_ALLOCATOR (allocator) ? allocator : NULL;
+
   return TRUE;
 }
 
@@ -782,13 +1183,24 @@ gst_aja_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer,
     GstBufferPoolAcquireParams * params)
 {
   GstAjaBufferPool *aja_pool = GST_AJA_BUFFER_POOL (pool);
-  GstFlowReturn ret;
+  GstFlowReturn ret = GST_FLOW_OK;
 
-  ret =
-      GST_BUFFER_POOL_CLASS (gst_aja_buffer_pool_parent_class)->alloc_buffer
-      (pool, buffer, params);
-  if (ret != GST_FLOW_OK)
-    return ret;
+  // Exported memory isn't the allocator's own, the pool can't allocate it
+  if (aja_pool->allocator && GST_AJA_ALLOCATOR (aja_pool->allocator)->exports) {
+    GstMemory *mem = gst_aja_allocator_alloc_exported (aja_pool->allocator,
+        aja_pool->size);
+
+    if (!mem)
+      return GST_FLOW_ERROR;
+    *buffer = gst_buffer_new ();
+    gst_buffer_append_memory (*buffer, mem);
+  } else {
+    ret =
+        GST_BUFFER_POOL_CLASS (gst_aja_buffer_pool_parent_class)->alloc_buffer
+        (pool, buffer, params);
+    if (ret != GST_FLOW_OK)
+      return ret;
+  }
 
   if (!aja_pool->is_video) {
     AjaAudioBuff *audioBuff = new AjaAudioBuff;
@@ -807,14 +1219,40 @@ gst_aja_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer,
     videoBuff->videoBufferSize = 0;
     videoBuff->videoDataSize = 0;
     videoBuff->isNvmm = false;
+    videoBuff->isForeign = false;
+    videoBuff->shmSlot = -1;
 
     gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (*buffer),
         video_buffer_quark, videoBuff, (GDestroyNotify) aja_video_buff_free);
   }
 
+  GstAjaHeldBuffer *held = g_slice_new0 (GstAjaHeldBuffer);
+  held->link.data = held;
+  held->buffer = *buffer;
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (*buffer),
+      held_buffer_quark, held, (GDestroyNotify) _aja_held_buffer_free);
+
+  GST_OBJECT_LOCK (pool);
+  aja_pool->num_buffers++;
+  GST_OBJECT_UNLOCK (pool);
+
   return ret;
 }
 
+static void
+gst_aja_buffer_pool_free_buffer (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstAjaBufferPool *aja_pool = GST_AJA_BUFFER_POOL (pool);
+
+  GST_OBJECT_LOCK (pool);
+  if (aja_pool->num_buffers > 0)
+    aja_pool->num_buffers--;
+  GST_OBJECT_UNLOCK (pool);
+
+  GST_BUFFER_POOL_CLASS (gst_aja_buffer_pool_parent_class)->free_buffer (pool,
+      buffer);
+}
+
 static void
 gst_aja_buffer_pool_reset_buffer (GstBufferPool * pool, GstBuffer * buffer)
 {
@@ -835,9 +1273,77 @@ gst_aja_buffer_pool_reset_buffer (GstBufferPool * pool, GstBuffer * buffer)
       buffer);
 }
 
+static GstFlowReturn
+gst_aja_buffer_pool_acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstAjaBufferPool *aja_pool = GST_AJA_BUFFER_POOL (pool);
+  GstFlowReturn ret;
+
+  ret =
+      GST_BUFFER_POOL_CLASS (gst_aja_buffer_pool_parent_class)->acquire_buffer
+      (pool, buffer, params);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  // Nobody else sees the record until it's queued
+  GstAjaHeldBuffer *held = _aja_buffer_pool_get_held (*buffer);
+  if (held) {
+    held->delivered = FALSE;
+    held->copying = FALSE;
+    held->copied_out = FALSE;
+    held->pass = 0;
+    if (aja_pool->allocator && gst_buffer_n_memory (*buffer) == 1)
+      held->memory = gst_memory_ref (gst_buffer_peek_memory (*buffer, 0));
+  }
+
+  // How many buffers capture and downstream hold at once, to size the next pool
+  GST_OBJECT_LOCK (pool);
+  aja_pool->outstanding++;
+  aja_pool->peak_outstanding = MAX (aja_pool->peak_outstanding, aja_pool->outstanding);
+  if (held) {
+    g_queue_push_tail_link (&aja_pool->held, &held->link);
+    held->queued = TRUE;
+  }
+  GST_OBJECT_UNLOCK (pool);
+
+  return ret;
+}
+
 static void
 gst_aja_buffer_pool_release_buffer (GstBufferPool * pool, GstBuffer * buffer)
 {
+  GstAjaBufferPool *aja_pool = GST_AJA_BUFFER_POOL (pool);
+
+  GST_OBJECT_LOCK (pool);
+  if (aja_pool->outstanding > 0)
+    aja_pool->outstanding--;
+
+  GstAjaHeldBuffer *held = _aja_buffer_pool_get_held (buffer);
+  if (held && !held->queued)
+    held = NULL;
+  if (held) {
+    // Only delivered buffers are copied out. The capture thread discards the
+    // ones no consumer got without marking them, and the delivery thread
+    // leaves its releases to the streaming threads, so neither waits here.
+    while (held->copying)
+      g_cond_wait (&aja_pool->copy_out_cond, GST_OBJECT_GET_LOCK (pool));
+    g_queue_unlink (&aja_pool->held, &held->link);
+    held->queued = FALSE;
+  }
+  GST_OBJECT_UNLOCK (pool);
+
+  // Copied out buffers are ordinary memory now, let the pool free them and
+  // allocate a new one around the DMA block they gave back
+  if (held) {
+    if (held->copied_out)
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+    if (held->memory) {
+      gst_memory_unref (held->memory);
+      held->memory = NULL;
+    }
+  }
+
   // Free if something removed our qdata
   if (!gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
           audio_buffer_quark)
@@ -849,23 +1355,43 @@ gst_aja_buffer_pool_release_buffer (GstBufferPool * pool, GstBuffer * buffer)
       (pool, buffer);
 }
 
+static void
+gst_aja_buffer_pool_finalize (GObject * object)
+{
+  GstAjaBufferPool *aja_pool = GST_AJA_BUFFER_POOL (object);
+
+  // Every buffer keeps the pool alive, none can be held anymore, and the
+  // records go with the buffers
+  g_cond_clear (&aja_pool->copy_out_cond);
+
+  G_OBJECT_CLASS (gst_aja_buffer_pool_parent_class)->finalize (object);
+}
+
 static void
 gst_aja_buffer_pool_class_init (GstAjaBufferPoolClass * klass)
 {
+  GObjectClass *gobject_class = (GObjectClass *) klass;
   GstBufferPoolClass *buffer_pool_class = (GstBufferPoolClass *) klass;
 
+  gobject_class->finalize = gst_aja_buffer_pool_finalize;
+
   buffer_pool_class->set_config = gst_aja_buffer_pool_set_config;
   buffer_pool_class->alloc_buffer = gst_aja_buffer_pool_alloc_buffer;
+  buffer_pool_class->free_buffer = gst_aja_buffer_pool_free_buffer;
+  buffer_pool_class->acquire_buffer = gst_aja_buffer_pool_acquire_buffer;
   buffer_pool_class->reset_buffer = gst_aja_buffer_pool_reset_buffer;
   buffer_pool_class->release_buffer = gst_aja_buffer_pool_release_buffer;
 
   video_buffer_quark = g_quark_from_static_string ("AjaVideoBuff");
   audio_buffer_quark = g_quark_from_static_string ("AjaAudioBuff");
+  held_buffer_quark = g_quark_from_static_string ("AjaHeldBuffer");
 }
 
 static void
 gst_aja_buffer_pool_init (GstAjaBufferPool * buffer_pool)
 {
+  g_queue_init (&buffer_pool->held);
+  g_cond_init (&buffer_pool->copy_out_cond);
 }
 
 GstBufferPool *
@@ -877,6 +1403,142 @@ gst_aja_buffer_pool_new (void)
   return GST_BUFFER_POOL_CAST (self);
 }
 
+guint
+gst_aja_buffer_pool_get_peak_outstanding (GstBufferPool * pool)
+{
+  GstAjaBufferPool *aja_pool;
+  guint peak;
+
+  // The NVMM pool doesn't keep track
+  if (!GST_IS_Aja_BUFFER_POOL (pool))
+    return 0;
+
+  aja_pool = GST_AJA_BUFFER_POOL (pool);
+  GST_OBJECT_LOCK (pool);
+  peak = aja_pool->peak_outstanding;
+  GST_OBJECT_UNLOCK (pool);
+
+  return peak;
+}
+
+// DMA blocks the capture thread can take without allocating: the pool's free
+// buffers and the blocks its allocator has left
+guint
+gst_aja_buffer_pool_get_free (GstBufferPool * pool)
+{
+  GstAjaBufferPool *aja_pool;
+  GstAllocator *allocator;
+  guint num_free;
+
+  if (!GST_IS_Aja_BUFFER_POOL (pool))
+    return G_MAXUINT;
+
+  aja_pool = GST_AJA_BUFFER_POOL (pool);
+  GST_OBJECT_LOCK (pool);
+  num_free = aja_pool->num_buffers > aja_pool->outstanding ?
+      aja_pool->num_buffers - aja_pool->outstanding : 0;
+  allocator = aja_pool->allocator;
+  GST_OBJECT_UNLOCK (pool);
+
+  if (allocator) {
+    GST_OBJECT_LOCK (allocator);
+    num_free += GST_AJA_ALLOCATOR (allocator)->free_list->len;
+    GST_OBJECT_UNLOCK (allocator);
+  }
+
+  return num_free;
+}
+
+// Lets go of the capture side's reference to a buffer the consumers got.
+// If downstream still holds it, its memory may be copied out from then on.
+// The last reference goes straight back to the pool, copying it out would be
+// for nothing and its release would wait for that.
+void
+gst_aja_buffer_pool_release_delivered (GstBuffer * buffer)
+{
+  GstBufferPool *pool = buffer->pool;
+
+  if (pool && GST_IS_Aja_BUFFER_POOL (pool) &&
+      GST_MINI_OBJECT_REFCOUNT_VALUE (buffer) > 1) {
+    GST_OBJECT_LOCK (pool);
+    GstAjaHeldBuffer *held = _aja_buffer_pool_get_held (buffer);
+    if (held && held->queued)
+      held->delivered = TRUE;
+    GST_OBJECT_UNLOCK (pool);
+  }
+
+  gst_buffer_unref (buffer);
+}
+
+// Copies the memory of the oldest buffers held downstream to ordinary memory
+// until at least min_free DMA blocks are free again or no buffer is left to
+// copy. Buffers mapped at the moment are skipped. Returns the number of
+// buffers copied out.
+guint
+gst_aja_buffer_pool_copy_out (GstBufferPool * pool, guint min_free)
+{
+  GstAjaBufferPool *aja_pool;
+  guint pass, copied = 0;
+
+  if (!GST_IS_Aja_BUFFER_POOL (pool))
+    return 0;
+
+  aja_pool = GST_AJA_BUFFER_POOL (pool);
+  GST_OBJECT_LOCK (pool);
+  pass = ++aja_pool->copy_out_pass;
+  GST_OBJECT_UNLOCK (pool);
+
+  while (gst_aja_buffer_pool_get_free (pool) < min_free) {
+    GstAjaHeldBuffer *held = NULL;
+
+    GST_OBJECT_LOCK (pool);
+    for (GList * l = aja_pool->held.head; l; l = l->next) {
+      GstAjaHeldBuffer *candidate = (GstAjaHeldBuffer *) l->data;
+
+      if (candidate->memory && candidate->delivered &&
+          !candidate->copied_out && candidate->pass != pass) {
+        held = candidate;
+        break;
+      }
+    }
+    if (!held) {
+      GST_OBJECT_UNLOCK (pool);
+      break;
+    }
+    held->copying = TRUE;
+    held->pass = pass;
+    GST_OBJECT_UNLOCK (pool);
+
+    gboolean done = _aja_allocator_copy_out (held->memory);
+
+    GST_OBJECT_LOCK (pool);
+    held->copying = FALSE;
+    held->copied_out = done;
+    g_cond_broadcast (&aja_pool->copy_out_cond);
+    GST_OBJECT_UNLOCK (pool);
+
+    if (done)
+      copied++;
+  }
+
+  return copied;
+}
+
+// For one of several sources that got the same captured buffer: shares the
+// memory and copies the metadata into a buffer of its own, the captured one
+// stays alive, and out of its pool, until that is freed
+GstBuffer *
+gst_aja_buffer_share (GstBuffer * buffer)
+{
+  GstBuffer *shared = gst_buffer_new ();
+
+  gst_buffer_copy_into (shared, buffer, (GstBufferCopyFlags)
+      (GST_BUFFER_COPY_METADATA | GST_BUFFER_COPY_MEMORY), 0, -1);
+  gst_buffer_add_parent_buffer_meta (shared, buffer);
+
+  return shared;
+}
+
 AjaVideoBuff *
 gst_aja_buffer_get_video_buff (GstBuffer * buffer)
 {
@@ -885,6 +1547,31 @@ gst_aja_buffer_get_video_buff (GstBuffer * buffer)
       video_buffer_quark);
 }
 
+// Buffers of a downstream pool get theirs the first time they are captured
+// into, it stays with them while their pool reuses them
+AjaVideoBuff *
+gst_aja_buffer_ensure_video_buff (GstBuffer * buffer)
+{
+  AjaVideoBuff *videoBuff = gst_aja_buffer_get_video_buff (buffer);
+
+  if (videoBuff)
+    return videoBuff;
+
+  videoBuff = new AjaVideoBuff;
+  videoBuff->buffer = buffer;
+  videoBuff->pVideoBuffer = NULL;
+  videoBuff->videoBufferSize = 0;
+  videoBuff->videoDataSize = 0;
+  videoBuff->isNvmm = false;
+  videoBuff->isForeign = true;
+  videoBuff->shmSlot = -1;
+
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buffer),
+      video_buffer_quark, videoBuff, (GDestroyNotify) aja_video_buff_free);
+
+  return videoBuff;
+}
+
 AjaAudioBuff *
 gst_aja_buffer_get_audio_buff (GstBuffer * buffer)
 {
@@ -898,10 +1585,14 @@ typedef struct
   GstMemory mem;
 
   guint8 *data;
+  gint maps;                                // Mappings of it and its sub-memories, -1 while copying out
+  gboolean copied_out;                      // data is ordinary memory, the DMA block went back to the allocator
 } GstAjaMemory;
 
 G_DEFINE_TYPE (GstAjaAllocator, gst_aja_allocator, GST_TYPE_ALLOCATOR);
 
+static GQuark export_block_quark;
+
 static inline void
 _aja_memory_init (GstAjaAllocator *alloc, GstAjaMemory * mem, GstMemoryFlags flags,
     GstMemory * parent, gpointer data, gsize maxsize,
@@ -912,6 +1603,8 @@ _aja_memory_init (GstAjaAllocator *alloc, GstAjaMemory * mem, GstMemoryFlags fla
       4095, offset, size);
 
   mem->data = (guint8 *) data;
+  mem->maps = 0;
+  mem->copied_out = FALSE;
 }
 
 static inline GstAjaMemory *
@@ -928,6 +1621,197 @@ _aja_memory_new (GstAjaAllocator *alloc, GstMemoryFlags flags, GstAjaMemory * pa
   return mem;
 }
 
+// Keeps the block from being paged out if the real-time profile asks for it.
+// Only the first failure is logged, the pool keeps working unlocked.
+static void
+_aja_allocator_lock_block (GstAjaAllocator *alloc, guint8 * data)
+{
+  int res;
+
+  if (!alloc->lock_memory)
+    return;
+
+  res = NTV2GstRealtimeLockMemory (data, alloc->alloc_size);
+
+  GST_OBJECT_LOCK (alloc);
+  if (res == 0) {
+    alloc->num_locked++;
+    GST_OBJECT_UNLOCK (alloc);
+    return;
+  }
+  alloc->num_lock_failed++;
+  if (alloc->num_lock_failed > 1) {
+    GST_OBJECT_UNLOCK (alloc);
+    return;
+  }
+  GST_OBJECT_UNLOCK (alloc);
+
+  GST_WARNING_OBJECT (alloc, "Failed to lock %" G_GSIZE_FORMAT " bytes of pool memory: %s",
+      alloc->alloc_size, NTV2GstRealtimeDescribeError (res, true).c_str ());
+}
+
+// Maps a memfd backed block, NULL if memfds are unavailable. The first
+// failure turns exporting off for the allocator's later blocks.
+static guint8 *
+_aja_allocator_map_export (GstAjaAllocator *alloc)
+{
+  NTV2GstExportBlock *block = g_slice_new (NTV2GstExportBlock);
+  int res = 0;
+
+  GST_OBJECT_LOCK (alloc);
+  const NTV2GstExportMode mode = alloc->export_mode;
+  GST_OBJECT_UNLOCK (alloc);
+
+  if (mode == NTV2_EXPORT_MODE_NONE) {
+    g_slice_free (NTV2GstExportBlock, block);
+    return NULL;
+  }
+
+  if (!NTV2GstExportAllocBlock (alloc->alloc_size,
+          mode == NTV2_EXPORT_MODE_DMABUF, *block, res)) {
+    g_slice_free (NTV2GstExportBlock, block);
+    GST_WARNING_OBJECT (alloc, "Failed to create a memfd of %" G_GSIZE_FORMAT
+        " bytes, not exporting pool memory: %s", alloc->alloc_size,
+        g_strerror (res));
+    GST_OBJECT_LOCK (alloc);
+    alloc->export_mode = NTV2_EXPORT_MODE_NONE;
+    GST_OBJECT_UNLOCK (alloc);
+    return NULL;
+  }
+
+  GST_OBJECT_LOCK (alloc);
+  g_hash_table_insert (alloc->exports, block->data, block);
+  if (block->dmabuf >= 0)
+    alloc->num_dmabufs++;
+  GST_OBJECT_UNLOCK (alloc);
+
+  return block->data;
+}
+
+// Allocates a block on the device's NUMA node, faulted in and locked for DMA
+static guint8 *
+_aja_allocator_alloc_block (GstAjaAllocator *alloc)
+{
+  guint8 *data = NULL;
+
+  // Blocks of the arena are placed and locked already. Once its budget is
+  // used up, the block comes from the heap like without an arena.
+  if (alloc->arena) {
+    data = alloc->arena->Alloc (alloc->alloc_size, alloc->owner, alloc->device);
+    if (!data && alloc->arena->Reserve (alloc->alloc_size, 1, alloc->numa_node,
+            alloc->huge_page_size, alloc->lock_memory) > 0)
+      data = alloc->arena->Alloc (alloc->alloc_size, alloc->owner, alloc->device);
+    if (data)
+      return data;
+  }
+
+  // Shared pages are placed and locked like private ones
+  if (alloc->exports)
+    data = _aja_allocator_map_export (alloc);
+  if (!data)
+    data = (guint8 *) AJAMemory::AllocateAligned (alloc->alloc_size, 4096);
+
+  GST_DEBUG_OBJECT (alloc, "Allocated %" G_GSIZE_FORMAT " at %p", alloc->alloc_size, data);
+
+  if (alloc->numa_node >= 0) {
+    int res = NTV2GstTopologyPlaceMemory (data, alloc->alloc_size, alloc->numa_node);
+
+    GST_OBJECT_LOCK (alloc);
+    if (res != 0 && alloc->num_misplaced++ == 0) {
+      GST_OBJECT_UNLOCK (alloc);
+      GST_WARNING_OBJECT (alloc, "Failed to place memory on NUMA node %d: %s",
+          alloc->numa_node, g_strerror (res));
+    } else {
+      GST_OBJECT_UNLOCK (alloc);
+    }
+  }
+
+  if (!alloc->device->DMABufferLock((ULWord*)data, alloc->alloc_size, true)) {
+    GST_WARNING_OBJECT (alloc, "Failed to pre-lock memory");
+  }
+  _aja_allocator_lock_block (alloc, data);
+
+  return data;
+}
+
+static inline gboolean
+_aja_allocator_in_slab (GstAjaAllocator *alloc, guint8 * data)
+{
+  return alloc->slab && data >= alloc->slab && data < alloc->slab + alloc->slab_size;
+}
+
+static void
+_aja_allocator_free_block (GstAjaAllocator *alloc, guint8 * data)
+{
+  if (alloc->arena && alloc->arena->Contains (data)) {
+    alloc->arena->Free (data, alloc->owner);
+    return;
+  }
+
+  NTV2GstExportBlock *block = NULL;
+  if (alloc->exports) {
+    GST_OBJECT_LOCK (alloc);
+    block = (NTV2GstExportBlock *) g_hash_table_lookup (alloc->exports, data);
+    if (block) {
+      g_hash_table_remove (alloc->exports, data);
+      if (block->dmabuf >= 0)
+        alloc->num_dmabufs--;
+    }
+    GST_OBJECT_UNLOCK (alloc);
+  }
+
+  GST_DEBUG_OBJECT (alloc, "Freeing memory at %p", data);
+  alloc->device->DMABufferUnlock((ULWord*)data, alloc->alloc_size);
+  if (alloc->lock_memory)
+    NTV2GstRealtimeUnlockMemory (data, alloc->alloc_size);
+  // Huge page blocks go away with the whole slab
+  if (block) {
+    NTV2GstExportFreeBlock (*block);
+    g_slice_free (NTV2GstExportBlock, block);
+  } else if (!_aja_allocator_in_slab (alloc, data)) {
+    AJAMemory::FreeAligned (data);
+  }
+}
+
+// Maps one huge page backed slab for all preallocated blocks, so the driver's
+// scatter-gather lists and the CPU's TLB deal with a few large pages instead
+// of thousands of 4 KiB ones.
+static gboolean
+_aja_allocator_map_slab (GstAjaAllocator *alloc, gsize huge_page_size)
+{
+  const gsize stride = GST_ROUND_UP_N (alloc->alloc_size, (gsize) 4096);
+  const gsize needed = stride * alloc->num_prealloc;
+  size_t slab_size = 0, page_size = 0;
+  int res = 0;
+
+  void *slab = NTV2GstTopologyMapHugePages (needed, huge_page_size, slab_size,
+      page_size, res);
+  if (!slab) {
+    GST_WARNING_OBJECT (alloc, "Huge pages unavailable for %" G_GSIZE_FORMAT
+        " bytes of pool memory, using regular pages: %s", needed,
+        res != 0 ? g_strerror (res) : "none large enough");
+    return FALSE;
+  }
+
+  alloc->slab = (guint8 *) slab;
+  alloc->slab_size = slab_size;
+  alloc->huge_page_size = page_size;
+
+  // Placed on the device's node and pre-faulted, so a missing huge page
+  // shows up here and not as SIGBUS in the middle of a transfer
+  res = NTV2GstTopologyPlaceMemory (slab, slab_size, alloc->numa_node);
+  if (res != 0 && alloc->numa_node >= 0) {
+    GST_WARNING_OBJECT (alloc, "Failed to place huge pages on NUMA node %d: %s",
+        alloc->numa_node, g_strerror (res));
+    alloc->num_misplaced = alloc->num_prealloc;
+  }
+
+  GST_DEBUG_OBJECT (alloc, "Mapped %" G_GSIZE_FORMAT " bytes with %"
+      G_GSIZE_FORMAT " MiB huge pages at %p", (gsize) slab_size,
+      (gsize) (page_size >> 20), slab);
+  return TRUE;
+}
+
 static GstAjaMemory *
 _aja_memory_new_block (GstAjaAllocator *alloc, GstMemoryFlags flags,
     gsize maxsize, gsize offset, gsize size)
@@ -940,15 +1824,19 @@ _aja_memory_new_block (GstAjaAllocator *alloc, GstMemoryFlags flags,
   mem = (GstAjaMemory *) g_slice_alloc (sizeof (GstAjaMemory));
 
   GST_OBJECT_LOCK (alloc);
-  data = (guint8 *) gst_queue_array_pop_head (alloc->free_list);
-  if (!data) {
+  // Most recently freed first, it's the most likely to still be cache and
+  // TLB warm
+  data = alloc->free_list->len > 0 ?
+      (guint8 *) g_ptr_array_remove_index_fast (alloc->free_list, alloc->free_list->len - 1) : NULL;
+  if (!data && !alloc->grow) {
+    // Not on the capture thread, the pool fails the acquire instead
+    GST_OBJECT_UNLOCK (alloc);
+    g_slice_free1 (sizeof (GstAjaMemory), mem);
+    return NULL;
+  } else if (!data) {
     alloc->num_allocated++;
     GST_OBJECT_UNLOCK (alloc);
-    data = (guint8 *) AJAMemory::AllocateAligned (alloc->alloc_size, 4096);
-    GST_DEBUG_OBJECT (alloc, "Allocated %" G_GSIZE_FORMAT " at %p", alloc->alloc_size, data);
-    if (!alloc->device->DMABufferLock((ULWord*)data, alloc->alloc_size, true)) {
-      GST_WARNING_OBJECT (alloc, "Failed to pre-lock memory");
-    }
+    data = _aja_allocator_alloc_block (alloc);
   } else {
     GST_OBJECT_UNLOCK (alloc);
   }
@@ -959,35 +1847,151 @@ _aja_memory_new_block (GstAjaAllocator *alloc, GstMemoryFlags flags,
   return mem;
 }
 
+// Sub-memories share the data of their parent, which might be copied out
+// after they were created
+static inline GstAjaMemory *
+_aja_memory_root (GstAjaMemory * mem)
+{
+  return mem->mem.parent ? (GstAjaMemory *) mem->mem.parent : mem;
+}
+
+// Keeps the data from being copied out until unpinned. Only waits while a
+// copy-out is in progress, which never happens to a buffer on its way from
+// the capture thread to the element.
+static guint8 *
+_aja_memory_pin (GstAjaMemory * mem)
+{
+  GstAjaMemory *root = _aja_memory_root (mem);
+
+  while (TRUE) {
+    gint maps = g_atomic_int_get (&root->maps);
+
+    if (maps >= 0 && g_atomic_int_compare_and_exchange (&root->maps, maps, maps + 1))
+      return root->data;
+    g_thread_yield ();
+  }
+}
+
+static void
+_aja_memory_unpin (GstAjaMemory * mem)
+{
+  g_atomic_int_add (&_aja_memory_root (mem)->maps, -1);
+}
+
 static gpointer
 _aja_memory_map (GstAjaMemory * mem, gsize maxsize, GstMapFlags flags)
 {
-  return mem->data;
+  return _aja_memory_pin (mem);
 }
 
 static gboolean
 _aja_memory_unmap (GstAjaMemory * mem)
 {
+  _aja_memory_unpin (mem);
   return TRUE;
 }
 
+// Ordinary memory for copies and copied out blocks. Freed ones are kept for
+// the next copy instead of going back to the system, the frame sized
+// allocations would otherwise fault in every page again each time.
+static guint8 *
+_aja_allocator_alloc_copy (GstAjaAllocator *alloc)
+{
+  guint8 *data = NULL;
+
+  GST_OBJECT_LOCK (alloc);
+  if (alloc->copy_list->len > 0)
+    data = (guint8 *) g_ptr_array_remove_index (alloc->copy_list,
+        alloc->copy_list->len - 1);
+  GST_OBJECT_UNLOCK (alloc);
+
+  if (!data)
+    data = (guint8 *) AJAMemory::AllocateAligned (alloc->alloc_size, 4096);
+
+  return data;
+}
+
+static void
+_aja_allocator_free_copy (GstAjaAllocator *alloc, guint8 * data)
+{
+  GST_OBJECT_LOCK (alloc);
+  if (alloc->copy_list->len < MAX (alloc->num_prealloc, (guint) 4)) {
+    g_ptr_array_add (alloc->copy_list, (gpointer) data);
+    data = NULL;
+  }
+  GST_OBJECT_UNLOCK (alloc);
+
+  if (data)
+    AJAMemory::FreeAligned (data);
+}
+
 static GstMemory *
 _aja_memory_copy (GstAjaMemory * mem, gssize offset, gsize size)
 {
-  GstMemory *copy;
-  GstMapInfo map;
+  GstAjaAllocator *alloc = GST_AJA_ALLOCATOR (mem->mem.allocator);
+  GstAjaMemory *copy;
+  guint8 *copy_data, *data;
 
   if (size == (gsize) -1)
     size = mem->mem.size > (gsize) offset ? mem->mem.size - offset : 0;
 
   // Create copies in normal system memory
-  copy = gst_allocator_alloc (NULL, size, NULL);
-  gst_memory_map (copy, &map, GST_MAP_READ);
-  GST_DEBUG ("memcpy %" G_GSIZE_FORMAT " memory %p -> %p", size, mem, copy);
-  memcpy (map.data, mem->data + mem->mem.offset + offset, size);
-  gst_memory_unmap (copy, &map);
+  if (size > alloc->alloc_size || !(copy_data = _aja_allocator_alloc_copy (alloc)))
+    return NULL;
+
+  copy = _aja_memory_new (alloc, (GstMemoryFlags) 0, NULL, copy_data,
+      alloc->alloc_size, 0, size);
+  copy->copied_out = TRUE;
+
+  GST_DEBUG ("Copying %" G_GSIZE_FORMAT " bytes of memory %p -> %p", size, mem, copy);
+  data = _aja_memory_pin (mem);
+  NTV2GstCopyMemory (copy_data, data + mem->mem.offset + offset, size);
+  _aja_memory_unpin (mem);
 
-  return copy;
+  return GST_MEMORY_CAST (copy);
+}
+
+// Moves the data of a memory nobody has mapped to ordinary memory and gives
+// its DMA block back to the allocator. Fails if it's mapped.
+static gboolean
+_aja_memory_copy_out (GstAjaMemory * mem)
+{
+  GstAjaAllocator *alloc = GST_AJA_ALLOCATOR (mem->mem.allocator);
+  guint8 *block, *copy;
+
+  if (mem->mem.parent || mem->copied_out)
+    return FALSE;
+
+  if (!g_atomic_int_compare_and_exchange (&mem->maps, 0, -1))
+    return FALSE;
+
+  block = mem->data;
+  copy = _aja_allocator_alloc_copy (alloc);
+  if (!copy) {
+    g_atomic_int_set (&mem->maps, 0);
+    return FALSE;
+  }
+  // From the start of the block, the VANC lines before offset included
+  NTV2GstCopyMemory (copy, block, mem->mem.offset + mem->mem.size);
+  mem->data = copy;
+  mem->copied_out = TRUE;
+  g_atomic_int_set (&mem->maps, 0);
+
+  GST_OBJECT_LOCK (alloc);
+  g_ptr_array_add (alloc->free_list, (gpointer) block);
+  alloc->num_copied_out++;
+  GST_OBJECT_UNLOCK (alloc);
+
+  return TRUE;
+}
+
+static gboolean
+_aja_allocator_copy_out (GstMemory * mem)
+{
+  if (!GST_IS_Aja_ALLOCATOR (mem->allocator))
+    return FALSE;
+
+  return _aja_memory_copy_out ((GstAjaMemory *) mem);
 }
 
 static GstAjaMemory *
@@ -1027,18 +2031,19 @@ gst_aja_allocator_free (GstAllocator * alloc, GstMemory * mem)
 {
   GstAjaMemory *dmem = (GstAjaMemory *) mem;
 
-  if (!mem->parent) {
+  if (!mem->parent && dmem->copied_out) {
+    _aja_allocator_free_copy (GST_AJA_ALLOCATOR (alloc), dmem->data);
+  } else if (!mem->parent) {
     GstAjaAllocator *aja_alloc = GST_AJA_ALLOCATOR (alloc);
 
     GST_OBJECT_LOCK (alloc);
-    if (gst_queue_array_get_length (aja_alloc->free_list) >= 8 && aja_alloc->num_prealloc < aja_alloc->num_allocated) {
+    if (aja_alloc->free_list->len >= 8 && aja_alloc->num_prealloc < aja_alloc->num_allocated
+        && !_aja_allocator_in_slab (aja_alloc, dmem->data)) {
       aja_alloc->num_allocated--;
       GST_OBJECT_UNLOCK (alloc);
-      GST_DEBUG_OBJECT (alloc, "Freeing memory at %p", dmem->data);
-      aja_alloc->device->DMABufferUnlock((ULWord*)dmem->data, mem->maxsize);
-      AJAMemory::FreeAligned (dmem->data);
+      _aja_allocator_free_block (aja_alloc, dmem->data);
     } else {
-      gst_queue_array_push_tail (aja_alloc->free_list, (gpointer) dmem->data);
+      g_ptr_array_add (aja_alloc->free_list, (gpointer) dmem->data);
       GST_OBJECT_UNLOCK (alloc);
     }
   }
@@ -1050,15 +2055,30 @@ static void
 gst_aja_allocator_finalize (GObject *alloc)
 {
   GstAjaAllocator *aja_alloc = GST_AJA_ALLOCATOR (alloc);
-  guint8 *data;
+  guint i;
 
   GST_DEBUG_OBJECT (alloc, "Freeing allocator");
 
-  while ((data = (guint8 *) gst_queue_array_pop_head (aja_alloc->free_list))) {
-    GST_DEBUG_OBJECT (alloc, "Freeing memory at %p", data);
-    aja_alloc->device->DMABufferUnlock((ULWord*)data, aja_alloc->alloc_size);
-    AJAMemory::FreeAligned (data);
+  for (i = 0; i < aja_alloc->free_list->len; i++)
+    _aja_allocator_free_block (aja_alloc, (guint8 *) g_ptr_array_index (aja_alloc->free_list, i));
+  g_ptr_array_free (aja_alloc->free_list, TRUE);
+
+  for (i = 0; i < aja_alloc->copy_list->len; i++)
+    AJAMemory::FreeAligned (g_ptr_array_index (aja_alloc->copy_list, i));
+  g_ptr_array_free (aja_alloc->copy_list, TRUE);
+
+  if (aja_alloc->exports)
+    g_hash_table_destroy (aja_alloc->exports);
+  if (aja_alloc->fd_allocator)
+    gst_object_unref (aja_alloc->fd_allocator);
+  if (aja_alloc->dmabuf_allocator)
+    gst_object_unref (aja_alloc->dmabuf_allocator);
+
+  if (aja_alloc->slab) {
+    munmap (aja_alloc->slab, aja_alloc->slab_size);
+    aja_alloc->slab = NULL;
   }
+  g_free (aja_alloc->owner);
 
   G_OBJECT_CLASS (gst_aja_allocator_parent_class)->finalize (alloc);
 }
@@ -1076,6 +2096,8 @@ gst_aja_allocator_class_init (GstAjaAllocatorClass * klass)
 
   allocator_class->alloc = gst_aja_allocator_alloc;
   allocator_class->free = gst_aja_allocator_free;
+
+  export_block_quark = g_quark_from_static_string ("GstAjaExportBlock");
 }
 
 static void
@@ -1088,36 +2110,170 @@ gst_aja_allocator_init (GstAjaAllocator * aja_alloc)
   alloc->mem_unmap = (GstMemoryUnmapFunction) _aja_memory_unmap;
   alloc->mem_copy = (GstMemoryCopyFunction) _aja_memory_copy;
   alloc->mem_share = (GstMemoryShareFunction) _aja_memory_share;
+
+  aja_alloc->grow = TRUE;
+  aja_alloc->copy_list = g_ptr_array_new ();
 }
 
 GstAllocator *
-gst_aja_allocator_new (CNTV2Card *device, gsize alloc_size, guint num_prealloc)
+gst_aja_allocator_new (NTV2GstDevice *device, gsize alloc_size, guint num_prealloc,
+    gboolean lock_memory, gint numa_node, gsize huge_page_size,
+    NTV2GstArena *arena, const gchar *owner, NTV2GstExportMode export_mode)
 {
   GstAjaAllocator *alloc = (GstAjaAllocator *) g_object_new (GST_TYPE_AJA_ALLOCATOR, NULL);
   guint i;
 
+  // Exported blocks are memfds of their own, neither the arena's memory
+  // nor huge pages can be shared by descriptor
+  if (export_mode != NTV2_EXPORT_MODE_NONE) {
+    if (arena || huge_page_size > 0)
+      GST_INFO_OBJECT (alloc, "Exported pool memory comes from neither the "
+          "DMA arena nor huge pages");
+    arena = NULL;
+    huge_page_size = 0;
+
+    if (export_mode == NTV2_EXPORT_MODE_DMABUF && !NTV2GstExportHaveDMABuf ()) {
+      GST_WARNING_OBJECT (alloc, "No udmabuf device, exporting pool memory as "
+          "memfds instead of DMABufs");
+      export_mode = NTV2_EXPORT_MODE_MEMFD;
+    }
+
+    alloc->export_mode = export_mode;
+    alloc->exports = g_hash_table_new (NULL, NULL);
+    alloc->fd_allocator = gst_fd_allocator_new ();
+    if (export_mode == NTV2_EXPORT_MODE_DMABUF)
+      alloc->dmabuf_allocator = gst_dmabuf_allocator_new ();
+  }
+
   alloc->device = device;
   alloc->alloc_size = alloc_size;
   alloc->num_prealloc = num_prealloc;
+  alloc->lock_memory = lock_memory;
+  alloc->numa_node = numa_node;
+  alloc->arena = arena;
+  alloc->owner = g_strdup (owner);
 
   GST_DEBUG_OBJECT (alloc, "Creating allocator for size %" G_GSIZE_FORMAT " and %u preallocated", alloc_size, num_prealloc);
 
-  alloc->free_list = gst_queue_array_new (num_prealloc);
-  for (i = 0; i < num_prealloc; i++) {
-    guint8 *data = (guint8 *) AJAMemory::AllocateAligned (alloc->alloc_size, 4096);
+  alloc->free_list = g_ptr_array_sized_new (num_prealloc);
+  if (arena) {
+    // The arena maps the huge pages itself, one slab for all missing blocks
+    alloc->huge_page_size = huge_page_size;
+    arena->Reserve (alloc_size, num_prealloc, numa_node, huge_page_size,
+        lock_memory);
+
+    for (i = 0; i < num_prealloc; i++) {
+      guint8 *data = _aja_allocator_alloc_block (alloc);
+
+      g_ptr_array_add (alloc->free_list, (gpointer) data);
+    }
+  } else if (huge_page_size > 0 && num_prealloc > 0 &&
+      _aja_allocator_map_slab (alloc, huge_page_size)) {
+    const gsize stride = GST_ROUND_UP_N (alloc_size, (gsize) 4096);
+
+    for (i = 0; i < num_prealloc; i++) {
+      guint8 *data = alloc->slab + i * stride;
+
+      if (!alloc->device->DMABufferLock((ULWord*)data, alloc->alloc_size, true)) {
+        GST_WARNING_OBJECT (alloc, "Failed to pre-lock memory");
+      }
+      _aja_allocator_lock_block (alloc, data);
 
-    GST_DEBUG_OBJECT (alloc, "Allocated %" G_GSIZE_FORMAT " at %p", alloc_size, data);
-    if (!alloc->device->DMABufferLock((ULWord*)data, alloc->alloc_size, true)) {
-      GST_WARNING_OBJECT (alloc, "Failed to pre-lock memory");
+      g_ptr_array_add (alloc->free_list, (gpointer) data);
     }
+  } else {
+    for (i = 0; i < num_prealloc; i++) {
+      guint8 *data = _aja_allocator_alloc_block (alloc);
 
-    gst_queue_array_push_tail (alloc->free_list, (gpointer) data);
+      g_ptr_array_add (alloc->free_list, (gpointer) data);
+    }
   }
   alloc->num_allocated = alloc->num_prealloc;
 
+  if (alloc->exports)
+    GST_INFO_OBJECT (alloc, "Exporting %u preallocated blocks, %u as DMABufs "
+        "and %u as memfds", num_prealloc, alloc->num_dmabufs,
+        g_hash_table_size (alloc->exports) - alloc->num_dmabufs);
+
   return GST_ALLOCATOR (alloc);
 }
 
+void
+gst_aja_allocator_set_grow (GstAllocator * allocator, gboolean grow)
+{
+  GstAjaAllocator *aja_alloc = GST_AJA_ALLOCATOR (allocator);
+
+  GST_OBJECT_LOCK (aja_alloc);
+  aja_alloc->grow = grow;
+  GST_OBJECT_UNLOCK (aja_alloc);
+}
+
+// A block wrapped in file descriptor memory, which other processes can map
+// and other devices import as a DMABuf. The block goes back to the free list
+// once the wrapping memory is freed. A block that isn't memfd backed, because
+// memfds turned out to be unavailable, is returned as it is.
+GstMemory *
+gst_aja_allocator_alloc_exported (GstAllocator * allocator, gsize size)
+{
+  GstAjaAllocator *alloc = GST_AJA_ALLOCATOR (allocator);
+  NTV2GstExportBlock *exported = NULL;
+  GstAjaMemory *block;
+  GstMemory *mem = NULL;
+  int fd;
+
+  block = _aja_memory_new_block (alloc, (GstMemoryFlags) 0, alloc->alloc_size,
+      0, size);
+  if (!block)
+    return NULL;
+
+  GST_OBJECT_LOCK (alloc);
+  if (alloc->exports)
+    exported = (NTV2GstExportBlock *) g_hash_table_lookup (alloc->exports,
+        block->data);
+  GST_OBJECT_UNLOCK (alloc);
+  if (!exported)
+    return GST_MEMORY_CAST (block);
+
+  // Duplicates, the block keeps its own descriptors for the next buffer.
+  // Kept mapped, or every frame would map and fault in the pages again.
+  if (exported->dmabuf >= 0 && (fd = dup (exported->dmabuf)) >= 0) {
+#if GST_CHECK_VERSION(1, 16, 0)
+    mem = gst_dmabuf_allocator_alloc_with_flags (alloc->dmabuf_allocator, fd,
+        exported->size, GST_FD_MEMORY_FLAG_KEEP_MAPPED);
+#else
+    mem = gst_dmabuf_allocator_alloc (alloc->dmabuf_allocator, fd,
+        exported->size);
+#endif
+  } else if ((fd = dup (exported->memfd)) >= 0) {
+    mem = gst_fd_allocator_alloc (alloc->fd_allocator, fd, exported->size,
+        GST_FD_MEMORY_FLAG_KEEP_MAPPED);
+  }
+
+  if (!mem) {
+    GST_WARNING_OBJECT (alloc, "Failed to export memory at %p: %s",
+        block->data, g_strerror (errno));
+    return GST_MEMORY_CAST (block);
+  }
+
+  gst_memory_resize (mem, 0, size);
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (mem), export_block_quark,
+      block, (GDestroyNotify) gst_memory_unref);
+
+  return mem;
+}
+
+// Where the data of exported memory lies in its block, which is mapped and
+// locked for DMA elsewhere than the descriptor's mapping. NULL for all other
+// memory.
+guint8 *
+gst_aja_memory_get_dma_data (GstMemory * mem)
+{
+  GstAjaMemory *block = (GstAjaMemory *)
+      gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (mem), export_block_quark);
+
+  return block ? block->data + mem->offset : NULL;
+}
+
 #if ENABLE_NVMM
 
 G_DEFINE_TYPE (GstAjaNvmmBufferPool, gst_aja_nvmm_buffer_pool, GST_TYPE_NVDS_BUFFER_POOL);
@@ -1160,6 +2316,8 @@ gst_aja_nvmm_buffer_pool_alloc_buffer (GstBufferPool * pool, GstBuffer ** buffer
   videoBuff->videoBufferSize = 0;
   videoBuff->videoDataSize = 0;
   videoBuff->isNvmm = true;
+  videoBuff->isForeign = false;
+  videoBuff->shmSlot = -1;
 
   gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (*buffer),
       video_buffer_quark, videoBuff, (GDestroyNotify) aja_video_buff_free);
@@ -1230,6 +2388,8 @@ aja_init (GstPlugin * plugin)
       GST_TYPE_AJA_VIDEO_SRC);
   gst_element_register (plugin, "ajaaudiosrc", GST_RANK_NONE,
       GST_TYPE_AJA_AUDIO_SRC);
+  gst_element_register (plugin, "ajashmsrc", GST_RANK_NONE,
+      GST_TYPE_AJA_SHM_SRC);
 
   gst_device_provider_register (plugin, "ajadeviceprovider",
         GST_RANK_PRIMARY, GST_TYPE_AJA_DEVICE_PROVIDER);
@@ -239,6 +239,47 @@ typedef enum {
 #define GST_TYPE_AJA_TIMECODE_MODE (gst_aja_timecode_mode_get_type ())
 GType gst_aja_timecode_mode_get_type (void);
 
+#define GST_TYPE_AJA_REALTIME_POLICY (gst_aja_realtime_policy_get_type ())
+GType gst_aja_realtime_policy_get_type (void);
+
+typedef enum {
+  GST_AJA_HUGE_PAGES_NONE,
+  GST_AJA_HUGE_PAGES_2MB,
+  GST_AJA_HUGE_PAGES_1GB,
+} GstAjaHugePages;
+
+#define GST_TYPE_AJA_HUGE_PAGES (gst_aja_huge_pages_get_type ())
+GType gst_aja_huge_pages_get_type (void);
+
+typedef enum {
+  GST_AJA_QUEUE_POLICY_DROP_OLDEST,
+  GST_AJA_QUEUE_POLICY_DROP_NEWEST,
+  GST_AJA_QUEUE_POLICY_BLOCK,
+} GstAjaQueuePolicy;
+
+#define GST_TYPE_AJA_QUEUE_POLICY (gst_aja_queue_policy_get_type ())
+GType gst_aja_queue_policy_get_type (void);
+
+// Sizes the queue of a source within its latency budget from how late
+// downstream comes back for the next frame. Streaming thread only.
+typedef struct {
+    GstClockTime last_take;       // Running time of the last frame taken
+    GstClockTime jitter;          // Decaying peak of how much later than a frame downstream came back
+} GstAjaQueueTuner;
+
+void  gst_aja_queue_tuner_reset (GstAjaQueueTuner * tuner);
+guint gst_aja_queue_tuner_update (GstAjaQueueTuner * tuner, GstClockTime now,
+    GstClockTime frame_duration, GstClockTime max_latency, guint max_depth);
+
+GstClockTime gst_aja_get_running_time (GstElement * element);
+GstClockTime gst_aja_get_capture_running_time (GstElement * element, guint64 timeStamp);
+
+#define GST_TYPE_AJA_EXHAUSTION_POLICY (gst_aja_exhaustion_policy_get_type ())
+GType gst_aja_exhaustion_policy_get_type (void);
+
+#define GST_TYPE_AJA_EXPORT_MODE (gst_aja_export_mode_get_type ())
+GType gst_aja_export_mode_get_type (void);
+
 typedef enum {
   GST_AJA_AUDIO_INPUT_MODE_EMBEDDED,
   GST_AJA_AUDIO_INPUT_MODE_HDMI,
@@ -315,10 +356,13 @@ struct _GstAjaInput
     
     GMutex              lock;
     
-    GstElement          *audiosrc;
+    GstElement          *audiosrc;          /// The audio source that configured the audio
+    GList               *audiosrcs;         /// All audio sources sharing the input, audiosrc first
     gboolean            audio_enabled;
-    GstElement          *videosrc;
+    GstElement          *videosrc;          /// The video source that configured the input
+    GList               *videosrcs;         /// All video sources sharing the input, videosrc first
     gboolean            video_enabled;
+    gint                num_srcs;           /// Length of audiosrcs and videosrcs, atomic
     void (*start_streams) (GstElement *videosrc);
 };
 
@@ -353,6 +397,26 @@ struct _GstAjaClockClass
 GType gst_aja_clock_get_type (void);
 
 GstAjaInput *  gst_aja_acquire_input (const gchar * deviceIdentifier, gint channel, GstElement * src, gboolean is_audio);
+gboolean       gst_aja_release_input (GstAjaInput * input, GstElement * src, gboolean is_audio);
+gboolean       gst_aja_input_is_shared (GstAjaInput * input);
+
+// The queue of a source between the capture thread and its streaming thread,
+// for video frames and audio packets alike. queue-size, max-latency and
+// queue-policy are the source's properties, depth and room its atomics.
+GstAjaQueuePolicy gst_aja_queue_get_policy (GstAjaInput * input,
+    GstAjaQueuePolicy policy);
+guint          gst_aja_queue_get_limit (NTV2GstLeakyRingBase * ring,
+    guint queue_size, GstClockTime max_latency, gint * depth);
+void           gst_aja_queue_update_room (GstAjaInput * input,
+    NTV2GstLeakyRingBase * ring, GstAjaQueuePolicy policy, guint queue_size,
+    GstClockTime max_latency, gint * depth, gint * room);
+gboolean       gst_aja_queue_wait_room (GstAjaInput * input,
+    NTV2GstLeakyRingBase * ring, guint limit, GstClockTime max_latency);
+void           gst_aja_queue_tune (GstElement * element, GstAjaQueueTuner * tuner,
+    GstClockTime frame_duration, GstClockTime max_latency, guint queue_size,
+    gint * depth);
+NTV2GstScheduler * gst_aja_acquire_scheduler (const gchar * deviceIdentifier, guint numThreads);
+NTV2GstArena * gst_aja_acquire_arena (const gchar * deviceIdentifier);
 
 #define GST_TYPE_AJA_BUFFER_POOL \
 (gst_aja_buffer_pool_get_type())
@@ -376,6 +440,15 @@ struct _GstAjaBufferPool
 
     gboolean is_video;
     guint size;
+
+    guint outstanding;                      /// Buffers acquired and not released yet
+    guint peak_outstanding;
+
+    GstAllocator *allocator;                /// The GstAjaAllocator of the buffers, or NULL
+    guint num_buffers;                      /// Buffers allocated by the pool, free or not
+    GQueue held;                            /// Outstanding buffers, oldest first, see gst_aja_buffer_pool_copy_out
+    GCond copy_out_cond;                    /// Signalled when a buffer of held was copied out
+    guint copy_out_pass;
 };
 
 struct _GstAjaBufferPoolClass
@@ -385,7 +458,13 @@ struct _GstAjaBufferPoolClass
 
 GType gst_aja_buffer_pool_get_type (void);
 GstBufferPool * gst_aja_buffer_pool_new (void);
+guint gst_aja_buffer_pool_get_peak_outstanding (GstBufferPool * pool);
+guint gst_aja_buffer_pool_get_free (GstBufferPool * pool);
+void gst_aja_buffer_pool_release_delivered (GstBuffer * buffer);
+guint gst_aja_buffer_pool_copy_out (GstBufferPool * pool, guint min_free);
 AjaVideoBuff * gst_aja_buffer_get_video_buff (GstBuffer * buffer);
+AjaVideoBuff * gst_aja_buffer_ensure_video_buff (GstBuffer * buffer);
+GstBuffer * gst_aja_buffer_share (GstBuffer * buffer);
 AjaAudioBuff * gst_aja_buffer_get_audio_buff (GstBuffer * buffer);
 
 #define GST_TYPE_AJA_ALLOCATOR \
@@ -408,10 +487,34 @@ struct _GstAjaAllocator
 {
     GstAllocator allocator;
 
-    CNTV2Card *device;
+    NTV2GstDevice *device;
     gsize alloc_size;
     guint num_prealloc, num_allocated;
-    GstQueueArray *free_list;
+    GPtrArray *free_list;                   /// Used as a stack, most recently freed block first
+
+    gboolean lock_memory;                   /// mlock() every block, see NTV2GstRealtimeProfile
+    guint num_locked, num_lock_failed;
+
+    gint numa_node;                         /// Place every block on this NUMA node, -1 for anywhere
+    guint num_misplaced;
+
+    guint8 *slab;                           /// Huge page backed memory of the preallocated blocks, or NULL
+    gsize slab_size;
+    gsize huge_page_size;                   /// Page size of the slab, or the largest one asked of the arena
+
+    NTV2GstArena *arena;                    /// Device-wide memory the blocks come from, or NULL
+    gchar *owner;                           /// Usage of the blocks is accounted to this in the arena
+
+    gboolean grow;                          /// Allocate more blocks once the free ones are used up
+    guint num_copied_out;                   /// Blocks freed by copying their memory out
+
+    GPtrArray *copy_list;                   /// Ordinary memory of alloc_size for copies, recycled
+
+    NTV2GstExportMode export_mode;          /// Back the blocks with memfds, see gst_aja_allocator_alloc_exported
+    GHashTable *exports;                    /// NTV2GstExportBlock of every memfd backed block, by its data
+    GstAllocator *fd_allocator;             /// Wraps the memfds for downstream
+    GstAllocator *dmabuf_allocator;         /// Wraps the DMABufs for downstream, or NULL
+    guint num_dmabufs;                      /// Blocks exported as DMABufs, the others as memfds
 };
 
 struct _GstAjaAllocatorClass
@@ -420,7 +523,10 @@ struct _GstAjaAllocatorClass
 };
 
 GType gst_aja_allocator_get_type (void);
-GstAllocator * gst_aja_allocator_new (CNTV2Card *device, gsize alloc_size, guint num_prealloc);
+GstAllocator * gst_aja_allocator_new (NTV2GstDevice *device, gsize alloc_size, guint num_prealloc, gboolean lock_memory, gint numa_node, gsize huge_page_size, NTV2GstArena *arena, const gchar *owner, NTV2GstExportMode export_mode);
+void gst_aja_allocator_set_grow (GstAllocator * allocator, gboolean grow);
+GstMemory * gst_aja_allocator_alloc_exported (GstAllocator * allocator, gsize size);
+guint8 * gst_aja_memory_get_dma_data (GstMemory * mem);
 
 
 #if ENABLE_NVMM
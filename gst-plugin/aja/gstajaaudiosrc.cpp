@@ -48,6 +48,9 @@ GST_DEBUG_CATEGORY_STATIC (gst_aja_audio_src_debug);
 #define DEFAULT_INPUT_CHANNEL   (0)
 #define DEFAULT_CHANNELS        (8)
 #define DEFAULT_QUEUE_SIZE      (10)
+#define MAX_QUEUE_CAPACITY      (1024)   // Of the queue from the capture thread
+#define DEFAULT_MAX_LATENCY     (0)
+#define DEFAULT_QUEUE_POLICY    (GST_AJA_QUEUE_POLICY_DROP_OLDEST)
 
 #define DEFAULT_ALIGNMENT_THRESHOLD   (40 * GST_MSECOND)
 #define DEFAULT_DISCONT_WAIT          (1 * GST_SECOND)
@@ -62,6 +65,8 @@ enum
   PROP_ALIGNMENT_THRESHOLD,
   PROP_DISCONT_WAIT,
   PROP_QUEUE_SIZE,
+  PROP_MAX_LATENCY,
+  PROP_QUEUE_POLICY,
 };
 
 static GstStaticPadTemplate gst_aja_audio_src_template =
@@ -76,14 +81,16 @@ static GstStaticPadTemplate gst_aja_audio_src_template =
     );
 
 
-typedef struct
+struct _AjaCaptureAudioPacket
 {
   GstAjaAudioSrc *audio_src;
   AjaAudioBuff *audio_buff;
   GstClockTime capture_time;
   GstClockTime stream_time;
+  GstClockTime capture_running_time;  // For max-latency, whatever the timestamps are
   gboolean first_buffer;
-} AjaCaptureAudioPacket;
+  gboolean dropped_before;      // Packets were dropped from our queue before this one
+};
 
 static void
 aja_capture_audio_packet_clear (void *data)
@@ -96,6 +103,19 @@ aja_capture_audio_packet_clear (void *data)
   memset(packet, 0, sizeof (*packet));
 }
 
+// Releases all packets queued for the streaming thread
+static void
+gst_aja_audio_src_clear_packets (GstAjaAudioSrc * src)
+{
+  AjaCaptureAudioPacket p;
+
+  if (src->current_packets) {
+    while (src->current_packets->Pop (p))
+      aja_capture_audio_packet_clear (&p);
+    gst_aja_audio_src_update_room (src);
+  }
+}
+
 static void gst_aja_audio_src_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_aja_audio_src_get_property (GObject * object, guint property_id,
@@ -121,6 +141,7 @@ static GstStateChangeReturn gst_aja_audio_src_change_state (GstElement *
     element, GstStateChange transition);
 
 static bool gst_aja_audio_src_audio_callback (void *refcon, void *msg);
+static void gst_aja_audio_src_update_room (GstAjaAudioSrc * src);
 
 #define parent_class gst_aja_audio_src_parent_class
 G_DEFINE_TYPE (GstAjaAudioSrc, gst_aja_audio_src, GST_TYPE_PUSH_SRC);
@@ -153,7 +174,7 @@ gst_aja_audio_src_class_init (GstAjaAudioSrcClass * klass)
   g_object_class_install_property (gobject_class, PROP_DEVICE_IDENTIFIER,
       g_param_spec_string ("device-identifier",
           "Device identifier",
-          "Input device instance to use",
+          "Input device instance to use (\"sim\" or \"sim:options\" for a simulated device)",
           DEFAULT_DEVICE_IDENTIFIER,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
               G_PARAM_CONSTRUCT)));
@@ -204,6 +225,26 @@ gst_aja_audio_src_class_init (GstAjaAudioSrcClass * klass)
           1, G_MAXINT, DEFAULT_QUEUE_SIZE,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+  g_object_class_install_property (gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_uint64 ("max-latency",
+          "Max Latency",
+          "Drop packets captured longer than this ago instead of pushing them, "
+          "and size the queue within it from how regularly downstream takes "
+          "packets, queue-size still being the limit (0 = queue-size only)",
+          0, G_MAXUINT64, DEFAULT_MAX_LATENCY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_POLICY,
+      g_param_spec_enum ("queue-policy",
+          "Queue Policy",
+          "What to do with the audio packet of a captured frame when the "
+          "queue is full. Blocking holds up the input and only applies to "
+          "an audio source that has the input to itself, next to a video "
+          "source the oldest packet is dropped instead. If the video source "
+          "has no room either, the packet isn't even transferred",
+          GST_TYPE_AJA_QUEUE_POLICY, DEFAULT_QUEUE_POLICY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
 
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&gst_aja_audio_src_template));
@@ -225,6 +266,11 @@ gst_aja_audio_src_init (GstAjaAudioSrc * src)
   src->device_identifier = g_strdup (DEFAULT_DEVICE_IDENTIFIER);
   src->channels = DEFAULT_CHANNELS;
   src->queue_size = DEFAULT_QUEUE_SIZE;
+  src->max_latency = DEFAULT_MAX_LATENCY;
+  src->queue_policy = DEFAULT_QUEUE_POLICY;
+  src->queue_depth = DEFAULT_QUEUE_SIZE;
+  gst_aja_queue_tuner_reset (&src->queue_tuner);
+  src->late_dropped = 0;
   src->alignment_threshold = DEFAULT_ALIGNMENT_THRESHOLD;
   src->discont_wait = DEFAULT_DISCONT_WAIT;
 
@@ -233,9 +279,8 @@ gst_aja_audio_src_init (GstAjaAudioSrc * src)
   gst_pad_use_fixed_caps (GST_BASE_SRC_PAD (src));
 
   g_mutex_init (&src->lock);
-  g_cond_init (&src->cond);
 
-  src->current_packets = gst_queue_array_new_for_struct (sizeof (AjaCaptureAudioPacket), DEFAULT_QUEUE_SIZE);
+  src->current_packets = NULL;
 
   src->skipped_last = 0;
   src->skipped_overall = 0;
@@ -280,6 +325,16 @@ gst_aja_audio_src_set_property (GObject * object, guint property_id,
       src->queue_size = g_value_get_uint (value);
       break;
 
+    case PROP_MAX_LATENCY:
+      src->max_latency = g_value_get_uint64 (value);
+      gst_element_post_message (GST_ELEMENT_CAST (src),
+          gst_message_new_latency (GST_OBJECT_CAST (src)));
+      break;
+
+    case PROP_QUEUE_POLICY:
+      src->queue_policy = (GstAjaQueuePolicy) g_value_get_enum (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -321,6 +376,12 @@ gst_aja_audio_src_get_property (GObject * object, guint property_id,
     case PROP_QUEUE_SIZE:
       g_value_set_uint (value, src->queue_size);
       break;
+    case PROP_MAX_LATENCY:
+      g_value_set_uint64 (value, src->max_latency);
+      break;
+    case PROP_QUEUE_POLICY:
+      g_value_set_enum (value, src->queue_policy);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -333,18 +394,14 @@ gst_aja_audio_src_finalize (GObject * object)
   GstAjaAudioSrc *src = GST_AJA_AUDIO_SRC (object);
   GST_DEBUG_OBJECT (src, "finalize");
 
-  AjaCaptureAudioPacket *packet;
-  while ((packet = (AjaCaptureAudioPacket *) gst_queue_array_pop_head_struct (src->current_packets))) {
-    aja_capture_audio_packet_clear (packet);
-  }
-  gst_queue_array_free (src->current_packets);
+  gst_aja_audio_src_clear_packets (src);
+  delete src->current_packets;
   src->current_packets = NULL;
 
   g_free (src->device_identifier);
   src->device_identifier = NULL;
 
   g_mutex_clear (&src->lock);
-  g_cond_clear (&src->cond);
 
   G_OBJECT_CLASS (gst_aja_audio_src_parent_class)->finalize (object);
 }
@@ -429,7 +486,11 @@ gst_aja_audio_src_query (GstBaseSrc * bsrc, GstQuery * query)
           min =
               gst_util_uint64_scale_ceil (GST_SECOND, src->input->mode->fps_d,
               src->input->mode->fps_n);
-          max = src->queue_size * min;
+          // Nothing older than the budget is pushed, whatever the queue holds
+          if (src->max_latency > 0)
+            max = MAX (min, src->max_latency);
+          else
+            max = src->queue_size * min;
 
           gst_query_set_latency (query, TRUE, min, max);
           ret = TRUE;
@@ -456,10 +517,9 @@ gst_aja_audio_src_unlock (GstBaseSrc * bsrc)
   GstAjaAudioSrc *src = GST_AJA_AUDIO_SRC (bsrc);
   GST_DEBUG_OBJECT (src, "unlock");
 
-  g_mutex_lock (&src->lock);
-  src->flushing = TRUE;
-  g_cond_signal (&src->cond);
-  g_mutex_unlock (&src->lock);
+  g_atomic_int_set (&src->flushing, TRUE);
+  if (src->current_packets)
+    src->current_packets->Wake ();
 
   return TRUE;
 }
@@ -471,14 +531,8 @@ gst_aja_audio_src_unlock_stop (GstBaseSrc * bsrc)
   GstAjaAudioSrc *src = GST_AJA_AUDIO_SRC (bsrc);
   GST_DEBUG_OBJECT (src, "unlock_stop");
 
-  g_mutex_lock (&src->lock);
-  src->flushing = FALSE;
-
-  AjaCaptureAudioPacket *packet;
-  while ((packet = (AjaCaptureAudioPacket *) gst_queue_array_pop_head_struct (src->current_packets))) {
-    aja_capture_audio_packet_clear (packet);
-  }
-  g_mutex_unlock (&src->lock);
+  g_atomic_int_set (&src->flushing, FALSE);
+  gst_aja_audio_src_clear_packets (src);
 
   return TRUE;
 }
@@ -500,6 +554,27 @@ gst_aja_audio_src_open (GstAjaAudioSrc * src)
   }
 
   g_mutex_lock (&src->input->lock);
+
+  // Another audio source configured the audio already, we get its packets
+  if (src->input->audiosrc != GST_ELEMENT_CAST (src)) {
+    GstAjaAudioSrc *first = GST_AJA_AUDIO_SRC (src->input->audiosrc);
+    gboolean compatible = first->input_mode == src->input_mode;
+
+    if (compatible) {
+      GST_INFO_OBJECT (src, "Sharing the audio of %" GST_PTR_FORMAT, first);
+      src->channels = first->channels;
+    } else {
+      GST_ERROR_OBJECT (src, "Audio is captured by %" GST_PTR_FORMAT
+          " from another input", first);
+      gst_aja_release_input (src->input, GST_ELEMENT_CAST (src), TRUE);
+    }
+    g_mutex_unlock (&src->input->lock);
+
+    if (!compatible)
+      src->input = NULL;
+    return compatible;
+  }
+
   status = src->input->ntv2AV->Open ();
   if (!AJA_SUCCESS (status)) {
     GST_ERROR_OBJECT (src, "Failed to open input");
@@ -549,9 +624,8 @@ gst_aja_audio_src_close (GstAjaAudioSrc * src)
   if (src->input) {
     // The real shutdown will happen by the videosrc
     g_mutex_lock (&src->input->lock);
-    src->input->audio_enabled = FALSE;
-    gst_object_unref (src->input->audiosrc);
-    src->input->audiosrc = NULL;
+    if (gst_aja_release_input (src->input, GST_ELEMENT_CAST (src), TRUE))
+      src->input->audio_enabled = FALSE;
     g_mutex_unlock (&src->input->lock);
     src->input = NULL;
   }
@@ -564,17 +638,29 @@ gst_aja_audio_src_stop (GstAjaAudioSrc * src)
 {
   GST_DEBUG_OBJECT (src, "stop");
 
-  if (src->input && src->input->audio_enabled) {
+  if (src->input) {
+    NTV2GstAV *ntv2AV;
+
     g_mutex_lock (&src->input->lock);
-    src->input->audio_enabled = FALSE;
-    src->input->ntv2AV->SetCallback (AUDIO_CALLBACK, 0, 0);
+    ntv2AV = src->input->ntv2AV;
     g_mutex_unlock (&src->input->lock);
-  }
 
-  AjaCaptureAudioPacket *packet;
-  while ((packet = (AjaCaptureAudioPacket *) gst_queue_array_pop_head_struct (src->current_packets))) {
-    aja_capture_audio_packet_clear (packet);
+    // Not under the input's lock, our callback takes it
+    if (ntv2AV) {
+      ntv2AV->RemoveCallback (AUDIO_CALLBACK,
+          &gst_aja_audio_src_audio_callback, src);
+
+      g_mutex_lock (&src->input->lock);
+      if (ntv2AV->GetNumCallbacks (AUDIO_CALLBACK) == 0)
+        src->input->audio_enabled = FALSE;
+      g_mutex_unlock (&src->input->lock);
+    }
   }
+
+  // The capture thread doesn't call us anymore
+  gst_aja_audio_src_clear_packets (src);
+  delete src->current_packets;
+  src->current_packets = NULL;
   src->had_signal = FALSE;
 
   return TRUE;
@@ -599,18 +685,33 @@ gst_aja_audio_src_change_state (GstElement * element, GstStateChange transition)
     case GST_STATE_CHANGE_READY_TO_PAUSED:
     {
       GstElement *videosrc = NULL;
+      NTV2GstAV *ntv2AV;
 
       src->had_signal = FALSE;
 
+      // Changing queue-size later can't grow it beyond this
+      delete src->current_packets;
+      src->current_packets = new NTV2GstLeakyRing < AjaCaptureAudioPacket >
+          (MIN (src->queue_size, MAX_QUEUE_CAPACITY));
+      g_atomic_int_set (&src->queue_depth, src->queue_size);
+      gst_aja_queue_tuner_reset (&src->queue_tuner);
+      src->late_dropped = 0;
+      g_atomic_int_set (&src->flushing, FALSE);
+      gst_aja_audio_src_update_room (src);
+
       // Check if there is a video src for this input too and if it
       // is actually in the same pipeline
       g_mutex_lock (&src->input->lock);
       if (src->input->videosrc)
         videosrc = GST_ELEMENT_CAST (gst_object_ref (src->input->videosrc));
-      src->input->ntv2AV->SetCallback (AUDIO_CALLBACK,
-          &gst_aja_audio_src_audio_callback, src);
+      ntv2AV = src->input->ntv2AV;
       g_mutex_unlock (&src->input->lock);
 
+      // Not under the input's lock, our callback takes it
+      ntv2AV->AddCallback (AUDIO_CALLBACK,
+          &gst_aja_audio_src_audio_callback, src,
+          &src->room);
+
       if (!videosrc) {
         GST_ELEMENT_ERROR (src, STREAM, FAILED, (NULL),
             ("Audio src needs a video src for its operation"));
@@ -630,7 +731,6 @@ gst_aja_audio_src_change_state (GstElement * element, GstStateChange transition)
       if (videosrc)
         gst_object_unref (videosrc);
 
-      src->flushing = FALSE;
       src->next_offset = -1;
       break;
     }
@@ -660,6 +760,101 @@ out:
   return ret;
 }
 
+// Publishes the room of the queue for the capture thread
+static void
+gst_aja_audio_src_update_room (GstAjaAudioSrc * src)
+{
+  gst_aja_queue_update_room (src->input, src->current_packets,
+      src->queue_policy, src->queue_size, src->max_latency, &src->queue_depth,
+      &src->room);
+}
+
+// Capture thread only. Makes room for the packet as queue-policy says and
+// queues it for the streaming thread. The ring takes no lock, so unless
+// blocking was asked for the streaming thread never holds up the capture here,
+// whatever it's doing.
+static void
+gst_aja_audio_src_queue_packet (GstAjaAudioSrc * src, AjaCaptureAudioPacket * p)
+{
+  NTV2GstLeakyRing < AjaCaptureAudioPacket > *ring = src->current_packets;
+  const guint limit = gst_aja_queue_get_limit (ring, src->queue_size,
+      src->max_latency, &src->queue_depth);
+  guint skipped_frames = 0;
+  gboolean drop = FALSE;
+  AjaCaptureAudioPacket old;
+
+  if (ring->GetLength () >= limit) {
+    switch (gst_aja_queue_get_policy (src->input, src->queue_policy)) {
+      case GST_AJA_QUEUE_POLICY_BLOCK:
+        drop = !gst_aja_queue_wait_room (src->input, ring, limit,
+            src->max_latency) || g_atomic_int_get (&src->flushing);
+        break;
+      case GST_AJA_QUEUE_POLICY_DROP_NEWEST:
+        drop = TRUE;
+        break;
+      case GST_AJA_QUEUE_POLICY_DROP_OLDEST:
+      default:
+        while (ring->GetLength () >= limit && ring->Pop (old)) {
+          GST_WARNING_OBJECT (src, "Dropping old packet at %" GST_TIME_FORMAT,
+              GST_TIME_ARGS (old.capture_time));
+
+          if (skipped_frames == 0 && src->skipped_last == 0)
+            src->skip_from_timestamp = old.capture_time;
+          skipped_frames++;
+          src->skip_to_timestamp = old.capture_time;
+
+          aja_capture_audio_packet_clear (&old);
+        }
+        break;
+    }
+  }
+
+  if (drop) {
+    GST_WARNING_OBJECT (src, "Dropping new packet at %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (p->capture_time));
+
+    if (src->skipped_last == 0)
+      src->skip_from_timestamp = p->capture_time;
+    src->skip_to_timestamp = p->capture_time;
+    src->skipped_last++;
+    aja_capture_audio_packet_clear (p);
+    return;
+  }
+
+  if (src->skipped_last == 0 && skipped_frames > 0) {
+    GST_WARNING_OBJECT (src, "Starting to drop frames");
+  }
+
+  if (skipped_frames == 0 && src->skipped_last > 0) {
+    GST_ELEMENT_WARNING_WITH_DETAILS (src,
+        STREAM, FAILED,
+        ("Dropped %u old frames from %" GST_TIME_FORMAT " to %"
+        GST_TIME_FORMAT, src->skipped_last,
+        GST_TIME_ARGS (src->skip_from_timestamp),
+        GST_TIME_ARGS (src->skip_to_timestamp)),
+        (NULL),
+        ("dropped", G_TYPE_UINT, src->skipped_last,
+         "from", G_TYPE_UINT64, src->skip_from_timestamp,
+         "to", G_TYPE_UINT64, src->skip_to_timestamp, NULL));
+    src->skipped_overall += src->skipped_last;
+    src->skipped_last = 0;
+    p->dropped_before = TRUE;
+  }
+
+  // The streaming thread is still copying out the packet that had the slot,
+  // rather drop this one than wait for it
+  if (!ring->Push (*p)) {
+    if (skipped_frames == 0 && src->skipped_last == 0)
+      src->skip_from_timestamp = p->capture_time;
+    skipped_frames++;
+    src->skip_to_timestamp = p->capture_time;
+    aja_capture_audio_packet_clear (p);
+  }
+  gst_aja_audio_src_update_room (src);
+
+  src->skipped_last += skipped_frames;
+}
+
 static void
 gst_aja_audio_src_got_packet (GstAjaAudioSrc * src, AjaAudioBuff * audioBuff)
 {
@@ -683,8 +878,18 @@ gst_aja_audio_src_got_packet (GstAjaAudioSrc * src, AjaAudioBuff * audioBuff)
   g_mutex_unlock (&src->input->lock);
 
   if (videosrc) {
-    // The videosrc is always first passed the frame
-    g_assert (videosrc->first_time != GST_CLOCK_TIME_NONE);
+    // The videosrc is always first passed the frame, but with decimation
+    // audio of frames without video may come before it got any. Without a
+    // time for it the packet is dropped, but counted with the ones dropped
+    // from the queue. Nothing was pushed yet, nothing to warn about.
+    if (videosrc->first_time == GST_CLOCK_TIME_NONE) {
+      GST_DEBUG_OBJECT (src, "Dropping packet of frame %u before the first "
+          "video frame", audioBuff->frameNumber);
+      src->skipped_overall++;
+      gst_object_unref (videosrc);
+      src->input->ntv2AV->ReleaseAudioBuffer (audioBuff);
+      return;
+    }
 
     stream_time = videosrc->discont_time +
         gst_util_uint64_scale (audioBuff->frameNumber - videosrc->discont_frame_number,
@@ -715,65 +920,22 @@ gst_aja_audio_src_got_packet (GstAjaAudioSrc * src, AjaAudioBuff * audioBuff)
     stream_time = GST_CLOCK_TIME_NONE;
   }
 
-  g_mutex_lock (&src->lock);
   had_signal = src->had_signal;
   src->had_signal = TRUE;
-  if (!src->flushing) {
-    guint skipped_frames = 0;
-    gboolean skipped_before = FALSE;
-
-    while (gst_queue_array_get_length (src->current_packets) >= src->queue_size) {
-      AjaCaptureAudioPacket *f = (AjaCaptureAudioPacket *) gst_queue_array_pop_head_struct (src->current_packets);
-      GST_WARNING_OBJECT (src, "Dropping old packet at %" GST_TIME_FORMAT,
-          GST_TIME_ARGS (f->capture_time));
-
-      if (f->audio_buff) {
-        if (skipped_frames == 0 && src->skipped_last == 0)
-          src->skip_from_timestamp = f->capture_time;
-        skipped_frames++;
-        src->skip_to_timestamp = f->capture_time;
-      }
-
-      aja_capture_audio_packet_clear (f);
-    }
-
-    if (src->skipped_last == 0 && skipped_frames > 0) {
-      GST_WARNING_OBJECT (src, "Starting to drop frames");
-    }
-
-    if (skipped_frames == 0 && src->skipped_last > 0) {
-      GST_ELEMENT_WARNING_WITH_DETAILS (src,
-          STREAM, FAILED,
-          ("Dropped %u old frames from %" GST_TIME_FORMAT " to %"
-          GST_TIME_FORMAT, src->skipped_last,
-          GST_TIME_ARGS (src->skip_from_timestamp),
-          GST_TIME_ARGS (src->skip_to_timestamp)),
-          (NULL),
-          ("dropped", G_TYPE_UINT, src->skipped_last,
-           "from", G_TYPE_UINT64, src->skip_from_timestamp,
-           "to", G_TYPE_UINT64, src->skip_to_timestamp, NULL));
-      src->skipped_overall += src->skipped_last;
-      src->skipped_last = 0;
-      skipped_before = TRUE;
-    }
-
-    src->skipped_last += skipped_frames;
-
+  if (!g_atomic_int_get (&src->flushing)) {
     AjaCaptureAudioPacket f;
     memset(&f, 0, sizeof (f));
     f.audio_src = src;
     f.audio_buff = audioBuff;
     f.capture_time = timestamp;
     f.stream_time = stream_time;
+    f.capture_running_time = src->max_latency > 0 ?
+        gst_aja_get_capture_running_time (GST_ELEMENT_CAST (src),
+        audioBuff->timeStamp) : GST_CLOCK_TIME_NONE;
     f.first_buffer = !had_signal;
-    if (skipped_before)
-      audioBuff->droppedChanged = TRUE;
 
-    gst_queue_array_push_tail_struct (src->current_packets, &f);
-    g_cond_signal (&src->cond);
-    g_mutex_unlock (&src->lock);
+    gst_aja_audio_src_queue_packet (src, &f);
   } else {
-    g_mutex_unlock (&src->lock);
     src->input->ntv2AV->ReleaseAudioBuffer (audioBuff);
   }
 }
@@ -794,6 +956,7 @@ gst_aja_audio_src_create (GstPushSrc * bsrc, GstBuffer ** buffer)
   GstClockTime start_time, end_time;
   guint64 start_offset, end_offset;
   gboolean discont = FALSE;
+  gboolean dropped, late = FALSE;
   static GstStaticCaps stream_reference =
       GST_STATIC_CAPS ("timestamp/x-aja-stream");
 
@@ -801,30 +964,67 @@ gst_aja_audio_src_create (GstPushSrc * bsrc, GstBuffer ** buffer)
     return GST_FLOW_NOT_NEGOTIATED;
   }
 
-  g_mutex_lock (&src->lock);
-  while (gst_queue_array_is_empty (src->current_packets) && !src->flushing) {
-    g_cond_wait (&src->cond, &src->lock);
-  }
+  // Packets the delivery thread dropped are freed here, off its back
+  src->input->ntv2AV->ReclaimBuffers ();
 
-  if (src->flushing) {
-    g_mutex_unlock (&src->lock);
-    GST_DEBUG_OBJECT (src, "Flushing");
-    return GST_FLOW_FLUSHING;
-  }
+  // Downstream is back for the next packet
+  gst_aja_queue_tune (GST_ELEMENT_CAST (src), &src->queue_tuner,
+      gst_util_uint64_scale_ceil (GST_SECOND, src->input->mode->fps_d,
+          src->input->mode->fps_n), src->max_latency, src->queue_size,
+      &src->queue_depth);
+  gst_aja_audio_src_update_room (src);
+
+  for (;;) {
+    GstClockTime now;
+
+    if (g_atomic_int_get (&src->flushing)) {
+      GST_DEBUG_OBJECT (src, "Flushing");
+      return GST_FLOW_FLUSHING;
+    }
+
+    if (!src->current_packets->WaitPop (p))
+      continue;
+    gst_aja_audio_src_update_room (src);
+    if (g_atomic_int_get (&src->flushing)) {
+      aja_capture_audio_packet_clear (&p);
+      continue;
+    }
 
-  p = *(AjaCaptureAudioPacket *) gst_queue_array_pop_head_struct (src->current_packets);
-  g_mutex_unlock (&src->lock);
+    // Over budget and a newer one is already queued to take its place
+    if (src->max_latency > 0 &&
+        GST_CLOCK_TIME_IS_VALID (p.capture_running_time) &&
+        src->current_packets->GetLength () > 0) {
+      now = gst_aja_get_running_time (GST_ELEMENT_CAST (src));
+      if (GST_CLOCK_TIME_IS_VALID (now) &&
+          now > p.capture_running_time + src->max_latency) {
+        GST_DEBUG_OBJECT (src, "Dropping packet captured %" GST_TIME_FORMAT
+            " ago", GST_TIME_ARGS (now - p.capture_running_time));
+        src->late_dropped++;
+        late = TRUE;
+        aja_capture_audio_packet_clear (&p);
+        continue;
+      }
+    }
+
+    break;
+  }
 
   data_size = (gsize) p.audio_buff->audioDataSize;
   sample_count = data_size / src->info.bpf;
 
-  *buffer = gst_buffer_ref (p.audio_buff->buffer);
+  // Other audio sources of the input still hold the captured buffer, what we
+  // set on it goes on one of our own
+  if (gst_buffer_is_writable (p.audio_buff->buffer))
+    *buffer = gst_buffer_ref (p.audio_buff->buffer);
+  else
+    *buffer = gst_aja_buffer_share (p.audio_buff->buffer);
 
   timestamp = p.capture_time;
   stream_time = p.stream_time;
-  discont = p.first_buffer || p.audio_buff->droppedChanged;
+  dropped = p.dropped_before || p.audio_buff->droppedChanged || late;
+  discont = p.first_buffer || dropped;
 
-  if (p.audio_buff->droppedChanged) {
+  if (dropped) {
     GstMessage *msg;
     GstClockTime running_time;
 
@@ -835,8 +1035,14 @@ gst_aja_audio_src_create (GstPushSrc * bsrc, GstBuffer ** buffer)
         p.capture_time, gst_util_uint64_scale_int (GST_SECOND,
       src->input->mode->fps_d, src->input->mode->fps_n));
     gst_message_set_qos_stats (msg, GST_FORMAT_BUFFERS,
-                               p.audio_buff->framesProcessed - src->skipped_overall,
-                               p.audio_buff->framesDropped + src->skipped_overall);
+                               p.audio_buff->framesProcessed - src->skipped_overall - src->late_dropped,
+                               p.audio_buff->framesDropped + p.audio_buff->framesSkipped +
+                               src->skipped_overall + src->late_dropped);
+    GST_DEBUG_OBJECT (src, "Frames dropped by the device %" G_GUINT64_FORMAT
+        ", not transferred %" G_GUINT64_FORMAT ", dropped from the queue %"
+        G_GUINT64_FORMAT ", over max-latency %" G_GUINT64_FORMAT,
+        p.audio_buff->framesDropped, p.audio_buff->framesSkipped,
+        src->skipped_overall, src->late_dropped);
     gst_element_post_message (GST_ELEMENT (src), msg);
   }
 
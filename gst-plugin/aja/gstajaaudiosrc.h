@@ -34,6 +34,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstAjaAudioSrc GstAjaAudioSrc;
 typedef struct _GstAjaAudioSrcClass GstAjaAudioSrcClass;
+typedef struct _AjaCaptureAudioPacket AjaCaptureAudioPacket;
 
 struct _GstAjaAudioSrc
 {
@@ -42,10 +43,9 @@ struct _GstAjaAudioSrc
     GstAudioInfo                info;
     GstAjaInput                 *input;
 
-    GCond                       cond;
     GMutex                      lock;
-    gboolean                    flushing;
-    GstQueueArray              *current_packets;
+    gint                        flushing;               /// Atomic, the capture thread reads it without the lock
+    NTV2GstLeakyRing<AjaCaptureAudioPacket> *current_packets;  /// From the capture thread, sized when starting
 
     GstClockTime                alignment_threshold;
     GstClockTime                discont_wait;
@@ -56,6 +56,12 @@ struct _GstAjaAudioSrc
     guint                       input_channel;
     guint                       channels;
     guint                       queue_size;
+    GstClockTime                max_latency;
+    GstAjaQueuePolicy           queue_policy;
+    gint                        queue_depth;            /// Atomic, tuned within max-latency by the streaming thread
+    gint                        room;                   /// Atomic, packets the queue could still take, read by the capture thread
+    GstAjaQueueTuner            queue_tuner;
+    guint64                     late_dropped;           /// Over max-latency when taken, streaming thread only
     guint64                     next_offset;
     gboolean                    had_signal;
 
@@ -0,0 +1,663 @@
+/* GStreamer
+ * Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:element-ajashmsrc
+ *
+ * Reads the frames an ajavideosrc with the publish property set captures in
+ * another process, straight from the shared memory the card wrote them to.
+ * Any number of processes can read the same ring. A reader that falls behind
+ * skips frames, it never holds up the capture or the other readers.
+ *
+ * <refsect2>
+ * <title>Example launch lines</title>
+ * |[
+ * gst-launch-1.0 ajavideosrc publish=cam1 ! fakesink
+ * gst-launch-1.0 ajashmsrc ring=cam1 ! videoconvert ! autovideosink
+ * gst-launch-1.0 ajashmsrc ring=cam1 audio=true ! audioconvert ! autoaudiosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "gstaja.h"
+#include "gstajashmsrc.h"
+#include "gstntv2copy.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_aja_shm_src_debug);
+#define GST_CAT_DEFAULT gst_aja_shm_src_debug
+
+#define DEFAULT_RING               (NULL)
+#define DEFAULT_AUDIO              (FALSE)
+#define DEFAULT_MAX_HELD           (0)
+
+// How long to wait for a frame, or for the ring to appear, before checking
+// for flushing again
+#define WAIT_TIMEOUT_US            (100 * 1000)
+
+enum
+{
+  PROP_0,
+  PROP_RING,
+  PROP_AUDIO,
+  PROP_MAX_HELD,
+  PROP_SKIPPED
+};
+
+static GstStaticPadTemplate gst_aja_shm_src_template =
+    GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw; "
+        "audio/x-raw, format=S32LE, rate=48000, layout=interleaved")
+    );
+
+// What a buffer wrapping a slot releases when freed
+typedef struct
+{
+  GstAjaShmSrc *src;
+  NTV2GstShmRing *ring;
+  int32_t slot;
+} AjaShmHeldSlot;
+
+static void gst_aja_shm_src_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_aja_shm_src_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_aja_shm_src_finalize (GObject * object);
+
+static gboolean gst_aja_shm_src_start (GstBaseSrc * bsrc);
+static gboolean gst_aja_shm_src_stop (GstBaseSrc * bsrc);
+static gboolean gst_aja_shm_src_unlock (GstBaseSrc * bsrc);
+static gboolean gst_aja_shm_src_unlock_stop (GstBaseSrc * bsrc);
+static gboolean gst_aja_shm_src_query (GstBaseSrc * bsrc, GstQuery * query);
+
+static GstFlowReturn gst_aja_shm_src_create (GstPushSrc * psrc,
+    GstBuffer ** buffer);
+
+#define parent_class gst_aja_shm_src_parent_class
+G_DEFINE_TYPE (GstAjaShmSrc, gst_aja_shm_src, GST_TYPE_PUSH_SRC);
+
+static void
+gst_aja_shm_src_class_init (GstAjaShmSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS (klass);
+
+  gobject_class->set_property = gst_aja_shm_src_set_property;
+  gobject_class->get_property = gst_aja_shm_src_get_property;
+  gobject_class->finalize = gst_aja_shm_src_finalize;
+
+  basesrc_class->start = GST_DEBUG_FUNCPTR (gst_aja_shm_src_start);
+  basesrc_class->stop = GST_DEBUG_FUNCPTR (gst_aja_shm_src_stop);
+  basesrc_class->unlock = GST_DEBUG_FUNCPTR (gst_aja_shm_src_unlock);
+  basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_aja_shm_src_unlock_stop);
+  basesrc_class->query = GST_DEBUG_FUNCPTR (gst_aja_shm_src_query);
+
+  pushsrc_class->create = GST_DEBUG_FUNCPTR (gst_aja_shm_src_create);
+
+  g_object_class_install_property (gobject_class, PROP_RING,
+      g_param_spec_string ("ring", "Ring",
+          "Name of the ring an ajavideosrc publishes to with its publish "
+          "property",
+          DEFAULT_RING,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_AUDIO,
+      g_param_spec_boolean ("audio", "Audio",
+          "Output the audio captured with the frames instead of the video",
+          DEFAULT_AUDIO,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_HELD,
+      g_param_spec_uint ("max-held", "Max Held",
+          "Frames held downstream at most before further frames are copied "
+          "out of the ring, so that the writer keeps free slots (0=half the "
+          "ring's slots)",
+          0, NTV2_SHM_MAX_SLOTS, DEFAULT_MAX_HELD,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_SKIPPED,
+      g_param_spec_uint64 ("skipped", "Skipped",
+          "Frames the writer did not publish because readers held all slots",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_aja_shm_src_template);
+
+  gst_element_class_set_static_metadata (element_class,
+      "Aja Shared Memory Source", "Video/Audio/Src",
+      "Reads the frames an Aja source publishes to shared memory",
+      "NVIDIA Corporation");
+
+  GST_DEBUG_CATEGORY_INIT (gst_aja_shm_src_debug, "ajashmsrc", 0,
+      "debug category for ajashmsrc element");
+}
+
+static void
+gst_aja_shm_src_init (GstAjaShmSrc * src)
+{
+  src->ring_name = g_strdup (DEFAULT_RING);
+  src->audio = DEFAULT_AUDIO;
+  src->max_held = DEFAULT_MAX_HELD;
+
+  src->ring = NULL;
+  src->last_sequence = 0;
+  src->caps_serial = 0;
+  src->frame_duration = GST_CLOCK_TIME_NONE;
+  src->held = 0;
+  gst_video_info_init (&src->info);
+
+  g_mutex_init (&src->lock);
+  g_cond_init (&src->cond);
+
+  gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
+}
+
+static void
+gst_aja_shm_src_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (object);
+
+  switch (property_id) {
+    case PROP_RING:
+      g_free (src->ring_name);
+      src->ring_name = g_value_dup_string (value);
+      break;
+
+    case PROP_AUDIO:
+      src->audio = g_value_get_boolean (value);
+      break;
+
+    case PROP_MAX_HELD:
+      src->max_held = g_value_get_uint (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_aja_shm_src_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (object);
+
+  switch (property_id) {
+    case PROP_RING:
+      g_value_set_string (value, src->ring_name);
+      break;
+
+    case PROP_AUDIO:
+      g_value_set_boolean (value, src->audio);
+      break;
+
+    case PROP_MAX_HELD:
+      g_value_set_uint (value, src->max_held);
+      break;
+
+    case PROP_SKIPPED:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint64 (value, src->ring ? src->ring->GetNumSkipped () : 0);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_aja_shm_src_finalize (GObject * object)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (object);
+
+  g_free (src->ring_name);
+  src->ring_name = NULL;
+
+  g_mutex_clear (&src->lock);
+  g_cond_clear (&src->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_aja_shm_src_close_ring (GstAjaShmSrc * src)
+{
+  NTV2GstShmRing *ring;
+
+  GST_OBJECT_LOCK (src);
+  ring = src->ring;
+  src->ring = NULL;
+  GST_OBJECT_UNLOCK (src);
+
+  // Buffers still downstream keep it open
+  if (ring)
+    ring->Unref ();
+}
+
+// A writer that restarted made a new ring of the same name, its sequence
+// numbers and caps start over
+static gboolean
+gst_aja_shm_src_open_ring (GstAjaShmSrc * src)
+{
+  NTV2GstShmRing *ring;
+  int error;
+
+  gst_aja_shm_src_close_ring (src);
+
+  ring = NTV2GstShmRing::Open (src->ring_name, error);
+  if (!ring) {
+    GST_LOG_OBJECT (src, "No ring '%s' to read yet: %s", src->ring_name,
+        g_strerror (error));
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT (src, "Reading ring '%s' of %u slots", src->ring_name,
+      ring->GetNumSlots ());
+
+  GST_OBJECT_LOCK (src);
+  src->ring = ring;
+  GST_OBJECT_UNLOCK (src);
+  src->last_sequence = 0;
+  src->caps_serial = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_aja_shm_src_start (GstBaseSrc * bsrc)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (bsrc);
+
+  if (!src->ring_name || !*src->ring_name) {
+    GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS, (NULL),
+        ("No ring name set"));
+    return FALSE;
+  }
+
+  // Waits for the writer in create if it's not there yet
+  gst_aja_shm_src_open_ring (src);
+
+  return TRUE;
+}
+
+static gboolean
+gst_aja_shm_src_stop (GstBaseSrc * bsrc)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (bsrc);
+
+  gst_aja_shm_src_close_ring (src);
+  src->frame_duration = GST_CLOCK_TIME_NONE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_aja_shm_src_unlock (GstBaseSrc * bsrc)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (bsrc);
+
+  g_mutex_lock (&src->lock);
+  src->flushing = TRUE;
+  g_cond_signal (&src->cond);
+  g_mutex_unlock (&src->lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_aja_shm_src_unlock_stop (GstBaseSrc * bsrc)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (bsrc);
+
+  g_mutex_lock (&src->lock);
+  src->flushing = FALSE;
+  g_mutex_unlock (&src->lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_aja_shm_src_query (GstBaseSrc * bsrc, GstQuery * query)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (bsrc);
+  gboolean ret;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+    {
+      if (GST_CLOCK_TIME_IS_VALID (src->frame_duration)) {
+        GstClockTime max = GST_CLOCK_TIME_NONE;
+
+        // Frames wait in the ring for as long as its slots last
+        GST_OBJECT_LOCK (src);
+        if (src->ring)
+          max = src->ring->GetNumSlots () * src->frame_duration;
+        GST_OBJECT_UNLOCK (src);
+
+        gst_query_set_latency (query, TRUE, src->frame_duration, max);
+        ret = TRUE;
+      } else {
+        ret = FALSE;
+      }
+      break;
+    }
+
+    default:
+      ret = GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
+      break;
+  }
+
+  return ret;
+}
+
+// Waits on the cond so that unlock doesn't have to wait out the timeout
+static gboolean
+gst_aja_shm_src_wait (GstAjaShmSrc * src)
+{
+  gboolean flushing;
+
+  g_mutex_lock (&src->lock);
+  if (!src->flushing)
+    g_cond_wait_until (&src->cond, &src->lock,
+        g_get_monotonic_time () + WAIT_TIMEOUT_US);
+  flushing = src->flushing;
+  g_mutex_unlock (&src->lock);
+
+  return !flushing;
+}
+
+static gboolean
+gst_aja_shm_src_is_flushing (GstAjaShmSrc * src)
+{
+  gboolean flushing;
+
+  g_mutex_lock (&src->lock);
+  flushing = src->flushing;
+  g_mutex_unlock (&src->lock);
+
+  return flushing;
+}
+
+// Sets the caps the writer published with the frame, if they changed
+static gboolean
+gst_aja_shm_src_update_caps (GstAjaShmSrc * src, const NTV2GstShmFrame & frame)
+{
+  std::string video_caps;
+  GstCaps *caps;
+  guint32 channels;
+
+  if (frame.capsSerial == src->caps_serial && src->caps_serial != 0)
+    return TRUE;
+
+  // Older caps might be gone by now, the current ones are what follows
+  src->caps_serial = src->ring->GetCaps (video_caps, channels);
+  if (src->caps_serial == 0 || video_caps.empty ())
+    return FALSE;
+
+  // The frame rate and interlacing of the audio come from the video too
+  caps = gst_caps_from_string (video_caps.c_str ());
+  if (!caps || !gst_video_info_from_caps (&src->info, caps)) {
+    GST_WARNING_OBJECT (src, "Unusable caps in the ring: %s",
+        video_caps.c_str ());
+    if (caps)
+      gst_caps_unref (caps);
+    return FALSE;
+  }
+
+  if (src->audio) {
+    GstAudioInfo audio_info;
+
+    gst_caps_unref (caps);
+    if (channels == 0)
+      return FALSE;
+
+    gst_audio_info_set_format (&audio_info, GST_AUDIO_FORMAT_S32LE, 48000,
+        channels, NULL);
+    caps = gst_audio_info_to_caps (&audio_info);
+  }
+
+  src->frame_duration = src->info.fps_n > 0 ?
+      gst_util_uint64_scale_int (GST_SECOND, src->info.fps_d, src->info.fps_n) :
+      GST_CLOCK_TIME_NONE;
+
+  GST_INFO_OBJECT (src, "Caps of the ring changed to %" GST_PTR_FORMAT, caps);
+  gst_base_src_set_caps (GST_BASE_SRC_CAST (src), caps);
+  gst_element_post_message (GST_ELEMENT_CAST (src),
+      gst_message_new_latency (GST_OBJECT_CAST (src)));
+  gst_caps_unref (caps);
+
+  return TRUE;
+}
+
+static void
+gst_aja_shm_src_release_slot (gpointer data)
+{
+  AjaShmHeldSlot *held = (AjaShmHeldSlot *) data;
+
+  held->ring->ReleaseSlot (held->slot);
+  held->ring->Unref ();
+  g_atomic_int_add (&held->src->held, -1);
+  gst_object_unref (held->src);
+  delete held;
+}
+
+// The ring is written by another process, don't trust what it says of a frame
+static gboolean
+gst_aja_shm_src_frame_fits (GstAjaShmSrc * src, const NTV2GstShmFrame & frame)
+{
+  if ((size_t) frame.videoOffset + frame.videoSize >
+      src->ring->GetVideoSize ()) {
+    GST_WARNING_OBJECT (src, "Dropping frame %" G_GUINT64_FORMAT ", video of "
+        "%u bytes at %u is beyond the slot of %" G_GSIZE_FORMAT " bytes",
+        (guint64) frame.frameNumber, frame.videoSize, frame.videoOffset,
+        (gsize) src->ring->GetVideoSize ());
+    return FALSE;
+  }
+
+  if (frame.audioSize > src->ring->GetAudioSize ()) {
+    GST_WARNING_OBJECT (src, "Dropping frame %" G_GUINT64_FORMAT ", audio of "
+        "%u bytes is beyond the slot of %" G_GSIZE_FORMAT " bytes",
+        (guint64) frame.frameNumber, frame.audioSize,
+        (gsize) src->ring->GetAudioSize ());
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+// Wraps the slot, or copies it out and lets it go if downstream already
+// holds as many as it may
+static GstBuffer *
+gst_aja_shm_src_slot_to_buffer (GstAjaShmSrc * src, int32_t slot,
+    const NTV2GstShmFrame & frame)
+{
+  const guint max_held = src->max_held > 0 ? src->max_held :
+      MAX (1, src->ring->GetNumSlots () / 2);
+  guint8 *data;
+  gsize size;
+  GstBuffer *buffer;
+
+  if (src->audio) {
+    data = src->ring->GetAudio (slot);
+    size = frame.audioSize;
+  } else {
+    data = src->ring->GetVideo (slot) + frame.videoOffset;
+    size = frame.videoSize;
+  }
+
+  if ((guint) g_atomic_int_get (&src->held) >= max_held) {
+    GstMapInfo map;
+
+    GST_LOG_OBJECT (src, "Holding %u slots already, copying", max_held);
+    buffer = gst_buffer_new_allocate (NULL, size, NULL);
+    gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+    NTV2GstCopyMemory (map.data, data, size);
+    gst_buffer_unmap (buffer, &map);
+    src->ring->ReleaseSlot (slot);
+
+    return buffer;
+  }
+
+  AjaShmHeldSlot *held = new AjaShmHeldSlot;
+  held->src = (GstAjaShmSrc *) gst_object_ref (src);
+  held->ring = src->ring;
+  held->slot = slot;
+  src->ring->Ref ();
+  g_atomic_int_inc (&src->held);
+
+  // Other readers map the same pages
+  return gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, data, size, 0,
+      size, held, gst_aja_shm_src_release_slot);
+}
+
+static void
+gst_aja_shm_src_add_timecode (GstAjaShmSrc * src, GstBuffer * buffer,
+    const NTV2GstShmFrame & frame)
+{
+  const gboolean interlaced = GST_VIDEO_INFO_IS_INTERLACED (&src->info);
+  GstVideoTimeCodeFlags flags = GST_VIDEO_TIME_CODE_FLAGS_NONE;
+  guint field_count = 0;
+  guint8 hours, minutes, seconds, frames;
+  GstVideoTimeCode tc;
+
+  if (interlaced) {
+    flags = (GstVideoTimeCodeFlags) (flags |
+        GST_VIDEO_TIME_CODE_FLAGS_INTERLACED);
+    field_count = frame.fieldCount == 0 ? 2 : frame.fieldCount;
+  }
+  if (src->info.fps_d == 1001 &&
+      (src->info.fps_n == 30000 || src->info.fps_n == 60000))
+    flags = (GstVideoTimeCodeFlags) (flags |
+        GST_VIDEO_TIME_CODE_FLAGS_DROP_FRAME);
+
+  hours = (((frame.timeCodeHigh & RP188_HOURTENS_MASK) >> 24) * 10) +
+      ((frame.timeCodeHigh & RP188_HOURUNITS_MASK) >> 16);
+  minutes = (((frame.timeCodeHigh & RP188_MINUTESTENS_MASK) >> 8) * 10) +
+      (frame.timeCodeHigh & RP188_MINUTESUNITS_MASK);
+  seconds = (((frame.timeCodeLow & RP188_SECONDTENS_MASK) >> 24) * 10) +
+      ((frame.timeCodeLow & RP188_SECONDUNITS_MASK) >> 16);
+  frames = (((frame.timeCodeLow & RP188_FRAMETENS_MASK) >> 8) * 10) +
+      (frame.timeCodeLow & RP188_FRAMEUNITS_MASK);
+
+  gst_video_time_code_init (&tc, src->info.fps_n, src->info.fps_d, NULL,
+      flags, hours, minutes, seconds, frames, field_count);
+  if (gst_video_time_code_is_valid (&tc))
+    gst_buffer_add_video_time_code_meta (buffer, &tc);
+  gst_video_time_code_clear (&tc);
+}
+
+static GstFlowReturn
+gst_aja_shm_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
+{
+  GstAjaShmSrc *src = GST_AJA_SHM_SRC (psrc);
+  uint64_t sequence = 0;
+  int32_t slot = -1;
+
+  while (slot < 0) {
+    if (gst_aja_shm_src_is_flushing (src))
+      return GST_FLOW_FLUSHING;
+
+    if (!src->ring || src->ring->IsClosed ()) {
+      if (!gst_aja_shm_src_open_ring (src) && !gst_aja_shm_src_wait (src))
+        return GST_FLOW_FLUSHING;
+      continue;
+    }
+
+    slot = src->ring->WaitFrame (src->last_sequence, WAIT_TIMEOUT_US,
+        sequence);
+    if (slot < 0)
+      continue;
+
+    // Frames from before the writer set any caps can't be described, nor
+    // ones claiming more than the slot holds
+    if (!gst_aja_shm_src_frame_fits (src, src->ring->GetFrame (slot)) ||
+        !gst_aja_shm_src_update_caps (src, src->ring->GetFrame (slot)) ||
+        (src->audio && src->ring->GetFrame (slot).audioSize == 0)) {
+      src->ring->ReleaseSlot (slot);
+      src->last_sequence = sequence;
+      slot = -1;
+    }
+  }
+
+  const NTV2GstShmFrame frame = src->ring->GetFrame (slot);
+  const gboolean discont = src->last_sequence == 0 ||
+      sequence != src->last_sequence + 1;
+
+  if (discont && src->last_sequence != 0)
+    GST_DEBUG_OBJECT (src, "Missed %" G_GUINT64_FORMAT " frames",
+        (guint64) (sequence - src->last_sequence - 1));
+  src->last_sequence = sequence;
+
+  *buffer = gst_aja_shm_src_slot_to_buffer (src, slot, frame);
+
+  // The frame's capture time in the pipeline clock's time
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT_CAST (src));
+  if (clock) {
+    const GstClockTime now = gst_clock_get_time (clock);
+    const GstClockTime base_time =
+        gst_element_get_base_time (GST_ELEMENT_CAST (src));
+    const GstClockTime age = MIN ((GstClockTime) g_get_monotonic_time () *
+        1000 - frame.captureTime, now - base_time);
+
+    GST_BUFFER_PTS (*buffer) = now - base_time - age;
+    gst_object_unref (clock);
+  }
+  GST_BUFFER_DURATION (*buffer) = src->frame_duration;
+  GST_BUFFER_OFFSET (*buffer) = frame.frameNumber;
+
+  if (discont)
+    GST_BUFFER_FLAG_SET (*buffer, GST_BUFFER_FLAG_DISCONT);
+
+  if (!src->audio) {
+    if (GST_VIDEO_INFO_IS_INTERLACED (&src->info)) {
+      GST_BUFFER_FLAG_SET (*buffer, GST_VIDEO_BUFFER_FLAG_INTERLACED);
+#if GST_CHECK_VERSION(1, 12, 0)
+      if (GST_VIDEO_INFO_FIELD_ORDER (&src->info) ==
+          GST_VIDEO_FIELD_ORDER_TOP_FIELD_FIRST)
+        GST_BUFFER_FLAG_SET (*buffer, GST_VIDEO_BUFFER_FLAG_TFF);
+#endif
+    }
+
+    if (frame.timeCodeValid && src->info.fps_n > 0)
+      gst_aja_shm_src_add_timecode (src, *buffer, frame);
+  }
+
+  GST_LOG_OBJECT (src, "Frame %" G_GUINT64_FORMAT " of slot %d, timestamp %"
+      GST_TIME_FORMAT, (guint64) frame.frameNumber, slot,
+      GST_TIME_ARGS (GST_BUFFER_PTS (*buffer)));
+
+  return GST_FLOW_OK;
+}
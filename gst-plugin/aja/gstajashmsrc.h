@@ -0,0 +1,71 @@
+/* GStreamer
+ * Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_AJA_SHM_SRC_H_
+#define _GST_AJA_SHM_SRC_H_
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
+
+#include "gstntv2shm.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AJA_SHM_SRC          (gst_aja_shm_src_get_type())
+#define GST_AJA_SHM_SRC(obj)          (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AJA_SHM_SRC,GstAjaShmSrc))
+#define GST_AJA_SHM_SRC_CLASS(klass)  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_AJA_SHM_SRC,GstAjaShmSrcClass))
+#define GST_IS_AJA_SHM_SRC(obj)       (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_AJA_SHM_SRC))
+#define GST_IS_AJA_SHM_SRC_CLASS(obj) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_AJA_SHM_SRC))
+
+typedef struct _GstAjaShmSrc GstAjaShmSrc;
+typedef struct _GstAjaShmSrcClass GstAjaShmSrcClass;
+
+struct _GstAjaShmSrc
+{
+    GstPushSrc                  parent;
+
+    gchar *                     ring_name;
+    gboolean                    audio;
+    guint                       max_held;
+
+    GMutex                      lock;
+    GCond                       cond;
+    gboolean                    flushing;
+
+    // All only accessed from the streaming thread
+    NTV2GstShmRing *            ring;               /// Opened by name, again whenever the writer restarts
+    guint64                     last_sequence;      /// Of the last frame read, 0 for none
+    guint32                     caps_serial;        /// Of the caps set on the pad, 0 for none
+    GstVideoInfo                info;
+    GstClockTime                frame_duration;
+
+    gint                        held;               /// Slots held by buffers downstream, atomic
+};
+
+struct _GstAjaShmSrcClass
+{
+    GstPushSrcClass parent_class;
+};
+
+GType gst_aja_shm_src_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -25,6 +25,8 @@
 
 #include "gstajavideosrc.h"
 #include "gstajavideosrc.h"
+#include "gstntv2arena.h"
+#include "gstntv2shm.h"
 
 #if GST_CHECK_VERSION(1, 15, 0)
 #include <gst/video/video-anc.h>
@@ -40,11 +42,37 @@ GST_DEBUG_CATEGORY_STATIC (gst_aja_video_src_debug);
 #define DEFAULT_INPUT_CHANNEL      (0)
 #define DEFAULT_PASSTHROUGH        (FALSE)
 #define DEFAULT_QUEUE_SIZE         (10)
+// Of the queue between the capture and the streaming thread, the video pool
+// can't have more frames in flight anyway
+#define MAX_QUEUE_CAPACITY         (1024)
+#define DEFAULT_MAX_LATENCY        (0)
+#define DEFAULT_QUEUE_POLICY       (GST_AJA_QUEUE_POLICY_DROP_OLDEST)
 #define DEFAULT_OUTPUT_STREAM_TIME (FALSE)
 #define DEFAULT_SKIP_FIRST_TIME    (0)
 #define DEFAULT_TIMECODE_MODE	   (GST_AJA_TIMECODE_MODE_VITC1)
 #define DEFAULT_OUTPUT_CC	   (FALSE)
 #define DEFAULT_CAPTURE_CPU_CORE   ((guint)-1)
+#define DEFAULT_SCHEDULER_THREADS  (0)
+#define DEFAULT_REALTIME_POLICY    (NTV2_REALTIME_POLICY_NONE)
+#define DEFAULT_REALTIME_PRIORITY  (50)
+#define DEFAULT_LOCK_MEMORY        (FALSE)
+#define DEFAULT_DELIVERY_CPU_CORE  ((guint)-1)
+#define DEFAULT_HUGE_PAGES         (GST_AJA_HUGE_PAGES_NONE)
+#define DEFAULT_VIDEO_POOL_SIZE    (0)
+#define DEFAULT_AUDIO_POOL_SIZE    (0)
+#define DEFAULT_DMA_ARENA          (FALSE)
+#define DEFAULT_DMA_ARENA_BUDGET   (0)
+#define DEFAULT_EXHAUSTION_POLICY  (NTV2_EXHAUSTION_POLICY_COPY_OUT)
+#define DEFAULT_COPY_OUT_WATERMARK (2)
+#define DEFAULT_DOWNSTREAM_POOL    (TRUE)
+#define DEFAULT_EXPORT_MEMORY      (NTV2_EXPORT_MODE_NONE)
+#define DEFAULT_PUBLISH            (NULL)
+#define DEFAULT_PUBLISH_SLOTS      (8)
+#define DEFAULT_DECIMATION         (1)
+#define DEFAULT_CROP_X             (0)
+#define DEFAULT_CROP_Y             (0)
+#define DEFAULT_CROP_WIDTH         (0)
+#define DEFAULT_CROP_HEIGHT        (0)
 
 enum
 {
@@ -56,12 +84,38 @@ enum
   PROP_INPUT_CHANNEL,
   PROP_PASSTHROUGH,
   PROP_QUEUE_SIZE,
+  PROP_MAX_LATENCY,
+  PROP_QUEUE_POLICY,
   PROP_OUTPUT_STREAM_TIME,
   PROP_SKIP_FIRST_TIME,
   PROP_TIMECODE_MODE,
   PROP_OUTPUT_CC,
   PROP_SIGNAL,
   PROP_CAPTURE_CPU_CORE,
+  PROP_SCHEDULER_THREADS,
+  PROP_REALTIME_POLICY,
+  PROP_REALTIME_PRIORITY,
+  PROP_LOCK_MEMORY,
+  PROP_DELIVERY_CPU_CORE,
+  PROP_HUGE_PAGES,
+  PROP_VIDEO_POOL_SIZE,
+  PROP_AUDIO_POOL_SIZE,
+  PROP_DMA_ARENA,
+  PROP_DMA_ARENA_BUDGET,
+  PROP_EXHAUSTION_POLICY,
+  PROP_COPY_OUT_WATERMARK,
+  PROP_DOWNSTREAM_POOL,
+  PROP_EXPORT_MEMORY,
+  PROP_PUBLISH,
+  PROP_PUBLISH_SLOTS,
+  PROP_DECIMATION,
+  PROP_MAX_FRAMERATE,
+  PROP_CROP_X,
+  PROP_CROP_Y,
+  PROP_CROP_WIDTH,
+  PROP_CROP_HEIGHT,
+  PROP_NUMA_NODE,
+  PROP_NUMA_CPUS,
   PROP_NVMM
 };
 
@@ -72,16 +126,18 @@ typedef enum {
   LOST_SIGNAL,
 } SignalChange;
 
-typedef struct
+struct _AjaCaptureVideoFrame
 {
   GstAjaVideoSrc *video_src;
   SignalChange signal_change;
   AjaVideoBuff *video_buff;
   GstClockTime capture_time;
   GstClockTime stream_time;
+  GstClockTime capture_running_time;  // For max-latency, whatever the timestamps are
   GstAjaModeRawEnum mode;
   gboolean first_buffer;
-} AjaCaptureVideoFrame;
+  gboolean dropped_before;      // Frames were dropped from our queue before this one
+};
 
 static void
 aja_capture_video_frame_clear (void *data)
@@ -93,6 +149,25 @@ aja_capture_video_frame_clear (void *data)
   memset(frame, 0, sizeof (*frame));
 }
 
+// Releases all frames queued for the streaming thread
+static void
+gst_aja_video_src_clear_frames (GstAjaVideoSrc * src)
+{
+  AjaCaptureVideoFrame f;
+
+  if (src->next_frame) {
+    aja_capture_video_frame_clear (src->next_frame);
+    g_free (src->next_frame);
+    src->next_frame = NULL;
+  }
+
+  if (src->current_frames) {
+    while (src->current_frames->Pop (f))
+      aja_capture_video_frame_clear (&f);
+    gst_aja_video_src_update_room (src);
+  }
+}
+
 static void gst_aja_video_src_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_aja_video_src_get_property (GObject * object, guint property_id,
@@ -119,6 +194,7 @@ static GstStateChangeReturn gst_aja_video_src_change_state (GstElement *
     element, GstStateChange transition);
 
 static bool gst_aja_video_src_video_callback (void *refcon, void *msg);
+static void gst_aja_video_src_update_room (GstAjaVideoSrc * src);
 
 #define parent_class gst_aja_video_src_parent_class
 G_DEFINE_TYPE (GstAjaVideoSrc, gst_aja_video_src, GST_TYPE_PUSH_SRC);
@@ -158,7 +234,7 @@ gst_aja_video_src_class_init (GstAjaVideoSrcClass * klass)
   g_object_class_install_property (gobject_class, PROP_DEVICE_IDENTIFIER,
       g_param_spec_string ("device-identifier",
           "Device identifier",
-          "Input device instance to use",
+          "Input device instance to use (\"sim\" or \"sim:options\" for a simulated device)",
           DEFAULT_DEVICE_IDENTIFIER,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
               G_PARAM_CONSTRUCT)));
@@ -200,6 +276,25 @@ gst_aja_video_src_class_init (GstAjaVideoSrcClass * klass)
           1, G_MAXINT, DEFAULT_QUEUE_SIZE,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+  g_object_class_install_property (gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_uint64 ("max-latency",
+          "Max Latency",
+          "Drop frames captured longer than this ago instead of pushing them, "
+          "and size the queue within it from how regularly downstream takes "
+          "frames, queue-size still being the limit (0 = queue-size only)",
+          0, G_MAXUINT64, DEFAULT_MAX_LATENCY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_POLICY,
+      g_param_spec_enum ("queue-policy",
+          "Queue Policy",
+          "What to do with a captured frame when the queue is full. Blocking "
+          "only applies to a source that has the input to itself, with others "
+          "the oldest is dropped instead. If no source of the input has room, the "
+          "frame isn't even transferred from the device",
+          GST_TYPE_AJA_QUEUE_POLICY, DEFAULT_QUEUE_POLICY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
   g_object_class_install_property (gobject_class, PROP_OUTPUT_STREAM_TIME,
       g_param_spec_boolean ("output-stream-time", "Output Stream Time",
           "Output stream time directly instead of translating to pipeline clock",
@@ -221,7 +316,9 @@ gst_aja_video_src_class_init (GstAjaVideoSrcClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_OUTPUT_CC,
       g_param_spec_boolean ("output-cc", "Output Closed Caption",
-          "Extract and output CC as GstMeta (if present)",
+          "Extract and output CC as GstMeta (if present). With the ANC "
+          "extractor of the device, for any format, every ancillary packet is "
+          "output as GstAncillaryMeta too",
           DEFAULT_OUTPUT_CC,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
@@ -238,6 +335,210 @@ gst_aja_video_src_class_init (GstAjaVideoSrcClass * klass)
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
               G_PARAM_CONSTRUCT)));
 
+  g_object_class_install_property (gobject_class, PROP_SCHEDULER_THREADS,
+      g_param_spec_uint ("scheduler-threads",
+          "Scheduler Threads",
+          "Capture with the device-wide scheduler using this many threads for all "
+          "channels of the device, staggering their transfers (0=own capture thread)",
+          0, NTV2_MAX_NUM_CHANNELS, DEFAULT_SCHEDULER_THREADS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_REALTIME_POLICY,
+      g_param_spec_enum ("realtime-policy", "Real-time Policy",
+          "Scheduling policy of the capture thread (needs CAP_SYS_NICE or RLIMIT_RTPRIO)",
+          GST_TYPE_AJA_REALTIME_POLICY, DEFAULT_REALTIME_POLICY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_REALTIME_PRIORITY,
+      g_param_spec_uint ("realtime-priority",
+          "Real-time Priority",
+          "Priority of the capture thread with the fifo and rr real-time policies",
+          1, 99, DEFAULT_REALTIME_PRIORITY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_LOCK_MEMORY,
+      g_param_spec_boolean ("lock-memory",
+          "Lock Memory",
+          "Lock the capture thread's stack and the buffer pools into RAM "
+          "(needs CAP_IPC_LOCK or RLIMIT_MEMLOCK)",
+          DEFAULT_LOCK_MEMORY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_DELIVERY_CPU_CORE,
+      g_param_spec_uint ("delivery-cpu-core",
+          "Delivery CPU Core",
+          "Sets the affinity of the thread handing captured frames to the element "
+          "to this CPU core (-1=disabled)",
+          0, G_MAXUINT, DEFAULT_DELIVERY_CPU_CORE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_HUGE_PAGES,
+      g_param_spec_enum ("huge-pages", "Huge Pages",
+          "Back the preallocated buffers with huge pages, falling back to regular "
+          "pages if none are reserved (see /proc/sys/vm/nr_hugepages)",
+          GST_TYPE_AJA_HUGE_PAGES, DEFAULT_HUGE_PAGES,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_VIDEO_POOL_SIZE,
+      g_param_spec_uint ("video-pool-size",
+          "Video Pool Size",
+          "Number of preallocated and locked video buffers (0=auto from frame size, "
+          "queue-size and the buffers held downstream)",
+          0, G_MAXINT, DEFAULT_VIDEO_POOL_SIZE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_AUDIO_POOL_SIZE,
+      g_param_spec_uint ("audio-pool-size",
+          "Audio Pool Size",
+          "Number of preallocated and locked audio buffers (0=auto from queue-size "
+          "and the buffers held downstream)",
+          0, G_MAXINT, DEFAULT_AUDIO_POOL_SIZE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_DMA_ARENA,
+      g_param_spec_boolean ("dma-arena",
+          "DMA Arena",
+          "Take the buffers from memory shared by all channels of the device, "
+          "which stays allocated and locked across pipeline restarts",
+          DEFAULT_DMA_ARENA,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_DMA_ARENA_BUDGET,
+      g_param_spec_uint64 ("dma-arena-budget",
+          "DMA Arena Budget",
+          "Most bytes the DMA arenas of all devices of the process may map, beyond "
+          "that buffers are allocated per pool (0=RLIMIT_MEMLOCK with lock-memory, "
+          "unlimited otherwise)",
+          0, G_MAXUINT64, DEFAULT_DMA_ARENA_BUDGET,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_EXHAUSTION_POLICY,
+      g_param_spec_enum ("exhaustion-policy", "Exhaustion Policy",
+          "What to do when all DMA buffers are held downstream: allocate more on "
+          "the capture thread, copy the oldest held buffers to ordinary memory in "
+          "the background, or drop frames. Frames are dropped and counted whenever "
+          "no buffer is free",
+          GST_TYPE_AJA_EXHAUSTION_POLICY, DEFAULT_EXHAUSTION_POLICY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_COPY_OUT_WATERMARK,
+      g_param_spec_uint ("copy-out-watermark",
+          "Copy-out Watermark",
+          "Number of free DMA buffers below which buffers held downstream are "
+          "copied out (exhaustion-policy=copy-out)",
+          1, G_MAXINT, DEFAULT_COPY_OUT_WATERMARK,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_DOWNSTREAM_POOL,
+      g_param_spec_boolean ("downstream-pool",
+          "Downstream Pool",
+          "Capture straight into the buffers of a system memory pool downstream "
+          "proposes instead of copying them downstream",
+          DEFAULT_DOWNSTREAM_POOL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_EXPORT_MEMORY,
+      g_param_spec_enum ("export-memory", "Export Memory",
+          "Back the captured frames with memfds or DMABufs, so that encoders, "
+          "other devices and other processes can import the pages the card "
+          "wrote without a copy. Disables downstream-pool, dma-arena, "
+          "huge-pages and copying out for video",
+          GST_TYPE_AJA_EXPORT_MODE, DEFAULT_EXPORT_MEMORY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_PUBLISH,
+      g_param_spec_string ("publish", "Publish",
+          "Capture into a ring of this name in shared memory and publish every "
+          "frame with its audio and timecode to ajashmsrc elements in other "
+          "processes (NULL=don't publish)",
+          DEFAULT_PUBLISH,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_PUBLISH_SLOTS,
+      g_param_spec_uint ("publish-slots", "Publish Slots",
+          "Frames in the published ring. Frames are not published while "
+          "readers and this pipeline hold all of them",
+          2, NTV2_SHM_MAX_SLOTS, DEFAULT_PUBLISH_SLOTS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_DECIMATION,
+      g_param_spec_uint ("decimation", "Decimation",
+          "Transfer the video of only every Nth frame from the device, the "
+          "caps have the reduced framerate. Audio is still captured for "
+          "every frame",
+          1, G_MAXINT, DEFAULT_DECIMATION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_FRAMERATE,
+      gst_param_spec_fraction ("max-framerate", "Max Framerate",
+          "Decimate the video by the smallest N that brings the framerate of "
+          "the mode down to at most this, if that is more than decimation "
+          "(0/1 = no limit)",
+          0, 1, G_MAXINT, 1, 0, 1,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_X,
+      g_param_spec_uint ("crop-x", "Crop X",
+          "Left edge of the rectangle to capture, rounded down to a multiple "
+          "of 6 pixels for 10 bit and 2 for 8 bit YUV",
+          0, G_MAXINT, DEFAULT_CROP_X,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_Y,
+      g_param_spec_uint ("crop-y", "Crop Y",
+          "Top edge of the rectangle to capture",
+          0, G_MAXINT, DEFAULT_CROP_Y,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_WIDTH,
+      g_param_spec_uint ("crop-width", "Crop Width",
+          "Width of the rectangle to capture, only its lines and bytes are "
+          "transferred from the device and the caps have its size. Rounded "
+          "up to even pixels for YUV (0=to the right edge)",
+          0, G_MAXINT, DEFAULT_CROP_WIDTH,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_HEIGHT,
+      g_param_spec_uint ("crop-height", "Crop Height",
+          "Height of the rectangle to capture, rounded up to even lines for "
+          "interlaced modes (0=to the bottom edge)",
+          0, G_MAXINT, DEFAULT_CROP_HEIGHT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class, PROP_NUMA_NODE,
+      g_param_spec_int ("numa-node", "NUMA Node",
+          "NUMA node of the device the buffers are placed on (-1=unknown)",
+          -1, G_MAXINT, -1,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_NUMA_CPUS,
+      g_param_spec_string ("numa-cpus", "NUMA CPUs",
+          "Cores of the device's NUMA node that the capture and delivery threads "
+          "run on unless capture-cpu-core or delivery-cpu-core are set",
+          NULL, (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
 #if ENABLE_NVMM
   g_object_class_install_property (gobject_class, PROP_NVMM,
       g_param_spec_boolean ("nvmm", "Use NVMM (NVIDIA GPU) Buffers",
@@ -269,10 +570,45 @@ gst_aja_video_src_init (GstAjaVideoSrc * src)
   src->passthrough = DEFAULT_PASSTHROUGH;
   src->device_identifier = g_strdup (DEFAULT_DEVICE_IDENTIFIER);
   src->queue_size = DEFAULT_QUEUE_SIZE;
+  src->max_latency = DEFAULT_MAX_LATENCY;
+  src->queue_policy = DEFAULT_QUEUE_POLICY;
+  src->queue_depth = DEFAULT_QUEUE_SIZE;
+  gst_aja_queue_tuner_reset (&src->queue_tuner);
+  src->late_dropped = 0;
+  src->late_pending = FALSE;
   src->output_stream_time = DEFAULT_OUTPUT_STREAM_TIME;
   src->skip_first_time = DEFAULT_SKIP_FIRST_TIME;
   src->timecode_mode = DEFAULT_TIMECODE_MODE;
   src->capture_cpu_core = DEFAULT_CAPTURE_CPU_CORE;
+  src->scheduler_threads = DEFAULT_SCHEDULER_THREADS;
+  src->realtime_policy = DEFAULT_REALTIME_POLICY;
+  src->realtime_priority = DEFAULT_REALTIME_PRIORITY;
+  src->lock_memory = DEFAULT_LOCK_MEMORY;
+  src->delivery_cpu_core = DEFAULT_DELIVERY_CPU_CORE;
+  src->huge_pages = DEFAULT_HUGE_PAGES;
+  src->video_pool_size = DEFAULT_VIDEO_POOL_SIZE;
+  src->audio_pool_size = DEFAULT_AUDIO_POOL_SIZE;
+  src->dma_arena = DEFAULT_DMA_ARENA;
+  src->dma_arena_budget = DEFAULT_DMA_ARENA_BUDGET;
+  src->exhaustion_policy = DEFAULT_EXHAUSTION_POLICY;
+  src->copy_out_watermark = DEFAULT_COPY_OUT_WATERMARK;
+  src->downstream_pool = DEFAULT_DOWNSTREAM_POOL;
+  src->active_downstream_pool = NULL;
+  src->export_memory = DEFAULT_EXPORT_MEMORY;
+  src->publish = g_strdup (DEFAULT_PUBLISH);
+  src->publish_slots = DEFAULT_PUBLISH_SLOTS;
+  src->decimation = DEFAULT_DECIMATION;
+  src->max_framerate_n = 0;
+  src->max_framerate_d = 1;
+  src->active_decimation = 1;
+  src->crop_x = DEFAULT_CROP_X;
+  src->crop_y = DEFAULT_CROP_Y;
+  src->crop_width = DEFAULT_CROP_WIDTH;
+  src->crop_height = DEFAULT_CROP_HEIGHT;
+  src->active_crop.x = src->active_crop.y = 0;
+  src->active_crop.w = src->active_crop.h = 0;
+  src->numa_node = -1;
+  src->numa_cpus = NULL;
 
   src->window_size = 64;
   src->times = g_new (GstClockTime, 4 * src->window_size);
@@ -289,9 +625,10 @@ gst_aja_video_src_init (GstAjaVideoSrc * src)
   gst_pad_use_fixed_caps (GST_BASE_SRC_PAD (src));
 
   g_mutex_init (&src->lock);
-  g_cond_init (&src->cond);
 
-  src->current_frames = gst_queue_array_new_for_struct (sizeof (AjaCaptureVideoFrame), DEFAULT_QUEUE_SIZE);
+  src->current_frames = NULL;
+  src->next_frame = NULL;
+  src->dropped_signal_change = NO_CHANGE;
 
   src->skipped_last = 0;
   src->skipped_overall = 0;
@@ -336,6 +673,16 @@ gst_aja_video_src_set_property (GObject * object, guint property_id,
       src->queue_size = g_value_get_uint (value);
       break;
 
+    case PROP_MAX_LATENCY:
+      src->max_latency = g_value_get_uint64 (value);
+      gst_element_post_message (GST_ELEMENT_CAST (src),
+          gst_message_new_latency (GST_OBJECT_CAST (src)));
+      break;
+
+    case PROP_QUEUE_POLICY:
+      src->queue_policy = (GstAjaQueuePolicy) g_value_get_enum (value);
+      break;
+
     case PROP_OUTPUT_STREAM_TIME:
       src->output_stream_time = g_value_get_boolean (value);
       break;
@@ -391,6 +738,96 @@ gst_aja_video_src_set_property (GObject * object, guint property_id,
       src->capture_cpu_core = g_value_get_uint (value);
       break;
 
+    case PROP_SCHEDULER_THREADS:
+      src->scheduler_threads = g_value_get_uint (value);
+      break;
+
+    case PROP_REALTIME_POLICY:
+      src->realtime_policy = (NTV2GstRealtimePolicy) g_value_get_enum (value);
+      break;
+
+    case PROP_REALTIME_PRIORITY:
+      src->realtime_priority = g_value_get_uint (value);
+      break;
+
+    case PROP_LOCK_MEMORY:
+      src->lock_memory = g_value_get_boolean (value);
+      break;
+
+    case PROP_DELIVERY_CPU_CORE:
+      src->delivery_cpu_core = g_value_get_uint (value);
+      break;
+
+    case PROP_HUGE_PAGES:
+      src->huge_pages = (GstAjaHugePages) g_value_get_enum (value);
+      break;
+
+    case PROP_VIDEO_POOL_SIZE:
+      src->video_pool_size = g_value_get_uint (value);
+      break;
+
+    case PROP_AUDIO_POOL_SIZE:
+      src->audio_pool_size = g_value_get_uint (value);
+      break;
+
+    case PROP_DMA_ARENA:
+      src->dma_arena = g_value_get_boolean (value);
+      break;
+
+    case PROP_DMA_ARENA_BUDGET:
+      src->dma_arena_budget = g_value_get_uint64 (value);
+      break;
+
+    case PROP_EXHAUSTION_POLICY:
+      src->exhaustion_policy = (NTV2GstExhaustionPolicy) g_value_get_enum (value);
+      break;
+
+    case PROP_COPY_OUT_WATERMARK:
+      src->copy_out_watermark = g_value_get_uint (value);
+      break;
+
+    case PROP_DOWNSTREAM_POOL:
+      src->downstream_pool = g_value_get_boolean (value);
+      break;
+
+    case PROP_EXPORT_MEMORY:
+      src->export_memory = (NTV2GstExportMode) g_value_get_enum (value);
+      break;
+
+    case PROP_DECIMATION:
+      src->decimation = g_value_get_uint (value);
+      break;
+
+    case PROP_MAX_FRAMERATE:
+      src->max_framerate_n = gst_value_get_fraction_numerator (value);
+      src->max_framerate_d = gst_value_get_fraction_denominator (value);
+      break;
+
+    case PROP_CROP_X:
+      src->crop_x = g_value_get_uint (value);
+      break;
+
+    case PROP_CROP_Y:
+      src->crop_y = g_value_get_uint (value);
+      break;
+
+    case PROP_CROP_WIDTH:
+      src->crop_width = g_value_get_uint (value);
+      break;
+
+    case PROP_CROP_HEIGHT:
+      src->crop_height = g_value_get_uint (value);
+      break;
+
+    case PROP_PUBLISH:
+      g_free (src->publish);
+      src->publish = g_value_dup_string (value);
+      break;
+
+    case PROP_PUBLISH_SLOTS:
+      src->publish_slots = g_value_get_uint (value);
+      break;
+
 #if ENABLE_NVMM
     case PROP_NVMM:
       src->use_nvmm = g_value_get_boolean (value);
@@ -439,6 +876,14 @@ gst_aja_video_src_get_property (GObject * object, guint property_id,
       g_value_set_uint (value, src->queue_size);
       break;
 
+    case PROP_MAX_LATENCY:
+      g_value_set_uint64 (value, src->max_latency);
+      break;
+
+    case PROP_QUEUE_POLICY:
+      g_value_set_enum (value, src->queue_policy);
+      break;
+
     case PROP_OUTPUT_STREAM_TIME:
       g_value_set_boolean (value, src->output_stream_time);
       break;
@@ -463,6 +908,105 @@ gst_aja_video_src_get_property (GObject * object, guint property_id,
       g_value_set_uint (value, src->capture_cpu_core);
       break;
 
+    case PROP_SCHEDULER_THREADS:
+      g_value_set_uint (value, src->scheduler_threads);
+      break;
+
+    case PROP_REALTIME_POLICY:
+      g_value_set_enum (value, src->realtime_policy);
+      break;
+
+    case PROP_REALTIME_PRIORITY:
+      g_value_set_uint (value, src->realtime_priority);
+      break;
+
+    case PROP_LOCK_MEMORY:
+      g_value_set_boolean (value, src->lock_memory);
+      break;
+
+    case PROP_DELIVERY_CPU_CORE:
+      g_value_set_uint (value, src->delivery_cpu_core);
+      break;
+
+    case PROP_HUGE_PAGES:
+      g_value_set_enum (value, src->huge_pages);
+      break;
+
+    case PROP_VIDEO_POOL_SIZE:
+      g_value_set_uint (value, src->video_pool_size);
+      break;
+
+    case PROP_AUDIO_POOL_SIZE:
+      g_value_set_uint (value, src->audio_pool_size);
+      break;
+
+    case PROP_DMA_ARENA:
+      g_value_set_boolean (value, src->dma_arena);
+      break;
+
+    case PROP_DMA_ARENA_BUDGET:
+      g_value_set_uint64 (value, src->dma_arena_budget);
+      break;
+
+    case PROP_EXHAUSTION_POLICY:
+      g_value_set_enum (value, src->exhaustion_policy);
+      break;
+
+    case PROP_COPY_OUT_WATERMARK:
+      g_value_set_uint (value, src->copy_out_watermark);
+      break;
+
+    case PROP_DOWNSTREAM_POOL:
+      g_value_set_boolean (value, src->downstream_pool);
+      break;
+
+    case PROP_EXPORT_MEMORY:
+      g_value_set_enum (value, src->export_memory);
+      break;
+
+    case PROP_PUBLISH:
+      g_value_set_string (value, src->publish);
+      break;
+
+    case PROP_PUBLISH_SLOTS:
+      g_value_set_uint (value, src->publish_slots);
+      break;
+
+    case PROP_DECIMATION:
+      g_value_set_uint (value, src->decimation);
+      break;
+
+    case PROP_MAX_FRAMERATE:
+      gst_value_set_fraction (value, src->max_framerate_n,
+          src->max_framerate_d);
+      break;
+
+    case PROP_CROP_X:
+      g_value_set_uint (value, src->crop_x);
+      break;
+
+    case PROP_CROP_Y:
+      g_value_set_uint (value, src->crop_y);
+      break;
+
+    case PROP_CROP_WIDTH:
+      g_value_set_uint (value, src->crop_width);
+      break;
+
+    case PROP_CROP_HEIGHT:
+      g_value_set_uint (value, src->crop_height);
+      break;
+
+    case PROP_NUMA_NODE:
+      g_value_set_int (value, src->numa_node);
+      break;
+
+    case PROP_NUMA_CPUS:
+      GST_OBJECT_LOCK (src);
+      g_value_set_string (value, src->numa_cpus);
+      GST_OBJECT_UNLOCK (src);
+      break;
+
 #if ENABLE_NVMM
     case PROP_NVMM:
       g_value_set_boolean (value, src->use_nvmm);
@@ -482,20 +1026,22 @@ gst_aja_video_src_finalize (GObject * object)
 
   GST_DEBUG_OBJECT (src, "finalize");
 
-  AjaCaptureVideoFrame *frame;
-  while ((frame = (AjaCaptureVideoFrame *) gst_queue_array_pop_head_struct (src->current_frames))) {
-    aja_capture_video_frame_clear (frame);
-  }
-  gst_queue_array_free (src->current_frames);
+  gst_aja_video_src_clear_frames (src);
+  delete src->current_frames;
   src->current_frames = NULL;
 
   g_free (src->device_identifier);
   src->device_identifier = NULL;
 
+  g_free (src->numa_cpus);
+  src->numa_cpus = NULL;
+
+  g_free (src->publish);
+  src->publish = NULL;
+
   g_free (src->times);
   src->times = NULL;
   g_mutex_clear (&src->lock);
-  g_cond_clear (&src->cond);
 
   // Call parent class
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -521,7 +1067,7 @@ gst_aja_video_src_start (GstAjaVideoSrc *src)
   src->input->mode = mode;
   src->input->video_enabled = TRUE;
   if (src->input->start_streams)
-    src->input->start_streams (src->input->videosrc);
+    src->input->start_streams (GST_ELEMENT_CAST (src));
   g_mutex_unlock (&src->input->lock);
 
   src->skipped_last = 0;
@@ -532,13 +1078,115 @@ gst_aja_video_src_start (GstAjaVideoSrc *src)
   return TRUE;
 }
 
+// Frames of the mode per frame transferred, from decimation and max-framerate
+static guint
+gst_aja_video_src_get_decimation (GstAjaVideoSrc * src)
+{
+  const GstAjaMode *mode = gst_aja_get_mode_raw (src->modeEnum);
+  guint decimation = MAX (src->decimation, 1);
+
+  if (mode && src->max_framerate_n > 0) {
+    // ceil ((fps_n / fps_d) / (max_n / max_d))
+    guint64 num = (guint64) mode->fps_n * src->max_framerate_d;
+    guint64 den = (guint64) mode->fps_d * src->max_framerate_n;
+    guint64 n = (num + den - 1) / den;
+
+    decimation = MAX (decimation, (guint) MIN (n, (guint64) G_MAXINT));
+  }
+
+  return decimation;
+}
+
+// The framerate of the mode divided by the decimation
+static void
+gst_aja_video_src_decimate_caps (GstAjaVideoSrc * src, GstCaps * caps,
+    guint decimation)
+{
+  guint i;
+
+  if (decimation <= 1)
+    return;
+
+  for (i = 0; i < gst_caps_get_size (caps); i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+    gint fps_n, fps_d;
+
+    if (gst_structure_get_fraction (s, "framerate", &fps_n, &fps_d) &&
+        fps_n > 0 && gst_util_fraction_multiply (fps_n, fps_d, 1,
+            (gint) decimation, &fps_n, &fps_d))
+      gst_structure_set (s, "framerate", GST_TYPE_FRACTION, fps_n, fps_d,
+          NULL);
+  }
+}
+
+// The rectangle of the picture to capture, aligned to the pixel groups of
+// the format and clipped to the picture. FALSE for the whole picture.
+static gboolean
+gst_aja_video_src_get_crop (GstAjaVideoSrc * src, GstVideoRectangle * crop)
+{
+  const GstAjaMode *mode = gst_aja_get_mode_raw (src->modeEnum);
+  guint align_x, align_w, align_y, x, y, w, h;
+
+  crop->x = crop->y = crop->w = crop->h = 0;
+  if (!mode || (src->crop_x == 0 && src->crop_y == 0 &&
+          src->crop_width == 0 && src->crop_height == 0))
+    return FALSE;
+
+  // Shared memory readers and NVMM get the whole picture
+  if (src->use_nvmm || src->publish)
+    return FALSE;
+
+  // v210 packs 6 pixels in 16 bytes, and 4:2:2 shares chroma between 2
+  align_x = mode->isRGBA ? 1 : mode->bitDepth == 10 ? 6 : 2;
+  align_w = mode->isRGBA ? 1 : 2;
+  align_y = mode->isInterlaced ? 2 : 1;
+
+  x = MIN (src->crop_x, (guint) mode->width - 1) / align_x * align_x;
+  y = MIN (src->crop_y, (guint) mode->height - 1) / align_y * align_y;
+  w = src->crop_width > 0 ? src->crop_width : mode->width - x;
+  h = src->crop_height > 0 ? src->crop_height : mode->height - y;
+  w = MIN (GST_ROUND_UP_N (w, align_w), mode->width - x);
+  h = MIN (GST_ROUND_UP_N (h, align_y), mode->height - y);
+
+  if (x == 0 && y == 0 && w == (guint) mode->width &&
+      h == (guint) mode->height)
+    return FALSE;
+
+  crop->x = x;
+  crop->y = y;
+  crop->w = w;
+  crop->h = h;
+
+  return TRUE;
+}
+
+// The size of the crop, if any
+static void
+gst_aja_video_src_crop_caps (GstAjaVideoSrc * src, GstCaps * caps,
+    const GstVideoRectangle * crop)
+{
+  if (crop->w == 0)
+    return;
+
+  gst_caps_set_simple (caps, "width", G_TYPE_INT, crop->w,
+      "height", G_TYPE_INT, crop->h, NULL);
+}
+
 static GstCaps *
 gst_aja_video_src_get_caps (GstBaseSrc * bsrc, GstCaps * filter)
 {
   GstAjaVideoSrc *src = GST_AJA_VIDEO_SRC (bsrc);
+  GstVideoRectangle crop;
   GstCaps *caps;
 
   caps = gst_aja_mode_get_caps_raw (src->modeEnum, src->use_nvmm);
+  gst_aja_video_src_decimate_caps (src, caps,
+      gst_aja_video_src_get_decimation (src));
+  if (src->input)
+    crop = src->active_crop;
+  else
+    gst_aja_video_src_get_crop (src, &crop);
+  gst_aja_video_src_crop_caps (src, caps, &crop);
   if (filter) {
     GstCaps *tmp = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
     gst_caps_unref (caps);
@@ -564,10 +1212,17 @@ gst_aja_video_src_query (GstBaseSrc * bsrc, GstQuery * query)
         if (src->input->mode) {
           GstClockTime min, max;
 
+          // One output frame, which spans as many input frames as are
+          // decimated into it
           min =
-              gst_util_uint64_scale_ceil (GST_SECOND, src->input->mode->fps_d,
+              gst_util_uint64_scale_ceil (GST_SECOND,
+              (guint64) src->input->mode->fps_d * src->active_decimation,
               src->input->mode->fps_n);
-          max = src->queue_size * min;
+          // Nothing older than the budget is pushed, whatever the queue holds
+          if (src->max_latency > 0)
+            max = MAX (min, src->max_latency);
+          else
+            max = src->queue_size * min;
 
           gst_query_set_latency (query, TRUE, min, max);
           ret = TRUE;
@@ -597,10 +1252,9 @@ gst_aja_video_src_unlock (GstBaseSrc * bsrc)
   GstAjaVideoSrc *src = GST_AJA_VIDEO_SRC (bsrc);
   GST_DEBUG_OBJECT (src, "unlock");
 
-  g_mutex_lock (&src->lock);
-  src->flushing = TRUE;
-  g_cond_signal (&src->cond);
-  g_mutex_unlock (&src->lock);
+  g_atomic_int_set (&src->flushing, TRUE);
+  if (src->current_frames)
+    src->current_frames->Wake ();
 
   return TRUE;
 }
@@ -612,14 +1266,8 @@ gst_aja_video_src_unlock_stop (GstBaseSrc * bsrc)
   GstAjaVideoSrc *src = GST_AJA_VIDEO_SRC (bsrc);
   GST_DEBUG_OBJECT (src, "unlock_stop");
 
-  g_mutex_lock (&src->lock);
-  src->flushing = FALSE;
-
-  AjaCaptureVideoFrame *frame;
-  while ((frame = (AjaCaptureVideoFrame *) gst_queue_array_pop_head_struct (src->current_frames))) {
-    aja_capture_video_frame_clear (frame);
-  }
-  g_mutex_unlock (&src->lock);
+  g_atomic_int_set (&src->flushing, FALSE);
+  gst_aja_video_src_clear_frames (src);
 
   return TRUE;
 }
@@ -643,6 +1291,44 @@ gst_aja_video_src_open (GstAjaVideoSrc * src)
     return FALSE;
   }
 
+  // Another video source captures the input already, we get its frames as
+  // they are and its settings apply
+  g_mutex_lock (&src->input->lock);
+  if (src->input->videosrc != GST_ELEMENT_CAST (src)) {
+    GstAjaVideoSrc *first = GST_AJA_VIDEO_SRC_CAST (src->input->videosrc);
+    GstVideoRectangle crop;
+    gst_aja_video_src_get_crop (src, &crop);
+    gboolean compatible = first->modeEnum == src->modeEnum &&
+        first->input_mode == src->input_mode &&
+        first->sdi_input_mode == src->sdi_input_mode &&
+        first->active_decimation == gst_aja_video_src_get_decimation (src) &&
+        first->active_crop.x == crop.x && first->active_crop.y == crop.y &&
+        first->active_crop.w == crop.w && first->active_crop.h == crop.h;
+
+    if (compatible) {
+      GST_INFO_OBJECT (src, "Sharing the capture of %" GST_PTR_FORMAT, first);
+      src->active_decimation = first->active_decimation;
+      src->active_crop = first->active_crop;
+      std::string numa_cpus = src->input->ntv2AV->GetNUMACPUs ();
+      GST_OBJECT_LOCK (src);
+      src->numa_node = src->input->ntv2AV->GetNUMANode ();
+      g_free (src->numa_cpus);
+      src->numa_cpus =
+          numa_cpus.empty ()? NULL : g_strdup (numa_cpus.c_str ());
+      GST_OBJECT_UNLOCK (src);
+    } else {
+      GST_ERROR_OBJECT (src, "Input is captured by %" GST_PTR_FORMAT
+          " in another mode, decimation or crop", first);
+      gst_aja_release_input (src->input, GST_ELEMENT_CAST (src), FALSE);
+    }
+    g_mutex_unlock (&src->input->lock);
+
+    if (!compatible)
+      src->input = NULL;
+    return compatible;
+  }
+  g_mutex_unlock (&src->input->lock);
+
   mode = gst_aja_get_mode_raw (src->modeEnum);
   g_assert (mode != NULL);
 
@@ -660,6 +1346,15 @@ gst_aja_video_src_open (GstAjaVideoSrc * src)
     return FALSE;
   }
 
+  std::string numa_cpus = src->input->ntv2AV->GetNUMACPUs ();
+  GST_OBJECT_LOCK (src);
+  src->numa_node = src->input->ntv2AV->GetNUMANode ();
+  g_free (src->numa_cpus);
+  src->numa_cpus = numa_cpus.empty ()? NULL : g_strdup (numa_cpus.c_str ());
+  GST_OBJECT_UNLOCK (src);
+  GST_DEBUG_OBJECT (src, "Device on NUMA node %d, cores %s", src->numa_node,
+      GST_STR_NULL (src->numa_cpus));
+
   switch (src->input_mode) {
     case GST_AJA_VIDEO_INPUT_MODE_SDI:
       input_source = NTV2_INPUTSOURCE_SDI1;
@@ -719,6 +1414,62 @@ gst_aja_video_src_open (GstAjaVideoSrc * src)
     return FALSE;
   }
 
+  src->input->ntv2AV->SetScheduler (src->scheduler_threads > 0 ?
+      gst_aja_acquire_scheduler (src->device_identifier,
+          src->scheduler_threads) : NULL);
+
+  NTV2GstRealtimeProfile profile;
+  NTV2GstRealtimeProfileInit (profile);
+  profile.policy = src->realtime_policy;
+  profile.priority = src->realtime_priority;
+  profile.lockMemory = src->lock_memory ? true : false;
+  profile.deliveryCPUCore = src->delivery_cpu_core;
+  src->input->ntv2AV->SetRealtimeProfile (profile);
+
+  switch (src->huge_pages) {
+    case GST_AJA_HUGE_PAGES_2MB:
+      src->input->ntv2AV->SetHugePageSize (2 * 1024 * 1024);
+      break;
+
+    case GST_AJA_HUGE_PAGES_1GB:
+      src->input->ntv2AV->SetHugePageSize (1024 * 1024 * 1024);
+      break;
+
+    default:
+      src->input->ntv2AV->SetHugePageSize (0);
+      break;
+  }
+
+  src->input->ntv2AV->SetPoolSizes (src->video_pool_size, src->audio_pool_size,
+      src->queue_size);
+
+  if (src->dma_arena)
+    NTV2GstArena::SetBudget (src->dma_arena_budget);
+  src->input->ntv2AV->SetArena (src->dma_arena ?
+      gst_aja_acquire_arena (src->device_identifier) : NULL);
+  src->input->ntv2AV->SetExhaustionPolicy (src->exhaustion_policy,
+      src->copy_out_watermark);
+  src->input->ntv2AV->SetExportMode (src->export_memory);
+  src->input->ntv2AV->SetPublisher (src->publish ? src->publish : "",
+      src->publish_slots);
+  src->active_decimation = gst_aja_video_src_get_decimation (src);
+  src->input->ntv2AV->SetDecimation (src->active_decimation);
+  if (src->active_decimation > 1)
+    GST_INFO_OBJECT (src, "Transferring the video of one in %u frames",
+        src->active_decimation);
+  gst_aja_video_src_get_crop (src, &src->active_crop);
+  if (!src->input->ntv2AV->SetCrop (src->active_crop.x, src->active_crop.y,
+          src->active_crop.w, src->active_crop.h)) {
+    GST_WARNING_OBJECT (src, "Can't crop to %dx%d at %d,%d, capturing the "
+        "whole picture", src->active_crop.w, src->active_crop.h,
+        src->active_crop.x, src->active_crop.y);
+    src->active_crop.x = src->active_crop.y = 0;
+    src->active_crop.w = src->active_crop.h = 0;
+  } else if (src->active_crop.w > 0) {
+    GST_INFO_OBJECT (src, "Capturing %dx%d at %d,%d", src->active_crop.w,
+        src->active_crop.h, src->active_crop.x, src->active_crop.y);
+  }
+
   g_mutex_unlock (&src->input->lock);
 
   return TRUE;
@@ -732,19 +1483,20 @@ gst_aja_video_src_close (GstAjaVideoSrc * src)
   if (src->input) {
     g_mutex_lock (&src->input->lock);
 
-    if (src->input->ntv2AV) {
-      src->input->ntv2AV->Quit ();
-      src->input->ntv2AV->Close ();
-      delete src->input->ntv2AV;
-      src->input->ntv2AV = NULL;
-      GST_DEBUG_OBJECT (src, "shut down ntv2HEVC");
-    }
+    // The capture goes on as long as other video sources share it
+    if (gst_aja_release_input (src->input, GST_ELEMENT_CAST (src), FALSE)) {
+      if (src->input->ntv2AV) {
+        src->input->ntv2AV->Quit ();
+        src->input->ntv2AV->Close ();
+        delete src->input->ntv2AV;
+        src->input->ntv2AV = NULL;
+        GST_DEBUG_OBJECT (src, "shut down ntv2HEVC");
+      }
 
-    src->input->mode = NULL;
-    src->input->video_enabled = FALSE;
-    gst_object_unref (src->input->videosrc);
-    src->input->videosrc = NULL;
-    src->input->start_streams = NULL;
+      src->input->mode = NULL;
+      src->input->video_enabled = FALSE;
+      src->input->start_streams = NULL;
+    }
 
     g_mutex_unlock (&src->input->lock);
     src->input = NULL;
@@ -753,24 +1505,114 @@ gst_aja_video_src_close (GstAjaVideoSrc * src)
   return TRUE;
 }
 
-static gboolean
-gst_aja_video_src_stop (GstAjaVideoSrc * src)
+static void
+gst_aja_video_src_release_downstream_pool (GstAjaVideoSrc * src)
 {
-  GST_DEBUG_OBJECT (src, "stop");
+  GstBufferPool *pool = src->active_downstream_pool;
 
-  if (src->input && src->input->video_enabled) {
-    g_mutex_lock (&src->input->lock);
-    src->input->ntv2AV->Quit ();
-    src->input->video_enabled = FALSE;
-    src->input->ntv2AV->SetCallback (VIDEO_CALLBACK, 0, 0);
-    g_mutex_unlock (&src->input->lock);
+  if (!pool)
+    return;
+
+  if (src->input && src->input->ntv2AV)
+    src->input->ntv2AV->SetDownstreamPool (NULL);
+  gst_buffer_pool_set_active (pool, FALSE);
+  gst_object_unref (pool);
+  src->active_downstream_pool = NULL;
+}
+
+// The element never negotiates through GstBaseSrc, so the allocation query
+// is ours to run whenever the caps change. A system memory pool downstream
+// proposes is configured for frames with their VANC lines and the capture
+// DMAs straight into its buffers while it has free ones.
+static void
+gst_aja_video_src_decide_allocation (GstAjaVideoSrc * src, GstCaps * caps)
+{
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  GstQuery *query;
+  guint size = 0, min = 0, max = 0;
+
+  gst_aja_video_src_release_downstream_pool (src);
+
+  // Downstream imports our exported memory instead
+  if (!src->downstream_pool || src->use_nvmm ||
+      src->export_memory != NTV2_EXPORT_MODE_NONE)
+    return;
+
+  // Only the video source that configured the input decides where it
+  // captures into
+  g_mutex_lock (&src->input->lock);
+  gboolean configured = src->input->videosrc == GST_ELEMENT_CAST (src);
+  g_mutex_unlock (&src->input->lock);
+  if (!configured)
+    return;
+
+  query = gst_query_new_allocation (caps, TRUE);
+  if (gst_pad_peer_query (GST_BASE_SRC_PAD (src), query) &&
+      gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  gst_query_unref (query);
+
+  if (!pool) {
+    GST_DEBUG_OBJECT (src, "Downstream proposed no pool");
+    return;
   }
 
-  AjaCaptureVideoFrame *frame;
-  while ((frame = (AjaCaptureVideoFrame *) gst_queue_array_pop_head_struct (src->current_frames))) {
-    aja_capture_video_frame_clear (frame);
+  g_mutex_lock (&src->input->lock);
+  size = MAX (size, src->input->ntv2AV->GetVideoBufferSize ());
+  g_mutex_unlock (&src->input->lock);
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  if (!gst_buffer_pool_set_config (pool, config) ||
+      !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_INFO_OBJECT (src, "Downstream pool %" GST_PTR_FORMAT " refused buffers "
+        "of %u bytes, capturing into our own", pool, size);
+    gst_object_unref (pool);
+    return;
   }
 
+  GST_INFO_OBJECT (src, "Capturing into downstream pool %" GST_PTR_FORMAT
+      " with buffers of %u bytes", pool, size);
+  src->active_downstream_pool = pool;
+  g_mutex_lock (&src->input->lock);
+  src->input->ntv2AV->SetDownstreamPool (pool);
+  g_mutex_unlock (&src->input->lock);
+}
+
+static gboolean
+gst_aja_video_src_stop (GstAjaVideoSrc * src)
+{
+  GST_DEBUG_OBJECT (src, "stop");
+
+  gst_aja_video_src_release_downstream_pool (src);
+
+  if (src->input) {
+    NTV2GstAV *ntv2AV;
+
+    g_mutex_lock (&src->input->lock);
+    ntv2AV = src->input->ntv2AV;
+    g_mutex_unlock (&src->input->lock);
+
+    // Not under the input's lock, the callbacks of the audio sources take it
+    ntv2AV->RemoveCallback (VIDEO_CALLBACK,
+        &gst_aja_video_src_video_callback, src);
+
+    // The capture goes on while other video sources of the input run
+    g_mutex_lock (&src->input->lock);
+    if (src->input->video_enabled &&
+        ntv2AV->GetNumCallbacks (VIDEO_CALLBACK) == 0) {
+      ntv2AV->Quit ();
+      src->input->video_enabled = FALSE;
+    }
+    g_mutex_unlock (&src->input->lock);
+  }
+
+  // The capture thread doesn't call us anymore
+  gst_aja_video_src_clear_frames (src);
+  delete src->current_frames;
+  src->current_frames = NULL;
+
   src->signal_state = SIGNAL_STATE_UNKNOWN;
 
   return TRUE;
@@ -807,7 +1649,8 @@ gst_aja_video_src_start_streams (GstElement * element)
     src->next_time_mapping.den = 1;
     g_mutex_unlock (&src->lock);
 
-    if (src->input->ntv2AV) {
+    // Other video sources of the input might have started it already
+    if (src->input->ntv2AV && !src->input->ntv2AV->IsRunning ()) {
       src->input->started = TRUE;
       src->input->ntv2AV->Run ();
     }
@@ -831,12 +1674,29 @@ gst_aja_video_src_change_state (GstElement * element, GstStateChange transition)
       break;
 
     case GST_STATE_CHANGE_READY_TO_PAUSED:
+    {
+      NTV2GstAV *ntv2AV;
+
+      // Changing queue-size later can't grow it beyond this
+      delete src->current_frames;
+      src->current_frames = new NTV2GstLeakyRing < AjaCaptureVideoFrame >
+          (MIN (src->queue_size, MAX_QUEUE_CAPACITY));
+      g_atomic_int_set (&src->dropped_signal_change, NO_CHANGE);
+      g_atomic_int_set (&src->queue_depth, src->queue_size);
+      gst_aja_queue_tuner_reset (&src->queue_tuner);
+      src->late_dropped = 0;
+      src->late_pending = FALSE;
+      g_atomic_int_set (&src->flushing, FALSE);
+      gst_aja_video_src_update_room (src);
+
       g_mutex_lock (&src->input->lock);
-      src->input->ntv2AV->SetCallback (VIDEO_CALLBACK,
-          &gst_aja_video_src_video_callback, src);
+      ntv2AV = src->input->ntv2AV;
       g_mutex_unlock (&src->input->lock);
-      src->flushing = FALSE;
+      ntv2AV->AddCallback (VIDEO_CALLBACK,
+          &gst_aja_video_src_video_callback, src,
+          &src->room);
       break;
+    }
 
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
     {
@@ -872,7 +1732,7 @@ gst_aja_video_src_change_state (GstElement * element, GstStateChange transition)
     {
       g_mutex_lock (&src->input->lock);
       if (src->input->start_streams)
-        src->input->start_streams (src->input->videosrc);
+        src->input->start_streams (element);
       g_mutex_unlock (&src->input->lock);
 
       break;
@@ -1001,6 +1861,105 @@ gst_aja_video_src_update_time_mapping (GstAjaVideoSrc * src,
   }
 }
 
+// Capture thread only. Releases a frame dropped from the queue and remembers
+// what the streaming thread would have learned from it.
+static void
+gst_aja_video_src_drop_frame (GstAjaVideoSrc * src, AjaCaptureVideoFrame * f,
+    SignalChange * signal_change, guint * skipped_frames)
+{
+  // We need to remember if we got signal back here at some point
+  if ((f->signal_change == GOT_SIGNAL && *signal_change != RECOVERED_SIGNAL)
+      || f->signal_change == RECOVERED_SIGNAL)
+    *signal_change = f->signal_change;
+  if (f->video_buff) {
+    if (*skipped_frames == 0 && src->skipped_last == 0)
+      src->skip_from_timestamp = f->capture_time;
+    (*skipped_frames)++;
+    src->skip_to_timestamp = f->capture_time;
+  }
+  aja_capture_video_frame_clear (f);
+}
+
+// Publishes the room of the queue for the capture thread
+static void
+gst_aja_video_src_update_room (GstAjaVideoSrc * src)
+{
+  gst_aja_queue_update_room (src->input, src->current_frames, src->queue_policy,
+      src->queue_size, src->max_latency, &src->queue_depth, &src->room);
+}
+
+// Capture thread only. Makes room for the frame as queue-policy says and
+// queues it for the streaming thread. The ring takes no lock, so unless
+// blocking was asked for the streaming thread never holds up the capture here,
+// whatever it's doing.
+static void
+gst_aja_video_src_queue_frame (GstAjaVideoSrc * src, AjaCaptureVideoFrame * f)
+{
+  NTV2GstLeakyRing < AjaCaptureVideoFrame > *ring = src->current_frames;
+  const guint limit = gst_aja_queue_get_limit (ring, src->queue_size,
+      src->max_latency, &src->queue_depth);
+  SignalChange signal_change = NO_CHANGE;
+  guint skipped_frames = 0;
+  gboolean drop = FALSE;
+  AjaCaptureVideoFrame old;
+
+  if (ring->GetLength () >= limit) {
+    switch (gst_aja_queue_get_policy (src->input, src->queue_policy)) {
+      case GST_AJA_QUEUE_POLICY_BLOCK:
+        drop = !gst_aja_queue_wait_room (src->input, ring, limit,
+            src->max_latency) || g_atomic_int_get (&src->flushing);
+        break;
+      case GST_AJA_QUEUE_POLICY_DROP_NEWEST:
+        drop = TRUE;
+        break;
+      case GST_AJA_QUEUE_POLICY_DROP_OLDEST:
+      default:
+        while (ring->GetLength () >= limit && ring->Pop (old))
+          gst_aja_video_src_drop_frame (src, &old, &signal_change,
+              &skipped_frames);
+        break;
+    }
+  }
+
+  if (drop) {
+    gst_aja_video_src_drop_frame (src, f, &signal_change, &skipped_frames);
+  } else if (f->video_buff) {
+    if (src->skipped_last == 0 && skipped_frames > 0) {
+      GST_WARNING_OBJECT (src, "Starting to drop frames");
+    }
+
+    if (skipped_frames == 0 && src->skipped_last > 0) {
+      GST_ELEMENT_WARNING_WITH_DETAILS (src,
+          STREAM, FAILED,
+          ("Dropped %u old frames from %" GST_TIME_FORMAT " to %"
+          GST_TIME_FORMAT, src->skipped_last,
+          GST_TIME_ARGS (src->skip_from_timestamp),
+          GST_TIME_ARGS (src->skip_to_timestamp)),
+          (NULL),
+          ("dropped", G_TYPE_UINT, src->skipped_last,
+           "from", G_TYPE_UINT64, src->skip_from_timestamp,
+           "to", G_TYPE_UINT64, src->skip_to_timestamp, NULL));
+      src->skipped_overall += src->skipped_last;
+      src->skipped_last = 0;
+      f->dropped_before = TRUE;
+    }
+  }
+
+  // The streaming thread is still copying out the frame that had the slot,
+  // rather drop this one than wait for it
+  if (!drop && !ring->Push (*f))
+    gst_aja_video_src_drop_frame (src, f, &signal_change, &skipped_frames);
+  gst_aja_video_src_update_room (src);
+
+  src->skipped_last += skipped_frames;
+
+  // The streaming thread hears of it with the next frame it takes, all still
+  // queued came after it
+  if (signal_change != NO_CHANGE &&
+      g_atomic_int_get (&src->dropped_signal_change) != RECOVERED_SIGNAL)
+    g_atomic_int_set (&src->dropped_signal_change, signal_change);
+}
+
 static void
 gst_aja_video_src_got_frame (GstAjaVideoSrc * src, AjaVideoBuff * videoBuff)
 {
@@ -1048,14 +2007,13 @@ gst_aja_video_src_got_frame (GstAjaVideoSrc * src, AjaVideoBuff * videoBuff)
 
       // Signal to the streaming thread that we lost signal so it can handle
       // this after all remaining queued up frames are handled
-      if (!src->flushing) {
+      if (!g_atomic_int_get (&src->flushing)) {
         AjaCaptureVideoFrame f;
 
         memset(&f, 0, sizeof (f));
         f.signal_change = LOST_SIGNAL;
 
-        gst_queue_array_push_tail_struct (src->current_frames, &f);
-        g_cond_signal (&src->cond);
+        gst_aja_video_src_queue_frame (src, &f);
       }
     }
 
@@ -1067,14 +2025,13 @@ gst_aja_video_src_got_frame (GstAjaVideoSrc * src, AjaVideoBuff * videoBuff)
 
       // Signal to the streaming thread that we got signal again so it can handle
       // this after all remaining queued up frames are handled
-      if (!src->flushing) {
+      if (!g_atomic_int_get (&src->flushing)) {
         AjaCaptureVideoFrame f;
 
         memset(&f, 0, sizeof (f));
         f.signal_change = previous_signal_state == SIGNAL_STATE_LOST ? RECOVERED_SIGNAL : GOT_SIGNAL;
 
-        gst_queue_array_push_tail_struct (src->current_frames, &f);
-        g_cond_signal (&src->cond);
+        gst_aja_video_src_queue_frame (src, &f);
       }
       had_signal = FALSE;
     }
@@ -1116,75 +2073,22 @@ gst_aja_video_src_got_frame (GstAjaVideoSrc * src, AjaVideoBuff * videoBuff)
 
   //GST_ERROR_OBJECT (src, "Actual timestamp %" GST_TIME_FORMAT, GST_TIME_ARGS (capture_time));
 
-  g_mutex_lock (&src->lock);
-  if (!src->flushing) {
-    SignalChange signal_change = NO_CHANGE;
-    guint skipped_frames = 0;
-    gboolean skipped_before = FALSE;
-
-    while (gst_queue_array_get_length (src->current_frames) >= src->queue_size) {
-      AjaCaptureVideoFrame *f = (AjaCaptureVideoFrame *) gst_queue_array_pop_head_struct (src->current_frames);
-
-      // We need to remember if we got signal back here at some point
-      if ((f->signal_change == GOT_SIGNAL && signal_change != RECOVERED_SIGNAL)
-          || f->signal_change == RECOVERED_SIGNAL)
-        signal_change = f->signal_change;
-      if (f->video_buff) {
-        if (skipped_frames == 0 && src->skipped_last == 0)
-          src->skip_from_timestamp = f->capture_time;
-        skipped_frames++;
-        src->skip_to_timestamp = f->capture_time;
-      }
-      aja_capture_video_frame_clear (f);
-    }
-
-    if (src->skipped_last == 0 && skipped_frames > 0) {
-      GST_WARNING_OBJECT (src, "Starting to drop frames");
-    }
-
-    if (skipped_frames == 0 && src->skipped_last > 0) {
-      GST_ELEMENT_WARNING_WITH_DETAILS (src,
-          STREAM, FAILED,
-          ("Dropped %u old frames from %" GST_TIME_FORMAT " to %"
-          GST_TIME_FORMAT, src->skipped_last,
-          GST_TIME_ARGS (src->skip_from_timestamp),
-          GST_TIME_ARGS (src->skip_to_timestamp)),
-          (NULL),
-          ("dropped", G_TYPE_UINT, src->skipped_last,
-           "from", G_TYPE_UINT64, src->skip_from_timestamp,
-           "to", G_TYPE_UINT64, src->skip_to_timestamp, NULL));
-      src->skipped_overall += src->skipped_last;
-      src->skipped_last = 0;
-      skipped_before = TRUE;
-    }
-
-    src->skipped_last += skipped_frames;
-
-    // Write the GOT_SIGNAL change into the oldest frame again
-    if (signal_change != NO_CHANGE) {
-      AjaCaptureVideoFrame *f = (AjaCaptureVideoFrame *) gst_queue_array_peek_head_struct (src->current_frames);
-      if (f)
-        f->signal_change = signal_change;
-    }
-
+  if (!g_atomic_int_get (&src->flushing)) {
     AjaCaptureVideoFrame f;
     memset(&f, 0, sizeof (f));
     f.video_src = src;
     f.video_buff = videoBuff;
     f.capture_time = timestamp;
     f.stream_time = stream_time;
+    f.capture_running_time = src->max_latency > 0 ?
+        gst_aja_get_capture_running_time (GST_ELEMENT_CAST (src),
+        videoBuff->timeStamp) : GST_CLOCK_TIME_NONE;
     f.mode = src->modeEnum;
     f.signal_change = NO_CHANGE;
     f.first_buffer = !had_signal;
 
-    if (skipped_before)
-      videoBuff->droppedChanged = true;
-
-    gst_queue_array_push_tail_struct (src->current_frames, &f);
-    g_cond_signal (&src->cond);
-    g_mutex_unlock (&src->lock);
+    gst_aja_video_src_queue_frame (src, &f);
   } else {
-    g_mutex_unlock (&src->lock);
     src->input->ntv2AV->ReleaseVideoBuffer (videoBuff);
   }
 }
@@ -1273,68 +2177,294 @@ extract_cc_from_vbi (GstAjaVideoSrc * src, GstBuffer ** buffer,
 }
 #endif
 
-/* ask the subclass to create a buffer with offset and size, the default
- * implementation will call alloc and fill. */
-static GstFlowReturn
-gst_aja_video_src_create (GstPushSrc * bsrc, GstBuffer ** buffer)
+// Returns TRUE if the frame needs different caps than the ones configured last
+static gboolean
+gst_aja_video_src_frame_changes_caps (GstAjaVideoSrc * src,
+    AjaCaptureVideoFrame * f)
+{
+  return src->modeEnum != f->mode ||
+      src->transferCharacteristics != f->video_buff->transferCharacteristics ||
+      src->colorimetry != f->video_buff->colorimetry ||
+      src->fullRange != f->video_buff->fullRange;
+}
+
+// Turns a captured frame into the buffer to push and releases the frame
+static GstBuffer *
+gst_aja_video_src_frame_to_buffer (GstAjaVideoSrc * src,
+    AjaCaptureVideoFrame * f)
 {
   static GstStaticCaps stream_reference =
       GST_STATIC_CAPS ("timestamp/x-aja-stream");
-  GstAjaVideoSrc *src = GST_AJA_VIDEO_SRC (bsrc);
-  //GST_DEBUG_OBJECT (src, "create");
-
-  GstFlowReturn flow_ret = GST_FLOW_OK;
-
-  AjaCaptureVideoFrame f;
-  GstCaps *caps;
-  GstCapsFeatures *features;
+  GstBuffer *buffer;
   GstClockTime capture_time, stream_time;
   gboolean timecode_valid;
   guint32 timecode_high, timecode_low;
   guint8 aja_field_count;
+  gboolean has_ancillary_data;
   guint8 *ancillary_data;
   gboolean discont = false;
+  gboolean dropped;
 
-  if (!gst_aja_video_src_start (src)) {
-    return GST_FLOW_NOT_NEGOTIATED;
+  // Other video sources of the input still hold the captured buffer, what we
+  // set on it goes on one of our own
+  if (gst_buffer_is_writable (f->video_buff->buffer))
+    buffer = gst_buffer_ref (f->video_buff->buffer);
+  else
+    buffer = gst_aja_buffer_share (f->video_buff->buffer);
+  capture_time = f->capture_time;
+  stream_time = f->stream_time;
+  timecode_valid = f->video_buff->timeCodeValid;
+  aja_field_count = f->video_buff->fieldCount;
+  timecode_high = f->video_buff->timeCodeHigh;
+  timecode_low = f->video_buff->timeCodeLow;
+  has_ancillary_data = f->video_buff->pAncillaryData != NULL;
+  ancillary_data = f->video_buff->isNvmm ?
+      (guint8 *) f->video_buff->pAncillaryData : NULL;
+  dropped = f->dropped_before || f->video_buff->droppedChanged ||
+      src->late_pending;
+  src->late_pending = FALSE;
+  discont = f->first_buffer || dropped;
+
+  if (dropped) {
+    GstMessage *msg;
+    GstClockTime running_time;
+
+    running_time = gst_segment_to_running_time (&GST_BASE_SRC (src)->segment,
+        GST_FORMAT_TIME, capture_time);
+
+    msg = gst_message_new_qos (GST_OBJECT (src), TRUE, running_time, f->stream_time,
+        f->capture_time, gst_util_uint64_scale_int (GST_SECOND,
+      src->input->mode->fps_d, src->input->mode->fps_n));
+    gst_message_set_qos_stats (msg, GST_FORMAT_BUFFERS,
+                               f->video_buff->framesProcessed - src->skipped_overall - src->late_dropped,
+                               f->video_buff->framesDropped + f->video_buff->framesSkipped +
+                               src->skipped_overall + src->late_dropped);
+    GST_DEBUG_OBJECT (src, "Frames dropped by the device %" G_GUINT64_FORMAT
+        ", not transferred %" G_GUINT64_FORMAT ", dropped from the queue %"
+        G_GUINT64_FORMAT ", over max-latency %" G_GUINT64_FORMAT,
+        f->video_buff->framesDropped, f->video_buff->framesSkipped,
+        src->skipped_overall, src->late_dropped);
+    gst_element_post_message (GST_ELEMENT (src), msg);
   }
 
-  g_mutex_lock (&src->lock);
-retry:
-  while (gst_queue_array_is_empty (src->current_frames) && !src->flushing) {
-    g_cond_wait (&src->cond, &src->lock);
+  aja_capture_video_frame_clear (f);
+
+  GST_BUFFER_TIMESTAMP (buffer) = capture_time;
+  GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (GST_SECOND,
+      (guint64) src->input->mode->fps_d * src->active_decimation,
+      src->input->mode->fps_n);
+
+  if (src->input->mode->isInterlaced) {
+    GST_BUFFER_FLAG_SET (buffer, GST_VIDEO_BUFFER_FLAG_INTERLACED);
+    if (src->input->mode->isTff)
+      GST_BUFFER_FLAG_SET (buffer, GST_VIDEO_BUFFER_FLAG_TFF);
   }
 
-  if (src->flushing) {
-    g_mutex_unlock (&src->lock);
-    GST_DEBUG_OBJECT (src, "Flushing");
-    return GST_FLOW_FLUSHING;
+  if (discont)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+
+  if (timecode_valid) {
+    uint8_t hours, minutes, seconds, frames;
+    GstVideoTimeCodeFlags flags = GST_VIDEO_TIME_CODE_FLAGS_NONE;
+    guint field_count = 0;
+    GstVideoTimeCode tc;
+
+    if (src->input->mode->isInterlaced) {
+      flags =
+          (GstVideoTimeCodeFlags) (flags |
+          GST_VIDEO_TIME_CODE_FLAGS_INTERLACED);
+      field_count = aja_field_count == 0 ? 2 : aja_field_count;
+    }
+    // Any better way to detect this?
+    if (src->input->mode->fps_d == 1001) {
+      if (src->input->mode->fps_n == 30000 || src->input->mode->fps_n == 60000)
+        flags =
+            (GstVideoTimeCodeFlags) (flags |
+            GST_VIDEO_TIME_CODE_FLAGS_DROP_FRAME);
+      else
+        flags =
+                (GstVideoTimeCodeFlags) (flags &
+                ~GST_VIDEO_TIME_CODE_FLAGS_DROP_FRAME);
+    }
+
+    hours = (((timecode_high & RP188_HOURTENS_MASK) >> 24) * 10) +
+        ((timecode_high & RP188_HOURUNITS_MASK) >> 16);
+    minutes = (((timecode_high & RP188_MINUTESTENS_MASK) >> 8) * 10) +
+        (timecode_high & RP188_MINUTESUNITS_MASK);
+    seconds = (((timecode_low & RP188_SECONDTENS_MASK) >> 24) * 10) +
+        ((timecode_low & RP188_SECONDUNITS_MASK) >> 16);
+    frames = (((timecode_low & RP188_FRAMETENS_MASK) >> 8) * 10) +
+        (timecode_low & RP188_FRAMEUNITS_MASK);
+
+    gst_video_time_code_init (&tc, src->input->mode->fps_n,
+        src->input->mode->fps_d, NULL, flags, hours, minutes, seconds, frames,
+        field_count);
+    if (gst_video_time_code_is_valid (&tc)) {
+      GST_DEBUG_OBJECT (src, "Adding timecode %02u:%02u:%02u.%02u", hours, minutes, seconds, frames);
+      gst_buffer_add_video_time_code_meta (buffer, &tc);
+    }
+    gst_video_time_code_clear (&tc);
   }
+#if GST_CHECK_VERSION (1, 13, 0)
+  gst_buffer_add_reference_timestamp_meta (buffer,
+      gst_static_caps_get (&stream_reference), stream_time,
+      GST_CLOCK_TIME_NONE);
+#endif
 
-  f = *(AjaCaptureVideoFrame *) gst_queue_array_pop_head_struct (src->current_frames);
+#if GST_CHECK_VERSION(1, 15, 0)
+  if (has_ancillary_data && src->output_cc) {
+    GstMapInfo map;
+
+    // Once the frame is released its memory might be copied out of the DMA
+    // block pAncillaryData points into, the VANC lines in front of the
+    // picture move along with it. Mapped, it stays where it is.
+    if (ancillary_data) {
+      extract_cc_from_vbi (src, &buffer, ancillary_data);
+    } else if (gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+      extract_cc_from_vbi (src, &buffer,
+          map.data - gst_buffer_peek_memory (buffer, 0)->offset);
+      gst_buffer_unmap (buffer, &map);
+    }
+  }
+#endif
 
-  // First of all, notify about signal change
-  if (f.signal_change == GOT_SIGNAL || f.signal_change == RECOVERED_SIGNAL) {
+#if 1
+  GST_DEBUG_OBJECT (src,
+      "Outputting buffer %p with timestamp %" GST_TIME_FORMAT " and duration %"
+      GST_TIME_FORMAT, buffer, GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buffer)),
+      GST_TIME_ARGS (GST_BUFFER_DURATION (buffer)));
+#endif
+
+  return buffer;
+}
+
+/* ask the subclass to create a buffer with offset and size, the default
+ * implementation will call alloc and fill. */
+// Streaming thread only. Waits for the next frame, FALSE when flushing.
+static gboolean
+gst_aja_video_src_take_frame (GstAjaVideoSrc * src, AjaCaptureVideoFrame * f)
+{
+  while (!g_atomic_int_get (&src->flushing)) {
+    if (src->next_frame) {
+      *f = *src->next_frame;
+      g_free (src->next_frame);
+      src->next_frame = NULL;
+      return TRUE;
+    }
+
+    if (src->current_frames->WaitPop (*f)) {
+      gst_aja_video_src_update_room (src);
+      if (!g_atomic_int_get (&src->flushing))
+        return TRUE;
+      aja_capture_video_frame_clear (f);
+    }
+  }
+
+  return FALSE;
+}
+
+// Streaming thread only. Returns TRUE if the frame is over max-latency and a
+// newer one is already queued to take its place.
+static gboolean
+gst_aja_video_src_frame_is_late (GstAjaVideoSrc * src, AjaCaptureVideoFrame * f)
+{
+  GstClockTime now;
+
+  if (src->max_latency == 0 ||
+      !GST_CLOCK_TIME_IS_VALID (f->capture_running_time) ||
+      src->current_frames->GetLength () == 0)
+    return FALSE;
+
+  now = gst_aja_get_running_time (GST_ELEMENT_CAST (src));
+  if (!GST_CLOCK_TIME_IS_VALID (now) ||
+      now <= f->capture_running_time + src->max_latency)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (src, "Dropping frame captured %" GST_TIME_FORMAT " ago",
+      GST_TIME_ARGS (now - f->capture_running_time));
+  src->late_dropped++;
+  src->late_pending = TRUE;
+
+  return TRUE;
+}
+
+static SignalChange
+gst_aja_video_src_take_dropped_signal_change (GstAjaVideoSrc * src)
+{
+  gint change;
+
+  do {
+    change = g_atomic_int_get (&src->dropped_signal_change);
+  } while (change != NO_CHANGE &&
+      !g_atomic_int_compare_and_exchange (&src->dropped_signal_change, change,
+          NO_CHANGE));
+
+  return (SignalChange) change;
+}
+
+static void
+gst_aja_video_src_notify_signal_change (GstAjaVideoSrc * src,
+    SignalChange signal_change)
+{
+  if (signal_change == GOT_SIGNAL || signal_change == RECOVERED_SIGNAL) {
     g_object_notify (G_OBJECT (src), "signal");
-    if (f.signal_change == RECOVERED_SIGNAL)
+    if (signal_change == RECOVERED_SIGNAL)
       GST_ELEMENT_INFO (GST_ELEMENT (src), RESOURCE, READ, ("Signal recovered"),
         ("Input source detected"));
-  } else if (f.signal_change == LOST_SIGNAL) {
+  } else if (signal_change == LOST_SIGNAL) {
     g_object_notify (G_OBJECT (src), "signal");
     GST_ELEMENT_WARNING (GST_ELEMENT (src), RESOURCE, READ, ("Signal lost"),
         ("No input source was detected - video frames invalid"));
   }
+}
+
+static GstFlowReturn
+gst_aja_video_src_create (GstPushSrc * bsrc, GstBuffer ** buffer)
+{
+  GstAjaVideoSrc *src = GST_AJA_VIDEO_SRC (bsrc);
+  //GST_DEBUG_OBJECT (src, "create");
+
+  GstFlowReturn flow_ret = GST_FLOW_OK;
+
+  AjaCaptureVideoFrame f;
+  GstCaps *caps;
+  GstCapsFeatures *features;
+
+  if (!gst_aja_video_src_start (src)) {
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  // Frames the delivery thread dropped are freed here, off its back
+  src->input->ntv2AV->ReclaimBuffers ();
 
-  // Retry if we got no video buffer
-  if (!f.video_buff) {
+  // Downstream is back for the next frame
+  gst_aja_queue_tune (GST_ELEMENT_CAST (src), &src->queue_tuner,
+      src->info.fps_n > 0 ? gst_util_uint64_scale_ceil (GST_SECOND,
+          src->info.fps_d, src->info.fps_n) : GST_CLOCK_TIME_NONE,
+      src->max_latency, src->queue_size, &src->queue_depth);
+  gst_aja_video_src_update_room (src);
+
+retry:
+  if (!gst_aja_video_src_take_frame (src, &f)) {
+    GST_DEBUG_OBJECT (src, "Flushing");
+    return GST_FLOW_FLUSHING;
+  }
+
+  // First of all, notify about signal change, the ones of dropped frames
+  // came before
+  gst_aja_video_src_notify_signal_change (src,
+      gst_aja_video_src_take_dropped_signal_change (src));
+  gst_aja_video_src_notify_signal_change (src, f.signal_change);
+
+  // Retry if we got no video buffer, or a newer one is still within budget
+  if (!f.video_buff || gst_aja_video_src_frame_is_late (src, &f)) {
     aja_capture_video_frame_clear (&f);
     goto retry;
   }
 
-  if (src->modeEnum != f.mode ||
-      src->transferCharacteristics != f.video_buff->transferCharacteristics ||
-      src->colorimetry != f.video_buff->colorimetry ||
-      src->fullRange != f.video_buff->fullRange ||
+  g_mutex_lock (&src->lock);
+
+  if (gst_aja_video_src_frame_changes_caps (src, &f) ||
       !gst_pad_has_current_caps (GST_BASE_SRC_PAD (src))) {
     GST_DEBUG_OBJECT (src, "Mode changed from %d to %d (transfer "
         "characteristics: %d -> %d, colorimetry: %d -> %d, full "
@@ -1349,6 +2479,8 @@ retry:
     src->fullRange = f.video_buff->fullRange;
     g_mutex_unlock (&src->lock);
     caps = gst_aja_mode_get_caps_raw (f.mode, f.video_buff->isNvmm);
+    gst_aja_video_src_decimate_caps (src, caps, src->active_decimation);
+    gst_aja_video_src_crop_caps (src, caps, &src->active_crop);
     gst_video_info_from_caps (&src->info, caps);
     // TODO: Work with videoinfo instead of caps
     gst_caps_unref (caps);
@@ -1388,6 +2520,14 @@ retry:
       gst_caps_set_features(caps, 0, features);
     }
     gst_base_src_set_caps (GST_BASE_SRC_CAST (bsrc), caps);
+    gst_aja_video_src_decide_allocation (src, caps);
+    if (src->publish) {
+      gchar *caps_str = gst_caps_to_string (caps);
+      g_mutex_lock (&src->input->lock);
+      src->input->ntv2AV->SetPublishedCaps (caps_str);
+      g_mutex_unlock (&src->input->lock);
+      g_free (caps_str);
+    }
     gst_element_post_message (GST_ELEMENT_CAST (src),
         gst_message_new_latency (GST_OBJECT_CAST (src)));
     gst_caps_unref (caps);
@@ -1396,107 +2536,48 @@ retry:
     g_mutex_unlock (&src->lock);
   }
 
-  //printf("data_size = %ld\n", data_size);
+  *buffer = gst_aja_video_src_frame_to_buffer (src, &f);
 
-  *buffer = gst_buffer_ref (f.video_buff->buffer);
-  capture_time = f.capture_time;
-  stream_time = f.stream_time;
-  timecode_valid = f.video_buff->timeCodeValid;
-  aja_field_count = f.video_buff->fieldCount;
-  timecode_high = f.video_buff->timeCodeHigh;
-  timecode_low = f.video_buff->timeCodeLow;
-  ancillary_data = (guint8 *) f.video_buff->pAncillaryData;
-  discont = f.first_buffer || f.video_buff->droppedChanged;
+#if GST_CHECK_VERSION(1, 14, 0)
+  // If we fell behind, push all frames that are already queued up and need
+  // no caps change together as one buffer list
+  GstBufferList *list = NULL;
 
-  if (f.video_buff->droppedChanged) {
-    GstMessage *msg;
-    GstClockTime running_time;
-
-    running_time = gst_segment_to_running_time (&GST_BASE_SRC (src)->segment,
-        GST_FORMAT_TIME, capture_time);
-
-    msg = gst_message_new_qos (GST_OBJECT (src), TRUE, running_time, f.stream_time,
-        f.capture_time, gst_util_uint64_scale_int (GST_SECOND,
-      src->input->mode->fps_d, src->input->mode->fps_n));
-    gst_message_set_qos_stats (msg, GST_FORMAT_BUFFERS,
-                               f.video_buff->framesProcessed - src->skipped_overall,
-                               f.video_buff->framesDropped + src->skipped_overall);
-    gst_element_post_message (GST_ELEMENT (src), msg);
-  }
-
-  aja_capture_video_frame_clear (&f);
-
-  GST_BUFFER_TIMESTAMP (*buffer) = capture_time;
-  GST_BUFFER_DURATION (*buffer) = gst_util_uint64_scale_int (GST_SECOND,
-      src->input->mode->fps_d, src->input->mode->fps_n);
-
-  if (src->input->mode->isInterlaced) {
-    GST_BUFFER_FLAG_SET (*buffer, GST_VIDEO_BUFFER_FLAG_INTERLACED);
-    if (src->input->mode->isTff)
-      GST_BUFFER_FLAG_SET (*buffer, GST_VIDEO_BUFFER_FLAG_TFF);
-  }
-
-  if (discont)
-    GST_BUFFER_FLAG_SET (*buffer, GST_BUFFER_FLAG_DISCONT);
-
-  if (timecode_valid) {
-    uint8_t hours, minutes, seconds, frames;
-    GstVideoTimeCodeFlags flags = GST_VIDEO_TIME_CODE_FLAGS_NONE;
-    guint field_count = 0;
-    GstVideoTimeCode tc;
-
-    if (src->input->mode->isInterlaced) {
-      flags =
-          (GstVideoTimeCodeFlags) (flags |
-          GST_VIDEO_TIME_CODE_FLAGS_INTERLACED);
-      field_count = aja_field_count == 0 ? 2 : aja_field_count;
-    }
-    // Any better way to detect this?
-    if (src->input->mode->fps_d == 1001) {
-      if (src->input->mode->fps_n == 30000 || src->input->mode->fps_n == 60000)
-        flags =
-            (GstVideoTimeCodeFlags) (flags |
-            GST_VIDEO_TIME_CODE_FLAGS_DROP_FRAME);
-      else
-        flags =
-                (GstVideoTimeCodeFlags) (flags &
-                ~GST_VIDEO_TIME_CODE_FLAGS_DROP_FRAME);
+  while (!g_atomic_int_get (&src->flushing) &&
+      (!list || gst_buffer_list_length (list) < src->queue_size) &&
+      src->current_frames->Pop (f)) {
+    if (f.video_buff && f.signal_change == NO_CHANGE &&
+        gst_aja_video_src_frame_is_late (src, &f)) {
+      aja_capture_video_frame_clear (&f);
+      continue;
     }
 
-    hours = (((timecode_high & RP188_HOURTENS_MASK) >> 24) * 10) +
-        ((timecode_high & RP188_HOURUNITS_MASK) >> 16);
-    minutes = (((timecode_high & RP188_MINUTESTENS_MASK) >> 8) * 10) +
-        (timecode_high & RP188_MINUTESUNITS_MASK);
-    seconds = (((timecode_low & RP188_SECONDTENS_MASK) >> 24) * 10) +
-        ((timecode_low & RP188_SECONDUNITS_MASK) >> 16);
-    frames = (((timecode_low & RP188_FRAMETENS_MASK) >> 8) * 10) +
-        (timecode_low & RP188_FRAMEUNITS_MASK);
+    // Left for the next create() if it can't go along
+    g_mutex_lock (&src->lock);
+    gboolean changes_caps = f.video_buff &&
+        gst_aja_video_src_frame_changes_caps (src, &f);
+    g_mutex_unlock (&src->lock);
+    if (f.signal_change != NO_CHANGE || !f.video_buff || changes_caps ||
+        g_atomic_int_get (&src->dropped_signal_change) != NO_CHANGE) {
+      src->next_frame = g_new (AjaCaptureVideoFrame, 1);
+      *src->next_frame = f;
+      break;
+    }
 
-    gst_video_time_code_init (&tc, src->input->mode->fps_n,
-        src->input->mode->fps_d, NULL, flags, hours, minutes, seconds, frames,
-        field_count);
-    if (gst_video_time_code_is_valid (&tc)) {
-      GST_DEBUG_OBJECT (src, "Adding timecode %02u:%02u:%02u.%02u", hours, minutes, seconds, frames);
-      gst_buffer_add_video_time_code_meta (*buffer, &tc);
+    if (!list) {
+      list = gst_buffer_list_new_sized (src->queue_size);
+      gst_buffer_list_add (list, *buffer);
+      *buffer = NULL;
     }
-    gst_video_time_code_clear (&tc);
+    gst_buffer_list_add (list, gst_aja_video_src_frame_to_buffer (src, &f));
   }
-#if GST_CHECK_VERSION (1, 13, 0)
-  gst_buffer_add_reference_timestamp_meta (*buffer,
-      gst_static_caps_get (&stream_reference), stream_time,
-      GST_CLOCK_TIME_NONE);
-#endif
-
-#if GST_CHECK_VERSION(1, 15, 0)
-  if (ancillary_data && src->output_cc)
-    extract_cc_from_vbi (src, buffer, ancillary_data);
-#endif
+  gst_aja_video_src_update_room (src);
 
-#if 1
-  GST_DEBUG_OBJECT (src,
-      "Outputting buffer %p with timestamp %" GST_TIME_FORMAT " and duration %"
-      GST_TIME_FORMAT, *buffer, GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (*buffer)),
-      GST_TIME_ARGS (GST_BUFFER_DURATION (*buffer)));
+  if (list) {
+    GST_DEBUG_OBJECT (src, "Catching up with %u queued frames",
+        gst_buffer_list_length (list));
+    gst_base_src_submit_buffer_list (GST_BASE_SRC_CAST (src), list);
+  }
 #endif
 
   return flow_ret;
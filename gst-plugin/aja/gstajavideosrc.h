@@ -25,6 +25,7 @@
 #include <gst/gst.h>
 #include <gst/base/base.h>
 #include <gst/video/video.h>
+#include <gst/video/gstvideosink.h>
 #include "gstaja.h"
 
 #include <gst/base/gstbasesrc.h>
@@ -40,6 +41,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstAjaVideoSrc GstAjaVideoSrc;
 typedef struct _GstAjaVideoSrcClass GstAjaVideoSrcClass;
+typedef struct _AjaCaptureVideoFrame AjaCaptureVideoFrame;
 
 typedef enum {
   SIGNAL_STATE_UNKNOWN,
@@ -59,12 +61,20 @@ struct _GstAjaVideoSrc
     GstVideoInfo                info;
     GstAjaInput                 *input;
 
-    GCond                       cond;
     GMutex                      lock;
-    gboolean                    flushing;
-    GstQueueArray               *current_frames;
+    gint                        flushing;               /// Atomic, the capture thread reads it without the lock
+    NTV2GstLeakyRing<AjaCaptureVideoFrame> *current_frames;    /// From the capture thread, sized when starting
+    AjaCaptureVideoFrame        *next_frame;            /// Taken from current_frames but not pushed yet, or NULL
+    gint                        dropped_signal_change;  /// Atomic, of frames the capture thread dropped
 
     guint                       queue_size;
+    GstClockTime                max_latency;
+    GstAjaQueuePolicy           queue_policy;
+    gint                        queue_depth;            /// Atomic, tuned within max-latency by the streaming thread
+    gint                        room;                   /// Atomic, frames the queue could still take, read by the capture thread
+    GstAjaQueueTuner            queue_tuner;
+    guint64                     late_dropped;           /// Over max-latency when taken, streaming thread only
+    gboolean                    late_pending;
     gchar *                     device_identifier;
     GstAjaVideoInputMode        input_mode;
     SDIInputMode                sdi_input_mode;
@@ -76,7 +86,35 @@ struct _GstAjaVideoSrc
     gboolean                    output_cc;
     gint			last_cc_vbi_line;
     guint                       capture_cpu_core;
+    guint                       scheduler_threads;
+    NTV2GstRealtimePolicy       realtime_policy;
+    guint                       realtime_priority;
+    gboolean                    lock_memory;
+    guint                       delivery_cpu_core;
+    GstAjaHugePages             huge_pages;
+    guint                       video_pool_size;
+    guint                       audio_pool_size;
+    gboolean                    dma_arena;
+    guint64                     dma_arena_budget;
+    NTV2GstExhaustionPolicy     exhaustion_policy;
+    guint                       copy_out_watermark;
+    gboolean                    downstream_pool;
+    GstBufferPool *             active_downstream_pool;
+    NTV2GstExportMode           export_memory;
+    gchar *                     publish;
+    guint                       publish_slots;
+    gint                        numa_node;
+    gchar *                     numa_cpus;
     gboolean                    use_nvmm;
+    guint                       decimation;
+    gint                        max_framerate_n;
+    gint                        max_framerate_d;
+    guint                       active_decimation;      /// Of the capture, see gst_aja_video_src_get_decimation
+    guint                       crop_x;
+    guint                       crop_y;
+    guint                       crop_width;
+    guint                       crop_height;
+    GstVideoRectangle           active_crop;            /// Of the capture, w 0 for none, see gst_aja_video_src_get_crop
 
     guint skipped_last;
     guint64 skipped_overall;
@@ -7,6 +7,8 @@
 **/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <semaphore.h>
 #include <fcntl.h>
 #include <string>
@@ -15,6 +17,11 @@
 #include <pthread.h>
 
 #include "gstntv2.h"
+#include "gstntv2scheduler.h"
+#include "gstntv2arena.h"
+#include "gstntv2lockregistry.h"
+#include "gstntv2shm.h"
+#include "gstntv2anc.h"
 #include "gstaja.h"
 #include "ntv2utils.h"
 #include "ntv2devicefeatures.h"
@@ -28,7 +35,199 @@
 GST_DEBUG_CATEGORY_STATIC (gst_ntv2_debug);
 #define GST_CAT_DEFAULT gst_ntv2_debug
 
-#define NTV2_AUDIOSIZE_MAX        (401 * 1024)
+// Longest audio cadence of any frame rate, e.g. 1602/1601/1602/1601/1602 at
+// 29.97 fps
+#define AUDIO_CADENCE_FRAMES      5
+// Audio buffers hold a quarter more than the largest frame of the cadence,
+// as a transfer can pick up a few samples more depending on interrupt timing
+#define AUDIO_SIZE_HEADROOM(s)    ((s) + (s) / 4)
+
+// Re-read the input format and VPID at least this often (in frames) even if
+// nothing in the AutoCirculate status changed
+#define INPUT_REFRESH_INTERVAL    30
+
+// Quad-link formats. For UHD/4k the single raster format is captured as the
+// 4x format, for UHD2/8k only the 4x formats exist. Each link of a quad-link
+// SDI input carries the link format.
+typedef struct
+{
+  NTV2VideoFormat raster;
+  NTV2VideoFormat quad;
+  NTV2VideoFormat link;
+} QuadFormat;
+
+// *INDENT-OFF*
+static constexpr QuadFormat kQuadFormats[] =
+{
+  { NTV2_FORMAT_3840x2160p_2398,  NTV2_FORMAT_4x1920x1080p_2398,  NTV2_FORMAT_1080p_2398 },
+  { NTV2_FORMAT_3840x2160p_2400,  NTV2_FORMAT_4x1920x1080p_2400,  NTV2_FORMAT_1080p_2400 },
+  { NTV2_FORMAT_3840x2160p_2500,  NTV2_FORMAT_4x1920x1080p_2500,  NTV2_FORMAT_1080p_2500 },
+  { NTV2_FORMAT_3840x2160p_2997,  NTV2_FORMAT_4x1920x1080p_2997,  NTV2_FORMAT_1080p_2997 },
+  { NTV2_FORMAT_3840x2160p_3000,  NTV2_FORMAT_4x1920x1080p_3000,  NTV2_FORMAT_1080p_3000 },
+  { NTV2_FORMAT_3840x2160p_5000,  NTV2_FORMAT_4x1920x1080p_5000,  NTV2_FORMAT_1080p_5000_A },
+  { NTV2_FORMAT_3840x2160p_5994,  NTV2_FORMAT_4x1920x1080p_5994,  NTV2_FORMAT_1080p_5994_A },
+  { NTV2_FORMAT_3840x2160p_6000,  NTV2_FORMAT_4x1920x1080p_6000,  NTV2_FORMAT_1080p_6000_A },
+
+  { NTV2_FORMAT_4096x2160p_2398,  NTV2_FORMAT_4x2048x1080p_2398,  NTV2_FORMAT_1080p_2K_2398 },
+  { NTV2_FORMAT_4096x2160p_2400,  NTV2_FORMAT_4x2048x1080p_2400,  NTV2_FORMAT_1080p_2K_2400 },
+  { NTV2_FORMAT_4096x2160p_2500,  NTV2_FORMAT_4x2048x1080p_2500,  NTV2_FORMAT_1080p_2K_2500 },
+  { NTV2_FORMAT_4096x2160p_2997,  NTV2_FORMAT_4x2048x1080p_2997,  NTV2_FORMAT_1080p_2K_2997 },
+  { NTV2_FORMAT_4096x2160p_3000,  NTV2_FORMAT_4x2048x1080p_3000,  NTV2_FORMAT_1080p_2K_3000 },
+  { NTV2_FORMAT_4096x2160p_4795,  NTV2_FORMAT_4x2048x1080p_4795,  NTV2_FORMAT_1080p_2K_4795_A },
+  { NTV2_FORMAT_4096x2160p_4800,  NTV2_FORMAT_4x2048x1080p_4800,  NTV2_FORMAT_1080p_2K_4800_A },
+  { NTV2_FORMAT_4096x2160p_5000,  NTV2_FORMAT_4x2048x1080p_5000,  NTV2_FORMAT_1080p_2K_5000_A },
+  { NTV2_FORMAT_4096x2160p_5994,  NTV2_FORMAT_4x2048x1080p_5994,  NTV2_FORMAT_1080p_2K_5994_A },
+  { NTV2_FORMAT_4096x2160p_6000,  NTV2_FORMAT_4x2048x1080p_6000,  NTV2_FORMAT_1080p_2K_6000_A },
+  { NTV2_FORMAT_4096x2160p_11988, NTV2_FORMAT_4x2048x1080p_11988, NTV2_FORMAT_UNKNOWN },
+  { NTV2_FORMAT_4096x2160p_12000, NTV2_FORMAT_4x2048x1080p_12000, NTV2_FORMAT_UNKNOWN },
+
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_2398,  NTV2_FORMAT_3840x2160p_2398 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_2400,  NTV2_FORMAT_3840x2160p_2400 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_2500,  NTV2_FORMAT_3840x2160p_2500 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_2997,  NTV2_FORMAT_3840x2160p_2997 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_3000,  NTV2_FORMAT_3840x2160p_3000 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_5000,  NTV2_FORMAT_3840x2160p_5000 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_5994,  NTV2_FORMAT_3840x2160p_5994 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x3840x2160p_6000,  NTV2_FORMAT_3840x2160p_6000 },
+
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_2398,  NTV2_FORMAT_4096x2160p_2398 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_2400,  NTV2_FORMAT_4096x2160p_2400 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_2500,  NTV2_FORMAT_4096x2160p_2500 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_2997,  NTV2_FORMAT_4096x2160p_2997 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_3000,  NTV2_FORMAT_4096x2160p_3000 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_4795,  NTV2_FORMAT_4096x2160p_4795 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_4800,  NTV2_FORMAT_4096x2160p_4800 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_5000,  NTV2_FORMAT_4096x2160p_5000 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_5994,  NTV2_FORMAT_4096x2160p_5994 },
+  { NTV2_FORMAT_UNKNOWN,          NTV2_FORMAT_4x4096x2160p_6000,  NTV2_FORMAT_4096x2160p_6000 },
+};
+// *INDENT-ON*
+
+// Returns the 4x format a UHD/4k raster format is captured as, or
+// NTV2_FORMAT_UNKNOWN if there is none
+static NTV2VideoFormat
+_get_quad_format (NTV2VideoFormat rasterFormat)
+{
+  if (rasterFormat == NTV2_FORMAT_UNKNOWN)
+    return NTV2_FORMAT_UNKNOWN;
+
+  for (guint i = 0; i < G_N_ELEMENTS (kQuadFormats); i++) {
+    if (kQuadFormats[i].raster == rasterFormat)
+      return kQuadFormats[i].quad;
+  }
+
+  return NTV2_FORMAT_UNKNOWN;
+}
+
+// Returns the format each link of a quad-link input carries, or
+// NTV2_FORMAT_UNKNOWN if there is none
+static NTV2VideoFormat
+_get_link_format (NTV2VideoFormat quadFormat)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (kQuadFormats); i++) {
+    if (kQuadFormats[i].quad == quadFormat)
+      return kQuadFormats[i].link;
+  }
+
+  return NTV2_FORMAT_UNKNOWN;
+}
+
+// How colorimetry, transfer characteristics and range are signalled in VPID
+// byte 3 and 4, depending on the payload identifier in byte 1:
+//   292:  0x85, 0x8C (ST 292-1, ST 425-1)
+//   372:  0x87, 0x8A, 0x95, 0x96, 0x98, 0x9A, 0x9B (ST 372, ST 425-1/3/5/6)
+//   425:  0x88, 0x89, 0x94, 0x97, 0x99 (ST 425-1/3/5/6),
+//         0xC0, 0xC2, 0xC4, 0xC5, 0xF3 (ST 2081-10/11/12),
+//         0xCE, 0xCF, 0xD0 - 0xD3 (ST 2082-10/11/12)
+//   2036: 0xA1, 0xA2, 0xA5, 0xA6 (ST 2036-3/4), 0xC1 (ST 2081-10)
+// Everything else (ST 352, 292-2, 435-1, 2047, 2048, RDD 22, ...) carries no
+// such information.
+enum
+{
+  VPID_CLASS_NONE = 0,          // no information, or historical identifier
+  VPID_CLASS_292,               // ST 292-1 style, range in bit 1
+  VPID_CLASS_372,               // dual link style colorimetry
+  VPID_CLASS_425,               // 2 bit colorimetry
+  VPID_CLASS_2036,              // always BT.2020
+};
+
+#define VN VPID_CLASS_NONE
+#define VA VPID_CLASS_292
+#define VB VPID_CLASS_372
+#define VC VPID_CLASS_425
+#define VD VPID_CLASS_2036
+// *INDENT-OFF*
+static const guint8 kVpidClasses[256] =
+{
+/*         x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF */
+/* 0x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 1x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 2x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 3x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 4x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 5x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 6x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 7x */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* 8x */  VN, VN, VN, VN, VN, VA, VN, VB, VC, VC, VB, VN, VA, VN, VN, VN,
+/* 9x */  VN, VN, VN, VN, VC, VB, VB, VC, VB, VC, VB, VB, VN, VN, VN, VN,
+/* Ax */  VN, VD, VD, VN, VN, VD, VD, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* Bx */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* Cx */  VC, VD, VC, VN, VC, VC, VN, VN, VN, VN, VN, VN, VN, VN, VC, VC,
+/* Dx */  VC, VC, VC, VC, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* Ex */  VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+/* Fx */  VN, VN, VN, VC, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN, VN,
+};
+
+// Colorimetry of VPID_CLASS_292/372, indexed by (vpidA >> 12) & 0x09
+static const guint8 kVpidColorimetry[10] =
+{
+    0, 1, 3, 3, 3, 3, 3, 3, 2, 3
+};
+// *INDENT-ON*
+#undef VN
+#undef VA
+#undef VB
+#undef VC
+#undef VD
+
+static void
+_decode_vpid (ULWord vpidA, guint * transferCharacteristics,
+    guint * colorimetry, gboolean * fullRange)
+{
+  // Historical payload identifiers and ones without colorimetry/transfer/range
+  // information use the defaults
+  *transferCharacteristics = 3;
+  *colorimetry = 3;
+  *fullRange = FALSE;
+
+  if (!(vpidA & 0x80000000))
+    return;
+
+  switch (kVpidClasses[vpidA >> 24]) {
+    case VPID_CLASS_292:
+      *transferCharacteristics = (vpidA >> 20) & 0x03;
+      *colorimetry = kVpidColorimetry[(vpidA >> 12) & 0x09];
+      *fullRange = (vpidA & 0x02) == 0x02;
+      break;
+    case VPID_CLASS_372:
+      *transferCharacteristics = (vpidA >> 20) & 0x03;
+      *colorimetry = kVpidColorimetry[(vpidA >> 12) & 0x09];
+      *fullRange = (vpidA & 0x03) == 0x00 || (vpidA & 0x03) == 0x03;
+      break;
+    case VPID_CLASS_425:
+      *transferCharacteristics = (vpidA >> 20) & 0x03;
+      *colorimetry = (vpidA >> 12) & 0x03;
+      *fullRange = (vpidA & 0x03) == 0x00 || (vpidA & 0x03) == 0x03;
+      break;
+    case VPID_CLASS_2036:
+      *transferCharacteristics = (vpidA >> 20) & 0x03;
+      *colorimetry = 3;
+      *fullRange = (vpidA & 0x03) == 0x00 || (vpidA & 0x03) == 0x03;
+      break;
+    default:
+      break;
+  }
+}
 
 static void
 _init_ntv2_debug (void)
@@ -51,13 +250,47 @@ NTV2GstAV::NTV2GstAV (const std::string inDeviceSpecifier,
 
 
 mACInputThread (NULL),
+mACDeliveryThread (NULL),
+mDeliveryQuit (false),
+mReclaiming (false),
+mScheduler (NULL),
+mArena (NULL),
+mNUMANode (-1),
+mHugePageSize (0),
+mVideoPoolSize (0),
+mAudioPoolSize (0),
+mQueueSize (0),
+mVideoPeakHeld (0),
+mAudioPeakHeld (0),
+mAudioPoolDepth (0),
+mPendingAudioPool (NULL),
+mRetiredAudioPool (NULL),
+mDownstreamPool (NULL),
+mLockRegistry (NULL),
+mExhaustionPolicy (NTV2_EXHAUSTION_POLICY_GROW),
+mCopyOutWatermark (0),
+mExportMode (NTV2_EXPORT_MODE_NONE),
+mPublishSlots (0),
+mShmRing (NULL),
+mDecimation (1),
+mCropRows (0),
+mCropActiveBytes (0),
+mCropHostBytes (0),
+mCropDeviceBytes (0),
+mCropOffset (0),
+mCopyOutThread (NULL),
+mCopyOutPending (false),
+mCopyOutQuit (false),
 mLock (new AJALock),
+mDevice (NTV2GstDevice::Create (inDeviceSpecifier)),
 mDeviceID (DEVICE_ID_NOTFOUND),
 mDeviceSpecifier (inDeviceSpecifier),
 mInputChannel (inChannel),
 mInputSource (NTV2_INPUTSOURCE_SDI1),
 mVideoFormat (NTV2_MAX_NUM_VIDEO_FORMATS),
 mMultiStream (false),
+mCaptureTall (false),
+mCaptureAnc (false),
 mCaps (NULL),
 mAudioSystem (NTV2_AUDIOSYSTEM_1),
 mNumAudioChannels (0),
@@ -67,14 +300,17 @@ mLastFrameVideoOut (false),
 mLastFrameAudioOut (false),
 mGlobalQuit (false),
 mStarted (false),
-mVideoCallback (0),
-mVideoCallbackRefcon (0),
-mAudioCallback (0),
-mAudioCallbackRefcon (0),
+mConsumers (NULL),
+mConsumersReaders (0),
 mAudioBufferPool (NULL),
 mVideoBufferPool (NULL)
 {
   _init_ntv2_debug ();
+
+  mAncBuffer[0] = mAncBuffer[1] = NULL;
+  NTV2GstRealtimeProfileInit (mRealtimeProfile);
+  sem_init (&mCopyOutWake, 0, 0);
+  mLockRegistry = new NTV2GstLockRegistry (mDevice);
 }                               //    constructor
 
 
@@ -84,13 +320,36 @@ NTV2GstAV::~NTV2GstAV ()
   Quit ();
 
   // unsubscribe from input vertical event...
-  mDevice.UnsubscribeInputVerticalEvent (mInputChannel);
+  mDevice->UnsubscribeInputVerticalEvent (mInputChannel);
 
   FreeHostBuffers ();
 
+  // The arena keeps its memory, but the DMA locks go away with the handle
+  if (mArena)
+    mArena->ReleaseDevice (mDevice);
+
+  // Buffers still downstream keep the ring mapped, its lock goes with the handle
+  if (mShmRing) {
+    mShmRing->ReleaseDevice ();
+    mShmRing->Close ();
+    mShmRing->Unref ();
+    mShmRing = NULL;
+  }
+
+  SetDownstreamPool (NULL);
+  delete mLockRegistry;
+  mLockRegistry = NULL;
+
+  sem_destroy (&mCopyOutWake);
+
+  delete mConsumers.load ();
+
   delete mLock;
   mLock = NULL;
 
+  delete mDevice;
+  mDevice = NULL;
+
 
 }                               // destructor
 
@@ -101,30 +360,19 @@ AJAStatus NTV2GstAV::Open (void)
     return AJA_STATUS_SUCCESS;
 
   //    Open the device...
-  if (!CNTV2DeviceScanner::GetFirstDeviceFromArgument (mDeviceSpecifier,
-          mDevice)) {
+  if (!mDevice->Open ()) {
     GST_ERROR ("ERROR: Device not found");
     return AJA_STATUS_OPEN;
   }
 
-  mDevice.SetEveryFrameServices (NTV2_OEM_TASKS);       //    Since this is an OEM app, use the OEM service level
-  mDeviceID = mDevice.GetDeviceID ();   //    Keep the device ID handy, as it's used frequently
-
-  std::string serialNumber;
+  mDeviceID = mDevice->GetDeviceID ();   //    Keep the device ID handy, as it's used frequently
 
-  if (!mDevice.GetSerialNumberString (serialNumber))
-    serialNumber = "(none)";
-
-  GST_DEBUG ("Opened device with ID %d (%s, version %s, serial number %s)",
-      mDeviceID, mDevice.GetDisplayName ().c_str (),
-      mDevice.GetDeviceVersionString ().c_str (), serialNumber.c_str ());
-  GST_DEBUG ("Using SDK version %d.%d.%d.%d (%s) and driver version %s",
-      AJA_NTV2_SDK_VERSION_MAJOR, AJA_NTV2_SDK_VERSION_MINOR,
-      AJA_NTV2_SDK_VERSION_POINT, AJA_NTV2_SDK_BUILD_NUMBER,
-      AJA_NTV2_SDK_BUILD_DATETIME, mDevice.GetDriverVersionString ().c_str ());
-
-  // So we can configure each channel separately
-  mDevice.SetMultiFormatMode(true);
+  // Buffers and threads go where the device DMAs to
+  mNUMANode = mDevice->GetNUMANode ();
+  mNUMACPUs = NTV2GstTopologyGetNodeCPUs (mNUMANode);
+  if (mNUMANode >= 0)
+    GST_INFO ("Placing buffers on NUMA node %d and threads on its cores %s",
+        mNUMANode, GetNUMACPUs ().c_str ());
 
   return AJA_STATUS_SUCCESS;
 }
@@ -220,85 +468,25 @@ AJAStatus
   if (mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_SQD ||
       mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_TSI ||
       mVideoSource == NTV2_INPUTSOURCE_HDMI1) {
-    switch (inVideoFormat) {
-      case NTV2_FORMAT_3840x2160p_2398:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_2398;
-        break;
-      case NTV2_FORMAT_3840x2160p_2400:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_2400;
-        break;
-      case NTV2_FORMAT_3840x2160p_2500:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_2500;
-        break;
-      case NTV2_FORMAT_3840x2160p_2997:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_2997;
-        break;
-      case NTV2_FORMAT_3840x2160p_3000:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_3000;
-        break;
-      case NTV2_FORMAT_3840x2160p_5000:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_5000;
-        break;
-      case NTV2_FORMAT_3840x2160p_5994:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_5994;
-        break;
-      case NTV2_FORMAT_3840x2160p_6000:
-        mVideoFormat = NTV2_FORMAT_4x1920x1080p_6000;
-        break;
-      case NTV2_FORMAT_4096x2160p_2398:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_2398;
-        break;
-      case NTV2_FORMAT_4096x2160p_2400:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_2400;
-        break;
-      case NTV2_FORMAT_4096x2160p_2500:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_2500;
-        break;
-      case NTV2_FORMAT_4096x2160p_2997:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_2997;
-        break;
-      case NTV2_FORMAT_4096x2160p_3000:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_3000;
-        break;
-      case NTV2_FORMAT_4096x2160p_4795:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_4795;
-        break;
-      case NTV2_FORMAT_4096x2160p_4800:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_4800;
-        break;
-      case NTV2_FORMAT_4096x2160p_5000:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_5000;
-        break;
-      case NTV2_FORMAT_4096x2160p_5994:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_5994;
-        break;
-      case NTV2_FORMAT_4096x2160p_6000:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_6000;
-        break;
-      case NTV2_FORMAT_4096x2160p_11988:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_11988;
-        break;
-      case NTV2_FORMAT_4096x2160p_12000:
-        mVideoFormat = NTV2_FORMAT_4x2048x1080p_12000;
-        break;
-      default:
-        if (inVideoFormat >= NTV2_FORMAT_FIRST_UHD2_DEF_FORMAT &&
-            inVideoFormat <= NTV2_FORMAT_END_UHD2_FULL_DEF_FORMATS) {
-          // For UHD2/8k there are only the 4x formats available currently
-          mVideoFormat = inVideoFormat;
-          mQuad = true;
-        } else {
-          if (mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_SQD ||
-              mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_TSI) {
-            GST_ERROR ("Quad mode requires UHD/UHD2/4k/8k resolution");
-            return AJA_STATUS_FAIL;
-          }
-
-          // Ok for HDMI
-          mVideoFormat = inVideoFormat;
-          mQuad = false;
-        }
-        break;
+    NTV2VideoFormat quadFormat = _get_quad_format (inVideoFormat);
+
+    if (quadFormat != NTV2_FORMAT_UNKNOWN) {
+      mVideoFormat = quadFormat;
+    } else if (inVideoFormat >= NTV2_FORMAT_FIRST_UHD2_DEF_FORMAT &&
+        inVideoFormat <= NTV2_FORMAT_END_UHD2_FULL_DEF_FORMATS) {
+      // For UHD2/8k there are only the 4x formats available currently
+      mVideoFormat = inVideoFormat;
+      mQuad = true;
+    } else {
+      if (mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_SQD ||
+          mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_TSI) {
+        GST_ERROR ("Quad mode requires UHD/UHD2/4k/8k resolution");
+        return AJA_STATUS_FAIL;
+      }
+
+      // Ok for HDMI
+      mVideoFormat = inVideoFormat;
+      mQuad = false;
     }
   } else {
     mVideoFormat = inVideoFormat;
@@ -330,6 +518,16 @@ AJAStatus
     mBitDepth = 8;
   }
 
+  // The ANC extractor hands over only the packets, for every format and
+  // without VANC lines in the frame. Tall capture is left for devices
+  // without one.
+  mCaptureAnc = false;
+  if (mCaptureTall && mVideoSource != NTV2_INPUTSOURCE_HDMI1 &&
+      mDevice->GetCard () && ::NTV2DeviceCanDoCustomAnc (mDevice->GetDeviceID ())) {
+    mCaptureAnc = true;
+    mCaptureTall = false;
+  }
+
   // Ensure that mCaptureTall is only set for formats that can
   // actually contain VANC and that we handle
   switch (mVideoFormat) {
@@ -386,9 +584,20 @@ NTV2GstAV::InitAudio (const NTV2AudioSource inAudioSource, uint32_t * numAudioCh
     return status;
   }
 
+  // The audio buffers are sized for the channel count. While capturing the
+  // pool is rebuilt here, the capture loop only swaps it in. The published
+  // ring keeps its size, only its readers learn of the new channel count.
+  if (mStarted) {
+    RebuildAudioPool ();
+    mPoolLock.Lock ();
+    if (mShmRing)
+      mShmRing->SetCaps (mPublishCaps.c_str (), GetCapturedAudioChannels ());
+    mPoolLock.Unlock ();
+  }
+
   ULWord
       nchannels = -1;
-  mDevice.GetNumberAudioChannels (nchannels, mAudioSystem);
+  mDevice->GetNumberAudioChannels (nchannels, mAudioSystem);
   *numAudioChannels = nchannels;
 
   return status;
@@ -422,11 +631,15 @@ NTV2GstAV::Quit (void)
   FreeHostBuffers ();
 
   //  Stop video capture
-  mDevice.SetMode (mInputChannel, NTV2_MODE_DISPLAY, false);
+  CNTV2Card *card = mDevice->GetCard ();
+  if (!card)
+    return;
+
+  card->SetMode (mInputChannel, NTV2_MODE_DISPLAY, false);
   if (mQuad) {
-    mDevice.SetMode ((NTV2Channel) (mInputChannel + 1), NTV2_MODE_DISPLAY, false);
-    mDevice.SetMode ((NTV2Channel) (mInputChannel + 2), NTV2_MODE_DISPLAY, false);
-    mDevice.SetMode ((NTV2Channel) (mInputChannel + 3), NTV2_MODE_DISPLAY, false);
+    card->SetMode ((NTV2Channel) (mInputChannel + 1), NTV2_MODE_DISPLAY, false);
+    card->SetMode ((NTV2Channel) (mInputChannel + 2), NTV2_MODE_DISPLAY, false);
+    card->SetMode ((NTV2Channel) (mInputChannel + 3), NTV2_MODE_DISPLAY, false);
   }
 }
 
@@ -440,69 +653,91 @@ AJAStatus NTV2GstAV::SetupVideo (void)
   else
     mPixelFormat = NTV2_FBF_10BIT_YCBCR;
 
+  mTimeBase.SetAJAFrameRate (GetAJAFrameRate (GetNTV2FrameRateFromVideoFormat
+          (mVideoFormat)));
+
+  // For quad mode, we will get the format of a single input
+  mExpectedFormats.reset ();
+  if (mVideoFormat < NTV2_MAX_NUM_VIDEO_FORMATS)
+    mExpectedFormats.set (mVideoFormat);
+  if (mQuad && mVideoSource == NTV2_INPUTSOURCE_SDI1) {
+    NTV2VideoFormat linkFormat = _get_link_format (mVideoFormat);
+    if (linkFormat != NTV2_FORMAT_UNKNOWN)
+      mExpectedFormats.set (linkFormat);
+    GST_DEBUG ("Expected video format %08x (link %08x)", (int) mVideoFormat, (int) linkFormat);
+  }
+
+  if (!mDevice->ConfigureInput (mInputChannel, mVideoFormat, mPixelFormat,
+          mCaptureTall))
+    return AJA_STATUS_FAIL;
+
+  // Only real hardware needs any further setup and routing
+  CNTV2Card *card = mDevice->GetCard ();
+  if (!card) {
+    mInputSource = mVideoSource;
+    return AJA_STATUS_SUCCESS;
+  }
+
   // Enable and subscribe to the interrupts for the channel to be used...
-  mDevice.EnableOutputInterrupt ();
-  mDevice.EnableInputInterrupt (mInputChannel);
-  mDevice.SubscribeInputVerticalEvent (mInputChannel);
+  card->EnableOutputInterrupt ();
+  card->EnableInputInterrupt (mInputChannel);
+  mDevice->SubscribeInputVerticalEvent (mInputChannel);
 
   // Enable input channel
-  mDevice.SetMode (mInputChannel, NTV2_MODE_CAPTURE, false);
-  mDevice.SetFrameBufferFormat (mInputChannel, mPixelFormat);
+  card->SetMode (mInputChannel, NTV2_MODE_CAPTURE, false);
+  card->SetFrameBufferFormat (mInputChannel, mPixelFormat);
 
   if (mQuad && mVideoSource == NTV2_INPUTSOURCE_HDMI1) {
-    mDevice.Set4kSquaresEnable(true, (NTV2Channel) mInputChannel);
-    mDevice.SetTsiFrameEnable(true, (NTV2Channel) mInputChannel);
+    card->Set4kSquaresEnable(true, (NTV2Channel) mInputChannel);
+    card->SetTsiFrameEnable(true, (NTV2Channel) mInputChannel);
   } else if (mQuad) {
     if (mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_SQD) {
       if (mVideoFormat >= NTV2_FORMAT_FIRST_UHD2_DEF_FORMAT &&
           mVideoFormat <= NTV2_FORMAT_END_UHD2_FULL_DEF_FORMATS) {
-        mDevice.SetQuadQuadFrameEnable(true, (NTV2Channel) mInputChannel);
-        mDevice.SetQuadQuadSquaresEnable(true, (NTV2Channel) mInputChannel);
+        card->SetQuadQuadFrameEnable(true, (NTV2Channel) mInputChannel);
+        card->SetQuadQuadSquaresEnable(true, (NTV2Channel) mInputChannel);
       } else {
-        mDevice.Set4kSquaresEnable(true, (NTV2Channel) mInputChannel);
-        mDevice.SetTsiFrameEnable(false, (NTV2Channel) mInputChannel);
+        card->Set4kSquaresEnable(true, (NTV2Channel) mInputChannel);
+        card->SetTsiFrameEnable(false, (NTV2Channel) mInputChannel);
       }
     } else if (mSDIInputMode == SDI_INPUT_MODE_QUAD_LINK_TSI) {
       if (mVideoFormat >= NTV2_FORMAT_FIRST_UHD2_DEF_FORMAT &&
           mVideoFormat <= NTV2_FORMAT_END_UHD2_FULL_DEF_FORMATS) {
-        mDevice.SetQuadQuadFrameEnable(true, (NTV2Channel) mInputChannel);
-        mDevice.SetQuadQuadSquaresEnable(false, (NTV2Channel) mInputChannel);
+        card->SetQuadQuadFrameEnable(true, (NTV2Channel) mInputChannel);
+        card->SetQuadQuadSquaresEnable(false, (NTV2Channel) mInputChannel);
       } else {
-        mDevice.Set4kSquaresEnable(false, (NTV2Channel) mInputChannel);
-        mDevice.SetTsiFrameEnable(true, (NTV2Channel) mInputChannel);
+        card->Set4kSquaresEnable(false, (NTV2Channel) mInputChannel);
+        card->SetTsiFrameEnable(true, (NTV2Channel) mInputChannel);
       }
     } else {
       g_assert_not_reached ();
     }
   } else {
-    mDevice.Set4kSquaresEnable(false, (NTV2Channel) mInputChannel);
-    mDevice.SetTsiFrameEnable(false, (NTV2Channel) mInputChannel);
+    card->Set4kSquaresEnable(false, (NTV2Channel) mInputChannel);
+    card->SetTsiFrameEnable(false, (NTV2Channel) mInputChannel);
   }
 
-  mDevice.EnableChannel (mInputChannel);
+  card->EnableChannel (mInputChannel);
 
   //    Setup frame buffer
   if (mQuad) {
     //    Set capture mode
-    mDevice.SetMode ((NTV2Channel) (mInputChannel + 1), NTV2_MODE_CAPTURE, false);
-    mDevice.SetMode ((NTV2Channel) (mInputChannel + 2), NTV2_MODE_CAPTURE, false);
-    mDevice.SetMode ((NTV2Channel) (mInputChannel + 3), NTV2_MODE_CAPTURE, false);
+    card->SetMode ((NTV2Channel) (mInputChannel + 1), NTV2_MODE_CAPTURE, false);
+    card->SetMode ((NTV2Channel) (mInputChannel + 2), NTV2_MODE_CAPTURE, false);
+    card->SetMode ((NTV2Channel) (mInputChannel + 3), NTV2_MODE_CAPTURE, false);
 
     //    Set frame buffer format
-    mDevice.SetFrameBufferFormat ((NTV2Channel) (mInputChannel + 1), mPixelFormat);
-    mDevice.SetFrameBufferFormat ((NTV2Channel) (mInputChannel + 2), mPixelFormat);
-    mDevice.SetFrameBufferFormat ((NTV2Channel) (mInputChannel + 3), mPixelFormat);
+    card->SetFrameBufferFormat ((NTV2Channel) (mInputChannel + 1), mPixelFormat);
+    card->SetFrameBufferFormat ((NTV2Channel) (mInputChannel + 2), mPixelFormat);
+    card->SetFrameBufferFormat ((NTV2Channel) (mInputChannel + 3), mPixelFormat);
 
     //    Enable frame buffers
-    mDevice.EnableChannel ((NTV2Channel) (mInputChannel + 1));
-    mDevice.EnableChannel ((NTV2Channel) (mInputChannel + 2));
-    mDevice.EnableChannel ((NTV2Channel) (mInputChannel + 3));
+    card->EnableChannel ((NTV2Channel) (mInputChannel + 1));
+    card->EnableChannel ((NTV2Channel) (mInputChannel + 2));
+    card->EnableChannel ((NTV2Channel) (mInputChannel + 3));
   }
 
-  mDevice.SetVideoFormat(mVideoFormat, true, false, mInputChannel);
-
-  mTimeBase.SetAJAFrameRate (GetAJAFrameRate (GetNTV2FrameRateFromVideoFormat
-          (mVideoFormat)));
+  card->SetVideoFormat(mVideoFormat, true, false, mInputChannel);
 
   // Set up routing
 
@@ -573,7 +808,7 @@ AJAStatus NTV2GstAV::SetupVideo (void)
     case NTV2_INPUTSOURCE_HDMI1:
       // Select correct values based on channel
       NTV2LHIHDMIColorSpace hdmiColor;
-      mDevice.GetHDMIInputColor (hdmiColor, mInputChannel);
+      card->GetHDMIInputColor (hdmiColor, mInputChannel);
       inputRGB = hdmiColor == NTV2_LHIHDMIColorSpaceRGB;
       switch (mInputChannel) {
          default:
@@ -618,7 +853,7 @@ AJAStatus NTV2GstAV::SetupVideo (void)
   CNTV2SignalRouter router;
 
   // Get old router
-  mDevice.GetRouting(router);
+  card->GetRouting(router);
 
   // Get corresponding input select entries for the channel
   switch (mInputChannel) {
@@ -789,16 +1024,16 @@ AJAStatus NTV2GstAV::SetupVideo (void)
   // but only if the device supports bi-directional SDI,
   // and only if the input being used is an SDI input
   if (::NTV2DeviceHasBiDirectionalSDI (mDeviceID)) {
-    mDevice.SetSDITransmitEnable(mInputChannel, false);
+    card->SetSDITransmitEnable(mInputChannel, false);
     if (mQuad) {
-      mDevice.SetSDITransmitEnable ((NTV2Channel) (mInputChannel + 1), false);
-      mDevice.SetSDITransmitEnable ((NTV2Channel) (mInputChannel + 2), false);
-      mDevice.SetSDITransmitEnable ((NTV2Channel) (mInputChannel + 3), false);
-      mDevice.WaitForOutputVerticalInterrupt ();
-      mDevice.WaitForOutputVerticalInterrupt ();
-      mDevice.WaitForOutputVerticalInterrupt ();
+      card->SetSDITransmitEnable ((NTV2Channel) (mInputChannel + 1), false);
+      card->SetSDITransmitEnable ((NTV2Channel) (mInputChannel + 2), false);
+      card->SetSDITransmitEnable ((NTV2Channel) (mInputChannel + 3), false);
+      card->WaitForOutputVerticalInterrupt ();
+      card->WaitForOutputVerticalInterrupt ();
+      card->WaitForOutputVerticalInterrupt ();
     }
-    mDevice.WaitForOutputVerticalInterrupt ();
+    card->WaitForOutputVerticalInterrupt ();
   } else {
     if (mVideoSource == NTV2_INPUTSOURCE_HDMI1) {
       // Enable HDMI passthrough
@@ -899,30 +1134,37 @@ AJAStatus NTV2GstAV::SetupVideo (void)
   if (mPassthrough && ::NTV2DeviceHasBiDirectionalSDI(mDeviceID)) {
     int numVideoInputs = NTV2DeviceGetNumVideoOutputs (mDeviceID);
 
-    mDevice.SetMode((NTV2Channel)(mInputChannel + numVideoInputs / 2), NTV2_MODE_DISPLAY);
+    card->SetMode((NTV2Channel)(mInputChannel + numVideoInputs / 2), NTV2_MODE_DISPLAY);
     // Enable End to End mode for all AJA cards that don't support bidirectional SDI
     if (mInputChannel == NTV2_CHANNEL1) {
       router.AddConnection ((numVideoInputs == 8) ? NTV2_XptSDIOut5Input : NTV2_XptSDIOut3Input, NTV2_XptSDIIn1);
-      mDevice.SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL5 : NTV2_CHANNEL3, true);
+      card->SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL5 : NTV2_CHANNEL3, true);
     } else if (mInputChannel == NTV2_CHANNEL2) {
       router.AddConnection ((numVideoInputs == 8) ? NTV2_XptSDIOut6Input : NTV2_XptSDIOut4Input, NTV2_XptSDIIn2);
-      mDevice.SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL6 : NTV2_CHANNEL4 , true);
+      card->SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL6 : NTV2_CHANNEL4 , true);
     } else if (mInputChannel == NTV2_CHANNEL3) {
       router.AddConnection ((numVideoInputs == 8) ? NTV2_XptSDIOut7Input : NTV2_XptSDIOut5Input, NTV2_XptSDIIn3);
-      mDevice.SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL7 : NTV2_CHANNEL5 , true);
+      card->SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL7 : NTV2_CHANNEL5 , true);
     } else if (mInputChannel == NTV2_CHANNEL4) {
       router.AddConnection ((numVideoInputs == 8) ? NTV2_XptSDIOut8Input : NTV2_XptSDIOut6Input, NTV2_XptSDIIn4);
-      mDevice.SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL8 : NTV2_CHANNEL6 , true);
+      card->SetSDITransmitEnable ((numVideoInputs == 8) ? NTV2_CHANNEL8 : NTV2_CHANNEL6 , true);
     }
   }
 
   // VANC handling
-  if (mCaptureTall) {
+  if (mCaptureAnc) {
+    GST_DEBUG ("Asking to extract ANC packets from SDI %d", (int) mInputChannel + 1);
+    if (!card->AncExtractInit ((UWord) mInputChannel, mInputChannel) ||
+        !card->AncExtractSetEnable ((UWord) mInputChannel, true)) {
+      GST_WARNING ("Failed to set up the ANC extractor, no ancillary data");
+      mCaptureAnc = false;
+    }
+  } else if (mCaptureTall) {
     GST_DEBUG ("Asking to enable VANC Data");
-    mDevice.SetEnableVANCData (true, false, mInputChannel);
+    card->SetEnableVANCData (true, false, mInputChannel);
     if (mPixelFormat == NTV2_FBF_8BIT_YCBCR) {
       GST_DEBUG ("8bit, asking to shift VANC");
-      if (!mDevice.SetVANCShiftMode (mInputChannel,
+      if (!card->SetVANCShiftMode (mInputChannel,
               NTV2_VANCDATA_8BITSHIFT_ENABLE))
         GST_WARNING ("Failed to request 8bit VANC shift");
     }
@@ -932,15 +1174,15 @@ AJAStatus NTV2GstAV::SetupVideo (void)
   {
     std::stringstream os;
     CNTV2SignalRouter oldRouter;
-    mDevice.GetRouting(oldRouter);
+    card->GetRouting(oldRouter);
     oldRouter.Print(os);
     GST_DEBUG ("Previous routing:\n%s", os.str().c_str());
   }
-  mDevice.ApplySignalRoute (router, true);
+  card->ApplySignalRoute (router, true);
   {
     std::stringstream os;
     CNTV2SignalRouter currentRouter;
-    mDevice.GetRouting(currentRouter);
+    card->GetRouting(currentRouter);
     currentRouter.Print(os);
     GST_DEBUG ("New routing:\n%s", os.str().c_str());
   }
@@ -948,42 +1190,42 @@ AJAStatus NTV2GstAV::SetupVideo (void)
   //    Set the device reference to the input...
   //    FIXME
 //  if (mMultiStream) {
-//    mDevice.SetReference (NTV2_REFERENCE_FREERUN);
+//    card->SetReference (NTV2_REFERENCE_FREERUN);
 //  } else {
-    mDevice.SetReference (::NTV2InputSourceToReferenceSource (mInputSource));
+    card->SetReference (::NTV2InputSourceToReferenceSource (mInputSource));
 //  }
 
 #if 0
   //    When input is 3Gb convert to 3Ga for capture (no RGB support?)
   bool is3Gb = false;
-  mDevice.GetSDIInput3GbPresent (is3Gb, mInputChannel);
+  card->GetSDIInput3GbPresent (is3Gb, mInputChannel);
 
   if (mQuad) {
-    mDevice.SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL1, is3Gb);
-    mDevice.SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL2, is3Gb);
-    mDevice.SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL3, is3Gb);
-    mDevice.SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL4, is3Gb);
-    mDevice.SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL5, false);
-    mDevice.SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL6, false);
-    mDevice.SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL7, false);
-    mDevice.SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL8, false);
+    card->SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL1, is3Gb);
+    card->SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL2, is3Gb);
+    card->SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL3, is3Gb);
+    card->SetSDIInLevelBtoLevelAConversion (NTV2_CHANNEL4, is3Gb);
+    card->SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL5, false);
+    card->SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL6, false);
+    card->SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL7, false);
+    card->SetSDIOutLevelAtoLevelBConversion (NTV2_CHANNEL8, false);
   } else {
-    mDevice.SetSDIInLevelBtoLevelAConversion (mInputChannel, is3Gb);
-    mDevice.SetSDIOutLevelAtoLevelBConversion (mOutputChannel, false);
+    card->SetSDIInLevelBtoLevelAConversion (mInputChannel, is3Gb);
+    card->SetSDIOutLevelAtoLevelBConversion (mOutputChannel, false);
   }
 
   if (!mMultiStream)            //    If not doing multistream...
-    mDevice.ClearRouting ();    //    ...replace existing routing
+    card->ClearRouting ();    //    ...replace existing routing
 
   //    Connect SDI output spigots to FB outputs...
-  mDevice.Connect (NTV2_XptSDIOut5Input, NTV2_XptFrameBuffer5YUV);
-  mDevice.Connect (NTV2_XptSDIOut6Input, NTV2_XptFrameBuffer6YUV);
-  mDevice.Connect (NTV2_XptSDIOut7Input, NTV2_XptFrameBuffer7YUV);
-  mDevice.Connect (NTV2_XptSDIOut8Input, NTV2_XptFrameBuffer8YUV);
+  card->Connect (NTV2_XptSDIOut5Input, NTV2_XptFrameBuffer5YUV);
+  card->Connect (NTV2_XptSDIOut6Input, NTV2_XptFrameBuffer6YUV);
+  card->Connect (NTV2_XptSDIOut7Input, NTV2_XptFrameBuffer7YUV);
+  card->Connect (NTV2_XptSDIOut8Input, NTV2_XptFrameBuffer8YUV);
 #endif
 
   //    Give the device some time to lock to the input signal...
-  mDevice.WaitForOutputVerticalInterrupt (mInputChannel, 8);
+  card->WaitForOutputVerticalInterrupt (mInputChannel, 8);
 
 
   return AJA_STATUS_SUCCESS;
@@ -1021,42 +1263,55 @@ AJAStatus NTV2GstAV::SetupAudio (void)
       break;
   }
 
+  if (mNumAudioChannels == 0)
+    mNumAudioChannels =::NTV2DeviceGetMaxAudioChannels (mDeviceID);
+  if (mNumAudioChannels >::NTV2DeviceGetMaxAudioChannels (mDeviceID))
+    return AJA_STATUS_FAIL;
+
+  if (!mDevice->ConfigureAudio (mAudioSystem, mNumAudioChannels))
+    return AJA_STATUS_FAIL;
+
+  // Only real hardware needs the audio input routed
+  CNTV2Card *card = mDevice->GetCard ();
+  if (!card)
+    return AJA_STATUS_SUCCESS;
+
   // Then based on channel and/or mode, select the audio input
   switch (mAudioSource) {
     case NTV2_AUDIO_EMBEDDED:
       switch (mInputChannel) {
         default:
         case NTV2_CHANNEL1:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1, mAudioSystem);
           break;
         case NTV2_CHANNEL2:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2, mAudioSystem);
           break;
         case NTV2_CHANNEL3:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3, mAudioSystem);
           break;
         case NTV2_CHANNEL4:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4, mAudioSystem);
           break;
         case NTV2_CHANNEL5:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_5);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_5, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_5);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_5, mAudioSystem);
           break;
         case NTV2_CHANNEL6:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_6);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_6, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_6);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_6, mAudioSystem);
           break;
         case NTV2_CHANNEL7:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_7);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_7, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_7);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_7, mAudioSystem);
           break;
         case NTV2_CHANNEL8:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_8);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_8, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_EMBEDDED, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_8);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_8, mAudioSystem);
           break;
       }
 
@@ -1065,65 +1320,144 @@ AJAStatus NTV2GstAV::SetupAudio (void)
       switch (mInputChannel) {
         default:
         case NTV2_CHANNEL1:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1, mAudioSystem);
           break;
         case NTV2_CHANNEL2:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_2, mAudioSystem);
           break;
         case NTV2_CHANNEL3:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_3, mAudioSystem);
           break;
         case NTV2_CHANNEL4:
-          mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4);
-          mDevice.SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4, mAudioSystem);
+          card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_HDMI, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4);
+          card->SetEmbeddedAudioInput(NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_4, mAudioSystem);
           break;
       }
       break;
     case NTV2_AUDIO_AES:
-      mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_AES, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
+      card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_AES, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
       break;
     case NTV2_AUDIO_ANALOG:
-      mDevice.SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_ANALOG, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
+      card->SetAudioSystemInputSource (mAudioSystem, NTV2_AUDIO_ANALOG, NTV2_EMBEDDED_AUDIO_INPUT_VIDEO_1);
       break;
     default:
       g_assert_not_reached ();
       break;
   }
 
-  if (mNumAudioChannels == 0)
-    mNumAudioChannels =::NTV2DeviceGetMaxAudioChannels (mDeviceID);
-  if (mNumAudioChannels >::NTV2DeviceGetMaxAudioChannels (mDeviceID))
-    return AJA_STATUS_FAIL;
-
   // Setting channels or getting the maximum number of channels generally fails and we always
   // get all channels available to the card
-  mDevice.SetNumberAudioChannels (mNumAudioChannels, mAudioSystem);
-  mDevice.SetAudioRate (NTV2_AUDIO_48K, mAudioSystem);
-  mDevice.SetEmbeddedAudioClock (NTV2_EMBEDDED_AUDIO_CLOCK_VIDEO_INPUT,
+  card->SetNumberAudioChannels (mNumAudioChannels, mAudioSystem);
+  card->SetAudioRate (NTV2_AUDIO_48K, mAudioSystem);
+  card->SetEmbeddedAudioClock (NTV2_EMBEDDED_AUDIO_CLOCK_VIDEO_INPUT,
       mAudioSystem);
 
   //    The on-device audio buffer should be 4MB to work best across all devices & platforms...
-  mDevice.SetAudioBufferSize (NTV2_AUDIO_BUFFER_BIG, mAudioSystem);
+  card->SetAudioBufferSize (NTV2_AUDIO_BUFFER_BIG, mAudioSystem);
 
-  mDevice.SetAudioLoopBack(NTV2_AUDIO_LOOPBACK_OFF, mAudioSystem);
+  card->SetAudioLoopBack(NTV2_AUDIO_LOOPBACK_OFF, mAudioSystem);
 
   return AJA_STATUS_SUCCESS;
 
 }                               //    SetupAudio
 
 
+// Part of the real-time profile and placement report, the threads report
+// the rest
+static void
+_report_pool_placement (GstAllocator * allocator, const char *name)
+{
+  GstAjaAllocator *aja_alloc = GST_AJA_ALLOCATOR (allocator);
+
+  // Placed, backed and locked per slab by the arena, which reports that
+  // itself
+  if (aja_alloc->arena) {
+    GST_INFO ("%s", aja_alloc->arena->DescribeUsage ().c_str ());
+    return;
+  }
+
+  GST_OBJECT_LOCK (aja_alloc);
+  if (aja_alloc->numa_node >= 0) {
+    if (aja_alloc->num_misplaced > 0)
+      GST_WARNING ("Placed only %u of %u %s pool buffers on NUMA node %d",
+          aja_alloc->num_allocated - aja_alloc->num_misplaced,
+          aja_alloc->num_allocated, name, aja_alloc->numa_node);
+    else
+      GST_INFO ("Placed all %u %s pool buffers on NUMA node %d",
+          aja_alloc->num_allocated, name, aja_alloc->numa_node);
+  }
+
+  if (aja_alloc->slab) {
+    const gsize total = aja_alloc->num_allocated * aja_alloc->alloc_size;
+
+    GST_INFO ("%" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " KiB of %s pool "
+        "memory backed by %" G_GSIZE_FORMAT " MiB huge pages",
+        aja_alloc->num_prealloc * aja_alloc->alloc_size / 1024, total / 1024, name,
+        aja_alloc->huge_page_size >> 20);
+  }
+
+  if (aja_alloc->lock_memory) {
+    if (aja_alloc->num_lock_failed > 0)
+      GST_WARNING ("Real-time profile locked only %u of %u %s pool buffers",
+          aja_alloc->num_locked,
+          aja_alloc->num_locked + aja_alloc->num_lock_failed, name);
+    else
+      GST_INFO ("Real-time profile locked all %u %s pool buffers",
+          aja_alloc->num_locked, name);
+  }
+  GST_OBJECT_UNLOCK (aja_alloc);
+}
+
+
+// Buffers beyond what the consumer queues and held before: the one being
+// transferred, the one being delivered and some slack downstream
+#define AUTO_POOL_HEADROOM      4
+// Preallocate at most this much per pool, it still grows on demand
+#define AUTO_POOL_MAX_BYTES     (1024 * 1024 * 1024)
+
+static guint
+_auto_pool_size (guint queueSize, guint peakHeld, gsize bufferSize)
+{
+  const guint depth = MAX (queueSize, peakHeld) + AUTO_POOL_HEADROOM;
+  const guint cap = MAX (AUTO_POOL_HEADROOM, AUTO_POOL_MAX_BYTES / MAX (bufferSize, 1));
+
+  return MIN (depth, cap);
+}
+
+
 void
 NTV2GstAV::SetupHostBuffers (void)
 {
-  mVideoBufferSize =
-      GetVideoActiveSize (mVideoFormat, mPixelFormat,
-      mCaptureTall ? NTV2_VANCMODE_TALL : NTV2_VANCMODE_OFF);
-  mAudioBufferSize = NTV2_AUDIOSIZE_MAX;
+  if (mCropRows > 0) {
+    // Only the lines and bytes of the crop cross the bus, packed into
+    // buffers of just its size
+    mVideoBufferSize = mCropRows * mCropHostBytes;
+    mInputTransferStruct.EnableSegmentedDMAs (mCropRows, mCropActiveBytes,
+        mCropHostBytes, mCropDeviceBytes);
+    mInputTransferStruct.acInVideoDMAOffset = mCropOffset;
+  } else {
+    mVideoBufferSize =
+        GetVideoActiveSize (mVideoFormat, mPixelFormat,
+        mCaptureTall ? NTV2_VANCMODE_TALL : NTV2_VANCMODE_OFF);
+  }
+  mAudioBufferSize = GetAudioBufferSize ();
 
-  mDevice.DMABufferAutoLock(false, true, 0);
+  // Every video buffer comes with one audio buffer
+  const guint videoPoolSize = mVideoPoolSize > 0 ? mVideoPoolSize :
+      _auto_pool_size (mQueueSize, mVideoPeakHeld, mVideoBufferSize);
+  const guint audioPoolSize = mAudioPoolSize > 0 ? mAudioPoolSize :
+      _auto_pool_size (mQueueSize, MAX (mAudioPeakHeld, mVideoPeakHeld),
+      mAudioBufferSize.load ());
+
+  GST_INFO ("Preallocating %u video buffers of %u bytes and %u audio buffers "
+      "of %u bytes (queue size %u, held at most %u/%u before)", videoPoolSize,
+      mVideoBufferSize, audioPoolSize, mAudioBufferSize.load (), mQueueSize,
+      mVideoPeakHeld, mAudioPeakHeld);
+
+  mDevice->DMABufferAutoLock(false, true, 0);
 
   // These video buffers are actually passed out of this class so we need to assign them unique numbers
   // so they can be tracked and also they have a state
@@ -1133,54 +1467,247 @@ NTV2GstAV::SetupHostBuffers (void)
     mVideoBufferPool = gst_aja_nvmm_buffer_pool_new ();
     config = gst_buffer_pool_get_config (mVideoBufferPool);
     gst_buffer_pool_config_set_params (config, mCaps, mVideoBufferSize,
-        VIDEO_ARRAY_SIZE, 0);
+        videoPoolSize, 0);
 
     gst_buffer_pool_set_config (mVideoBufferPool, config);
     gst_buffer_pool_set_active (mVideoBufferPool, TRUE);
   } else
 #endif
   {
-    GstAllocator *video_alloc = gst_aja_allocator_new(&mDevice, mVideoBufferSize, VIDEO_ARRAY_SIZE);
+    gchar *owner = g_strdup_printf ("channel %d video", (int) mInputChannel + 1);
+    GstAllocator *video_alloc = gst_aja_allocator_new(mDevice, mVideoBufferSize, videoPoolSize,
+        mRealtimeProfile.lockMemory, mNUMANode, mHugePageSize, mArena, owner,
+        mExportMode);
+    g_free (owner);
+    gst_aja_allocator_set_grow (video_alloc,
+        mExhaustionPolicy == NTV2_EXHAUSTION_POLICY_GROW);
 
     mVideoBufferPool = gst_aja_buffer_pool_new ();
     config = gst_buffer_pool_get_config (mVideoBufferPool);
     gst_buffer_pool_config_set_params (config, NULL, mVideoBufferSize,
-        VIDEO_ARRAY_SIZE, 0);
+        videoPoolSize, 0);
     gst_buffer_pool_config_set_allocator (config, video_alloc, NULL);
     gst_structure_set (config, "is-video", G_TYPE_BOOLEAN, TRUE, NULL);
 
     gst_buffer_pool_set_config (mVideoBufferPool, config);
     gst_buffer_pool_set_active (mVideoBufferPool, TRUE);
+    _report_pool_placement (video_alloc, "video");
     gst_object_unref (video_alloc);
   }
 
-  GstAllocator *audio_alloc = gst_aja_allocator_new(&mDevice, mAudioBufferSize, AUDIO_ARRAY_SIZE);
-  mAudioBufferPool = gst_aja_buffer_pool_new ();
-  config = gst_buffer_pool_get_config (mAudioBufferPool);
+  mAudioPoolDepth = audioPoolSize;
+  mAudioBufferPool = NewAudioPool ();
+
+  // The packets are attached to the frame right after each transfer, one
+  // pair of buffers takes them all
+  for (int i = 0; mCaptureAnc && i < 2; i++) {
+    void *anc = NULL;
+
+    if (mAncBuffer[i])
+      continue;
+    if (posix_memalign (&anc, 4096, NTV2_ANCSIZE_MAX) != 0) {
+      GST_ERROR ("Failed to allocate the ANC buffers, no ancillary data");
+      break;
+    }
+    mAncBuffer[i] = (uint8_t *) anc;
+    mDevice->DMABufferLock ((ULWord *) mAncBuffer[i], NTV2_ANCSIZE_MAX, true);
+  }
+
+  SetupPublisher ();
+}                               //    SetupHostBuffers
+
+
+void
+NTV2GstAV::SetupPublisher (void)
+{
+  NTV2GstShmRing *ring = mShmRing;
+  int error;
+
+  if (ring && (mPublishName.empty () || mUseNvmm ||
+          ring->GetVideoSize () != mVideoBufferSize ||
+          ring->GetAudioSize () != mAudioBufferSize ||
+          ring->GetNumSlots () != mPublishSlots)) {
+    ring->ReleaseDevice ();
+    ring->Close ();
+    ring->Unref ();
+    ring = NULL;
+  }
+
+  // NVMM frames are in GPU memory that other processes can't map
+  if (!ring && !mPublishName.empty () && !mUseNvmm) {
+    ring = NTV2GstShmRing::Create (mPublishName, mPublishSlots,
+        mVideoBufferSize, mAudioBufferSize, mNUMANode, error);
+    if (ring)
+      ring->LockForDMA (mDevice);
+    else
+      GST_ERROR ("Failed to create the ring '%s' to publish to: %s",
+          mPublishName.c_str (), g_strerror (error));
+  }
+
+  mPoolLock.Lock ();
+  mShmRing = ring;
+  if (mShmRing)
+    mShmRing->SetCaps (mPublishCaps.c_str (), GetCapturedAudioChannels ());
+  mPoolLock.Unlock ();
+}
+
+
+// The device captures all of its channels no matter how many were asked for,
+// interleaved in every transfer
+uint32_t
+NTV2GstAV::GetCapturedAudioChannels (void)
+{
+  ULWord numChannels = 0;
+
+  if (!mDevice->GetNumberAudioChannels (numChannels, mAudioSystem) || numChannels == 0)
+    numChannels = ::NTV2DeviceGetMaxAudioChannels (mDeviceID);
+
+  return numChannels;
+}
+
+
+// Size of the audio of one frame: the largest frame of the frame rate's
+// sample cadence, for all channels the device captures, with some headroom
+uint32_t
+NTV2GstAV::GetAudioBufferSize (void)
+{
+  const NTV2FrameRate frameRate = GetNTV2FrameRateFromVideoFormat (mVideoFormat);
+  ULWord numChannels = GetCapturedAudioChannels ();
+  ULWord maxSamples = 0;
+
+  for (ULWord cadenceFrame = 0; cadenceFrame < AUDIO_CADENCE_FRAMES; cadenceFrame++)
+    maxSamples = MAX (maxSamples,
+        GetAudioSamplesPerFrame (frameRate, NTV2_AUDIO_48K, cadenceFrame));
+
+  // No frame rate yet, or no channels, take the largest a frame can have
+  if (maxSamples == 0 || numChannels == 0)
+    return NTV2_AUDIOSIZE_MAX;
+
+  // The published ring can't be resized while readers have it mapped, its
+  // audio fits all channels the device can capture from the start
+  if (!mPublishName.empty () && !mUseNvmm)
+    numChannels = ::NTV2DeviceGetMaxAudioChannels (mDeviceID);
+
+  return GST_ROUND_UP_N (AUDIO_SIZE_HEADROOM (maxSamples * numChannels * 4), 4096);
+}
+
+
+GstBufferPool *
+NTV2GstAV::NewAudioPool (void)
+{
+  GstBufferPool *pool;
+  GstStructure *config;
+
+  gchar *owner = g_strdup_printf ("channel %d audio", (int) mInputChannel + 1);
+  GstAllocator *audio_alloc = gst_aja_allocator_new(mDevice, mAudioBufferSize, mAudioPoolDepth,
+      mRealtimeProfile.lockMemory, mNUMANode, mHugePageSize, mArena, owner,
+      NTV2_EXPORT_MODE_NONE);
+  g_free (owner);
+  gst_aja_allocator_set_grow (audio_alloc,
+      mExhaustionPolicy == NTV2_EXHAUSTION_POLICY_GROW);
+  pool = gst_aja_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (pool);
   gst_buffer_pool_config_set_params (config, NULL, mAudioBufferSize,
-      AUDIO_ARRAY_SIZE, 0);
+      mAudioPoolDepth, 0);
   gst_buffer_pool_config_set_allocator (config, audio_alloc, NULL);
   gst_structure_set (config, "is-video", G_TYPE_BOOLEAN, FALSE, NULL);
-  gst_buffer_pool_set_config (mAudioBufferPool, config);
-  gst_buffer_pool_set_active (mAudioBufferPool, TRUE);
+  gst_buffer_pool_set_config (pool, config);
+  gst_buffer_pool_set_active (pool, TRUE);
+  _report_pool_placement (audio_alloc, "audio");
   gst_object_unref (audio_alloc);
-}                               //    SetupHostBuffers
+
+  return pool;
+}
+
+
+// Called when the audio configuration changed while capturing, from the
+// thread that changed it, with the input locked. Building and preallocating
+// the pool locks its memory for DMA, which the capture loop must not wait
+// for, it only swaps the pool in with the next frame. Nor does this wait for
+// that: the old pool is retired by the next rebuild or when stopping.
+void
+NTV2GstAV::RebuildAudioPool (void)
+{
+  const uint32_t audioBufferSize = GetAudioBufferSize ();
+
+  // The pool of the last rebuild, swapped out by now
+  RetireAudioPool (mRetiredAudioPool.exchange (NULL));
+
+  if (audioBufferSize == mAudioBufferSize.load ())
+    return;
+
+  GST_INFO ("Audio buffer size changed from %u to %u bytes, rebuilding the pool",
+      mAudioBufferSize.load (), audioBufferSize);
+
+  mAudioBufferSize.store (audioBufferSize);
+  GstBufferPool *pool = NewAudioPool ();
+
+  // Replaces one the capture loop never took
+  RetireAudioPool (mPendingAudioPool.exchange (pool));
+}
+
+
+// Capture loop only. Freeing a pool unlocks its memory for DMA, the capture
+// loop hands the old one on for RebuildAudioPool or FreeHostBuffers to free,
+// and swaps in none while one is still waiting there.
+void
+NTV2GstAV::SwapAudioPool (void)
+{
+  if (!mPendingAudioPool.load (std::memory_order_relaxed) ||
+      mRetiredAudioPool.load ())
+    return;
+
+  GstBufferPool *pool = mPendingAudioPool.exchange (NULL);
+  if (!pool)
+    return;
+
+  // The copy-out thread might be looking at the old pool
+  mPoolLock.Lock ();
+  std::swap (pool, mAudioBufferPool);
+  mPoolLock.Unlock ();
+
+  // Only this thread hands pools on, the slot is still empty
+  mRetiredAudioPool.store (pool);
+}
+
+
+// Buffers of the pool still downstream keep it alive until they come back
+void
+NTV2GstAV::RetireAudioPool (GstBufferPool * pool)
+{
+  if (!pool)
+    return;
+
+  mAudioPeakHeld = MAX (mAudioPeakHeld,
+      gst_aja_buffer_pool_get_peak_outstanding (pool));
+  gst_buffer_pool_set_active (pool, FALSE);
+  gst_object_unref (pool);
+}
 
 
 void
 NTV2GstAV::FreeHostBuffers (void)
 {
+  for (int i = 0; i < 2; i++) {
+    if (mAncBuffer[i]) {
+      mDevice->DMABufferUnlock ((ULWord *) mAncBuffer[i], NTV2_ANCSIZE_MAX);
+      free (mAncBuffer[i]);
+      mAncBuffer[i] = NULL;
+    }
+  }
+
   if (mVideoBufferPool) {
+    mVideoPeakHeld = MAX (mVideoPeakHeld,
+        gst_aja_buffer_pool_get_peak_outstanding (mVideoBufferPool));
     gst_buffer_pool_set_active (mVideoBufferPool, FALSE);
     gst_object_unref (mVideoBufferPool);
     mVideoBufferPool = NULL;
   }
 
-  if (mAudioBufferPool) {
-    gst_buffer_pool_set_active (mAudioBufferPool, FALSE);
-    gst_object_unref (mAudioBufferPool);
-    mAudioBufferPool = NULL;
-  }
+  RetireAudioPool (mPendingAudioPool.exchange (NULL));
+  RetireAudioPool (mRetiredAudioPool.exchange (NULL));
+  RetireAudioPool (mAudioBufferPool);
+  mAudioBufferPool = NULL;
 }
 
 void
@@ -1209,10 +1736,11 @@ NTV2GstAV::SetupAutoCirculate (void)
     frameEnd = frameStart + 6;
   }
 
-  mDevice.AutoCirculateStop (mInputChannel);
-  mDevice.AutoCirculateInitForInput (mInputChannel, 0,  //    Frames to circulate
+  mDevice->AutoCirculateStop (mInputChannel);
+  mDevice->AutoCirculateInitForInput (mInputChannel, 0,  //    Frames to circulate
       mAudioSystem,             //    Which audio system
-      AUTOCIRCULATE_WITH_RP188, //    With RP188?
+      AUTOCIRCULATE_WITH_RP188 |    //    With RP188?
+      (mCaptureAnc ? AUTOCIRCULATE_WITH_ANC : 0),
       1,                        //    1 channel
       frameStart,
       frameEnd);
@@ -1234,7 +1762,7 @@ AJAStatus NTV2GstAV::Run ()
   //    Setup the circular buffers
   SetupHostBuffers ();
 
-  if (mDevice.GetInputVideoFormat (mInputSource) == NTV2_FORMAT_UNKNOWN)
+  if (mDevice->GetInputVideoFormat (mInputSource) == NTV2_FORMAT_UNKNOWN)
     GST_WARNING ("No video signal present on the input connector");
 
   // always start the AC thread
@@ -1245,10 +1773,38 @@ AJAStatus NTV2GstAV::Run ()
 }
 
 
-// This is where we will start the AC thread
+// This is where we will start the AC thread and its delivery thread
 void
 NTV2GstAV::StartACThread (void)
 {
+  mDeliveryQuit = false;
+
+  // The delivery thread runs the callbacks, which must never delay the
+  // transfers, so it gets a lower priority than the AC thread
+  mACDeliveryThread = new AJAThread ();
+  mACDeliveryThread->Attach (ACDeliveryThreadStatic, this);
+  mACDeliveryThread->SetPriority (AJA_ThreadPriority_AboveNormal);
+  mACDeliveryThread->Start ();
+
+  if (mExhaustionPolicy == NTV2_EXHAUSTION_POLICY_COPY_OUT) {
+    mCopyOutQuit = false;
+    mCopyOutThread = new AJAThread ();
+    mCopyOutThread->Attach (CopyOutThreadStatic, this);
+    mCopyOutThread->Start ();
+  }
+
+  if (mScheduler) {
+    // The scheduler's threads run with the profile of the first channel,
+    // pinned to the device's node rather than to one channel's core
+    if (mCaptureCPUCore != (uint32_t) -1)
+      GST_WARNING ("Capture CPU core not applied, the device scheduler's "
+          "threads are shared by all channels");
+
+    ACInputBegin ();
+    mScheduler->Attach (this);
+    return;
+  }
+
   mACInputThread = new AJAThread ();
   mACInputThread->Attach (ACInputThreadStatic, this);
   mACInputThread->SetPriority (AJA_ThreadPriority_High);
@@ -1256,7 +1812,7 @@ NTV2GstAV::StartACThread (void)
 }
 
 
-// This is where we will stop the AC thread
+// This is where we will stop the AC thread and its delivery thread
 void
 NTV2GstAV::StopACThread (void)
 {
@@ -1266,7 +1822,35 @@ NTV2GstAV::StopACThread (void)
 
     delete mACInputThread;
     mACInputThread = NULL;
+  } else if (mScheduler && mScheduler->Detach (this)) {
+    ACInputEnd ();
+  }
+
+  // Nothing is queued anymore, let the delivery thread drain what is left
+  if (mACDeliveryThread) {
+    mDeliveryQuit = true;
+    mDeliveryRing.Wake ();
+
+    while (mACDeliveryThread->Active ())
+      AJATime::Sleep (10);
+
+    delete mACDeliveryThread;
+    mACDeliveryThread = NULL;
+  }
+
+  if (mCopyOutThread) {
+    mCopyOutQuit = true;
+    sem_post (&mCopyOutWake);
+
+    while (mCopyOutThread->Active ())
+      AJATime::Sleep (10);
+
+    delete mCopyOutThread;
+    mCopyOutThread = NULL;
   }
+
+  // Whatever the delivery thread dropped last goes back to the pools
+  ReclaimBuffers ();
 }
 
 
@@ -1278,597 +1862,1246 @@ NTV2GstAV::ACInputThreadStatic (AJAThread * pThread, void *pContext)
 
   NTV2GstAV *pApp (reinterpret_cast < NTV2GstAV * >(pContext));
 
-  if (pApp->mCaptureCPUCore != (uint32_t) -1) {
-    cpu_set_t mask;
-    pthread_t current_thread = pthread_self();
+  NTV2GstRealtimeApplyThread (pApp->mRealtimeProfile, "capture",
+      pApp->mCaptureCPUCore, pApp->mNUMACPUs, true);
 
-    CPU_ZERO(&mask);
-    CPU_SET(pApp->mCaptureCPUCore, &mask);
+  pApp->ACInputWorker ();
+}
 
-    if (pthread_setaffinity_np(current_thread, sizeof (mask), &mask) != 0) {
-      GST_ERROR ("Failed to set affinity for current thread to core %u", pApp->mCaptureCPUCore);
-    }
-  }
 
-  pApp->ACInputWorker ();
+// The engine whose delivery thread this is, NULL on any other thread
+static thread_local NTV2GstAV *sDeliveringAV = NULL;
+
+
+// The delivery thread static callback
+void
+NTV2GstAV::ACDeliveryThreadStatic (AJAThread * pThread, void *pContext)
+{
+  (void) pThread;
+
+  NTV2GstAV *pApp (reinterpret_cast < NTV2GstAV * >(pContext));
+
+  sDeliveringAV = pApp;
+
+  // Only pinned, the delivery thread must stay below the capture thread
+  NTV2GstRealtimeApplyThread (pApp->mRealtimeProfile, "delivery",
+      pApp->mRealtimeProfile.deliveryCPUCore, pApp->mNUMACPUs, false);
+
+  pApp->ACDeliveryWorker ();
 }
 
 
+// The copy-out thread static callback
 void
-NTV2GstAV::ACInputWorker (void)
+NTV2GstAV::CopyOutThreadStatic (AJAThread * pThread, void *pContext)
 {
-  // Choose timecode source
-  NTV2TCIndex tcIndex, configuredTcIndex = (NTV2TCIndex)-1;
-  ULWord vpidA, vpidB;
+  (void) pThread;
 
-  // start AutoCirculate running...
-  mDevice.AutoCirculateStart (mInputChannel);
+  NTV2GstAV *pApp (reinterpret_cast < NTV2GstAV * >(pContext));
 
-  bool haveSignal = true;
-  unsigned int iterations_without_frame = 0;
+  // Copies next to the device's memory, never real-time
+  NTV2GstRealtimeApplyThread (pApp->mRealtimeProfile, "copy-out",
+      (uint32_t) -1, pApp->mNUMACPUs, false);
 
-  uint64_t processed_frames = 0;
-  uint64_t dropped_frames = 0;
-  uint32_t last_dropped_frames = 0;
-  bool dropped_frames_now = false;
+  pApp->CopyOutWorker ();
+}
 
-  while (!mGlobalQuit) {
-    AUTOCIRCULATE_STATUS acStatus;
-    mDevice.AutoCirculateGetStatus (mInputChannel, acStatus);
-
-    // Update timecode index if it changed since the last frame
-    if (configuredTcIndex == (NTV2TCIndex)-1 || configuredTcIndex != mTimecodeMode) {
-      configuredTcIndex = mTimecodeMode;
-      if (mTimecodeMode == NTV2_TCINDEX_LTC1 || mTimecodeMode == NTV2_TCINDEX_LTC2) {
-        tcIndex = mTimecodeMode;
-        mDevice.SetLTCInputEnable (true);
-      } else {
-        switch (mInputChannel) {
-          default:
-          case NTV2_CHANNEL1:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI1_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI1_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI1_2;
-            break;
-          case NTV2_CHANNEL2:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI2_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI2_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI2_2;
-            break;
-          case NTV2_CHANNEL3:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI3_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI3_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI3_2;
-            break;
-          case NTV2_CHANNEL4:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI4_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI4_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI4_2;
-            break;
-          case NTV2_CHANNEL5:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI5_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI5_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI5_2;
-            break;
-          case NTV2_CHANNEL6:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI6_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI6_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI6_2;
-            break;
-          case NTV2_CHANNEL7:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI7_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI7_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI7_2;
-            break;
-          case NTV2_CHANNEL8:
-            if (mTimecodeMode == NTV2_TCINDEX_SDI1)
-              tcIndex = NTV2_TCINDEX_SDI8_LTC;
-            else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
-              tcIndex = NTV2_TCINDEX_SDI8_LTC;
-            else
-              tcIndex = NTV2_TCINDEX_SDI8_2;
-            break;
-        }
-      }
+
+void
+NTV2GstAV::WakeCopyOut (void)
+{
+  if (mCopyOutThread && !mCopyOutPending.exchange (true))
+    sem_post (&mCopyOutWake);
+}
+
+
+void
+NTV2GstAV::CopyOutWorker (void)
+{
+  while (true) {
+    while (sem_wait (&mCopyOutWake) != 0 && errno == EINTR)
+      ;
+    if (mCopyOutQuit)
+      break;
+    mCopyOutPending = false;
+
+    // Dropped buffers count as held until they're freed
+    ReclaimBuffers ();
+
+    GstBufferPool *pools[2] = { NULL, NULL };
+    mPoolLock.Lock ();
+    if (mVideoBufferPool)
+      pools[0] = (GstBufferPool *) gst_object_ref (mVideoBufferPool);
+    if (mAudioBufferPool)
+      pools[1] = (GstBufferPool *) gst_object_ref (mAudioBufferPool);
+    mPoolLock.Unlock ();
+
+    for (guint i = 0; i < G_N_ELEMENTS (pools); i++) {
+      if (!pools[i])
+        continue;
+
+      guint copied = gst_aja_buffer_pool_copy_out (pools[i], mCopyOutWatermark);
+      if (copied > 0)
+        GST_DEBUG ("Copied %u %s buffers out of DMA memory", copied,
+            i == 0 ? "video" : "audio");
+      gst_object_unref (pools[i]);
     }
+  }
+}
 
-    NTV2VideoFormat inputVideoFormat = mDevice.GetInputVideoFormat(mInputSource);
-    vpidA = 0;
-    vpidB = 0;
-    mDevice.ReadSDIInVPID(mInputChannel, vpidA, vpidB);
 
-    GST_DEBUG ("Got input video format %08x and VPIDs %08x / %08x", (int) inputVideoFormat, vpidA, vpidB);
+bool
+NTV2GstAV::QueueDelivery (AjaVideoBuff * videoBuffer,
+    AjaAudioBuff * audioBuffer, bool lastFrame)
+{
+  AjaCaptureDelivery delivery = { videoBuffer, audioBuffer, lastFrame };
 
-    // For quad mode, we will get the format of a single input
-    NTV2VideoFormat effectiveVideoFormat = mVideoFormat;
-    if (mQuad && mVideoSource == NTV2_INPUTSOURCE_SDI1) {
-      switch (mVideoFormat) {
-        case NTV2_FORMAT_4x1920x1080p_2398:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2398;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_2400:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2400;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_2500:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2500;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_2997:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2997;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_3000:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_3000;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_5000:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_5000_A;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_5994:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_5994_A;
-          break;
-        case NTV2_FORMAT_4x1920x1080p_6000:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_6000_A;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_2398:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_2398;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_2400:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_2400;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_2500:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_2500;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_2997:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_2997;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_3000:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_3000;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_4795:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_4795_A;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_4800:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_4800_A;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_5000:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_5000_A;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_5994:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_5994_A;
-          break;
-        case NTV2_FORMAT_4x2048x1080p_6000:
-          effectiveVideoFormat = NTV2_FORMAT_1080p_2K_6000_A;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_2398:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_2398;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_2400:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_2400;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_2500:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_2500;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_2997:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_2997;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_3000:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_3000;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_5000:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_5000;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_5994:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_5994;
-          break;
-        case NTV2_FORMAT_4x3840x2160p_6000:
-          effectiveVideoFormat = NTV2_FORMAT_3840x2160p_6000;
-          break;
-        case NTV2_FORMAT_4x4096x2160p_2398:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_2398;
-          break;
-        case NTV2_FORMAT_4x4096x2160p_2400:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_2400;
-          break;
-        case NTV2_FORMAT_4x4096x2160p_2500:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_2500;
-          break;
-        case NTV2_FORMAT_4x4096x2160p_2997:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_2997;
+  if (mDeliveryRing.Push (delivery))
+    return true;
+
+  // The consumers are more than a ring's worth of frames behind, drop the
+  // newest frame rather than stalling the transfers
+  if (videoBuffer)
+    DiscardVideoBuffer (videoBuffer);
+  if (audioBuffer)
+    DiscardAudioBuffer (audioBuffer);
+
+  return false;
+}
+
+
+void
+NTV2GstAV::ACDeliveryWorker (void)
+{
+  AjaCaptureDelivery delivery;
+
+  while (true) {
+    if (!mDeliveryRing.WaitPop (delivery)) {
+      // Woken up without a frame, only happens when stopping and after
+      // everything queued before was delivered
+      if (mDeliveryQuit)
+        break;
+      continue;
+    }
+
+    if (delivery.lastFrame) {
+      mLastFrameVideoOut = true;
+      mLastFrameAudioOut = true;
+      continue;
+    }
+
+    AjaVideoBuff *pVideoData = delivery.video;
+    AjaAudioBuff *pAudioData = delivery.audio;
+
+    // Audio of a frame whose video was decimated
+    if (!pVideoData && pAudioData) {
+      DoCallback (AUDIO_CALLBACK, pAudioData);
+      continue;
+    }
+
+    // Signal loss
+    if (!pVideoData) {
+      DoCallback (VIDEO_CALLBACK, NULL);
+      DoCallback (AUDIO_CALLBACK, NULL);
+      continue;
+    }
+
+    // The consumers own the buffers once called
+    const bool lastFrame = pVideoData->lastFrame;
+    const uint64_t frameNumber = pVideoData->framesProcessed - 1;
+
+    DoCallback (VIDEO_CALLBACK, pVideoData);
+
+    if (lastFrame) {
+      GST_INFO ("Video out last frame number %" G_GUINT64_FORMAT, frameNumber);
+      mLastFrameVideoOut = true;
+    }
+
+    DoCallback (AUDIO_CALLBACK, pAudioData);
+
+    if (lastFrame) {
+      GST_INFO ("Audio out last frame number %" G_GUINT64_FORMAT, frameNumber);
+      mLastFrameAudioOut = true;
+    }
+  }
+}
+
+
+void
+NTV2GstAV::ACInputWorker (void)
+{
+  ACInputBegin ();
+
+  while (!mGlobalQuit) {
+    if (ACInputPoll (true) == AC_INPUT_DONE)
+      break;
+  }                             // loop til quit signaled
+
+  ACInputEnd ();
+}
+
+
+// Resets the capture state and starts AutoCirculate, either from the AC
+// thread or before handing the channel to the device's scheduler
+void
+NTV2GstAV::ACInputBegin (void)
+{
+  ACInputState & st = mACInputState;
+
+  st.configuredTcIndex = (NTV2TCIndex)-1;
+  st.tcIndex = NTV2_TCINDEX_SDI1;
+  memset (&st.channelStatus, 0, sizeof (st.channelStatus));
+  memset (&st.lastChannelStatus, 0, sizeof (st.lastChannelStatus));
+  st.transferCharacteristics = 3;
+  st.colorimetry = 3;
+  st.fullRange = FALSE;
+  st.inputVideoFormat = NTV2_FORMAT_UNKNOWN;
+
+  st.haveSignal = true;
+  st.iterations_without_frame = 0;
+
+  st.processed_frames = 0;
+  st.dropped_frames = 0;
+  st.skipped_frames = 0;
+  st.decimated_frames = 0;
+  st.last_dropped_frames = 0;
+  st.dropped_frames_now = false;
+
+  // The AutoCirculate status is only queried after waking up from an
+  // interrupt; after a transfer the status returned with it is used instead.
+  // Input format and VPID are only re-read if something changed.
+  st.statusValid = false;
+  st.refreshInput = true;
+  st.lastState = NTV2_AUTOCIRCULATE_INVALID;
+  st.frames_since_refresh = 0;
+
+  // start AutoCirculate running...
+  mDevice->AutoCirculateStart (mInputChannel);
+}
+
+
+void
+NTV2GstAV::ACInputEnd (void)
+{
+  // Stop AutoCirculate...
+  mDevice->AutoCirculateStop (mInputChannel);
+}
+
+
+// One pass of the capture loop: transfers at most one frame, otherwise
+// reports signal loss and, if inWait is set, waits for the next interrupt
+NTV2GstAV::ACInputResult
+NTV2GstAV::ACInputPoll (bool inWait)
+{
+  ACInputState & st = mACInputState;
+
+  if (!st.statusValid) {
+    mDevice->AutoCirculateGetStatus (mInputChannel, st.acStatus);
+    st.statusValid = true;
+  }
+
+  if (st.acStatus.acState != st.lastState) {
+    st.lastState = st.acStatus.acState;
+    st.refreshInput = true;
+  }
+
+  // Update timecode index if it changed since the last frame
+  if (st.configuredTcIndex == (NTV2TCIndex)-1 || st.configuredTcIndex != mTimecodeMode) {
+    st.configuredTcIndex = mTimecodeMode;
+    if (mTimecodeMode == NTV2_TCINDEX_LTC1 || mTimecodeMode == NTV2_TCINDEX_LTC2) {
+      st.tcIndex = mTimecodeMode;
+      mDevice->SetLTCInputEnable (true);
+    } else {
+      switch (mInputChannel) {
+        default:
+        case NTV2_CHANNEL1:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI1_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI1_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI1_2;
           break;
-        case NTV2_FORMAT_4x4096x2160p_3000:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_3000;
+        case NTV2_CHANNEL2:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI2_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI2_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI2_2;
           break;
-        case NTV2_FORMAT_4x4096x2160p_4795:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_4795;
+        case NTV2_CHANNEL3:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI3_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI3_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI3_2;
           break;
-        case NTV2_FORMAT_4x4096x2160p_4800:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_4800;
+        case NTV2_CHANNEL4:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI4_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI4_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI4_2;
           break;
-        case NTV2_FORMAT_4x4096x2160p_5000:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_5000;
+        case NTV2_CHANNEL5:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI5_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI5_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI5_2;
           break;
-        case NTV2_FORMAT_4x4096x2160p_5994:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_5994;
+        case NTV2_CHANNEL6:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI6_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI6_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI6_2;
           break;
-        case NTV2_FORMAT_4x4096x2160p_6000:
-          effectiveVideoFormat = NTV2_FORMAT_4096x2160p_6000;
+        case NTV2_CHANNEL7:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI7_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI7_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI7_2;
           break;
-        default:
+        case NTV2_CHANNEL8:
+          if (mTimecodeMode == NTV2_TCINDEX_SDI1)
+            st.tcIndex = NTV2_TCINDEX_SDI8_LTC;
+          else if (mTimecodeMode == NTV2_TCINDEX_SDI1_LTC)
+            st.tcIndex = NTV2_TCINDEX_SDI8_LTC;
+          else
+            st.tcIndex = NTV2_TCINDEX_SDI8_2;
           break;
       }
     }
+  }
 
-    GST_DEBUG ("Expected video format %08x (effective %08x)", (int) mVideoFormat, (int) effectiveVideoFormat);
+  // One batched register read per pass, anything derived from it is only
+  // decoded again if the raw values changed
+  mDevice->ReadChannelStatus (mInputChannel, mInputSource, st.channelStatus);
+  if (st.channelStatus.inputStatus != st.lastChannelStatus.inputStatus ||
+      st.channelStatus.sdiStatus != st.lastChannelStatus.sdiStatus)
+    st.refreshInput = true;
 
-    haveSignal = (effectiveVideoFormat == inputVideoFormat) || (mVideoFormat == inputVideoFormat);
+  if (st.refreshInput || st.frames_since_refresh >= INPUT_REFRESH_INTERVAL) {
+    st.inputVideoFormat = mDevice->GetInputVideoFormat(mInputSource);
 
-    GST_DEBUG ("Autocirculate state: %d, buffer level %u, frames processed %u, frames dropped %u",
-               acStatus.acState, acStatus.acBufferLevel,
-               acStatus.acFramesProcessed, acStatus.acFramesDropped);
+    GST_DEBUG ("Got input video format %08x and VPIDs %08x / %08x", (int) st.inputVideoFormat,
+        st.channelStatus.vpidA, st.channelStatus.vpidB);
 
-    if (last_dropped_frames != acStatus.acFramesDropped) {
-      if (last_dropped_frames > acStatus.acFramesDropped) {
-        dropped_frames += (G_MAXUINT32 - last_dropped_frames) + acStatus.acFramesDropped;
-      } else {
-        dropped_frames += acStatus.acFramesDropped - last_dropped_frames;
-      }
+    st.haveSignal = st.inputVideoFormat < NTV2_MAX_NUM_VIDEO_FORMATS &&
+        mExpectedFormats.test (st.inputVideoFormat);
+    st.refreshInput = false;
+    st.frames_since_refresh = 0;
+  }
 
-      last_dropped_frames = acStatus.acFramesDropped;
-      dropped_frames_now = true;
-      GST_ERROR ("Dropped frames! Captured %" G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT, processed_frames + 1, dropped_frames);
-    }
+  if (st.channelStatus.vpidA != st.lastChannelStatus.vpidA) {
+    _decode_vpid (st.channelStatus.vpidA, &st.transferCharacteristics,
+        &st.colorimetry, &st.fullRange);
+  }
+  st.lastChannelStatus = st.channelStatus;
 
-    GST_DEBUG ("Overall frames captured %" G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT, processed_frames + 1, dropped_frames);
+  GST_DEBUG ("Autocirculate state: %d, buffer level %u, frames processed %u, frames dropped %u",
+             st.acStatus.acState, st.acStatus.acBufferLevel,
+             st.acStatus.acFramesProcessed, st.acStatus.acFramesDropped);
 
-    // wait for captured frame
-    if (acStatus.acState == NTV2_AUTOCIRCULATE_RUNNING
-        && acStatus.acBufferLevel > 1) {
-      // At this point, there's at least one fully-formed frame available in the device's
-      // frame buffer to transfer to the host. Reserve an AvaDataBuffer to "produce", and
-      // use it in the next transfer from the device...
-      AjaVideoBuff *pVideoData (AcquireVideoBuffer ());
-      GstMapInfo video_map, audio_map;
+  if (st.last_dropped_frames != st.acStatus.acFramesDropped) {
+    if (st.last_dropped_frames > st.acStatus.acFramesDropped) {
+      st.dropped_frames += (G_MAXUINT32 - st.last_dropped_frames) + st.acStatus.acFramesDropped;
+    } else {
+      st.dropped_frames += st.acStatus.acFramesDropped - st.last_dropped_frames;
+    }
 
-      iterations_without_frame = 0;
-      pVideoData->haveSignal = haveSignal;
+    st.last_dropped_frames = st.acStatus.acFramesDropped;
+    st.dropped_frames_now = true;
+    st.refreshInput = true;
+    GST_ERROR ("Dropped frames! Captured %" G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT, st.processed_frames + 1, st.dropped_frames);
+  }
 
-      if (pVideoData->buffer) {
-        gst_buffer_map (pVideoData->buffer, &video_map, GST_MAP_READWRITE);
+  GST_DEBUG ("Overall frames captured %" G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT, st.processed_frames + 1, st.dropped_frames);
+
+  // wait for captured frame
+  if (st.acStatus.acState == NTV2_AUTOCIRCULATE_RUNNING
+      && st.acStatus.acBufferLevel > 1) {
+    // At this point, there's at least one fully-formed frame available in the device's
+    // frame buffer to transfer to the host. Reserve an AvaDataBuffer to "produce", and
+    // use it in the next transfer from the device...
+    st.iterations_without_frame = 0;
+
+    // Frames are counted from the start, so the cadence survives drops. The
+    // first frame always has video, the audio consumers time theirs by it.
+    if (mDecimation > 1 && (st.processed_frames + st.dropped_frames +
+            st.skipped_frames + st.decimated_frames) % mDecimation != 0)
+      return ACInputDecimateFrame (st);
+
+    // Nobody would take the frame, or the delivery thread is a whole ring
+    // behind: rather than transferring it to drop it right after, let
+    // AutoCirculate recycle it and save the PCIe and memory bandwidth
+    if (mDeliveryRing.IsFull () || !CanDeliver ())
+      return ACInputSkipTransfer (st);
+
+    AjaVideoBuff *pVideoData (AcquireVideoBuffer ());
+    GstMapInfo video_map, audio_map;
+
+    if (!pVideoData)
+      return ACInputSkipFrame (st);
+    pVideoData->haveSignal = st.haveSignal;
+
+    if (pVideoData->buffer) {
+      gst_buffer_map (pVideoData->buffer, &video_map, GST_MAP_READWRITE);
 #if ENABLE_NVMM
-        if (pVideoData->isNvmm) {
-          NvBufSurface *surf = (NvBufSurface*)video_map.data;
-          pVideoData->pVideoBuffer = (uint32_t *) surf->surfaceList[0].dataPtr;
-          pVideoData->videoBufferSize = surf->surfaceList[0].dataSize;
-          // Lock the buffer for RDMA
-          mDevice.DMABufferLock(pVideoData->pVideoBuffer, pVideoData->videoBufferSize, false, true);
-        } else
+      if (pVideoData->isNvmm) {
+        NvBufSurface *surf = (NvBufSurface*)video_map.data;
+        pVideoData->pVideoBuffer = (uint32_t *) surf->surfaceList[0].dataPtr;
+        pVideoData->videoBufferSize = surf->surfaceList[0].dataSize;
+        // Locked for RDMA once, the NVMM pool reuses its surfaces
+        mLockRegistry->Lock (gst_buffer_peek_memory (pVideoData->buffer, 0),
+            pVideoData->pVideoBuffer, pVideoData->videoBufferSize, true);
+      } else
 #endif
-        {
-          pVideoData->pVideoBuffer = (uint32_t *) video_map.data;
-          pVideoData->videoBufferSize = video_map.size;
-        }
+      {
+        // Exported memory is mapped elsewhere than where its block is
+        // locked for DMA, the transfer goes to the locked pages
+        guint8 *dma_data = gst_aja_memory_get_dma_data (
+            gst_buffer_peek_memory (pVideoData->buffer, 0));
+
+        // Downstream buffers may be larger than the frame, only the frame
+        // is transferred and handed on
+        pVideoData->pVideoBuffer = (uint32_t *) (dma_data ? dma_data : video_map.data);
+        pVideoData->videoBufferSize = mVideoBufferSize;
+        if (pVideoData->isForeign)
+          mLockRegistry->Lock (gst_buffer_peek_memory (pVideoData->buffer, 0),
+              video_map.data, video_map.size, false);
       }
-      mInputTransferStruct.SetVideoBuffer (pVideoData->pVideoBuffer,
-          pVideoData->videoBufferSize);
+    }
+    mInputTransferStruct.SetVideoBuffer (pVideoData->pVideoBuffer,
+        pVideoData->videoBufferSize);
+    if (mAncBuffer[0] && mAncBuffer[1])
+      mInputTransferStruct.SetAncBuffers ((ULWord *) mAncBuffer[0],
+          NTV2_ANCSIZE_MAX, (ULWord *) mAncBuffer[1], NTV2_ANCSIZE_MAX);
 
-      AjaAudioBuff *pAudioData = AcquireAudioBuffer ();
-      pAudioData->haveSignal = haveSignal;
-      if (pAudioData->buffer) {
-        gst_buffer_map (pAudioData->buffer, &audio_map, GST_MAP_READWRITE);
-        pAudioData->pAudioBuffer = (uint32_t *) audio_map.data;
-        pAudioData->audioBufferSize = audio_map.size;
+    SwapAudioPool ();
+
+    AjaAudioBuff *pAudioData = AcquireAudioBuffer ();
+    if (!pAudioData) {
+      if (pVideoData->buffer) {
+        gst_buffer_unmap (pVideoData->buffer, &video_map);
+        pVideoData->pVideoBuffer = NULL;
       }
-      mInputTransferStruct.SetAudioBuffer (pAudioData->pAudioBuffer,
-          pAudioData->audioBufferSize);
+      DiscardVideoBuffer (pVideoData);
+      return ACInputSkipFrame (st);
+    }
+    pAudioData->haveSignal = st.haveSignal;
+    if (pAudioData->buffer) {
+      gst_buffer_map (pAudioData->buffer, &audio_map, GST_MAP_READWRITE);
+      pAudioData->pAudioBuffer = (uint32_t *) audio_map.data;
+      pAudioData->audioBufferSize = audio_map.size;
+    }
+    mInputTransferStruct.SetAudioBuffer (pAudioData->pAudioBuffer,
+        pAudioData->audioBufferSize);
 
-      // do the transfer from the device into our host AvaDataBuffer...
-      mDevice.AutoCirculateTransfer (mInputChannel, mInputTransferStruct);
+    // do the transfer from the device into our host AvaDataBuffer...
+    bool transferred =
+        mDevice->AutoCirculateTransfer (mInputChannel, mInputTransferStruct);
 
 #if ENABLE_NVMM
-      if (pVideoData->isNvmm) {
-        // Unlock from RDMA
-        mDevice.DMABufferUnlock(pVideoData->pVideoBuffer, pVideoData->videoBufferSize);
-        NvBufSurface *surf = (NvBufSurface*)video_map.data;
-        surf->numFilled = 1;
-      }
+    if (pVideoData->isNvmm) {
+      NvBufSurface *surf = (NvBufSurface*)video_map.data;
+      surf->numFilled = 1;
+    }
 #endif
 
-      // get the video data size
-      pVideoData->videoDataSize = pVideoData->videoBufferSize;
+    if (!transferred) {
+      // No frame after all, give the buffers back and ask the device again
+      GST_WARNING ("AutoCirculate transfer failed");
       if (pVideoData->buffer) {
-        bool validVanc = false;
-        NTV2FrameGeometry currentGeometry;
-        gsize offset = 0;       // Offset in number of lines
-
-        mDevice.GetFrameGeometry (currentGeometry);
-        switch (currentGeometry) {
-          case NTV2_FG_1920x1112:
-            // 32 line offset
-            // FIXME : Remove hardcording once gstntv2 is gstvideoformat aware
-            if (mBitDepth == 8)
-              offset = 32 * 1920 * 2;
-            else
-              offset = 32 * 1920 * 16 / 6;
-            validVanc = true;
-            break;
-          case NTV2_FG_1280x740:
-            // 20 line offset
-            // FIXME : Remove hardcording once gstntv2 is gstvideoformat aware
-            if (mBitDepth == 8)
-              offset = 20 * 1280 * 2;
-            else
-              offset = 20 * 1296 * 16 / 6;
-            validVanc = true;
-            break;
-          default:
-            if (mCaptureTall)
-              GST_ERROR ("UNKNOWN GEOMETRY %u!", currentGeometry);
-            break;
-        }
-        GST_DEBUG ("offset %" G_GSIZE_FORMAT, offset);
-        GST_DEBUG ("videoDataSize %u", pVideoData->videoDataSize);
         gst_buffer_unmap (pVideoData->buffer, &video_map);
-        if (!pVideoData->isNvmm) {
-          gst_buffer_resize (pVideoData->buffer, offset,
-              pVideoData->videoDataSize - offset);
-        }
-        pVideoData->pAncillaryData = validVanc ? pVideoData->pVideoBuffer : NULL;
         pVideoData->pVideoBuffer = NULL;
       }
-      pVideoData->lastFrame = mLastFrame;
-
-      // get the audio data size
-      pAudioData->audioDataSize =
-          mInputTransferStruct.acTransferStatus.acAudioTransferSize;
       if (pAudioData->buffer) {
         gst_buffer_unmap (pAudioData->buffer, &audio_map);
-        gst_buffer_resize (pAudioData->buffer, 0, pAudioData->audioDataSize);
         pAudioData->pAudioBuffer = NULL;
       }
-      pAudioData->lastFrame = mLastFrame;
-
-      // FIXME: this should actually use acAudioClockTimeStamp but
-      // it does not actually seem to be based on a 48kHz clock
-      pVideoData->timeStamp =
-          mInputTransferStruct.acTransferStatus.acFrameStamp.acFrameTime;
-      pAudioData->timeStamp =
-          mInputTransferStruct.acTransferStatus.acFrameStamp.acFrameTime;
-
-      pVideoData->fieldCount =
-          mInputTransferStruct.acTransferStatus.
-          acFrameStamp.acCurrentFieldCount;
-
-      pVideoData->frameNumber = processed_frames + dropped_frames;
-      pAudioData->frameNumber = processed_frames + dropped_frames;
-
-      pVideoData->framesProcessed = processed_frames + 1;
-      pAudioData->framesProcessed = processed_frames + 1;
-      pVideoData->framesDropped = dropped_frames;
-      pAudioData->framesDropped = dropped_frames;
-      pVideoData->droppedChanged = dropped_frames_now;
-      pAudioData->droppedChanged = dropped_frames_now;
-      if (dropped_frames_now) {
-        dropped_frames_now = false;
-      }
+      DiscardVideoBuffer (pVideoData);
+      DiscardAudioBuffer (pAudioData);
+      st.statusValid = false;
+      st.refreshInput = true;
+      return AC_INPUT_AGAIN;
+    }
 
-      pVideoData->timeCodeValid = false;
-      NTV2_RP188 timeCode;
-      if (mInputTransferStruct.acTransferStatus.
-          acFrameStamp.GetInputTimeCode (timeCode, tcIndex) &&
-          (timeCode.fDBB != 0xffffffff || timeCode.fLo != 0xffffffff || timeCode.fHi != 0xffffffff)) {
-        // get the sdi input anc data
-        pVideoData->timeCodeDBB = timeCode.fDBB;
-        pVideoData->timeCodeLow = timeCode.fLo;
-        pVideoData->timeCodeHigh = timeCode.fHi;
-        pVideoData->timeCodeValid = true;
+    // The transfer reports the state after dequeuing this frame, so any
+    // further frames that are already waiting are picked up without
+    // querying the status or waiting for another interrupt
+    st.acStatus.acState = mInputTransferStruct.acTransferStatus.acState;
+    st.acStatus.acBufferLevel = mInputTransferStruct.acTransferStatus.acBufferLevel;
+    st.acStatus.acFramesProcessed = mInputTransferStruct.acTransferStatus.acFramesProcessed;
+    st.acStatus.acFramesDropped = mInputTransferStruct.acTransferStatus.acFramesDropped;
+    st.frames_since_refresh++;
+
+    // get the video data size
+    pVideoData->videoDataSize = pVideoData->videoBufferSize;
+    if (pVideoData->buffer) {
+      bool validVanc = false;
+      gsize offset = 0;       // Offset in number of lines
+
+      switch (st.channelStatus.geometry) {
+        case NTV2_FG_1920x1112:
+          // 32 line offset
+          // FIXME : Remove hardcording once gstntv2 is gstvideoformat aware
+          if (mBitDepth == 8)
+            offset = 32 * 1920 * 2;
+          else
+            offset = 32 * 1920 * 16 / 6;
+          validVanc = true;
+          break;
+        case NTV2_FG_1280x740:
+          // 20 line offset
+          // FIXME : Remove hardcording once gstntv2 is gstvideoformat aware
+          if (mBitDepth == 8)
+            offset = 20 * 1280 * 2;
+          else
+            offset = 20 * 1296 * 16 / 6;
+          validVanc = true;
+          break;
+        default:
+          if (mCaptureTall)
+            GST_ERROR ("UNKNOWN GEOMETRY %u!", st.channelStatus.geometry);
+          break;
       }
-
-      pVideoData->transferCharacteristics = 3;
-      pVideoData->colorimetry = 3;
-      pVideoData->fullRange = FALSE;
-      if (mVideoSource == NTV2_INPUTSOURCE_SDI1 && vpidA != 0) {
-        if (vpidA & 0x80000000) {
-          switch (vpidA >> 24) {
-            case 0x81: // ST 352
-            case 0x82: // ST 352
-            case 0x83: // ST 352
-            case 0x86: // ST 352
-            case 0x84: // ST 292-1
-            case 0x8B: // ST 425-1
-            case 0x8D: // ST 425-1
-            case 0xB1: // ST 292-2
-            case 0x8E: // ST 425-2
-            case 0x8F: // ST 425-2
-            case 0x90: // ST 435-1
-            case 0x91: // ST 425-4
-            case 0x92: // ST 425-4
-            case 0x93: // ST 425-4
-            case 0xA0: // ST 435-1
-            case 0xB0: // ST 2047-2
-            case 0xB2: // ST 2047-4
-            case 0xB3: // ST 2048-3
-            case 0xB4: // RDD 22
-            case 0xB5: // RDD 22
-              // No colorimetry/transfer/range information
-              break;
-            case 0x85: // ST 292-1
-            case 0x8C: // ST 425-1
-            {
-              guint colorimetry = (vpidA >> 12) & 0x09;
-
-              pVideoData->transferCharacteristics = (vpidA >> 20) & 0x03;
-              if (colorimetry == 0x00)
-                pVideoData->colorimetry = 0;
-              else if (colorimetry == 0x01)
-                pVideoData->colorimetry = 1;
-              else if (colorimetry == 0x08)
-                pVideoData->colorimetry = 2;
-              else if (colorimetry == 0x09)
-                pVideoData->colorimetry = 3;
-
-              pVideoData->fullRange = (vpidA & 0x02) == 0x02;
-              break;
-            }
-              break;
-            case 0x87: // ST 372
-            case 0x8A: // ST 425-1
-            case 0x95: // ST 425-3
-            case 0x96: // ST 425-3
-            case 0x98: // ST 425-5
-            case 0x9A: // ST 425-6
-            case 0x9B: // ST 425-6
-            {
-              guint colorimetry = (vpidA >> 12) & 0x09;
-
-              pVideoData->transferCharacteristics = (vpidA >> 20) & 0x03;
-              if (colorimetry == 0x00)
-                pVideoData->colorimetry = 0;
-              else if (colorimetry == 0x01)
-                pVideoData->colorimetry = 1;
-              else if (colorimetry == 0x08)
-                pVideoData->colorimetry = 2;
-              else if (colorimetry == 0x09)
-                pVideoData->colorimetry = 3;
-
-              pVideoData->fullRange = (vpidA & 0x03) == 0x00 || (vpidA & 0x03) == 0x03;
-              break;
-            }
-            case 0x88: // ST 425-1
-            case 0x89: // ST 425-1
-            case 0x94: // ST 425-3
-            case 0x97: // ST 425-5
-            case 0x99: // ST 425-6
-            case 0xC0: // ST 2081-10
-            case 0xC2: // ST 2081-11
-            case 0xF3: // ST 2081-11
-            case 0xC4: // ST 2081-12
-            case 0xC5: // ST 2081-12
-            case 0xCE: // ST 2082-10
-            case 0xCF: // ST 2082-10
-            case 0xD0: // ST 2082-11
-            case 0xD1: // ST 2082-11
-            case 0xD2: // ST 2082-12
-            case 0xD3: // ST 2082-12
-              pVideoData->transferCharacteristics = (vpidA >> 20) & 0x03;
-              pVideoData->colorimetry = (vpidA >> 12) & 0x03;
-              pVideoData->fullRange = (vpidA & 0x03) == 0x00 || (vpidA & 0x03) == 0x03;
-              break;
-            case 0xA1: // ST 2036-3
-            case 0xA2: // ST 2036-3
-            case 0xA5: // ST 2036-4
-            case 0xA6: // ST 2036-4
-            case 0xC1: // ST 2081-10
-              pVideoData->transferCharacteristics = (vpidA >> 20) & 0x03;
-              pVideoData->colorimetry = 3;
-              pVideoData->fullRange = (vpidA & 0x03) == 0x00 || (vpidA & 0x03) == 0x03;
-              break;
-            default:
-              break;
-          }
-        } else {
-          // Historical payload identifiers
-          pVideoData->transferCharacteristics = 3;
-          pVideoData->colorimetry = 3;
-          pVideoData->fullRange = FALSE;
-        }
+      GST_DEBUG ("offset %" G_GSIZE_FORMAT, offset);
+      GST_DEBUG ("videoDataSize %u", pVideoData->videoDataSize);
+      gst_buffer_unmap (pVideoData->buffer, &video_map);
+      if (!pVideoData->isNvmm) {
+        gst_buffer_resize (pVideoData->buffer, offset,
+            pVideoData->videoDataSize - offset);
       }
+      pVideoData->pAncillaryData = validVanc ? pVideoData->pVideoBuffer : NULL;
+      pVideoData->pVideoBuffer = NULL;
 
-      if (pVideoData->lastFrame && !mLastFrameInput) {
-        GST_INFO ("Capture last frame number %" G_GUINT64_FORMAT, processed_frames);
-        mLastFrameInput = true;
-      }
+      if (mAncBuffer[0] && mAncBuffer[1])
+        AttachAncillaryData (pVideoData);
+    }
+    pVideoData->lastFrame = mLastFrame;
+
+    // get the audio data size
+    pAudioData->audioDataSize =
+        mInputTransferStruct.acTransferStatus.acAudioTransferSize;
+    if (pAudioData->buffer) {
+      gst_buffer_unmap (pAudioData->buffer, &audio_map);
+      gst_buffer_resize (pAudioData->buffer, 0, pAudioData->audioDataSize);
+      pAudioData->pAudioBuffer = NULL;
+    }
+    pAudioData->lastFrame = mLastFrame;
+
+    // FIXME: this should actually use acAudioClockTimeStamp but
+    // it does not actually seem to be based on a 48kHz clock
+    pVideoData->timeStamp =
+        mInputTransferStruct.acTransferStatus.acFrameStamp.acFrameTime;
+    pAudioData->timeStamp =
+        mInputTransferStruct.acTransferStatus.acFrameStamp.acFrameTime;
+
+    pVideoData->fieldCount =
+        mInputTransferStruct.acTransferStatus.
+        acFrameStamp.acCurrentFieldCount;
+
+    pVideoData->frameNumber = st.processed_frames + st.dropped_frames +
+        st.skipped_frames + st.decimated_frames;
+    pAudioData->frameNumber = pVideoData->frameNumber;
+
+    pVideoData->framesProcessed = st.processed_frames + 1;
+    pAudioData->framesProcessed = st.processed_frames + 1;
+    pVideoData->framesDropped = st.dropped_frames;
+    pAudioData->framesDropped = st.dropped_frames;
+    pVideoData->framesSkipped = st.skipped_frames;
+    pAudioData->framesSkipped = st.skipped_frames;
+    pVideoData->droppedChanged = st.dropped_frames_now;
+    pAudioData->droppedChanged = st.dropped_frames_now;
+    if (st.dropped_frames_now) {
+      st.dropped_frames_now = false;
+    }
+
+    pVideoData->timeCodeValid = false;
+    NTV2_RP188 timeCode;
+    if (mInputTransferStruct.acTransferStatus.
+        acFrameStamp.GetInputTimeCode (timeCode, st.tcIndex) &&
+        (timeCode.fDBB != 0xffffffff || timeCode.fLo != 0xffffffff || timeCode.fHi != 0xffffffff)) {
+      // get the sdi input anc data
+      pVideoData->timeCodeDBB = timeCode.fDBB;
+      pVideoData->timeCodeLow = timeCode.fLo;
+      pVideoData->timeCodeHigh = timeCode.fHi;
+      pVideoData->timeCodeValid = true;
+    }
 
-      processed_frames++;
+    pVideoData->transferCharacteristics = 3;
+    pVideoData->colorimetry = 3;
+    pVideoData->fullRange = FALSE;
+    if (mVideoSource == NTV2_INPUTSOURCE_SDI1 && st.channelStatus.vpidA != 0) {
+      pVideoData->transferCharacteristics = st.transferCharacteristics;
+      pVideoData->colorimetry = st.colorimetry;
+      pVideoData->fullRange = st.fullRange;
+    }
 
-      // Possible callbacks are not setup yet so make sure we release the buffer if
-      // no one is there to catch them
-      if (!DoCallback (VIDEO_CALLBACK, pVideoData))
-        ReleaseVideoBuffer (pVideoData);
+    if (pVideoData->lastFrame && !mLastFrameInput) {
+      GST_INFO ("Capture last frame number %" G_GUINT64_FORMAT, st.processed_frames);
+      mLastFrameInput = true;
+    }
 
-      if (pVideoData->lastFrame) {
-        GST_INFO ("Video out last frame number %" G_GUINT64_FORMAT, processed_frames);
-        mLastFrameVideoOut = true;
-      }
+    st.processed_frames++;
 
-      // Possible callbacks are not setup yet so make sure we release the buffer if
-      // no one is there to catch them
-      if (!DoCallback (AUDIO_CALLBACK, pAudioData))
-        ReleaseAudioBuffer (pAudioData);
+    if (pVideoData->shmSlot >= 0)
+      PublishFrame (pVideoData, pAudioData);
 
-      if (pAudioData->lastFrame) {
-        GST_INFO ("Audio out last frame number %" G_GUINT64_FORMAT, processed_frames);
-        mLastFrameAudioOut = true;
-      }
+    // The callbacks run on the delivery thread. If it fell behind by a
+    // whole ring the frame is lost, count it like a frame dropped by the
+    // driver so the consumers see the gap
+    if (!QueueDelivery (pVideoData, pAudioData)) {
+      st.processed_frames--;
+      st.dropped_frames++;
+      st.dropped_frames_now = true;
+      GST_WARNING ("Delivery queue full, dropped frame. Captured %" G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT, st.processed_frames, st.dropped_frames);
+    }
+
+    if (mCopyOutThread &&
+        (gst_aja_buffer_pool_get_free (mVideoBufferPool) < mCopyOutWatermark ||
+            gst_aja_buffer_pool_get_free (mAudioBufferPool) < mCopyOutWatermark))
+      WakeCopyOut ();
+
+    return AC_INPUT_AGAIN;
+  } else {
+    // Either AutoCirculate is not running, or there were no frames available on the device to transfer.
+    // Rather than waste CPU cycles spinning, waiting until a frame becomes available, it's far more
+    // efficient to wait for the next input vertical interrupt event to get signaled...
+    if (mLastFrame) {
+      // Delivered after all frames that are still queued. With the ring
+      // full the marker stays pending and is queued again by the next
+      // poll, a scheduler thread must not wait here for the other channels.
+      if (QueueDelivery (NULL, NULL, true) || mGlobalQuit)
+        return AC_INPUT_DONE;
+      if (inWait)
+        AJATime::Sleep (1);
+      return AC_INPUT_IDLE;
+    }
+
+    // If we don't have a frame for 32 interrupts then consider this as
+    // signal loss too even if the driver still reports the expected mode
+    // above
+    if (!st.haveSignal || st.iterations_without_frame >= 32)
+      QueueDelivery (NULL, NULL);
+
+    // Without signal the wait times out in the driver, otherwise it returns
+    // as soon as the next frame is complete, including the first frame after
+    // the signal came back. The scheduler doesn't wait, it polls every
+    // channel once per period of its own frame rate.
+    if (!inWait || mDevice->WaitForInputVerticalInterrupt (mInputChannel)) {
+      // One interrupt without a frame is normal for interlaced formats,
+      // more than that means the input is likely not what we expect
+      if (++st.iterations_without_frame > 2)
+        st.refreshInput = true;
     } else {
-      // Either AutoCirculate is not running, or there were no frames available on the device to transfer.
-      // Rather than waste CPU cycles spinning, waiting until a frame becomes available, it's far more
-      // efficient to wait for the next input vertical interrupt event to get signaled...
-      if (mLastFrame) {
-          mLastFrameVideoOut = true;
-          mLastFrameAudioOut = true;
-          break;
-      } else {
-        // If we don't have a frame for 32 iterations (512ms) then consider
-        // this as signal loss too even if the driver still reports the
-        // expected mode above
-        if (haveSignal && iterations_without_frame < 32) {
-          mDevice.WaitForInputVerticalInterrupt (mInputChannel);
-          iterations_without_frame++;
-        } else {
-          DoCallback (VIDEO_CALLBACK, NULL);
-          DoCallback (AUDIO_CALLBACK, NULL);
-          // Short enough to not miss any frames at 60fps / 16.667ms per frame
-          g_usleep (16000);
-        }
-      }
+      st.refreshInput = true;
     }
-  }                             // loop til quit signaled
+    st.statusValid = false;
 
-  // Stop AutoCirculate...
-  mDevice.AutoCirculateStop (mInputChannel);
+    return AC_INPUT_IDLE;
+  }
+}
+
+// The device's frame is transferred nowhere, only so that AutoCirculate
+// moves on and doesn't drop frames on its own later
+NTV2GstAV::ACInputResult
+NTV2GstAV::ACInputSkipFrame (ACInputState & st)
+{
+  mInputTransferStruct.SetVideoBuffer (NULL, 0);
+  mInputTransferStruct.SetAudioBuffer (NULL, 0);
+  mInputTransferStruct.SetAncBuffers (NULL, 0, NULL, 0);
+  mDevice->AutoCirculateTransfer (mInputChannel, mInputTransferStruct);
+
+  st.dropped_frames++;
+  st.dropped_frames_now = true;
+  st.statusValid = false;
+  GST_WARNING ("No free DMA buffer, dropped frame. Captured %" G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT, st.processed_frames, st.dropped_frames);
+
+  WakeCopyOut ();
+
+  return AC_INPUT_AGAIN;
+}
+
+// Like ACInputSkipFrame, but the consumers wouldn't have taken the frame
+// anyway. They still see the gap in the frame numbers and a discontinuity.
+NTV2GstAV::ACInputResult
+NTV2GstAV::ACInputSkipTransfer (ACInputState & st)
+{
+  mInputTransferStruct.SetVideoBuffer (NULL, 0);
+  mInputTransferStruct.SetAudioBuffer (NULL, 0);
+  mInputTransferStruct.SetAncBuffers (NULL, 0, NULL, 0);
+  mDevice->AutoCirculateTransfer (mInputChannel, mInputTransferStruct);
+
+  st.skipped_frames++;
+  st.dropped_frames_now = true;
+  st.statusValid = false;
+  GST_DEBUG ("Consumers full, skipped frame. Captured %" G_GUINT64_FORMAT " skipped %" G_GUINT64_FORMAT, st.processed_frames, st.skipped_frames);
+
+  return AC_INPUT_AGAIN;
+}
+
+
+NTV2GstAV::ACInputResult
+NTV2GstAV::ACInputDecimateFrame (ACInputState & st)
+{
+  AjaAudioBuff *pAudioData = NULL;
+  GstMapInfo audio_map;
+
+  const NTV2GstConsumers *consumers = AcquireConsumers ();
+  const bool wantAudio = consumers && consumers->numAudio > 0;
+  ReleaseConsumers ();
+  const bool behind = mDeliveryRing.IsFull ();
+
+  if (wantAudio && !behind) {
+    SwapAudioPool ();
+    pAudioData = AcquireAudioBuffer ();
+  }
+
+  mInputTransferStruct.SetVideoBuffer (NULL, 0);
+  mInputTransferStruct.SetAncBuffers (NULL, 0, NULL, 0);
+  if (pAudioData && pAudioData->buffer) {
+    gst_buffer_map (pAudioData->buffer, &audio_map, GST_MAP_READWRITE);
+    pAudioData->pAudioBuffer = (uint32_t *) audio_map.data;
+    pAudioData->audioBufferSize = audio_map.size;
+  }
+  if (pAudioData)
+    mInputTransferStruct.SetAudioBuffer (pAudioData->pAudioBuffer,
+        pAudioData->audioBufferSize);
+  else
+    mInputTransferStruct.SetAudioBuffer (NULL, 0);
+
+  const bool transferred =
+      mDevice->AutoCirculateTransfer (mInputChannel, mInputTransferStruct);
+  st.statusValid = false;
+
+  if (!pAudioData) {
+    if (transferred && wantAudio) {
+      // The audio consumers see the gap like that of a dropped frame
+      st.dropped_frames++;
+      st.dropped_frames_now = true;
+      GST_WARNING ("%s, dropped audio of decimated frame. Captured %"
+          G_GUINT64_FORMAT " dropped %" G_GUINT64_FORMAT,
+          behind ? "Delivery thread behind" : "No free audio buffer",
+          st.processed_frames, st.dropped_frames);
+      if (!behind)
+        WakeCopyOut ();
+    } else if (transferred) {
+      st.decimated_frames++;
+    }
+    return AC_INPUT_AGAIN;
+  }
+
+  if (pAudioData->buffer) {
+    gst_buffer_unmap (pAudioData->buffer, &audio_map);
+    pAudioData->pAudioBuffer = NULL;
+  }
+
+  if (!transferred) {
+    GST_WARNING ("AutoCirculate audio transfer failed");
+    DiscardAudioBuffer (pAudioData);
+    st.refreshInput = true;
+    return AC_INPUT_AGAIN;
+  }
+
+  pAudioData->audioDataSize =
+      mInputTransferStruct.acTransferStatus.acAudioTransferSize;
+  if (pAudioData->buffer)
+    gst_buffer_resize (pAudioData->buffer, 0, pAudioData->audioDataSize);
+  pAudioData->haveSignal = st.haveSignal;
+  pAudioData->lastFrame = false;
+  pAudioData->timeStamp =
+      mInputTransferStruct.acTransferStatus.acFrameStamp.acFrameTime;
+  pAudioData->frameNumber = st.processed_frames + st.dropped_frames +
+      st.skipped_frames + st.decimated_frames;
+  pAudioData->framesProcessed = st.processed_frames + 1;
+  pAudioData->framesDropped = st.dropped_frames;
+  pAudioData->framesSkipped = st.skipped_frames;
+  // Reported with the next frame that has video, for both
+  pAudioData->droppedChanged = false;
+
+  st.decimated_frames++;
+  QueueDelivery (NULL, pAudioData);
+
+  return AC_INPUT_AGAIN;
+}
+
+
+void
+NTV2GstAV::SetScheduler (NTV2GstScheduler * scheduler)
+{
+  mScheduler = scheduler;
+}
+
+
+void
+NTV2GstAV::SetArena (NTV2GstArena * arena)
+{
+  if (mArena && mArena != arena)
+    mArena->ReleaseDevice (mDevice);
+  mArena = arena;
 }
 
+
+void
+NTV2GstAV::SetRealtimeProfile (const NTV2GstRealtimeProfile & profile)
+{
+  mRealtimeProfile = profile;
+}
+
+
 void
-NTV2GstAV::SetCallback (CallBackType cbType, NTV2Callback callback,
+NTV2GstAV::SetHugePageSize (size_t hugePageSize)
+{
+  mHugePageSize = hugePageSize;
+}
+
+
+void
+NTV2GstAV::SetPoolSizes (uint32_t videoPoolSize, uint32_t audioPoolSize,
+    uint32_t queueSize)
+{
+  mVideoPoolSize = videoPoolSize;
+  mAudioPoolSize = audioPoolSize;
+  mQueueSize = queueSize;
+}
+
+
+void
+NTV2GstAV::SetExhaustionPolicy (NTV2GstExhaustionPolicy inPolicy,
+    uint32_t inWatermark)
+{
+  mExhaustionPolicy = inPolicy;
+  mCopyOutWatermark = inWatermark;
+}
+
+
+void
+NTV2GstAV::SetExportMode (NTV2GstExportMode inMode)
+{
+  mExportMode = inMode;
+}
+
+
+void
+NTV2GstAV::SetDecimation (uint32_t inDecimation)
+{
+  mDecimation = inDecimation > 0 ? inDecimation : 1;
+}
+
+
+// Only a few packets per field, parsed straight from the DMA buffers rather
+// than passing the buffers along with the frame
+void
+NTV2GstAV::AttachAncillaryData (AjaVideoBuff * videoBuffer)
+{
+  const bool interlaced = !::IsProgressivePicture (mVideoFormat);
+  const ULWord f1Size = MIN (NTV2_ANCSIZE_MAX,
+      mInputTransferStruct.acTransferStatus.acAncTransferSize);
+  const ULWord f2Size = MIN (NTV2_ANCSIZE_MAX,
+      mInputTransferStruct.acTransferStatus.acAncField2TransferSize);
+  uint32_t packets;
+
+  packets = NTV2GstAncAttach (videoBuffer->buffer, mAncBuffer[0], f1Size,
+      interlaced ? 1 : 0);
+  if (interlaced)
+    packets += NTV2GstAncAttach (videoBuffer->buffer, mAncBuffer[1], f2Size, 2);
+
+  GST_LOG ("%u ANC packets in %u + %u bytes", packets, f1Size, f2Size);
+}
+
+
+bool
+NTV2GstAV::SetCrop (uint32_t inX, uint32_t inY, uint32_t inWidth,
+    uint32_t inHeight)
+{
+  NTV2FormatDescriptor fd (mVideoFormat, mPixelFormat, NTV2_VANCMODE_OFF);
+  const uint32_t width = ::GetDisplayWidth (mVideoFormat);
+  const uint32_t height = ::GetDisplayHeight (mVideoFormat);
+  uint32_t xBytes, activeBytes, hostBytes;
+
+  mCropRows = 0;
+  if (inWidth == 0)
+    return true;
+
+  if (mUseNvmm || mCaptureTall || !mPublishName.empty ()) {
+    GST_WARNING ("Can't crop NVMM, tall VANC or published video");
+    return false;
+  }
+  if (inHeight == 0 || inX + inWidth > width || inY + inHeight > height) {
+    GST_WARNING ("Crop %ux%u at %u,%u is not inside the picture of %ux%u",
+        inWidth, inHeight, inX, inY, width, height);
+    return false;
+  }
+
+  switch (mPixelFormat) {
+    case NTV2_FBF_10BIT_YCBCR:
+      // v210, 16 bytes per 6 pixels and lines padded to 128 bytes
+      if (inX % 6 != 0) {
+        GST_WARNING ("v210 crop x must be a multiple of 6, not %u", inX);
+        return false;
+      }
+      if (inWidth % 2 != 0) {
+        GST_WARNING ("v210 crop width must be even, not %u", inWidth);
+        return false;
+      }
+      xBytes = inX / 6 * 16;
+      activeBytes = (inWidth + 5) / 6 * 16;
+      hostBytes = (inWidth + 47) / 48 * 128;
+      break;
+    case NTV2_FBF_8BIT_YCBCR:
+      if (inX % 2 != 0 || inWidth % 2 != 0) {
+        GST_WARNING ("UYVY crop must start at and span even pixels");
+        return false;
+      }
+      xBytes = inX * 2;
+      activeBytes = hostBytes = inWidth * 2;
+      break;
+    case NTV2_FBF_ABGR:
+      xBytes = inX * 4;
+      activeBytes = hostBytes = inWidth * 4;
+      break;
+    default:
+      GST_WARNING ("Can't crop pixel format %d", (int) mPixelFormat);
+      return false;
+  }
+
+  // The last group of v210 may reach into the padding, never past the line
+  if (xBytes + activeBytes > fd.GetBytesPerRow ()) {
+    GST_WARNING ("Crop %ux%u at %u,%u reaches past the lines of the device",
+        inWidth, inHeight, inX, inY);
+    return false;
+  }
+
+  mCropRows = inHeight;
+  mCropActiveBytes = activeBytes;
+  mCropHostBytes = hostBytes;
+  mCropDeviceBytes = fd.GetBytesPerRow ();
+  mCropOffset = inY * mCropDeviceBytes + xBytes;
+
+  GST_INFO ("Transferring %u lines of %u bytes at offset %u, %u%% of the "
+      "picture", mCropRows, mCropActiveBytes, mCropOffset,
+      (guint) ((guint64) mCropRows * mCropActiveBytes * 100 /
+          ((guint64) height * mCropDeviceBytes)));
+
+  return true;
+}
+
+
+void
+NTV2GstAV::SetPublisher (const std::string & inName, uint32_t inNumSlots)
+{
+  mPublishName = inName;
+  mPublishSlots = inNumSlots;
+}
+
+
+void
+NTV2GstAV::SetPublishedCaps (const std::string & inCaps)
+{
+  mPoolLock.Lock ();
+  mPublishCaps = inCaps;
+  if (mShmRing)
+    mShmRing->SetCaps (mPublishCaps.c_str (), GetCapturedAudioChannels ());
+  mPoolLock.Unlock ();
+}
+
+
+void
+NTV2GstAV::AddCallback (CallBackType cbType, NTV2Callback callback,
+    void *callbackRefcon, const gint * room)
+{
+  NTV2GstCallback cb;
+
+  cb.callback = callback;
+  cb.room = room;
+  cb.refcon = callbackRefcon;
+
+  mCallbackLock.Lock ();
+  if (cbType == VIDEO_CALLBACK)
+    mVideoCallbacks.push_back (cb);
+  else if (cbType == AUDIO_CALLBACK)
+    mAudioCallbacks.push_back (cb);
+  PublishConsumers ();
+  mCallbackLock.Unlock ();
+}
+
+
+void
+NTV2GstAV::RemoveCallback (CallBackType cbType, NTV2Callback callback,
     void *callbackRefcon)
 {
-  if (cbType == VIDEO_CALLBACK) {
-    mVideoCallback = callback;
-    mVideoCallbackRefcon = callbackRefcon;
-  } else if (cbType == AUDIO_CALLBACK) {
-    mAudioCallback = callback;
-    mAudioCallbackRefcon = callbackRefcon;
+  mCallbackLock.Lock ();
+  std::vector < NTV2GstCallback > &callbacks =
+      cbType == VIDEO_CALLBACK ? mVideoCallbacks : mAudioCallbacks;
+  for (size_t i = 0; i < callbacks.size (); i++) {
+    if (callbacks[i].callback == callback &&
+        callbacks[i].refcon == callbackRefcon) {
+      callbacks.erase (callbacks.begin () + i);
+      break;
+    }
+  }
+  PublishConsumers ();
+  mCallbackLock.Unlock ();
+}
+
+
+// Once this returns the capture thread doesn't look at the consumers that
+// were removed anymore
+void
+NTV2GstAV::PublishConsumers (void)
+{
+  NTV2GstConsumers *consumers = new NTV2GstConsumers;
+
+  for (size_t i = 0; i < mVideoCallbacks.size (); i++)
+    consumers->rooms.push_back (mVideoCallbacks[i].room);
+  for (size_t i = 0; i < mAudioCallbacks.size (); i++)
+    consumers->rooms.push_back (mAudioCallbacks[i].room);
+  consumers->numAudio = (uint32_t) mAudioCallbacks.size ();
+
+  consumers = mConsumers.exchange (consumers, std::memory_order_seq_cst);
+
+  // Readers only hold on to it for a few loads
+  while (mConsumersReaders.load (std::memory_order_seq_cst) != 0)
+    AJATime::Sleep (1);
+  delete consumers;
+}
+
+
+const NTV2GstConsumers *
+NTV2GstAV::AcquireConsumers (void)
+{
+  mConsumersReaders.fetch_add (1, std::memory_order_seq_cst);
+  return mConsumers.load (std::memory_order_seq_cst);
+}
+
+
+void
+NTV2GstAV::ReleaseConsumers (void)
+{
+  mConsumersReaders.fetch_sub (1, std::memory_order_release);
+}
+
+
+// The consumers publish their room themselves, so the capture thread neither
+// takes a lock nor calls into them here
+bool
+NTV2GstAV::CanDeliver (void)
+{
+  bool ready = false;
+
+  // Frames are published to other processes too, their readers are asked
+  // by the ring itself
+  if (mShmRing)
+    return true;
+
+  const NTV2GstConsumers *consumers = AcquireConsumers ();
+  const bool none = !consumers || consumers->rooms.empty ();
+  for (size_t i = 0; !none && !ready && i < consumers->rooms.size (); i++)
+    ready = !consumers->rooms[i] || g_atomic_int_get (consumers->rooms[i]) > 0;
+  ReleaseConsumers ();
+
+  // Without any consumer the frame is transferred as it always was, and
+  // released right away
+  return ready || none;
+}
+
+
+uint32_t
+NTV2GstAV::GetNumCallbacks (CallBackType cbType)
+{
+  mCallbackLock.Lock ();
+  const uint32_t num = (uint32_t) (cbType == VIDEO_CALLBACK ?
+      mVideoCallbacks.size () : mAudioCallbacks.size ());
+  mCallbackLock.Unlock ();
+
+  return num;
+}
+
+void
+NTV2GstAV::SetDownstreamPool (GstBufferPool * pool)
+{
+  if (pool)
+    gst_object_ref (pool);
+
+  mPoolLock.Lock ();
+  std::swap (pool, mDownstreamPool);
+  mPoolLock.Unlock ();
+
+  if (pool)
+    gst_object_unref (pool);
+}
+
+
+// A buffer of the downstream pool if one is free and the whole frame fits
+// into its one sysmem memory, NULL otherwise
+GstBuffer *
+NTV2GstAV::AcquireDownstreamBuffer (void)
+{
+  GstBufferPoolAcquireParams params = GstBufferPoolAcquireParams ();
+  GstBufferPool *pool = NULL;
+  GstBuffer *buffer = NULL;
+
+  mPoolLock.Lock ();
+  if (mDownstreamPool)
+    pool = (GstBufferPool *) gst_object_ref (mDownstreamPool);
+  mPoolLock.Unlock ();
+
+  if (!pool)
+    return NULL;
+
+  // Never wait for downstream, our own pool is there for that
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+  if (gst_buffer_pool_acquire_buffer (pool, &buffer, &params) != GST_FLOW_OK)
+    buffer = NULL;
+  gst_object_unref (pool);
+
+  if (!buffer)
+    return NULL;
+
+  // Memory the DMA can't write to won't change with the next buffer
+  if (gst_buffer_n_memory (buffer) != 1 ||
+      !gst_memory_is_type (gst_buffer_peek_memory (buffer, 0),
+          GST_ALLOCATOR_SYSMEM)) {
+    GST_INFO ("Downstream pool has no system memory buffers, capturing into "
+        "my own pool");
+    gst_buffer_unref (buffer);
+    SetDownstreamPool (NULL);
+    return NULL;
+  }
+
+  // Still sized for the previous format
+  if (gst_buffer_get_size (buffer) < mVideoBufferSize) {
+    GST_DEBUG ("Downstream buffer of %" G_GSIZE_FORMAT " bytes too small for %u",
+        gst_buffer_get_size (buffer), mVideoBufferSize);
+    gst_buffer_unref (buffer);
+    return NULL;
   }
+
+  return buffer;
+}
+
+
+// What a buffer wrapping a slot of the published ring releases when freed
+typedef struct
+{
+  NTV2GstShmRing *ring;
+  int32_t slot;
+} PublishedSlot;
+
+static void
+_published_slot_release (gpointer data)
+{
+  PublishedSlot *published = (PublishedSlot *) data;
+
+  published->ring->ReleaseSlot (published->slot);
+  published->ring->Unref ();
+  delete published;
+}
+
+
+GstBuffer *
+NTV2GstAV::AcquirePublishedBuffer (int32_t & outSlot)
+{
+  uint8_t *data = NULL;
+
+  if (!mShmRing)
+    return NULL;
+
+  const int32_t slot = mShmRing->AcquireSlot (data);
+  if (slot < 0) {
+    GST_LOG ("All %u slots of ring '%s' held, not publishing this frame",
+        mShmRing->GetNumSlots (), mPublishName.c_str ());
+    return NULL;
+  }
+
+  PublishedSlot *published = new PublishedSlot;
+  published->ring = mShmRing;
+  published->slot = slot;
+  mShmRing->Ref ();
+  outSlot = slot;
+
+  return gst_buffer_new_wrapped_full ((GstMemoryFlags) 0, data,
+      mShmRing->GetVideoSize (), 0, mShmRing->GetVideoSize (), published,
+      _published_slot_release);
 }
 
+
+void
+NTV2GstAV::PublishFrame (AjaVideoBuff * videoBuffer, AjaAudioBuff * audioBuffer)
+{
+  NTV2GstShmFrame frame = NTV2GstShmFrame ();
+  GstMapInfo audio_map;
+  gsize offset = 0;
+
+  frame.frameNumber = videoBuffer->frameNumber;
+  frame.captureTime = (uint64_t) g_get_monotonic_time () * 1000;
+  frame.deviceTime = videoBuffer->timeStamp;
+  frame.framesProcessed = videoBuffer->framesProcessed;
+  frame.framesDropped = videoBuffer->framesDropped;
+  frame.videoSize = (uint32_t) gst_buffer_get_sizes (videoBuffer->buffer,
+      &offset, NULL);
+  frame.videoOffset = (uint32_t) offset;
+  frame.timeCodeDBB = videoBuffer->timeCodeDBB;
+  frame.timeCodeLow = videoBuffer->timeCodeLow;
+  frame.timeCodeHigh = videoBuffer->timeCodeHigh;
+  frame.timeCodeValid = videoBuffer->timeCodeValid;
+  frame.fieldCount = videoBuffer->fieldCount;
+  frame.haveSignal = videoBuffer->haveSignal;
+  frame.transferCharacteristics = videoBuffer->transferCharacteristics;
+  frame.colorimetry = videoBuffer->colorimetry;
+  frame.fullRange = videoBuffer->fullRange;
+
+  // Audio is small next to the video, readers get their own copy of it
+  if (audioBuffer->buffer &&
+      gst_buffer_map (audioBuffer->buffer, &audio_map, GST_MAP_READ)) {
+    mShmRing->Publish (videoBuffer->shmSlot, frame, audio_map.data,
+        audio_map.size);
+    gst_buffer_unmap (audioBuffer->buffer, &audio_map);
+  } else {
+    mShmRing->Publish (videoBuffer->shmSlot, frame, NULL, 0);
+  }
+}
+
+
 AjaVideoBuff *
 NTV2GstAV::AcquireVideoBuffer ()
 {
   GstBuffer *buffer;
   AjaVideoBuff *videoBuff;
 
+  // The ring is locked for DMA as a whole, not per buffer
+  int32_t slot;
+  buffer = AcquirePublishedBuffer (slot);
+  if (buffer) {
+    videoBuff = gst_aja_buffer_ensure_video_buff (buffer);
+    videoBuff->isForeign = false;
+    videoBuff->shmSlot = slot;
+    return videoBuff;
+  }
+
+  buffer = AcquireDownstreamBuffer ();
+  if (buffer)
+    return gst_aja_buffer_ensure_video_buff (buffer);
+
+  // Out of buffers, maybe only because no streaming thread came by to free
+  // the ones the delivery thread dropped
   if (gst_buffer_pool_acquire_buffer (mVideoBufferPool, &buffer,
-          NULL) != GST_FLOW_OK)
-    return NULL;
+          NULL) != GST_FLOW_OK) {
+    ReclaimBuffers ();
+    if (gst_buffer_pool_acquire_buffer (mVideoBufferPool, &buffer,
+            NULL) != GST_FLOW_OK)
+      return NULL;
+  }
 
   videoBuff = gst_aja_buffer_get_video_buff (buffer);
   return videoBuff;
@@ -1881,8 +3114,12 @@ NTV2GstAV::AcquireAudioBuffer ()
   AjaAudioBuff *audioBuff;
 
   if (gst_buffer_pool_acquire_buffer (mAudioBufferPool, &buffer,
-          NULL) != GST_FLOW_OK)
-    return NULL;
+          NULL) != GST_FLOW_OK) {
+    ReclaimBuffers ();
+    if (gst_buffer_pool_acquire_buffer (mAudioBufferPool, &buffer,
+            NULL) != GST_FLOW_OK)
+      return NULL;
+  }
 
   audioBuff = gst_aja_buffer_get_audio_buff (buffer);
   return audioBuff;
@@ -1891,6 +3128,41 @@ NTV2GstAV::AcquireAudioBuffer ()
 
 void
 NTV2GstAV::ReleaseVideoBuffer (AjaVideoBuff * videoBuffer)
+{
+  if (!videoBuffer->buffer)
+    return;
+
+  // Freeing may wait for the pool's lock and a copy-out in progress, the
+  // delivery thread leaves that to the streaming threads. When they're that
+  // far behind, the buffer at least isn't offered to the copy-out.
+  if (sDeliveringAV == this) {
+    if (!mReturnRing.Push (videoBuffer->buffer))
+      DiscardVideoBuffer (videoBuffer);
+    return;
+  }
+
+  gst_aja_buffer_pool_release_delivered (videoBuffer->buffer);
+}
+
+
+void
+NTV2GstAV::ReleaseAudioBuffer (AjaAudioBuff * audioBuffer)
+{
+  if (!audioBuffer->buffer)
+    return;
+
+  if (sDeliveringAV == this) {
+    if (!mReturnRing.Push (audioBuffer->buffer))
+      DiscardAudioBuffer (audioBuffer);
+    return;
+  }
+
+  gst_aja_buffer_pool_release_delivered (audioBuffer->buffer);
+}
+
+
+void
+NTV2GstAV::DiscardVideoBuffer (AjaVideoBuff * videoBuffer)
 {
   if (videoBuffer->buffer)
     gst_buffer_unref (videoBuffer->buffer);
@@ -1898,13 +3170,29 @@ NTV2GstAV::ReleaseVideoBuffer (AjaVideoBuff * videoBuffer)
 
 
 void
-NTV2GstAV::ReleaseAudioBuffer (AjaAudioBuff * audioBuffer)
+NTV2GstAV::DiscardAudioBuffer (AjaAudioBuff * audioBuffer)
 {
   if (audioBuffer->buffer)
     gst_buffer_unref (audioBuffer->buffer);
 }
 
 
+void
+NTV2GstAV::ReclaimBuffers (void)
+{
+  GstBuffer *buffer;
+
+  // The ring has a single consumer, whoever gets here first
+  if (mReclaiming.exchange (true, std::memory_order_acquire))
+    return;
+
+  while (mReturnRing.TryPop (buffer))
+    gst_aja_buffer_pool_release_delivered (buffer);
+
+  mReclaiming.store (false, std::memory_order_release);
+}
+
+
 void
 NTV2GstAV::AddRefVideoBuffer (AjaVideoBuff * videoBuffer)
 {
@@ -1926,7 +3214,7 @@ bool NTV2GstAV::GetHardwareClock (uint64_t desiredTimeScale, uint64_t * time)
   uint32_t
   audioCounter (0);
 
-  bool status = mDevice.ReadRegister (kRegAud1Counter, audioCounter);
+  bool status = mDevice->ReadRegister (kRegAud1Counter, audioCounter);
   *time = (audioCounter * desiredTimeScale) / 48000;
   return status;
 }
@@ -1941,7 +3229,7 @@ AJAStatus
     NTV2GstAV::DetermineInputFormat (NTV2Channel inputChannel, bool quad,
     NTV2VideoFormat & videoFormat)
 {
-  NTV2VideoFormat sdiFormat = mDevice.GetSDIInputVideoFormat (inputChannel);
+  NTV2VideoFormat sdiFormat = mDevice->GetSDIInputVideoFormat (inputChannel);
   if (sdiFormat == NTV2_FORMAT_UNKNOWN)
     return AJA_STATUS_FAIL;
 
@@ -2004,16 +3292,44 @@ AJA_FrameRate NTV2GstAV::GetAJAFrameRate (NTV2FrameRate frameRate)
 }
 
 
-bool NTV2GstAV::DoCallback (CallBackType type, void *msg)
+// Every consumer gets a reference of its own, the last one the caller's. The
+// buffer is released if no one is there to catch it.
+void
+NTV2GstAV::DoCallback (CallBackType type, void *msg)
 {
-  if (type == VIDEO_CALLBACK) {
-    if (mVideoCallback) {
-      return mVideoCallback (mVideoCallbackRefcon, msg);
-    }
-  } else if (type == AUDIO_CALLBACK) {
-    if (mAudioCallback) {
-      return mAudioCallback (mAudioCallbackRefcon, msg);
+  std::vector < NTV2GstCallback > &callbacks =
+      type == VIDEO_CALLBACK ? mVideoCallbacks : mAudioCallbacks;
+  bool taken = false;
+
+  mCallbackLock.Lock ();
+  for (size_t i = 0; i < callbacks.size (); i++) {
+    const bool own = msg && i + 1 < callbacks.size ();
+
+    if (own) {
+      if (type == VIDEO_CALLBACK)
+        AddRefVideoBuffer ((AjaVideoBuff *) msg);
+      else
+        AddRefAudioBuffer ((AjaAudioBuff *) msg);
     }
+
+    const bool took = callbacks[i].callback (callbacks[i].refcon, msg);
+    if (own && !took)
+      ReleaseMessage (type, msg);
+    else if (!own && took)
+      taken = true;
   }
-  return false;
+  mCallbackLock.Unlock ();
+
+  if (msg && !taken)
+    ReleaseMessage (type, msg);
+}
+
+
+void
+NTV2GstAV::ReleaseMessage (CallBackType type, void *msg)
+{
+  if (type == VIDEO_CALLBACK)
+    ReleaseVideoBuffer ((AjaVideoBuff *) msg);
+  else
+    ReleaseAudioBuffer ((AjaAudioBuff *) msg);
 }
@@ -10,6 +10,10 @@
 #ifndef _NTV2ENCODE_H
 #define _NTV2ENCODE_H
 
+#include <atomic>
+#include <bitset>
+#include <semaphore.h>
+
 #include <gst/gst.h>
 
 #include "ntv2enums.h"
@@ -24,11 +28,19 @@
 #include "ajabase/system/thread.h"
 
 #include "ntv2m31.h"
+#include "gstntv2device.h"
+#include "gstntv2ring.h"
+#include "gstntv2realtime.h"
+#include "gstntv2topology.h"
+
+class NTV2GstScheduler;
+class NTV2GstArena;
+class NTV2GstLockRegistry;
+class NTV2GstShmRing;
 
 #define VIDEO_RING_SIZE            16
-#define VIDEO_ARRAY_SIZE        60
 #define AUDIO_RING_SIZE            (3*VIDEO_RING_SIZE)
-#define AUDIO_ARRAY_SIZE        (3*VIDEO_ARRAY_SIZE)
+#define RETURN_RING_SIZE           (4*VIDEO_RING_SIZE)
 
 #define ASECOND                 (1000000000)
 
@@ -40,17 +52,59 @@ typedef enum
     AUDIO_CALLBACK
 } CallBackType;
 
+typedef struct
+{
+    NTV2Callback        callback;
+    const gint *        room;                   /// Frames it could still take, atomic, NULL if it always takes the next
+    void *              refcon;
+} NTV2GstCallback;
+
+/**
+    @brief    What the capture thread knows of the consumers. Replaced as a whole whenever one is added
+              or removed, so that the capture thread reads it without a lock.
+**/
+typedef struct
+{
+    std::vector<const gint *>   rooms;          /// Of all video and audio consumers, see NTV2GstCallback
+    uint32_t                    numAudio;       /// Consumers of the audio
+} NTV2GstConsumers;
+
 typedef enum {
   SDI_INPUT_MODE_SINGLE_LINK,
   SDI_INPUT_MODE_QUAD_LINK_SQD,
   SDI_INPUT_MODE_QUAD_LINK_TSI,
 } SDIInputMode;
 
+/**
+    @brief    What the capture loop does when the pools have no free DMA buffer left because
+              downstream holds on to them.
+**/
+
+typedef enum
+{
+    NTV2_EXHAUSTION_POLICY_GROW,            /// Allocate and lock another buffer on the capture thread
+    NTV2_EXHAUSTION_POLICY_COPY_OUT,        /// Copy the oldest buffers held downstream to ordinary memory in the background, drop the frame if that's not enough
+    NTV2_EXHAUSTION_POLICY_DROP             /// Drop the frame
+} NTV2GstExhaustionPolicy;
+
+/**
+    @brief    How the memory of captured video is handed downstream.
+**/
+
+typedef enum
+{
+    NTV2_EXPORT_MODE_NONE,                  /// Private system memory, only mappable by this process
+    NTV2_EXPORT_MODE_MEMFD,                 /// Memfd backed GstFdMemory, mappable by other processes
+    NTV2_EXPORT_MODE_DMABUF                 /// udmabuf backed DMABuf memory, importable by encoders and other devices, memfd if udmabuf is unavailable
+} NTV2GstExportMode;
+
 typedef struct
 {
     GstBuffer *     buffer;                 /// If buffer != NULL, it actually owns the AjaVideoBuff and the following 3 fields are NULL
 
     bool            isNvmm;                 /// True if this is an NVIDIA NVMM GPU Buffer used with RDMA
+    bool            isForeign;              /// True if the buffer comes from a downstream pool
+    int32_t         shmSlot;                /// Slot of the published ring the buffer wraps, or -1
 
     uint32_t *      pVideoBuffer;           /// Pointer to host video buffer
     uint32_t        videoBufferSize;        /// Size of host video buffer (bytes)
@@ -73,7 +127,8 @@ typedef struct
 
     uint64_t        framesProcessed;
     uint64_t        framesDropped;
-    bool            droppedChanged;
+    uint64_t        framesSkipped;          /// Not transferred because no consumer could take them
+    bool            droppedChanged;         /// Frames were dropped or skipped right before this one
 } AjaVideoBuff;
 
 
@@ -92,9 +147,23 @@ typedef struct
 
     uint64_t        framesProcessed;
     uint64_t        framesDropped;
-    bool            droppedChanged;
+    uint64_t        framesSkipped;          /// Not transferred because no consumer could take them
+    bool            droppedChanged;         /// Frames were dropped or skipped right before this one
 } AjaAudioBuff;
 
+
+/**
+    @brief    One captured frame handed from the DMA thread to the delivery thread. Both buffers
+              are NULL while there is no signal, and when the DMA thread has stopped on the last frame.
+**/
+
+typedef struct
+{
+    AjaVideoBuff *  video;                  /// Captured video, or NULL
+    AjaAudioBuff *  audio;                  /// Captured audio, or NULL
+    bool            lastFrame;              /// DMA thread stopped, nothing follows this entry
+} AjaCaptureDelivery;
+
         
 
 /**
@@ -104,6 +173,8 @@ typedef struct
 
 class NTV2GstAV
 {
+    friend class NTV2GstScheduler;
+
     //    Public Instance Methods
     public:
         /**
@@ -125,8 +196,9 @@ class NTV2GstAV
                                             Defaults to no timecode burn.
             @param[in]    inInfoData          Use picture and encoded information.
                                             Defaults to no info data.
-            @param[in]    inCaptureTall       Capture Tall Video (i.e. with VBI)
-                                            Defaults to regular (non-tall) video height
+            @param[in]    inCaptureTall       Capture the ancillary data, with the ANC extractor if the device
+                                            has one, and as tall video (i.e. with VBI) otherwise.
+                                            Defaults to regular (non-tall) video height.
         **/
         NTV2GstAV(const std::string            inDeviceSpecifier    = "0",
                       const NTV2Channel            inChannel            = NTV2_CHANNEL1);
@@ -171,9 +243,31 @@ class NTV2GstAV
 
 
         /**
-            @brief    Set the callback and callback refcon.
+            @brief    Adds a consumer of the video or audio. Every consumer is called with each frame and
+                      gets a reference of its own to the buffer, which it releases when done with it.
+            @param[in]    room            Frames the consumer could still take, which it keeps up to date
+                                          with the glib atomics. The capture thread reads it before each
+                                          transfer, if no consumer of the video or audio has room the frame
+                                          isn't transferred at all. NULL if it always takes the next frame.
+        **/
+        virtual void            AddCallback(CallBackType cbType, NTV2Callback callback, void * callbackRefcon,
+                                            const gint * room = NULL);
+
+        /**
+            @brief    Removes a consumer added with AddCallback. It is not called anymore once this returns,
+                      so this must not be called with a lock its callback takes.
+        **/
+        virtual void            RemoveCallback(CallBackType cbType, NTV2Callback callback, void * callbackRefcon);
+
+        /**
+            @brief    Returns the number of consumers of the video or audio.
+        **/
+        virtual uint32_t        GetNumCallbacks(CallBackType cbType);
+
+        /**
+            @brief    True while the capture threads run, between Run and Quit.
         **/
-        virtual void            SetCallback(CallBackType cbType, NTV2Callback callback, void * callbackRefcon);
+        virtual bool            IsRunning(void) const               { return mStarted; }
     
         /**
             @brief    Acquire video buffer (just finds the first free buffer in the pool)
@@ -195,6 +289,12 @@ class NTV2GstAV
         **/
         virtual void            ReleaseAudioBuffer(AjaAudioBuff * audioBuffer);
 
+        /**
+            @brief    Frees the buffers the delivery thread released. Called by the streaming threads
+                      taking frames, it returns right away while another thread is at it.
+        **/
+        virtual void            ReclaimBuffers(void);
+
         /**
             @brief    Add a reference to the video buffer
         **/
@@ -216,6 +316,112 @@ class NTV2GstAV
         **/
         virtual void            UpdateTimecodeIndex(const NTV2TCIndex inTimeCode);
 
+        /**
+            @brief    Let the device's scheduler capture my frames instead of my own AC thread.
+            @note     Must be called before Run. NULL goes back to my own AC thread.
+        **/
+        virtual void            SetScheduler(NTV2GstScheduler * scheduler);
+
+        /**
+            @brief    Take my buffers from the device's DMA arena instead of allocating and locking them for
+                      every run. NULL for buffers of my own.
+            @note     Must be called before Run.
+        **/
+        virtual void            SetArena(NTV2GstArena * arena);
+
+        /**
+            @brief    Set the real-time profile of my AC input and delivery threads and my buffer pools.
+            @note     Must be called before Run.
+        **/
+        virtual void            SetRealtimeProfile(const NTV2GstRealtimeProfile & profile);
+
+        /**
+            @brief    Back my preallocated buffers with huge pages of up to this size, 0 for regular pages.
+            @note     Must be called before Run. Falls back to smaller or regular pages if unavailable.
+        **/
+        virtual void            SetHugePageSize(size_t hugePageSize);
+
+        /**
+            @brief    Set the number of preallocated video and audio buffers, 0 to size them automatically
+                      from the frame size, the consumer's queue size and the buffers held during the last run.
+            @note     Must be called before Run. The pools still grow if more buffers are needed.
+        **/
+        virtual void            SetPoolSizes(uint32_t videoPoolSize, uint32_t audioPoolSize, uint32_t queueSize);
+
+        /**
+            @brief    Set what happens when my pools run out of DMA buffers: grow them on the AC input
+                      thread, copy the oldest buffers held downstream out of DMA memory in the background
+                      once fewer than inWatermark are free, or only drop the frame.
+            @note     Must be called before Run. Whenever no buffer is free, the frame is dropped and counted.
+        **/
+        virtual void            SetExhaustionPolicy(NTV2GstExhaustionPolicy inPolicy, uint32_t inWatermark);
+
+        /**
+            @brief    Back my video buffers with memfds, or DMABufs made of them, and hand them downstream
+                      as file descriptor memory, so that other elements and processes map or import the
+                      pages the device wrote instead of copying them.
+            @note     Must be called before Run. Exported buffers neither come from the arena or huge pages
+                      nor are they ever copied out, and downstream pools are not captured into.
+        **/
+        virtual void            SetExportMode(NTV2GstExportMode inMode);
+
+        /**
+            @brief    Capture video into a ring of inNumSlots slots in shared memory named inName and
+                      publish every frame there, with its audio and timecode, for ajashmsrc elements in
+                      other processes. My own buffers wrap the slots, so my pipeline sees the same pages.
+                      An empty name publishes nothing.
+            @note     Must be called before Run. Frames are captured into my pool and not published
+                      while readers hold all slots.
+        **/
+        virtual void            SetPublisher(const std::string & inName, uint32_t inNumSlots);
+
+        /**
+            @brief    Transfer the video of only every inDecimation-th frame of the device. The audio of the
+                      frames in between is still transferred, and delivered on its own, while there are
+                      audio consumers.
+            @note     Must be called before Run. The frame numbers keep counting every frame of the device.
+        **/
+        virtual void            SetDecimation(uint32_t inDecimation);
+
+        /**
+            @brief    Transfer only a rectangle of the picture, line by line with segmented DMA, into
+                      buffers of just its size. A width of 0 transfers the whole picture.
+            @note     Must be called after Init and before Run. inX must start a group of pixels of
+                      the format, 6 pixels for v210, 2 for UYVY. The width of v210 is transferred in
+                      whole groups, the buffers have the stride of the width.
+            @return   False, and the whole picture is transferred, if the rectangle is not inside the
+                      picture or not aligned, or with NVMM, tall VANC or a publisher.
+        **/
+        virtual bool            SetCrop(uint32_t inX, uint32_t inY, uint32_t inWidth, uint32_t inHeight);
+
+        /**
+            @brief    Set the caps published with the following frames.
+            @note     Can be called while capturing.
+        **/
+        virtual void            SetPublishedCaps(const std::string & inCaps);
+
+        /**
+            @brief    Capture video straight into the buffers of a pool downstream provided, as long as
+                      they are large enough and a buffer is free, and into my own pool otherwise.
+                      NULL for my own pool only.
+            @note     Can be called while capturing. The pool must be active.
+        **/
+        virtual void            SetDownstreamPool(GstBufferPool * pool);
+
+        /**
+            @brief    Size a video buffer needs for the current format, VANC lines included.
+            @note     Only valid after Init.
+        **/
+        virtual uint32_t        GetVideoBufferSize(void) const      { return mVideoBufferSize; }
+
+        /**
+            @brief    NUMA node of the device my buffers are placed on, -1 if unknown, and the cores of
+                      that node my threads run on unless a core was given for them.
+            @note     Only valid after Open.
+        **/
+        virtual int             GetNUMANode(void) const             { return mNUMANode; }
+        virtual std::string     GetNUMACPUs(void) const             { return NTV2GstTopologyFormatCPUs (mNUMACPUs); }
+
     
     //    Protected Instance Methods
     protected:
@@ -234,6 +440,24 @@ class NTV2GstAV
         **/
         virtual void            SetupHostBuffers (void);
         virtual void            FreeHostBuffers (void);
+        virtual void            AttachAncillaryData (AjaVideoBuff * videoBuffer);
+
+        /**
+            @brief    Computes the size of my audio buffers, and creates/rebuilds my audio buffer pool with it.
+                      RebuildAudioPool builds the pool of a new audio configuration on the calling
+                      thread, SwapAudioPool swaps it in from the capture loop.
+        **/
+        virtual uint32_t        GetAudioBufferSize (void);
+        virtual uint32_t        GetCapturedAudioChannels (void);
+        virtual GstBufferPool * NewAudioPool (void);
+        virtual void            RebuildAudioPool (void);
+        virtual void            SwapAudioPool (void);
+        virtual void            RetireAudioPool (GstBufferPool * pool);
+
+        /**
+            @brief    Takes a free buffer of my downstream pool that fits a whole frame, or returns NULL.
+        **/
+        virtual GstBuffer *     AcquireDownstreamBuffer (void);
 
         /**
             @brief    Initializes AutoCirculate.
@@ -241,7 +465,7 @@ class NTV2GstAV
         virtual void            SetupAutoCirculate (void);
 
         /**
-            @brief    Start/Stop the AC input thread.
+            @brief    Start/Stop the AC input thread and its delivery thread.
         **/
         virtual void            StartACThread (void);
         virtual void            StopACThread (void);
@@ -252,6 +476,44 @@ class NTV2GstAV
         **/
         virtual void            ACInputWorker (void);
 
+        typedef enum
+        {
+            AC_INPUT_AGAIN,                     /// Poll again right away, more frames may be waiting
+            AC_INPUT_IDLE,                      /// No frame available until the next interrupt
+            AC_INPUT_DONE                       /// The last frame was captured
+        } ACInputResult;
+
+        /**
+            @brief    Start/Stop AutoCirculate and reset the capture state.
+        **/
+        virtual void            ACInputBegin (void);
+        virtual void            ACInputEnd (void);
+
+        /**
+            @brief    Runs one pass of the capture loop, transferring at most one frame.
+            @param[in]    inWait    Wait for the next input interrupt if no frame is available.
+        **/
+        virtual ACInputResult   ACInputPoll (bool inWait);
+
+        /**
+            @brief    Hands the frames captured by the AC input thread to the raw audio/video consumers,
+                      so that slow consumers never delay the next transfer
+        **/
+        virtual void            ACDeliveryWorker (void);
+
+        /**
+            @brief    Queues a captured frame for the delivery thread, releasing it if the queue is full.
+            @return   False if the frame was released instead of queued.
+        **/
+        virtual bool            QueueDelivery (AjaVideoBuff * videoBuffer, AjaAudioBuff * audioBuffer, bool lastFrame = false);
+
+        /**
+            @brief    Copies buffers held downstream out of DMA memory until my pools have enough free ones
+                      again. WakeCopyOut never blocks, it's called from the AC input thread.
+        **/
+        virtual void            CopyOutWorker (void);
+        virtual void            WakeCopyOut (void);
+
         //    Protected Class Methods
     protected:
         /**aja_video_src->ntv2->
@@ -261,20 +523,146 @@ class NTV2GstAV
             @param[in]    pContext    Context information to pass to the thread.
         **/
         static void                ACInputThreadStatic (AJAThread * pThread, void * pContext);
+        static void                ACDeliveryThreadStatic (AJAThread * pThread, void * pContext);
+        static void                CopyOutThreadStatic (AJAThread * pThread, void * pContext);
 
     private:
     
         AJAStatus DetermineInputFormat(NTV2Channel inputChannel, bool quad, NTV2VideoFormat& videoFormat);
         AJA_FrameRate GetAJAFrameRate(NTV2FrameRate frameRate);
 
-        bool DoCallback(CallBackType type, void * msg);
+        void DoCallback(CallBackType type, void * msg);
+        void ReleaseMessage(CallBackType type, void * msg);
+
+        /**
+            @brief    Gives back a buffer no consumer ever got. It isn't marked delivered, so no copy-out
+                      can pick it and hold up the capture thread freeing it.
+        **/
+        void DiscardVideoBuffer (AjaVideoBuff * videoBuffer);
+        void DiscardAudioBuffer (AjaAudioBuff * audioBuffer);
+
+        /**
+            @brief    Returns whether any consumer could take the next frame. Capture thread only.
+        **/
+        bool CanDeliver (void);
+
+        /**
+            @brief    Replaces the consumers the capture thread sees. Called with mCallbackLock held.
+        **/
+        void PublishConsumers (void);
+
+        /**
+            @brief    Returns the current consumers, valid until ReleaseConsumers. Never blocks.
+        **/
+        const NTV2GstConsumers * AcquireConsumers (void);
+        void ReleaseConsumers (void);
+
+        /**
+            @brief    Capture loop state, kept across ACInputPoll calls.
+        **/
+        typedef struct
+        {
+            NTV2TCIndex             tcIndex;                /// Timecode index read from the frame stamp
+            NTV2TCIndex             configuredTcIndex;      /// mTimecodeMode that tcIndex was chosen for
+            NTV2GstChannelStatus    channelStatus;
+            NTV2GstChannelStatus    lastChannelStatus;
+            guint                   transferCharacteristics;
+            guint                   colorimetry;
+            gboolean                fullRange;
+            NTV2VideoFormat         inputVideoFormat;
+            bool                    haveSignal;
+            unsigned int            iterations_without_frame;
+            uint64_t                processed_frames;
+            uint64_t                dropped_frames;
+            uint64_t                skipped_frames;         /// Not transferred, see ACInputSkipTransfer
+            uint64_t                decimated_frames;       /// Video not transferred, see ACInputDecimateFrame
+            uint32_t                last_dropped_frames;
+            bool                    dropped_frames_now;
+            AUTOCIRCULATE_STATUS    acStatus;
+            bool                    statusValid;            /// acStatus is current, no need to query it
+            bool                    refreshInput;           /// Re-read the input format on the next pass
+            NTV2AutoCirculateState  lastState;
+            unsigned int            frames_since_refresh;
+        } ACInputState;
+
+        /**
+            @brief    Skips the device's next frame because no DMA buffer is free, and counts it as dropped.
+        **/
+        ACInputResult ACInputSkipFrame (ACInputState & st);
+
+        /**
+            @brief    Skips the device's next frame because no consumer could take it, and counts it apart
+                      from the drops.
+        **/
+        ACInputResult ACInputSkipTransfer (ACInputState & st);
+
+        /**
+            @brief    Transfers only the audio of the device's next frame, and none at all without audio
+                      consumers, because its video is decimated.
+        **/
+        ACInputResult ACInputDecimateFrame (ACInputState & st);
+
+        /**
+            @brief    Creates the published ring, or keeps the one of the last run if the sizes still fit.
+        **/
+        void SetupPublisher (void);
+
+        /**
+            @brief    A buffer wrapping a free slot of the published ring, NULL if there is none.
+        **/
+        GstBuffer * AcquirePublishedBuffer (int32_t & outSlot);
+
+        /**
+            @brief    Publishes a frame captured into a slot of the published ring.
+        **/
+        void PublishFrame (AjaVideoBuff * videoBuffer, AjaAudioBuff * audioBuffer);
 
     //    Private Member Data
     private:
         AJAThread *                    mACInputThread;         ///    AutoCirculate input thread
+        AJAThread *                    mACDeliveryThread;      ///    Runs the callbacks for captured frames
+        NTV2GstSpscRing<AjaCaptureDelivery, VIDEO_RING_SIZE> mDeliveryRing; /// Captured frames waiting for the delivery thread
+        bool                           mDeliveryQuit;          ///    Set "true" once the AC input thread has stopped
+        NTV2GstSpscRing<GstBuffer *, RETURN_RING_SIZE> mReturnRing; /// Buffers the delivery thread released, freed by ReclaimBuffers
+        std::atomic<bool>              mReclaiming;            ///    A thread is popping mReturnRing
+        NTV2GstScheduler *             mScheduler;             ///    Device scheduler capturing my frames, or NULL for my own AC thread
+        NTV2GstArena *                 mArena;                 ///    Device memory my buffers come from, or NULL
+        ACInputState                   mACInputState;          ///    Capture loop state
+        NTV2GstRealtimeProfile         mRealtimeProfile;       ///    Scheduling, memory locking and affinities
+        int                            mNUMANode;              ///    NUMA node of the device, -1 if unknown
+        std::vector<uint32_t>          mNUMACPUs;              ///    Cores of mNUMANode
+        size_t                         mHugePageSize;          ///    Largest huge page size for the pools, 0 for none
+        uint32_t                       mVideoPoolSize;         ///    Preallocated video buffers, 0 for automatic
+        uint32_t                       mAudioPoolSize;         ///    Preallocated audio buffers, 0 for automatic
+        uint32_t                       mQueueSize;             ///    Frames the consumer queues
+        uint32_t                       mVideoPeakHeld;         ///    Most video buffers held at once during previous runs
+        uint32_t                       mAudioPeakHeld;         ///    Most audio buffers held at once during previous runs
+        uint32_t                       mAudioPoolDepth;        ///    Preallocated audio buffers of the current pool
+        std::atomic<GstBufferPool *>   mPendingAudioPool;      ///    Built for a new audio configuration, swapped in before the next transfer
+        std::atomic<GstBufferPool *>   mRetiredAudioPool;      ///    Swapped out by the capture loop, freed by the next RebuildAudioPool or on stop
+        AJALock                        mPoolLock;              ///    Held while a pool is replaced
+        GstBufferPool *                mDownstreamPool;        ///    Downstream pool video is captured into, or NULL
+        NTV2GstLockRegistry *          mLockRegistry;          ///    DMA locks of the downstream and NVMM buffers
+        NTV2GstExhaustionPolicy        mExhaustionPolicy;      ///    What to do when the pools run out of DMA buffers
+        uint32_t                       mCopyOutWatermark;      ///    Free DMA buffers below which buffers are copied out
+        NTV2GstExportMode              mExportMode;            ///    How video memory is handed downstream
+        std::string                    mPublishName;           ///    Name of the shared memory ring to publish to, empty for none
+        uint32_t                       mPublishSlots;          ///    Slots of the published ring
+        std::string                    mPublishCaps;           ///    Caps published with the frames
+        NTV2GstShmRing *               mShmRing;               ///    Ring video is captured into and published from, or NULL
+        uint32_t                       mDecimation;            ///    Video is transferred for every this many frames
+        uint32_t                       mCropRows;              ///    Lines transferred, 0 for the whole picture
+        uint32_t                       mCropActiveBytes;       ///    Bytes transferred of every line
+        uint32_t                       mCropHostBytes;         ///    Stride of the lines in my buffers
+        uint32_t                       mCropDeviceBytes;       ///    Stride of the lines on the device
+        uint32_t                       mCropOffset;            ///    Of the first byte transferred on the device
+        AJAThread *                    mCopyOutThread;         ///    Copies held buffers out of DMA memory, or NULL
+        sem_t                          mCopyOutWake;
+        std::atomic<bool>              mCopyOutPending;        ///    mCopyOutWake posted and not yet handled
+        bool                           mCopyOutQuit;
         AJALock *                    mLock;                  /// My mutex object
 
-        CNTV2Card                    mDevice;                ///    CNTV2Card instance
+        NTV2GstDevice *              mDevice;                ///    Device instance (hardware or simulated)
         NTV2DeviceID                mDeviceID;                ///    Device identifier
         const std::string            mDeviceSpecifier;        ///    The device specifier string
         NTV2Channel                 mInputChannel;            ///    Input channel
@@ -288,9 +676,12 @@ class NTV2GstAV
         bool                        mIsAuto;                /// Is auto mode (should only be used when called from the audiosrc to set device automatically based on input)
         SDIInputMode                mSDIInputMode;           /// SDI input mode
         bool                        mQuad;
+        std::bitset<NTV2_MAX_NUM_VIDEO_FORMATS> mExpectedFormats; /// Input formats that count as having signal
         bool                        mMultiStream;            /// Demonstrates how to configure the board for multi-stream
         NTV2TCIndex                 mTimecodeMode;        /// Add timecode burn
 	bool                        mCaptureTall;	    /// Capture Tall Video
+        bool                        mCaptureAnc;            /// Capture the packets of the ANC extractor instead
+        uint8_t *                   mAncBuffer[2];          /// The F1 and F2 packets of the last frame, DMA locked
         uint32_t                    mCaptureCPUCore;
         NTV2InputSource             mVideoSource;
         bool                        mPassthrough;
@@ -309,12 +700,13 @@ class NTV2GstAV
         uint32_t                    mVideoBufferSize;        ///    My video buffer size (bytes)
         uint32_t                    mPicInfoBufferSize;     /// My picture info buffer size (bytes)
         uint32_t                    mEncInfoBufferSize;     /// My encoded info buffer size (bytes)
-        uint32_t                    mAudioBufferSize;        ///    My audio buffer size (bytes)
+        std::atomic<uint32_t>       mAudioBufferSize;        ///    My audio buffer size (bytes), of the newest pool built
 
-        NTV2Callback               mVideoCallback;         /// Callback for video output
-        void *                     mVideoCallbackRefcon;   /// Callback refcon for video output
-        NTV2Callback               mAudioCallback;         /// Callback for audio output
-        void *                     mAudioCallbackRefcon;   /// Callback refcon for AC output
+        std::vector<NTV2GstCallback>   mVideoCallbacks;        /// Consumers of the video output
+        std::vector<NTV2GstCallback>   mAudioCallbacks;        /// Consumers of the audio output
+        AJALock                        mCallbackLock;          /// Held while the consumers are changed or called
+        std::atomic<NTV2GstConsumers *> mConsumers;            /// Published by PublishConsumers, NULL before the first
+        std::atomic<uint32_t>          mConsumersReaders;      /// Between AcquireConsumers and ReleaseConsumers
 
         GstBufferPool *                         mAudioBufferPool;
         GstBufferPool *                         mVideoBufferPool;
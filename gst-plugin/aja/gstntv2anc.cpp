@@ -0,0 +1,134 @@
+/**
+    @file        gstntv2anc.cpp
+    @brief       Implementation of the parser of the packets the ANC extractor of a device captured.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/video-anc.h>
+
+#include "gstntv2anc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_anc_debug);
+#define GST_CAT_DEFAULT gst_ntv2_anc_debug
+
+// The extractor writes every packet with 8 bit words: 0xFF, two bytes of
+// where it was found, DID, SDID, DC, the DC user data words and the
+// checksum. The first location byte has HANC in bit 6, the C channel in
+// bit 5 and the upper 4 bits of the line, the second the lower 7 bits.
+#define ANC_PACKET_START            0xFF
+#define ANC_PACKET_HEADER_SIZE      6
+#define ANC_PACKET_WRAPPER_SIZE     (ANC_PACKET_HEADER_SIZE + 1)
+
+static void
+_init_ntv2_anc (void)
+{
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+#ifndef GST_DISABLE_GST_DEBUG
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_anc_debug, "ajantv2anc", 0,
+        "AJA ntv2 ANC extractor packets");
+#endif
+    g_once_init_leave (&_init, 1);
+  }
+}
+
+#if GST_CHECK_VERSION(1, 24, 0)
+// 8 bit word with the even parity bit and its inverse on top
+static guint16
+_anc_word (guint8 inWord)
+{
+  guint16 parity = __builtin_parity (inWord);
+
+  return inWord | (parity << 8) | ((parity ^ 1) << 9);
+}
+
+static void
+_add_ancillary_meta (GstBuffer * ioBuffer, const guint8 * inPacket,
+    int inField)
+{
+  const guint8 dc = inPacket[5];
+  GstAncillaryMeta *meta = gst_buffer_add_ancillary_meta (ioBuffer);
+  guint16 sum;
+
+  switch (inField) {
+    case 1:
+      meta->field = GST_ANCILLARY_META_FIELD_INTERLACED_FIRST;
+      break;
+    case 2:
+      meta->field = GST_ANCILLARY_META_FIELD_INTERLACED_SECOND;
+      break;
+    default:
+      meta->field = GST_ANCILLARY_META_FIELD_PROGRESSIVE;
+      break;
+  }
+  meta->c_not_y_channel = (inPacket[1] & 0x20) != 0;
+  meta->line = ((inPacket[1] & 0x0F) << 7) | (inPacket[2] & 0x7F);
+  meta->offset = 0;
+  meta->DID = _anc_word (inPacket[3]);
+  meta->SDID_block_number = _anc_word (inPacket[4]);
+  meta->data_count = _anc_word (dc);
+  meta->data = (guint16 *) g_malloc (MAX (dc, 1) * sizeof (guint16));
+
+  // The extractor only keeps 8 bits of the checksum, rebuild all 10
+  sum = (meta->DID + meta->SDID_block_number + meta->data_count) & 0x1FF;
+  for (guint i = 0; i < dc; i++) {
+    meta->data[i] = _anc_word (inPacket[ANC_PACKET_HEADER_SIZE + i]);
+    sum = (sum + meta->data[i]) & 0x1FF;
+  }
+  meta->checksum = sum | ((~sum & 0x100) << 1);
+}
+#endif
+
+uint32_t
+NTV2GstAncAttach (GstBuffer * ioBuffer, const uint8_t * inData, size_t inSize,
+    int inField)
+{
+  uint32_t packets = 0;
+  size_t pos = 0;
+
+  _init_ntv2_anc ();
+
+  while (pos + ANC_PACKET_WRAPPER_SIZE <= inSize &&
+      inData[pos] == ANC_PACKET_START) {
+    const guint8 *packet = inData + pos;
+    const guint8 dc = packet[5];
+
+    if (pos + ANC_PACKET_WRAPPER_SIZE + dc > inSize) {
+      GST_WARNING ("Packet at %" G_GSIZE_FORMAT " of field %d is cut off",
+          (gsize) pos, inField);
+      break;
+    }
+
+    GST_LOG ("Packet DID 0x%02x SDID 0x%02x, %u words on line %u of field "
+        "%d", packet[3], packet[4], dc,
+        ((packet[1] & 0x0F) << 7) | (packet[2] & 0x7F), inField);
+
+#if GST_CHECK_VERSION(1, 24, 0)
+    _add_ancillary_meta (ioBuffer, packet, inField);
+#endif
+#if GST_CHECK_VERSION(1, 15, 0)
+    switch ((packet[3] << 8) | packet[4]) {
+      case GST_VIDEO_ANCILLARY_DID16_S334_EIA_708:
+        gst_buffer_add_video_caption_meta (ioBuffer,
+            GST_VIDEO_CAPTION_TYPE_CEA708_CDP, packet + ANC_PACKET_HEADER_SIZE,
+            dc);
+        break;
+      case GST_VIDEO_ANCILLARY_DID16_S334_EIA_608:
+        gst_buffer_add_video_caption_meta (ioBuffer,
+            GST_VIDEO_CAPTION_TYPE_CEA608_S334_1A,
+            packet + ANC_PACKET_HEADER_SIZE, dc);
+        break;
+      default:
+        break;
+    }
+#endif
+
+    packets++;
+    pos += ANC_PACKET_WRAPPER_SIZE + dc;
+  }
+
+  return packets;
+}
@@ -0,0 +1,29 @@
+/**
+    @file        gstntv2anc.h
+    @brief       Declares the parser of the packets the ANC extractor of a device captured.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_ANC_H
+#define _GST_NTV2_ANC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+
+/**
+    @brief    Attaches the packets the ANC extractor wrote into the buffer of one field to a buffer.
+              Every packet becomes a GstAncillaryMeta with GStreamer 1.24 and newer, CEA-708 CDPs
+              and CEA-608 packets a GstVideoCaptionMeta as well.
+    @param[in]    inData          The packets, as the extractor wrote them.
+    @param[in]    inSize          Bytes the transfer reported for the field.
+    @param[in]    inField         0 for a progressive frame, 1 or 2 for the fields of an interlaced one.
+    @return   The number of packets found.
+**/
+uint32_t    NTV2GstAncAttach (GstBuffer * ioBuffer, const uint8_t * inData, size_t inSize,
+                              int inField);
+
+#endif    //    _GST_NTV2_ANC_H
@@ -0,0 +1,343 @@
+/**
+    @file        gstntv2arena.cpp
+    @brief       Implementation of the NTV2GstArena class.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include <gst/gst.h>
+
+#include "gstntv2arena.h"
+#include "gstntv2device.h"
+#include "gstntv2realtime.h"
+#include "gstntv2topology.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_arena_debug);
+#define GST_CAT_DEFAULT gst_ntv2_arena_debug
+
+// Shared by the arenas of all devices
+G_LOCK_DEFINE_STATIC (arena_budget);
+static size_t arena_budget = 0;
+static size_t arena_mapped = 0;
+
+static void
+_init_ntv2_arena_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_arena_debug, "ajantv2arena", 0,
+        "AJA ntv2 DMA memory arena");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+
+// Bytes a new slab may still map
+static size_t
+_budget_available (bool inLockMemory)
+{
+  size_t budget;
+
+  G_LOCK (arena_budget);
+  budget = arena_budget;
+  G_UNLOCK (arena_budget);
+
+  if (budget == 0)
+    budget = inLockMemory ? NTV2GstRealtimeGetLockLimit () : SIZE_MAX;
+
+  G_LOCK (arena_budget);
+  const size_t available = budget > arena_mapped ? budget - arena_mapped : 0;
+  G_UNLOCK (arena_budget);
+
+  return available;
+}
+
+
+NTV2GstArena::NTV2GstArena (const std::string & inDeviceSpecifier)
+:
+mDeviceSpecifier (inDeviceSpecifier),
+mMappedBytes (0),
+mBudgetWarned (false)
+{
+  _init_ntv2_arena_debug ();
+}
+
+
+NTV2GstArena::~NTV2GstArena ()
+{
+  for (std::map<uint8_t *, Slab *>::iterator it = mSlabs.begin ();
+      it != mSlabs.end (); ++it) {
+    Slab *slab = it->second;
+
+    if (slab->locked)
+      NTV2GstRealtimeUnlockMemory (slab->data, slab->size);
+    munmap (slab->data, slab->size);
+    delete slab;
+  }
+  mSlabs.clear ();
+
+  G_LOCK (arena_budget);
+  arena_mapped -= mMappedBytes;
+  G_UNLOCK (arena_budget);
+}
+
+
+void
+NTV2GstArena::SetBudget (size_t inBytes)
+{
+  _init_ntv2_arena_debug ();
+
+  G_LOCK (arena_budget);
+  arena_budget = inBytes;
+  G_UNLOCK (arena_budget);
+
+  const size_t limit = NTV2GstRealtimeGetLockLimit ();
+  if (inBytes > limit)
+    GST_WARNING ("DMA arena budget of %" G_GSIZE_FORMAT " MiB exceeds "
+        "RLIMIT_MEMLOCK of %" G_GSIZE_FORMAT " MiB, locking memory will fail "
+        "beyond it", (gsize) (inBytes >> 20), (gsize) (limit >> 20));
+}
+
+
+// Rounds up to an eighth of the size's power of two, so that the frames of
+// similar formats share slabs and at most an eighth of a block is wasted
+size_t
+NTV2GstArena::GetClassSize (size_t inSize)
+{
+  const size_t size = GST_ROUND_UP_N (MAX (inSize, (size_t) 1), (size_t) 4096);
+  const size_t step = MAX ((size_t) 4096,
+      ((size_t) 1 << g_bit_nth_msf ((gulong) size, -1)) / 8);
+
+  return GST_ROUND_UP_N (size, step);
+}
+
+
+NTV2GstArena::Slab *
+NTV2GstArena::FindSlab (const uint8_t * inData)
+{
+  std::map<uint8_t *, Slab *>::iterator it =
+      mSlabs.upper_bound ((uint8_t *) inData);
+
+  if (it == mSlabs.begin ())
+    return NULL;
+  --it;
+
+  Slab *slab = it->second;
+  return inData < slab->data + slab->size ? slab : NULL;
+}
+
+
+uint32_t
+NTV2GstArena::Reserve (size_t inSize, uint32_t inCount, int inNUMANode,
+    size_t inHugePageSize, bool inLockMemory)
+{
+  AJAAutoLock locker (&mLock);
+  const size_t blockSize = GetClassSize (inSize);
+  std::vector<uint8_t *> & freeBlocks = mFree[blockSize];
+
+  if (freeBlocks.size () >= inCount)
+    return (uint32_t) freeBlocks.size ();
+
+  const size_t available = _budget_available (inLockMemory);
+  size_t needed = blockSize * (inCount - freeBlocks.size ());
+  if (needed > available) {
+    needed = available / blockSize * blockSize;
+    if (!mBudgetWarned) {
+      mBudgetWarned = true;
+      GST_WARNING ("DMA arena of device %s out of budget with %" G_GSIZE_FORMAT
+          " MiB mapped, %" G_GSIZE_FORMAT " KiB blocks come from the pools' own "
+          "memory", mDeviceSpecifier.c_str (), (gsize) (mMappedBytes >> 20),
+          (gsize) (blockSize / 1024));
+    }
+    if (needed == 0)
+      return (uint32_t) freeBlocks.size ();
+  }
+
+  size_t size = 0, pageSize = 0;
+  int res = 0;
+  void *data = NULL;
+
+  if (inHugePageSize > 0) {
+    data = NTV2GstTopologyMapHugePages (needed, inHugePageSize, size, pageSize,
+        res);
+    // Rounding up to whole huge pages must not break the budget either
+    if (data && size > available) {
+      munmap (data, size);
+      data = NULL;
+      res = ENOMEM;
+    }
+    if (!data)
+      GST_WARNING ("Huge pages unavailable for %" G_GSIZE_FORMAT
+          " bytes of arena memory, using regular pages: %s", (gsize) needed,
+          res != 0 ? g_strerror (res) : "none large enough");
+  }
+
+  if (!data) {
+    data = mmap (NULL, needed, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      GST_ERROR ("Failed to map %" G_GSIZE_FORMAT " bytes of arena memory: %s",
+          (gsize) needed, g_strerror (errno));
+      return (uint32_t) freeBlocks.size ();
+    }
+    size = needed;
+    pageSize = 0;
+  }
+
+  res = NTV2GstTopologyPlaceMemory (data, size, inNUMANode);
+  if (res != 0 && inNUMANode >= 0)
+    GST_WARNING ("Failed to place arena memory on NUMA node %d: %s",
+        inNUMANode, g_strerror (res));
+
+  Slab *slab = new Slab;
+  slab->data = (uint8_t *) data;
+  slab->size = size;
+  slab->blockSize = blockSize;
+  slab->pageSize = pageSize;
+  slab->locked = false;
+
+  if (inLockMemory) {
+    res = NTV2GstRealtimeLockMemory (data, size);
+    if (res == 0)
+      slab->locked = true;
+    else
+      GST_WARNING ("Failed to lock %" G_GSIZE_FORMAT " bytes of arena memory: %s",
+          (gsize) size, NTV2GstRealtimeDescribeError (res, true).c_str ());
+  }
+
+  mSlabs[slab->data] = slab;
+
+  // Lowest address on top, handed out first
+  const size_t numBlocks = size / blockSize;
+  for (size_t i = numBlocks; i > 0; i--)
+    freeBlocks.push_back (slab->data + (i - 1) * blockSize);
+
+  mMappedBytes += size;
+  G_LOCK (arena_budget);
+  arena_mapped += size;
+  G_UNLOCK (arena_budget);
+
+  GST_INFO ("Mapped a slab of %" G_GSIZE_FORMAT " blocks of %" G_GSIZE_FORMAT
+      " KiB on device %s (%s pages%s)", (gsize) numBlocks,
+      (gsize) (blockSize / 1024), mDeviceSpecifier.c_str (),
+      pageSize > 0 ? (pageSize > 2 * 1024 * 1024 ? "1 GiB" : "2 MiB") : "4 KiB",
+      slab->locked ? ", locked" : "");
+
+  return (uint32_t) freeBlocks.size ();
+}
+
+
+uint8_t *
+NTV2GstArena::Alloc (size_t inSize, const std::string & inOwner,
+    NTV2GstDevice * inDevice)
+{
+  AJAAutoLock locker (&mLock);
+  const size_t blockSize = GetClassSize (inSize);
+  std::vector<uint8_t *> & freeBlocks = mFree[blockSize];
+
+  if (freeBlocks.empty ())
+    return NULL;
+
+  uint8_t *data = freeBlocks.back ();
+  freeBlocks.pop_back ();
+
+  // The whole slab at once, and only the first time this handle uses it
+  Slab *slab = FindSlab (data);
+  if (inDevice && std::find (slab->dmaLocked.begin (), slab->dmaLocked.end (),
+          inDevice) == slab->dmaLocked.end ()) {
+    if (!inDevice->DMABufferLock ((ULWord *) slab->data, slab->size, true))
+      GST_WARNING ("Failed to pre-lock %" G_GSIZE_FORMAT " bytes of arena memory",
+          (gsize) slab->size);
+    slab->dmaLocked.push_back (inDevice);
+  }
+
+  Usage & usage = mUsage[inOwner];
+  usage.bytes += blockSize;
+  usage.blocks++;
+  usage.peakBytes = MAX (usage.peakBytes, usage.bytes);
+
+  return data;
+}
+
+
+void
+NTV2GstArena::Free (uint8_t * inData, const std::string & inOwner)
+{
+  AJAAutoLock locker (&mLock);
+  Slab *slab = FindSlab (inData);
+
+  g_return_if_fail (slab != NULL);
+
+  mFree[slab->blockSize].push_back (inData);
+
+  Usage & usage = mUsage[inOwner];
+  usage.bytes -= slab->blockSize;
+  usage.blocks--;
+}
+
+
+bool
+NTV2GstArena::Contains (const uint8_t * inData)
+{
+  AJAAutoLock locker (&mLock);
+
+  return FindSlab (inData) != NULL;
+}
+
+
+void
+NTV2GstArena::ReleaseDevice (NTV2GstDevice * inDevice)
+{
+  AJAAutoLock locker (&mLock);
+
+  for (std::map<uint8_t *, Slab *>::iterator it = mSlabs.begin ();
+      it != mSlabs.end (); ++it) {
+    Slab *slab = it->second;
+    std::vector<NTV2GstDevice *>::iterator dev =
+        std::find (slab->dmaLocked.begin (), slab->dmaLocked.end (), inDevice);
+
+    if (dev == slab->dmaLocked.end ())
+      continue;
+
+    inDevice->DMABufferUnlock ((ULWord *) slab->data, slab->size);
+    slab->dmaLocked.erase (dev);
+  }
+}
+
+
+std::string
+NTV2GstArena::DescribeUsage (void)
+{
+  AJAAutoLock locker (&mLock);
+  size_t freeBytes = 0;
+
+  for (std::map<size_t, std::vector<uint8_t *> >::iterator it = mFree.begin ();
+      it != mFree.end (); ++it)
+    freeBytes += it->first * it->second.size ();
+
+  gchar *summary = g_strdup_printf ("DMA arena of device %s: %" G_GSIZE_FORMAT
+      " MiB in %u slabs, %" G_GSIZE_FORMAT " MiB free", mDeviceSpecifier.c_str (),
+      (gsize) (mMappedBytes >> 20), (guint) mSlabs.size (),
+      (gsize) (freeBytes >> 20));
+  std::string description (summary);
+  g_free (summary);
+
+  for (std::map<std::string, Usage>::iterator it = mUsage.begin ();
+      it != mUsage.end (); ++it) {
+    gchar *owner = g_strdup_printf ("; %s: %u blocks, %" G_GSIZE_FORMAT
+        " KiB (peak %" G_GSIZE_FORMAT " KiB)", it->first.c_str (),
+        it->second.blocks, (gsize) (it->second.bytes / 1024),
+        (gsize) (it->second.peakBytes / 1024));
+    description += owner;
+    g_free (owner);
+  }
+
+  return description;
+}
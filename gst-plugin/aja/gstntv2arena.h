@@ -0,0 +1,115 @@
+/**
+    @file        gstntv2arena.h
+    @brief       Declares the NTV2GstArena class, the DMA memory shared by all channels of one device.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_ARENA_H
+#define _GST_NTV2_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ajabase/system/lock.h"
+
+class NTV2GstDevice;
+
+
+/**
+    @brief    Host memory for the video and audio pools of all channels of one device. Memory is
+              mapped in slabs of equally sized blocks, one size class per slab, placed on the
+              device's NUMA node, faulted in and locked once per slab. Blocks freed by a pool go
+              back to the arena and keep all of that, so restarting a pipeline or another channel
+              of the same size class reuses them without any locking.
+              The driver's DMA locks belong to a device handle, so each slab is locked once for
+              every handle that transfers into it, and stays locked until ReleaseDevice.
+              All arenas of the process share one budget, see SetBudget.
+**/
+
+class NTV2GstArena
+{
+    public:
+                                NTV2GstArena (const std::string & inDeviceSpecifier);
+        virtual                 ~NTV2GstArena ();
+
+        /**
+            @brief    Sets the most memory all arenas of the process map together, 0 for automatic:
+                      RLIMIT_MEMLOCK for arenas that lock their memory (unless CAP_IPC_LOCK lifts it)
+                      and no limit otherwise.
+        **/
+        static void             SetBudget (size_t inBytes);
+
+        /**
+            @brief    Makes sure at least inCount blocks of at least inSize bytes are free, mapping one
+                      new slab for the missing ones, as far as the budget allows.
+            @param[in]    inNUMANode        NUMA node of a new slab, -1 for anywhere.
+            @param[in]    inHugePageSize    Largest huge page size of a new slab, 0 for regular pages.
+            @param[in]    inLockMemory      mlock() a new slab.
+            @return   The number of free blocks of that size.
+        **/
+        virtual uint32_t        Reserve (size_t inSize, uint32_t inCount, int inNUMANode,
+                                         size_t inHugePageSize, bool inLockMemory);
+
+        /**
+            @brief    Takes a free block of at least inSize bytes for inOwner, DMA locked on inDevice.
+            @return   The block, or NULL if none is free.
+        **/
+        virtual uint8_t *       Alloc (size_t inSize, const std::string & inOwner, NTV2GstDevice * inDevice);
+
+        /**
+            @brief    Gives a block back. It stays mapped and locked for the next Alloc.
+        **/
+        virtual void            Free (uint8_t * inData, const std::string & inOwner);
+
+        /**
+            @brief    Returns true if the block belongs to this arena.
+        **/
+        virtual bool            Contains (const uint8_t * inData);
+
+        /**
+            @brief    Drops the DMA locks of a device handle that is about to be closed.
+        **/
+        virtual void            ReleaseDevice (NTV2GstDevice * inDevice);
+
+        /**
+            @brief    Describes the arena's memory and what each owner uses of it, for the log.
+        **/
+        virtual std::string     DescribeUsage (void);
+
+    protected:
+        typedef struct
+        {
+            uint8_t *               data;
+            size_t                  size;                   /// Bytes mapped
+            size_t                  blockSize;              /// Size class of the slab
+            size_t                  pageSize;               /// Huge page size, 0 for regular pages
+            bool                    locked;                 /// mlock()ed
+            std::vector<NTV2GstDevice *> dmaLocked;         /// Device handles the slab is DMA locked on
+        } Slab;
+
+        typedef struct
+        {
+            size_t                  bytes;                  /// Bytes of the blocks in use
+            uint32_t                blocks;
+            size_t                  peakBytes;
+        } Usage;
+
+        static size_t           GetClassSize (size_t inSize);
+        virtual Slab *          FindSlab (const uint8_t * inData);
+
+    private:
+        const std::string                           mDeviceSpecifier;
+        AJALock                                     mLock;          /// Protects everything below
+        std::map<uint8_t *, Slab *>                 mSlabs;         /// By start address
+        std::map<size_t, std::vector<uint8_t *> >   mFree;          /// Free blocks by size class, most recently freed last
+        std::map<std::string, Usage>                mUsage;         /// By owner
+        size_t                                      mMappedBytes;
+        bool                                        mBudgetWarned;
+};
+
+#endif    //    _GST_NTV2_ARENA_H
@@ -0,0 +1,334 @@
+/**
+    @file        gstntv2copy.cpp
+    @brief       Implementation of the copy engine used for frame sized copies of captured memory.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <gst/gst.h>
+
+#include "gstntv2copy.h"
+
+#include "ajabase/system/thread.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_copy_debug);
+#define GST_CAT_DEFAULT gst_ntv2_copy_debug
+
+// Below this a copy stays in the caches anyway, memcpy is as fast
+#define NTV2_COPY_STREAMING_MIN     (1024 * 1024)
+// Below this the workers cost more than they save
+#define NTV2_COPY_PARALLEL_MIN      (4 * 1024 * 1024)
+#define NTV2_COPY_CHUNK_MIN         (2 * 1024 * 1024)
+#define NTV2_COPY_MAX_WORKERS       4
+
+typedef void (*NTV2GstCopyFunc) (uint8_t * outDst, const uint8_t * inSrc,
+    size_t inSize);
+
+// One copy, split into chunks that the caller and the workers claim one by
+// one. Lives on the caller's stack until done and nobody is active in it.
+typedef struct
+{
+  uint8_t *dst;
+  const uint8_t *src;
+  size_t size;
+  size_t chunkSize;
+  size_t numChunks;
+  std::atomic<size_t> nextChunk;
+  size_t doneChunks;                        // Under copy_lock
+  guint active;                             // Workers copying chunks, under copy_lock
+} CopyJob;
+
+static NTV2GstCopyFunc copy_func = NULL;
+static const char *copy_func_name = "memcpy";
+
+static GMutex copy_lock;
+static GCond copy_work_cond;                // Signalled when a job was queued
+static GCond copy_done_cond;                // Signalled when chunks are done
+static GQueue copy_jobs = G_QUEUE_INIT;     // Jobs with chunks left to claim
+static guint copy_num_workers = 0;
+
+
+#if defined(__x86_64__)
+
+// Each starts with a regular copy up to the first aligned destination
+// address and ends with one for the tail, the stores are weakly ordered
+// until the fence
+
+static void
+_copy_sse2 (uint8_t * outDst, const uint8_t * inSrc, size_t inSize)
+{
+  const size_t head = MIN ((16 - ((uintptr_t) outDst & 15)) & 15, inSize);
+
+  memcpy (outDst, inSrc, head);
+  outDst += head;
+  inSrc += head;
+  inSize -= head;
+
+  for (; inSize >= 64; inSize -= 64, outDst += 64, inSrc += 64) {
+    const __m128i a = _mm_loadu_si128 ((const __m128i *) inSrc);
+    const __m128i b = _mm_loadu_si128 ((const __m128i *) (inSrc + 16));
+    const __m128i c = _mm_loadu_si128 ((const __m128i *) (inSrc + 32));
+    const __m128i d = _mm_loadu_si128 ((const __m128i *) (inSrc + 48));
+
+    _mm_stream_si128 ((__m128i *) outDst, a);
+    _mm_stream_si128 ((__m128i *) (outDst + 16), b);
+    _mm_stream_si128 ((__m128i *) (outDst + 32), c);
+    _mm_stream_si128 ((__m128i *) (outDst + 48), d);
+  }
+  _mm_sfence ();
+
+  memcpy (outDst, inSrc, inSize);
+}
+
+
+__attribute__ ((target ("avx2")))
+static void
+_copy_avx2 (uint8_t * outDst, const uint8_t * inSrc, size_t inSize)
+{
+  const size_t head = MIN ((32 - ((uintptr_t) outDst & 31)) & 31, inSize);
+
+  memcpy (outDst, inSrc, head);
+  outDst += head;
+  inSrc += head;
+  inSize -= head;
+
+  for (; inSize >= 128; inSize -= 128, outDst += 128, inSrc += 128) {
+    const __m256i a = _mm256_loadu_si256 ((const __m256i *) inSrc);
+    const __m256i b = _mm256_loadu_si256 ((const __m256i *) (inSrc + 32));
+    const __m256i c = _mm256_loadu_si256 ((const __m256i *) (inSrc + 64));
+    const __m256i d = _mm256_loadu_si256 ((const __m256i *) (inSrc + 96));
+
+    _mm256_stream_si256 ((__m256i *) outDst, a);
+    _mm256_stream_si256 ((__m256i *) (outDst + 32), b);
+    _mm256_stream_si256 ((__m256i *) (outDst + 64), c);
+    _mm256_stream_si256 ((__m256i *) (outDst + 96), d);
+  }
+  _mm_sfence ();
+
+  memcpy (outDst, inSrc, inSize);
+}
+
+
+__attribute__ ((target ("avx512f")))
+static void
+_copy_avx512 (uint8_t * outDst, const uint8_t * inSrc, size_t inSize)
+{
+  const size_t head = MIN ((64 - ((uintptr_t) outDst & 63)) & 63, inSize);
+
+  memcpy (outDst, inSrc, head);
+  outDst += head;
+  inSrc += head;
+  inSize -= head;
+
+  for (; inSize >= 256; inSize -= 256, outDst += 256, inSrc += 256) {
+    const __m512i a = _mm512_loadu_si512 ((const void *) inSrc);
+    const __m512i b = _mm512_loadu_si512 ((const void *) (inSrc + 64));
+    const __m512i c = _mm512_loadu_si512 ((const void *) (inSrc + 128));
+    const __m512i d = _mm512_loadu_si512 ((const void *) (inSrc + 192));
+
+    _mm512_stream_si512 ((__m512i *) outDst, a);
+    _mm512_stream_si512 ((__m512i *) (outDst + 64), b);
+    _mm512_stream_si512 ((__m512i *) (outDst + 128), c);
+    _mm512_stream_si512 ((__m512i *) (outDst + 192), d);
+  }
+  _mm_sfence ();
+
+  memcpy (outDst, inSrc, inSize);
+}
+
+#elif defined(__aarch64__)
+
+// STNP is only a hint, the core may still allocate the lines, but the
+// Carmel and Cortex cores of the Jetson modules honour it for streaming
+static void
+_copy_neon (uint8_t * outDst, const uint8_t * inSrc, size_t inSize)
+{
+  for (; inSize >= 64; inSize -= 64, outDst += 64, inSrc += 64) {
+    __asm__ volatile ("ldp q0, q1, [%1]\n\t"
+        "ldp q2, q3, [%1, #32]\n\t"
+        "stnp q0, q1, [%0]\n\t"
+        "stnp q2, q3, [%0, #32]\n\t"
+        : : "r" (outDst), "r" (inSrc) : "v0", "v1", "v2", "v3", "memory");
+  }
+
+  memcpy (outDst, inSrc, inSize);
+}
+
+#endif
+
+
+static void
+_copy_memcpy (uint8_t * outDst, const uint8_t * inSrc, size_t inSize)
+{
+  memcpy (outDst, inSrc, inSize);
+}
+
+
+// Claims and copies chunks until none are left, returns how many
+static size_t
+_copy_run_chunks (CopyJob * job)
+{
+  size_t done = 0;
+  size_t chunk;
+
+  while ((chunk = job->nextChunk.fetch_add (1)) < job->numChunks) {
+    const size_t offset = chunk * job->chunkSize;
+
+    copy_func (job->dst + offset, job->src + offset,
+        MIN (job->chunkSize, job->size - offset));
+    done++;
+  }
+
+  return done;
+}
+
+
+static void
+_copy_worker (AJAThread * pThread, void *pContext)
+{
+  (void) pThread;
+  (void) pContext;
+
+  g_mutex_lock (&copy_lock);
+  while (true) {
+    CopyJob *job = (CopyJob *) g_queue_peek_head (&copy_jobs);
+
+    if (!job) {
+      g_cond_wait (&copy_work_cond, &copy_lock);
+      continue;
+    }
+
+    // Everything claimed, the others finish it
+    if (job->nextChunk.load () >= job->numChunks) {
+      g_queue_pop_head (&copy_jobs);
+      continue;
+    }
+
+    job->active++;
+    g_mutex_unlock (&copy_lock);
+    const size_t done = _copy_run_chunks (job);
+    g_mutex_lock (&copy_lock);
+    job->active--;
+    job->doneChunks += done;
+    g_cond_broadcast (&copy_done_cond);
+  }
+  g_mutex_unlock (&copy_lock);
+}
+
+
+static void
+_init_ntv2_copy (void)
+{
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+#ifndef GST_DISABLE_GST_DEBUG
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_copy_debug, "ajantv2copy", 0,
+        "AJA ntv2 copy engine");
+#endif
+
+    copy_func = _copy_memcpy;
+#if defined(__x86_64__)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx512f")) {
+      copy_func = _copy_avx512;
+      copy_func_name = "AVX-512 streaming stores";
+    } else if (__builtin_cpu_supports ("avx2")) {
+      copy_func = _copy_avx2;
+      copy_func_name = "AVX2 streaming stores";
+    } else {
+      copy_func = _copy_sse2;
+      copy_func_name = "SSE2 streaming stores";
+    }
+#elif defined(__aarch64__)
+    copy_func = _copy_neon;
+    copy_func_name = "NEON non-temporal pair stores";
+#endif
+
+    // Half the cores at most, the capture and streaming threads need theirs
+    copy_num_workers = MIN ((guint) NTV2_COPY_MAX_WORKERS,
+        (guint) g_get_num_processors () / 2);
+    for (guint i = 0; i < copy_num_workers; i++) {
+      // Shared by all copies of the process for as long as it runs
+      AJAThread *thread = new AJAThread ();
+
+      thread->Attach (_copy_worker, NULL);
+      thread->Start ();
+    }
+
+    GST_INFO ("Copying with %s on up to %u threads", copy_func_name,
+        copy_num_workers + 1);
+
+    g_once_init_leave (&_init, 1);
+  }
+}
+
+
+const char *
+NTV2GstCopyDescribe (void)
+{
+  _init_ntv2_copy ();
+
+  return copy_func_name;
+}
+
+
+void
+NTV2GstCopyMemory (void *outDst, const void *inSrc, size_t inSize)
+{
+  if (inSize < NTV2_COPY_STREAMING_MIN) {
+    memcpy (outDst, inSrc, inSize);
+    return;
+  }
+
+  _init_ntv2_copy ();
+
+  const gint64 start = g_get_monotonic_time ();
+  CopyJob job;
+
+  job.dst = (uint8_t *) outDst;
+  job.src = (const uint8_t *) inSrc;
+  job.size = inSize;
+  job.numChunks = 1;
+  if (inSize >= NTV2_COPY_PARALLEL_MIN && copy_num_workers > 0)
+    job.numChunks = MIN ((size_t) copy_num_workers + 1,
+        inSize / NTV2_COPY_CHUNK_MIN);
+  // Page aligned chunks, so no two threads ever store to the same line
+  job.chunkSize = GST_ROUND_UP_N ((inSize + job.numChunks - 1) / job.numChunks,
+      (size_t) 4096);
+  job.numChunks = (inSize + job.chunkSize - 1) / job.chunkSize;
+  job.nextChunk = 0;
+  job.doneChunks = 0;
+  job.active = 0;
+
+  if (job.numChunks == 1) {
+    copy_func (job.dst, job.src, inSize);
+  } else {
+    g_mutex_lock (&copy_lock);
+    g_queue_push_tail (&copy_jobs, &job);
+    g_cond_broadcast (&copy_work_cond);
+    g_mutex_unlock (&copy_lock);
+
+    const size_t done = _copy_run_chunks (&job);
+
+    g_mutex_lock (&copy_lock);
+    job.doneChunks += done;
+    g_queue_remove (&copy_jobs, &job);
+    while (job.doneChunks < job.numChunks || job.active > 0)
+      g_cond_wait (&copy_done_cond, &copy_lock);
+    g_mutex_unlock (&copy_lock);
+  }
+
+  const gint64 elapsed = MAX (g_get_monotonic_time () - start, (gint64) 1);
+  GST_DEBUG ("Copied %" G_GSIZE_FORMAT " KiB in %" G_GINT64_FORMAT " us "
+      "(%.2f GB/s, %" G_GSIZE_FORMAT " chunks, %s)", (gsize) (inSize / 1024),
+      elapsed, (double) inSize / (elapsed * 1000.0), (gsize) job.numChunks,
+      copy_func_name);
+}
@@ -0,0 +1,31 @@
+/**
+    @file        gstntv2copy.h
+    @brief       Declares the copy engine used for frame sized copies of captured memory.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_COPY_H
+#define _GST_NTV2_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+    @brief    Copies inSize bytes. Frame sized copies are split across a few worker threads that
+              the calling thread helps out, and are written with non-temporal stores (AVX-512,
+              AVX2 or SSE2 on x86-64, NEON on AArch64, chosen at runtime) so that they neither read
+              the destination first nor evict the caches the consumers work in. Small copies are a
+              plain memcpy on the calling thread.
+    @note     Thread-safe. The workers are started by the first large copy and shared by the whole
+              process.
+**/
+void        NTV2GstCopyMemory (void * outDst, const void * inSrc, size_t inSize);
+
+/**
+    @brief    Names the store instructions large copies use, for the log.
+**/
+const char *NTV2GstCopyDescribe (void);
+
+#endif    //    _GST_NTV2_COPY_H
@@ -0,0 +1,900 @@
+/**
+    @file        gstntv2device.cpp
+    @brief       Implementation of the NTV2GstDevice interface for hardware and simulated devices.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <string.h>
+#include <math.h>
+
+#include <gst/gst.h>
+
+#include "gstntv2device.h"
+#include "gstntv2topology.h"
+#include "ntv2utils.h"
+#include "ntv2devicescanner.h"
+#include "ntv2formatdescriptor.h"
+#include "ntv2endian.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_device_debug);
+#define GST_CAT_DEFAULT gst_ntv2_device_debug
+
+// Default number of device frame buffers of the simulated device
+#define SIM_DEFAULT_FRAME_BUFFERS   7
+// Default audio channel count of the simulated device
+#define SIM_DEFAULT_AUDIO_CHANNELS  16
+// Length of one period of the 1kHz test tone at 48kHz
+#define SIM_TONE_PERIOD             48
+
+static void
+_init_ntv2_device_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_device_debug, "ajantv2device", 0,
+        "AJA ntv2 device");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+NTV2GstDevice *
+NTV2GstDevice::Create (const std::string & inDeviceSpecifier)
+{
+  _init_ntv2_device_debug ();
+
+  if (inDeviceSpecifier == NTV2_SIM_DEVICE_PREFIX ||
+      inDeviceSpecifier.compare (0, strlen (NTV2_SIM_DEVICE_PREFIX ":"),
+          NTV2_SIM_DEVICE_PREFIX ":") == 0)
+    return new NTV2GstSimDevice (inDeviceSpecifier);
+
+  return new NTV2GstCardDevice (inDeviceSpecifier);
+}
+
+
+NTV2GstCardDevice::NTV2GstCardDevice (const std::string & inDeviceSpecifier)
+:
+mDeviceSpecifier (inDeviceSpecifier),
+mStatusChannel (NTV2_CHANNEL_INVALID),
+mStatusSource (NTV2_INPUTSOURCE_INVALID)
+{
+}
+
+
+bool NTV2GstCardDevice::Open (void)
+{
+  if (!CNTV2DeviceScanner::GetFirstDeviceFromArgument (mDeviceSpecifier,
+          mCard))
+    return false;
+
+  mCard.SetEveryFrameServices (NTV2_OEM_TASKS);       //    Since this is an OEM app, use the OEM service level
+
+  std::string serialNumber;
+
+  if (!mCard.GetSerialNumberString (serialNumber))
+    serialNumber = "(none)";
+
+  GST_DEBUG ("Opened device with ID %d (%s, version %s, serial number %s)",
+      mCard.GetDeviceID (), mCard.GetDisplayName ().c_str (),
+      mCard.GetDeviceVersionString ().c_str (), serialNumber.c_str ());
+  GST_DEBUG ("Using SDK version %d.%d.%d.%d (%s) and driver version %s",
+      AJA_NTV2_SDK_VERSION_MAJOR, AJA_NTV2_SDK_VERSION_MINOR,
+      AJA_NTV2_SDK_VERSION_POINT, AJA_NTV2_SDK_BUILD_NUMBER,
+      AJA_NTV2_SDK_BUILD_DATETIME, mCard.GetDriverVersionString ().c_str ());
+
+  // So we can configure each channel separately
+  mCard.SetMultiFormatMode (true);
+
+  return true;
+}
+
+
+int
+NTV2GstCardDevice::GetNUMANode (void)
+{
+  return NTV2GstTopologyGetDeviceNode (mCard.GetIndexNumber ());
+}
+
+
+// *INDENT-OFF*
+// Registers making up the channel status snapshot, indexed by channel
+static const ULWord kInputStatusRegs[NTV2_MAX_NUM_CHANNELS] =
+{
+    kRegInputStatus,            kRegInputStatus,            kRegInputStatus2,           kRegInputStatus2,
+    kRegInput56Status,          kRegInput56Status,          kRegInput78Status,          kRegInput78Status
+};
+
+static const ULWord kSDIStatusRegs[NTV2_MAX_NUM_CHANNELS] =
+{
+    kRegSDIInput3GStatus,       kRegSDIInput3GStatus,       kRegSDIInput3GStatus2,      kRegSDIInput3GStatus2,
+    kRegSDI5678Input3GStatus,   kRegSDI5678Input3GStatus,   kRegSDI5678Input3GStatus,   kRegSDI5678Input3GStatus
+};
+
+// Each channel has its status in one byte of the 3G status register
+static const ULWord kSDIStatusShifts[NTV2_MAX_NUM_CHANNELS] =
+{
+    0, 8, 0, 8, 0, 8, 16, 24
+};
+
+static const ULWord kVPIDARegs[NTV2_MAX_NUM_CHANNELS] =
+{
+    kRegSDIIn1VPIDA,            kRegSDIIn2VPIDA,            kRegSDIIn3VPIDA,            kRegSDIIn4VPIDA,
+    kRegSDIIn5VPIDA,            kRegSDIIn6VPIDA,            kRegSDIIn7VPIDA,            kRegSDIIn8VPIDA
+};
+
+static const ULWord kVPIDBRegs[NTV2_MAX_NUM_CHANNELS] =
+{
+    kRegSDIIn1VPIDB,            kRegSDIIn2VPIDB,            kRegSDIIn3VPIDB,            kRegSDIIn4VPIDB,
+    kRegSDIIn5VPIDB,            kRegSDIIn6VPIDB,            kRegSDIIn7VPIDB,            kRegSDIIn8VPIDB
+};
+
+static const ULWord kGlobalControlRegs[NTV2_MAX_NUM_CHANNELS] =
+{
+    kRegGlobalControl,          kRegGlobalControlCh2,       kRegGlobalControlCh3,       kRegGlobalControlCh4,
+    kRegGlobalControlCh5,       kRegGlobalControlCh6,       kRegGlobalControlCh7,       kRegGlobalControlCh8
+};
+// *INDENT-ON*
+
+// Vertical blank and field ID bits of the input status register change every
+// field and say nothing about the format
+#define INPUT_STATUS_FIELD_BITS     (BIT(20) | BIT(21) | BIT(22) | BIT(23))
+
+enum
+{
+  STATUS_READ_INPUT = 0,
+  STATUS_READ_SDI,
+  STATUS_READ_VPID_A,
+  STATUS_READ_VPID_B,
+  STATUS_READ_GLOBAL_CONTROL,
+};
+
+bool
+NTV2GstCardDevice::ReadChannelStatus (const NTV2Channel inChannel,
+    const NTV2InputSource inInputSource, NTV2GstChannelStatus & outStatus)
+{
+  memset (&outStatus, 0, sizeof (outStatus));
+  if (!NTV2_IS_VALID_CHANNEL (inChannel))
+    return false;
+
+  if (inChannel != mStatusChannel || inInputSource != mStatusSource) {
+    mStatusReads.clear ();
+    mStatusReads.push_back (NTV2RegInfo (NTV2_INPUT_SOURCE_IS_HDMI (inInputSource) ?
+            (ULWord) kRegHDMIInputStatus : kInputStatusRegs[inChannel]));
+    mStatusReads.push_back (NTV2RegInfo (kSDIStatusRegs[inChannel]));
+    mStatusReads.push_back (NTV2RegInfo (kVPIDARegs[inChannel]));
+    mStatusReads.push_back (NTV2RegInfo (kVPIDBRegs[inChannel]));
+    mStatusReads.push_back (NTV2RegInfo (kGlobalControlRegs[inChannel]));
+    mStatusChannel = inChannel;
+    mStatusSource = inInputSource;
+  }
+
+  if (!mCard.ReadRegisters (mStatusReads))
+    return false;
+
+  const ULWord sdiStatus = mStatusReads[STATUS_READ_SDI].registerValue;
+  const ULWord sdiShift = kSDIStatusShifts[inChannel];
+
+  outStatus.inputStatus = mStatusReads[STATUS_READ_INPUT].registerValue;
+  if (!NTV2_INPUT_SOURCE_IS_HDMI (inInputSource))
+    outStatus.inputStatus &= ~INPUT_STATUS_FIELD_BITS;
+  outStatus.sdiStatus = (sdiStatus >> sdiShift) & 0xff;
+
+  // Same as ReadSDIInVPID(): only valid if link A says so
+  if (outStatus.sdiStatus & kRegMaskSDIInVPIDLinkAValid) {
+    outStatus.vpidA = NTV2EndianSwap32BtoH (mStatusReads[STATUS_READ_VPID_A].registerValue);
+    outStatus.vpidB = NTV2EndianSwap32BtoH (mStatusReads[STATUS_READ_VPID_B].registerValue);
+  }
+
+  outStatus.geometry = (NTV2FrameGeometry)
+      ((mStatusReads[STATUS_READ_GLOBAL_CONTROL].registerValue & kRegMaskGeometry)
+      >> kRegShiftGeometry);
+
+  return true;
+}
+
+
+// *INDENT-OFF*
+// 75% colour bars: white, yellow, cyan, green, magenta, red, blue, black
+static const uint8_t kBarsYCbCr[8][3] =
+{
+    {180, 128, 128}, {168,  44, 136}, {145, 147,  44}, {133,  63,  52},
+    { 63, 193, 204}, { 51, 109, 212}, { 28, 212, 120}, { 16, 128, 128}
+};
+
+static const uint8_t kBarsRGB[8][3] =
+{
+    {191, 191, 191}, {191, 191,   0}, {  0, 191, 191}, {  0, 191,   0},
+    {191,   0, 191}, {191,   0,   0}, {  0,   0, 191}, {  0,   0,   0}
+};
+// *INDENT-ON*
+
+NTV2GstSimDevice::NTV2GstSimDevice (const std::string & inDeviceSpecifier)
+:
+mDeviceSpecifier (inDeviceSpecifier),
+mSignalFormat (NTV2_FORMAT_UNKNOWN),
+mRealtime (true),
+mFillFrames (true),
+mFrameBufferOverride (0),
+mDropInterval (0),
+mSignalLossInterval (0),
+mSignalLossDuration (0),
+mVPIDOverride (0),
+mNUMANode (-1),
+mVideoFormat (NTV2_FORMAT_UNKNOWN),
+mPixelFormat (NTV2_FBF_8BIT_YCBCR),
+mCaptureTall (false),
+mNumAudioChannels (SIM_DEFAULT_AUDIO_CHANNELS),
+mFrameDuration (1000000.0 * 1001.0 / 30000.0),
+mFrameRate (NTV2_FRAMERATE_2997),
+mState (NTV2_AUTOCIRCULATE_DISABLED),
+mNumFrameBuffers (SIM_DEFAULT_FRAME_BUFFERS),
+mStartMonotonic (0),
+mStartReal (0),
+mVirtualTime (0),
+mNextIndex (0),
+mFramesProcessed (0),
+mFramesDropped (0),
+mLockedBytes (0)
+{
+  size_t pos = inDeviceSpecifier.find (':');
+
+  if (pos != std::string::npos)
+    ParseOptions (inDeviceSpecifier.substr (pos + 1));
+}
+
+
+NTV2GstSimDevice::~NTV2GstSimDevice ()
+{
+  if (mLockedBytes > 0)
+    GST_WARNING ("%" G_GUINT64_FORMAT " bytes still locked on close",
+        mLockedBytes);
+}
+
+
+void
+NTV2GstSimDevice::ParseOptions (const std::string & inOptions)
+{
+  gchar **options = g_strsplit (inOptions.c_str (), ",", -1);
+
+  for (gchar ** option = options; *option; option++) {
+    gchar **kv = g_strsplit (*option, "=", 2);
+
+    if (!kv[0] || !kv[1]) {
+      if (kv[0] && *kv[0])
+        GST_WARNING ("Ignoring simulated device option '%s' without value",
+            kv[0]);
+      g_strfreev (kv);
+      continue;
+    }
+
+    guint64 value = g_ascii_strtoull (kv[1], NULL, 0);
+
+    if (g_str_equal (kv[0], "format")) {
+      mSignalFormat = (NTV2VideoFormat) value;
+    } else if (g_str_equal (kv[0], "realtime")) {
+      mRealtime = value != 0;
+    } else if (g_str_equal (kv[0], "pattern")) {
+      mFillFrames = !g_str_equal (kv[1], "none");
+    } else if (g_str_equal (kv[0], "frames")) {
+      mFrameBufferOverride = MAX (value, 2);
+    } else if (g_str_equal (kv[0], "drop-interval")) {
+      mDropInterval = value;
+    } else if (g_str_equal (kv[0], "signal-loss-interval")) {
+      mSignalLossInterval = value;
+    } else if (g_str_equal (kv[0], "signal-loss-duration")) {
+      mSignalLossDuration = value;
+    } else if (g_str_equal (kv[0], "vpid")) {
+      mVPIDOverride = value;
+    } else if (g_str_equal (kv[0], "numa-node")) {
+      mNUMANode = (int) value;
+    } else {
+      GST_WARNING ("Unknown simulated device option '%s'", kv[0]);
+    }
+
+    g_strfreev (kv);
+  }
+  g_strfreev (options);
+
+  if (mSignalLossDuration >= mSignalLossInterval)
+    mSignalLossDuration = mSignalLossInterval > 0 ? mSignalLossInterval - 1 : 0;
+}
+
+
+bool NTV2GstSimDevice::Open (void)
+{
+  AJAAutoLock locker (&mLock);
+
+  mStartMonotonic = g_get_monotonic_time ();
+  mStartReal = g_get_real_time ();
+  mVirtualTime = mStartMonotonic;
+
+  GST_DEBUG ("Opened simulated device '%s' (%s, signal format %d, "
+      "drop interval %u, signal loss %u/%u)", mDeviceSpecifier.c_str (),
+      mRealtime ? "realtime" : "free running", (int) mSignalFormat,
+      mDropInterval, mSignalLossDuration, mSignalLossInterval);
+
+  return true;
+}
+
+
+int64_t NTV2GstSimDevice::Now (void) const
+{
+  return mRealtime ? g_get_monotonic_time () : mVirtualTime;
+}
+
+
+// Monotonic time at which the vertical interrupt completing frame inIndex fires
+int64_t NTV2GstSimDevice::FrameTime (uint64_t inIndex) const
+{
+  return mStartMonotonic + (int64_t) ((inIndex + 1) * mFrameDuration);
+}
+
+
+// Index of the frame that is currently being captured
+uint64_t NTV2GstSimDevice::CurrentIndex (void) const
+{
+  int64_t now = Now ();
+
+  if (now <= mStartMonotonic)
+    return 0;
+
+  return (uint64_t) ((now - mStartMonotonic) / mFrameDuration);
+}
+
+
+bool NTV2GstSimDevice::InSignalLoss (uint64_t inIndex) const
+{
+  if (mSignalLossInterval == 0 || mSignalLossDuration == 0)
+    return false;
+
+  return (inIndex % mSignalLossInterval) >=
+      mSignalLossInterval - mSignalLossDuration;
+}
+
+
+// Account for all vertical interrupts that happened since the last call,
+// like the driver does from its interrupt handler
+void
+NTV2GstSimDevice::Advance (void)
+{
+  if (mState != NTV2_AUTOCIRCULATE_RUNNING)
+    return;
+
+  int64_t now = Now ();
+
+  while (FrameTime (mNextIndex) <= now) {
+    uint64_t index = mNextIndex++;
+
+    if (InSignalLoss (index))
+      continue;
+
+    if ((mDropInterval > 0 && (index + 1) % mDropInterval == 0) ||
+        mReadyFrames.size () >= mNumFrameBuffers - 1) {
+      mFramesDropped++;
+      continue;
+    }
+
+    SimFrame frame;
+    frame.index = index;
+    frame.frameTime =
+        (mStartReal + (FrameTime (index) - mStartMonotonic)) * 10;
+    mReadyFrames.push_back (frame);
+  }
+}
+
+
+bool
+NTV2GstSimDevice::ConfigureInput (const NTV2Channel inChannel,
+    const NTV2VideoFormat inVideoFormat,
+    const NTV2FrameBufferFormat inPixelFormat, const bool inCaptureTall)
+{
+  AJAAutoLock locker (&mLock);
+
+  mVideoFormat = inVideoFormat;
+  mPixelFormat = inPixelFormat;
+  mCaptureTall = inCaptureTall;
+  mFrameRate = GetNTV2FrameRateFromVideoFormat (mVideoFormat);
+
+  double fps = GetFramesPerSecond (mFrameRate);
+  if (fps <= 0.0) {
+    GST_ERROR ("Unsupported video format %d", (int) mVideoFormat);
+    return false;
+  }
+  mFrameDuration = 1000000.0 / fps;
+
+  // Restart counting vertical interrupts with the new frame duration
+  int64_t now = Now ();
+  mStartReal += now - mStartMonotonic;
+  mStartMonotonic = now;
+  mNextIndex = 0;
+
+  RenderPattern ();
+
+  GST_DEBUG ("Configured simulated channel %d for format %d, pixel format %d,"
+      " %" G_GSIZE_FORMAT " bytes per frame", (int) inChannel,
+      (int) mVideoFormat, (int) mPixelFormat, mPattern.size ());
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::ConfigureAudio (const NTV2AudioSystem inAudioSystem,
+    const ULWord inNumChannels)
+{
+  AJAAutoLock locker (&mLock);
+
+  mNumAudioChannels = inNumChannels > 0 ? inNumChannels : SIM_DEFAULT_AUDIO_CHANNELS;
+
+  return true;
+}
+
+
+void
+NTV2GstSimDevice::RenderPattern (void)
+{
+  NTV2FormatDescriptor fd (mVideoFormat, mPixelFormat,
+      mCaptureTall ? NTV2_VANCMODE_TALL : NTV2_VANCMODE_OFF);
+  const ULWord rowBytes = fd.GetBytesPerRow ();
+  const ULWord rows = fd.GetFullRasterHeight ();
+  const ULWord width = fd.GetRasterWidth ();
+  const ULWord activeRows = MIN (::GetDisplayHeight (mVideoFormat), rows);
+  const ULWord vancRows = rows - activeRows;
+
+  mPattern.assign ((size_t) rowBytes * rows, 0);
+  if (width == 0)
+    return;
+
+  for (ULWord row = 0; row < rows; row++) {
+    uint8_t *line = &mPattern[(size_t) row * rowBytes];
+    bool black = row < vancRows;
+
+    switch (mPixelFormat) {
+      case NTV2_FBF_8BIT_YCBCR:
+        // UYVY
+        for (ULWord x = 0; x + 1 < width; x += 2) {
+          const uint8_t *c = kBarsYCbCr[black ? 7 : x * 8 / width];
+          line[2 * x + 0] = c[1];
+          line[2 * x + 1] = c[0];
+          line[2 * x + 2] = c[2];
+          line[2 * x + 3] = c[0];
+        }
+        break;
+      case NTV2_FBF_10BIT_YCBCR:
+        // v210, 6 pixels in 4 little endian words
+        for (ULWord x = 0; x + 5 < width; x += 6) {
+          const uint8_t *c = kBarsYCbCr[black ? 7 : x * 8 / width];
+          uint32_t y = c[0] << 2, cb = c[1] << 2, cr = c[2] << 2;
+          uint32_t *words = (uint32_t *) (line + x / 6 * 16);
+
+          words[0] = GUINT32_TO_LE (cb | (y << 10) | (cr << 20));
+          words[1] = GUINT32_TO_LE (y | (cb << 10) | (y << 20));
+          words[2] = GUINT32_TO_LE (cr | (y << 10) | (cb << 20));
+          words[3] = GUINT32_TO_LE (y | (cr << 10) | (y << 20));
+        }
+        break;
+      case NTV2_FBF_ABGR:
+        for (ULWord x = 0; x < width; x++) {
+          const uint8_t *c = kBarsRGB[black ? 7 : x * 8 / width];
+          line[4 * x + 0] = c[0];
+          line[4 * x + 1] = c[1];
+          line[4 * x + 2] = c[2];
+          line[4 * x + 3] = 0xff;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+
+bool
+NTV2GstSimDevice::AutoCirculateInitForInput (const NTV2Channel inChannel,
+    const UWord inFrameCount, const NTV2AudioSystem inAudioSystem,
+    const ULWord inOptionFlags, const UByte inNumChannels,
+    const UWord inStartFrameNumber, const UWord inEndFrameNumber)
+{
+  AJAAutoLock locker (&mLock);
+
+  if (mFrameBufferOverride > 0)
+    mNumFrameBuffers = mFrameBufferOverride;
+  else if (inEndFrameNumber > inStartFrameNumber)
+    mNumFrameBuffers = inEndFrameNumber - inStartFrameNumber + 1;
+  else if (inFrameCount >= 2)
+    mNumFrameBuffers = inFrameCount;
+  else
+    mNumFrameBuffers = SIM_DEFAULT_FRAME_BUFFERS;
+
+  mState = NTV2_AUTOCIRCULATE_INIT;
+  mReadyFrames.clear ();
+  mFramesProcessed = 0;
+  mFramesDropped = 0;
+
+  return true;
+}
+
+
+bool NTV2GstSimDevice::AutoCirculateStart (const NTV2Channel inChannel)
+{
+  AJAAutoLock locker (&mLock);
+
+  if (mState != NTV2_AUTOCIRCULATE_INIT)
+    return false;
+
+  mState = NTV2_AUTOCIRCULATE_RUNNING;
+  mNextIndex = CurrentIndex ();
+
+  return true;
+}
+
+
+bool NTV2GstSimDevice::AutoCirculateStop (const NTV2Channel inChannel)
+{
+  AJAAutoLock locker (&mLock);
+
+  mState = NTV2_AUTOCIRCULATE_DISABLED;
+  mReadyFrames.clear ();
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::AutoCirculateGetStatus (const NTV2Channel inChannel,
+    AUTOCIRCULATE_STATUS & outStatus)
+{
+  AJAAutoLock locker (&mLock);
+
+  Advance ();
+
+  outStatus.acState = mState;
+  outStatus.acBufferLevel = mState == NTV2_AUTOCIRCULATE_RUNNING ?
+      mReadyFrames.size () + 1 : 0;
+  outStatus.acFramesProcessed = mFramesProcessed;
+  outStatus.acFramesDropped = mFramesDropped;
+
+  return true;
+}
+
+
+uint64_t NTV2GstSimDevice::AudioSampleAt (uint64_t inIndex) const
+{
+  return (uint64_t) (inIndex * mFrameDuration * 48000.0 / 1000000.0 + 0.5);
+}
+
+
+void
+NTV2GstSimDevice::FillAudio (ULWord * pOutBuffer, uint64_t inFirstSample,
+    ULWord inNumSamples)
+{
+  static int32_t tone[SIM_TONE_PERIOD];
+  static gsize tone_initialized = 0;
+
+  // 1kHz sine at -20dBFS
+  if (g_once_init_enter (&tone_initialized)) {
+    for (int i = 0; i < SIM_TONE_PERIOD; i++)
+      tone[i] = (int32_t) (0.1 * G_MAXINT32 * sin (2.0 * G_PI * i / SIM_TONE_PERIOD));
+    g_once_init_leave (&tone_initialized, 1);
+  }
+
+  int32_t *out = (int32_t *) pOutBuffer;
+  for (ULWord i = 0; i < inNumSamples; i++) {
+    int32_t sample = tone[(inFirstSample + i) % SIM_TONE_PERIOD];
+
+    for (ULWord c = 0; c < mNumAudioChannels; c++)
+      *out++ = sample;
+  }
+}
+
+
+void
+NTV2GstSimDevice::GetTimecode (uint64_t inIndex, NTV2_RP188 & outTimecode) const
+{
+  ULWord fps = (ULWord) (GetFramesPerSecond (mFrameRate) + 0.5);
+  ULWord frames, seconds, minutes, hours;
+  uint64_t count = inIndex;
+
+  // Timecode frame numbers only go up to 30, count frame pairs above that
+  if (fps > 30) {
+    fps /= 2;
+    count /= 2;
+  }
+
+  frames = count % fps;
+  seconds = (count / fps) % 60;
+  minutes = (count / fps / 60) % 60;
+  hours = (count / fps / 3600) % 24;
+
+  outTimecode.fDBB = 0;
+  outTimecode.fLo = (frames % 10) | ((frames / 10) << 8) |
+      ((seconds % 10) << 16) | ((seconds / 10) << 24);
+  outTimecode.fHi = (minutes % 10) | ((minutes / 10) << 8) |
+      ((hours % 10) << 16) | ((hours / 10) << 24);
+}
+
+
+bool
+NTV2GstSimDevice::AutoCirculateTransfer (const NTV2Channel inChannel,
+    AUTOCIRCULATE_TRANSFER & inOutXferInfo)
+{
+  AJAAutoLock locker (&mLock);
+
+  Advance ();
+
+  if (mState != NTV2_AUTOCIRCULATE_RUNNING || mReadyFrames.empty ())
+    return false;
+
+  SimFrame frame = mReadyFrames.front ();
+  mReadyFrames.pop_front ();
+  mFramesProcessed++;
+
+  // Video: copy the pre-rendered frame like the DMA engine would
+  void *video = inOutXferInfo.acVideoBuffer.GetHostPointer ();
+  ULWord videoSize = inOutXferInfo.acVideoBuffer.GetByteCount ();
+  const NTV2SegmentedDMAInfo & segments = inOutXferInfo.acInSegmentedDMAInfo;
+  if (video && mFillFrames && segments.acNumSegments > 1) {
+    // Segmented, line by line from the offset
+    const ULWord offset = inOutXferInfo.acInVideoDMAOffset;
+    for (ULWord i = 0; i < segments.acNumSegments; i++) {
+      const size_t from = offset + (size_t) i * segments.acSegmentDevicePitch;
+      const size_t to = (size_t) i * segments.acSegmentHostPitch;
+      if (from + segments.acNumActiveBytesPerRow > mPattern.size () ||
+          to + segments.acNumActiveBytesPerRow > videoSize)
+        break;
+      memcpy ((uint8_t *) video + to, &mPattern[from],
+          segments.acNumActiveBytesPerRow);
+    }
+  } else if (video && mFillFrames)
+    memcpy (video, mPattern.data (), MIN (videoSize, (ULWord) mPattern.size ()));
+
+  // Audio: 1601/1602 sample cadence follows from the frame duration
+  ULWord *audio = (ULWord *) inOutXferInfo.acAudioBuffer.GetHostPointer ();
+  ULWord audioSize = inOutXferInfo.acAudioBuffer.GetByteCount ();
+  ULWord audioBytes = 0;
+  if (audio && mNumAudioChannels > 0) {
+    uint64_t first = AudioSampleAt (frame.index);
+    ULWord samples = AudioSampleAt (frame.index + 1) - first;
+
+    samples = MIN (samples, audioSize / (mNumAudioChannels * 4));
+    FillAudio (audio, first, samples);
+    audioBytes = samples * mNumAudioChannels * 4;
+  }
+
+  // RP188, the same for all timecode indices
+  NTV2_RP188 timecode;
+  GetTimecode (frame.index, timecode);
+  for (int i = 0; i < NTV2_MAX_NUM_TIMECODE_INDEXES; i++)
+    inOutXferInfo.acTransferStatus.acFrameStamp.SetInputTimecode ((NTV2TCIndex) i, timecode);
+
+  inOutXferInfo.acTransferStatus.acState = mState;
+  inOutXferInfo.acTransferStatus.acBufferLevel = mReadyFrames.size () + 1;
+  inOutXferInfo.acTransferStatus.acFramesProcessed = mFramesProcessed;
+  inOutXferInfo.acTransferStatus.acFramesDropped = mFramesDropped;
+  inOutXferInfo.acTransferStatus.acAudioTransferSize = audioBytes;
+  inOutXferInfo.acTransferStatus.acFrameStamp.acFrameTime = frame.frameTime;
+  inOutXferInfo.acTransferStatus.acFrameStamp.acCurrentFieldCount = 0;
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::WaitForInputVerticalInterrupt (const NTV2Channel inChannel,
+    UWord inRepeatCount)
+{
+  int64_t now, target;
+  uint64_t index;
+
+  {
+    AJAAutoLock locker (&mLock);
+
+    now = Now ();
+    index = CurrentIndex ();
+    while (FrameTime (index) <= now)
+      index++;
+    index += MAX (inRepeatCount, 1) - 1;
+    target = FrameTime (index);
+
+    if (!mRealtime)
+      mVirtualTime = target;
+  }
+
+  if (mRealtime && target > now)
+    g_usleep (target - now);
+
+  // Without signal the driver times out instead of seeing an interrupt
+  return !InSignalLoss (index);
+}
+
+
+// Format of the simulated input signal, or unknown during signal loss
+NTV2VideoFormat NTV2GstSimDevice::SignalFormat (void) const
+{
+  if (InSignalLoss (CurrentIndex ()))
+    return NTV2_FORMAT_UNKNOWN;
+
+  if (mSignalFormat != NTV2_FORMAT_UNKNOWN)
+    return mSignalFormat;
+  if (mVideoFormat != NTV2_FORMAT_UNKNOWN)
+    return mVideoFormat;
+
+  return NTV2_FORMAT_1080p_2997;
+}
+
+
+NTV2VideoFormat
+NTV2GstSimDevice::GetSDIInputVideoFormat (const NTV2Channel inChannel)
+{
+  AJAAutoLock locker (&mLock);
+
+  return SignalFormat ();
+}
+
+
+NTV2VideoFormat
+NTV2GstSimDevice::GetInputVideoFormat (const NTV2InputSource inInputSource)
+{
+  return GetSDIInputVideoFormat (NTV2_CHANNEL1);
+}
+
+
+ULWord NTV2GstSimDevice::DeriveVPID (void) const
+{
+  NTV2VideoFormat format =
+      mSignalFormat != NTV2_FORMAT_UNKNOWN ? mSignalFormat : mVideoFormat;
+  ULWord payload, picture, rate;
+
+  // Byte 1: payload identifier
+  if (NTV2_IS_SD_VIDEO_FORMAT (format))
+    payload = 0x81;             // ST 352
+  else if (NTV2_IS_720P_VIDEO_FORMAT (format))
+    payload = 0x84;             // ST 292-1
+  else if (NTV2_IS_QUAD_QUAD_FORMAT (format))
+    payload = 0xD0;             // ST 2082-11
+  else if (NTV2_IS_4K_VIDEO_FORMAT (format))
+    payload = 0xCE;             // ST 2082-10
+  else if (NTV2_IS_3G_FORMAT (format))
+    payload = 0x89;             // ST 425-1
+  else
+    payload = 0x85;             // ST 292-1
+
+  // Byte 2: progressive transport/picture and picture rate
+  picture = NTV2_VIDEO_FORMAT_HAS_PROGRESSIVE_PICTURE (format) ? 0xC0 : 0x00;
+  switch (GetNTV2FrameRateFromVideoFormat (format)) {
+    case NTV2_FRAMERATE_2398: rate = 0x2; break;
+    case NTV2_FRAMERATE_2400: rate = 0x3; break;
+    case NTV2_FRAMERATE_4795: rate = 0x4; break;
+    case NTV2_FRAMERATE_2500: rate = 0x5; break;
+    case NTV2_FRAMERATE_2997: rate = 0x6; break;
+    case NTV2_FRAMERATE_3000: rate = 0x7; break;
+    case NTV2_FRAMERATE_4800: rate = 0x8; break;
+    case NTV2_FRAMERATE_5000: rate = 0x9; break;
+    case NTV2_FRAMERATE_5994: rate = 0xA; break;
+    case NTV2_FRAMERATE_6000: rate = 0xB; break;
+    default: rate = 0x0; break;
+  }
+
+  // Byte 3: 4:2:2 YCbCr, Rec 709, SDR. Byte 4: 10 bit, narrow range
+  return (payload << 24) | ((picture | rate) << 16) | (0x00 << 8) | 0x01;
+}
+
+
+bool
+NTV2GstSimDevice::ReadSDIInVPID (const NTV2Channel inChannel,
+    ULWord & outValueA, ULWord & outValueB)
+{
+  AJAAutoLock locker (&mLock);
+
+  outValueA = 0;
+  outValueB = 0;
+  if (InSignalLoss (CurrentIndex ()))
+    return true;
+
+  outValueA = mVPIDOverride ? mVPIDOverride : DeriveVPID ();
+
+  return true;
+}
+
+
+NTV2FrameGeometry NTV2GstSimDevice::Geometry (void) const
+{
+  NTV2FrameGeometry geometry = GetNTV2FrameGeometryFromVideoFormat (mVideoFormat);
+
+  if (mCaptureTall) {
+    if (geometry == NTV2_FG_1920x1080)
+      geometry = NTV2_FG_1920x1112;
+    else if (geometry == NTV2_FG_1280x720)
+      geometry = NTV2_FG_1280x740;
+  }
+
+  return geometry;
+}
+
+
+bool
+NTV2GstSimDevice::GetFrameGeometry (NTV2FrameGeometry & outValue,
+    const NTV2Channel inChannel)
+{
+  AJAAutoLock locker (&mLock);
+
+  outValue = Geometry ();
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::ReadChannelStatus (const NTV2Channel inChannel,
+    const NTV2InputSource inInputSource, NTV2GstChannelStatus & outStatus)
+{
+  AJAAutoLock locker (&mLock);
+
+  memset (&outStatus, 0, sizeof (outStatus));
+
+  // There are no real registers, the format itself stands in for the input
+  // status so that the capture loop sees it change on signal loss
+  NTV2VideoFormat format = SignalFormat ();
+  outStatus.inputStatus = (ULWord) format;
+  if (format != NTV2_FORMAT_UNKNOWN) {
+    outStatus.sdiStatus = kRegMaskSDIInVPIDLinkAValid;
+    outStatus.vpidA = mVPIDOverride ? mVPIDOverride : DeriveVPID ();
+  }
+  outStatus.geometry = Geometry ();
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::ReadRegister (const ULWord inRegNum, ULWord & outValue)
+{
+  AJAAutoLock locker (&mLock);
+
+  outValue = 0;
+  if (inRegNum == kRegAud1Counter) {
+    // 48kHz sample counter
+    outValue = (ULWord) ((Now () - mStartMonotonic) * 48000 / 1000000);
+    return true;
+  }
+
+  return false;
+}
+
+
+bool
+NTV2GstSimDevice::GetNumberAudioChannels (ULWord & outNumChannels,
+    const NTV2AudioSystem inAudioSystem)
+{
+  AJAAutoLock locker (&mLock);
+
+  outNumChannels = mNumAudioChannels;
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::DMABufferLock (const ULWord * pInBuffer,
+    const ULWord64 inByteCount, bool inMap, bool inRDMA)
+{
+  AJAAutoLock locker (&mLock);
+
+  mLockedBytes += inByteCount;
+
+  return true;
+}
+
+
+bool
+NTV2GstSimDevice::DMABufferUnlock (const ULWord * pInBuffer,
+    const ULWord64 inByteCount)
+{
+  AJAAutoLock locker (&mLock);
+
+  mLockedBytes -= MIN (mLockedBytes, inByteCount);
+
+  return true;
+}
@@ -0,0 +1,311 @@
+/**
+    @file        gstntv2device.h
+    @brief       Declares the NTV2GstDevice interface and its hardware and simulated implementations.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_DEVICE_H
+#define _GST_NTV2_DEVICE_H
+
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "ntv2enums.h"
+#include "ntv2card.h"
+#include "ntv2publicinterface.h"
+
+#include "ajabase/system/lock.h"
+
+#define NTV2_SIM_DEVICE_PREFIX      "sim"
+
+
+/**
+    @brief    Raw input state of a capture channel, read with a single batched register read
+              once per frame. The capture loop compares snapshots and only decodes what changed.
+**/
+
+typedef struct
+{
+    ULWord                  inputStatus;            /// Input status register of the source, without the per-field bits
+    ULWord                  sdiStatus;              /// The channel's byte of the SDI 3G input status register
+    ULWord                  vpidA;                  /// VPID link A, 0 if not valid
+    ULWord                  vpidB;                  /// VPID link B, 0 if not valid
+    NTV2FrameGeometry       geometry;               /// Frame geometry of the channel's frame store
+} NTV2GstChannelStatus;
+
+
+/**
+    @brief    The subset of the NTV2 device API that the capture engine uses while capturing.
+              Device setup (routing, audio system configuration, ...) is only possible on real
+              hardware and goes through the CNTV2Card returned by GetCard().
+**/
+
+class NTV2GstDevice
+{
+    public:
+        /**
+            @brief    Creates the device implementation for the given device specifier. Specifiers
+                      starting with "sim" select the simulated device, everything else is passed
+                      on to the NTV2 device scanner.
+        **/
+        static NTV2GstDevice *  Create (const std::string & inDeviceSpecifier);
+
+        virtual                 ~NTV2GstDevice () {}
+
+        /**
+            @brief    Opens the device. Returns false if the device can't be found.
+        **/
+        virtual bool            Open (void) = 0;
+
+        /**
+            @brief    Returns the underlying CNTV2Card for device setup, or NULL if this is not a
+                      hardware device.
+        **/
+        virtual CNTV2Card *     GetCard (void)                      { return NULL; }
+
+        virtual NTV2DeviceID    GetDeviceID (void) = 0;
+
+        /**
+            @brief    Returns the NUMA node the device is attached to, or -1 if unknown.
+        **/
+        virtual int             GetNUMANode (void) = 0;
+
+        /**
+            @brief    Configures the input of a simulated device. This is a no-op on hardware,
+                      where SetupVideo()/SetupAudio() program the card directly.
+        **/
+        virtual bool            ConfigureInput (const NTV2Channel inChannel, const NTV2VideoFormat inVideoFormat,
+                                                const NTV2FrameBufferFormat inPixelFormat, const bool inCaptureTall)
+                                                                    { return true; }
+        virtual bool            ConfigureAudio (const NTV2AudioSystem inAudioSystem, const ULWord inNumChannels)
+                                                                    { return true; }
+
+        //  AutoCirculate
+        virtual bool            AutoCirculateInitForInput (const NTV2Channel inChannel, const UWord inFrameCount,
+                                                           const NTV2AudioSystem inAudioSystem, const ULWord inOptionFlags,
+                                                           const UByte inNumChannels, const UWord inStartFrameNumber,
+                                                           const UWord inEndFrameNumber) = 0;
+        virtual bool            AutoCirculateStart (const NTV2Channel inChannel) = 0;
+        virtual bool            AutoCirculateStop (const NTV2Channel inChannel) = 0;
+        virtual bool            AutoCirculateGetStatus (const NTV2Channel inChannel, AUTOCIRCULATE_STATUS & outStatus) = 0;
+        virtual bool            AutoCirculateTransfer (const NTV2Channel inChannel, AUTOCIRCULATE_TRANSFER & inOutXferInfo) = 0;
+
+        //  Interrupts
+        virtual bool            SubscribeInputVerticalEvent (const NTV2Channel inChannel) = 0;
+        virtual bool            UnsubscribeInputVerticalEvent (const NTV2Channel inChannel) = 0;
+        virtual bool            WaitForInputVerticalInterrupt (const NTV2Channel inChannel, UWord inRepeatCount = 1) = 0;
+
+        //  Input signal status
+        virtual bool            ReadChannelStatus (const NTV2Channel inChannel, const NTV2InputSource inInputSource,
+                                                   NTV2GstChannelStatus & outStatus) = 0;
+        virtual NTV2VideoFormat GetInputVideoFormat (const NTV2InputSource inInputSource) = 0;
+        virtual NTV2VideoFormat GetSDIInputVideoFormat (const NTV2Channel inChannel) = 0;
+        virtual bool            ReadSDIInVPID (const NTV2Channel inChannel, ULWord & outValueA, ULWord & outValueB) = 0;
+        virtual bool            GetFrameGeometry (NTV2FrameGeometry & outValue, const NTV2Channel inChannel = NTV2_CHANNEL1) = 0;
+        virtual bool            ReadRegister (const ULWord inRegNum, ULWord & outValue) = 0;
+        virtual bool            GetNumberAudioChannels (ULWord & outNumChannels, const NTV2AudioSystem inAudioSystem) = 0;
+        virtual bool            SetLTCInputEnable (const bool inEnable) = 0;
+
+        //  DMA buffer locking
+        virtual bool            DMABufferAutoLock (const bool inEnable, const bool inMap = false,
+                                                   const ULWord64 inMaxLockSize = 0) = 0;
+        virtual bool            DMABufferLock (const ULWord * pInBuffer, const ULWord64 inByteCount,
+                                               bool inMap = false, bool inRDMA = false) = 0;
+        virtual bool            DMABufferUnlock (const ULWord * pInBuffer, const ULWord64 inByteCount) = 0;
+};
+
+
+/**
+    @brief    Forwards everything to a real NTV2 device.
+**/
+
+class NTV2GstCardDevice : public NTV2GstDevice
+{
+    public:
+                                NTV2GstCardDevice (const std::string & inDeviceSpecifier);
+
+        virtual bool            Open (void);
+        virtual CNTV2Card *     GetCard (void)                      { return &mCard; }
+        virtual NTV2DeviceID    GetDeviceID (void)                  { return mCard.GetDeviceID (); }
+        virtual int             GetNUMANode (void);
+
+        virtual bool            AutoCirculateInitForInput (const NTV2Channel inChannel, const UWord inFrameCount,
+                                                           const NTV2AudioSystem inAudioSystem, const ULWord inOptionFlags,
+                                                           const UByte inNumChannels, const UWord inStartFrameNumber,
+                                                           const UWord inEndFrameNumber)
+            { return mCard.AutoCirculateInitForInput (inChannel, inFrameCount, inAudioSystem, inOptionFlags,
+                                                      inNumChannels, inStartFrameNumber, inEndFrameNumber); }
+        virtual bool            AutoCirculateStart (const NTV2Channel inChannel)
+            { return mCard.AutoCirculateStart (inChannel); }
+        virtual bool            AutoCirculateStop (const NTV2Channel inChannel)
+            { return mCard.AutoCirculateStop (inChannel); }
+        virtual bool            AutoCirculateGetStatus (const NTV2Channel inChannel, AUTOCIRCULATE_STATUS & outStatus)
+            { return mCard.AutoCirculateGetStatus (inChannel, outStatus); }
+        virtual bool            AutoCirculateTransfer (const NTV2Channel inChannel, AUTOCIRCULATE_TRANSFER & inOutXferInfo)
+            { return mCard.AutoCirculateTransfer (inChannel, inOutXferInfo); }
+
+        virtual bool            SubscribeInputVerticalEvent (const NTV2Channel inChannel)
+            { return mCard.SubscribeInputVerticalEvent (inChannel); }
+        virtual bool            UnsubscribeInputVerticalEvent (const NTV2Channel inChannel)
+            { return mCard.UnsubscribeInputVerticalEvent (inChannel); }
+        virtual bool            WaitForInputVerticalInterrupt (const NTV2Channel inChannel, UWord inRepeatCount = 1)
+            { return mCard.WaitForInputVerticalInterrupt (inChannel, inRepeatCount); }
+
+        virtual bool            ReadChannelStatus (const NTV2Channel inChannel, const NTV2InputSource inInputSource,
+                                                   NTV2GstChannelStatus & outStatus);
+        virtual NTV2VideoFormat GetInputVideoFormat (const NTV2InputSource inInputSource)
+            { return mCard.GetInputVideoFormat (inInputSource); }
+        virtual NTV2VideoFormat GetSDIInputVideoFormat (const NTV2Channel inChannel)
+            { return mCard.GetSDIInputVideoFormat (inChannel); }
+        virtual bool            ReadSDIInVPID (const NTV2Channel inChannel, ULWord & outValueA, ULWord & outValueB)
+            { return mCard.ReadSDIInVPID (inChannel, outValueA, outValueB); }
+        virtual bool            GetFrameGeometry (NTV2FrameGeometry & outValue, const NTV2Channel inChannel = NTV2_CHANNEL1)
+            { return mCard.GetFrameGeometry (outValue, inChannel); }
+        virtual bool            ReadRegister (const ULWord inRegNum, ULWord & outValue)
+            { return mCard.ReadRegister (inRegNum, outValue); }
+        virtual bool            GetNumberAudioChannels (ULWord & outNumChannels, const NTV2AudioSystem inAudioSystem)
+            { return mCard.GetNumberAudioChannels (outNumChannels, inAudioSystem); }
+        virtual bool            SetLTCInputEnable (const bool inEnable)
+            { return mCard.SetLTCInputEnable (inEnable); }
+
+        virtual bool            DMABufferAutoLock (const bool inEnable, const bool inMap = false,
+                                                   const ULWord64 inMaxLockSize = 0)
+            { return mCard.DMABufferAutoLock (inEnable, inMap, inMaxLockSize); }
+        virtual bool            DMABufferLock (const ULWord * pInBuffer, const ULWord64 inByteCount,
+                                               bool inMap = false, bool inRDMA = false)
+            { return mCard.DMABufferLock (pInBuffer, inByteCount, inMap, inRDMA); }
+        virtual bool            DMABufferUnlock (const ULWord * pInBuffer, const ULWord64 inByteCount)
+            { return mCard.DMABufferUnlock (pInBuffer, inByteCount); }
+
+    private:
+        CNTV2Card                   mCard;                  /// CNTV2Card instance
+        const std::string           mDeviceSpecifier;       /// The device specifier string
+        NTV2RegisterReads           mStatusReads;           /// Registers read by ReadChannelStatus()
+        NTV2Channel                 mStatusChannel;         /// Channel mStatusReads was set up for
+        NTV2InputSource             mStatusSource;          /// Input source mStatusReads was set up for
+};
+
+
+/**
+    @brief    A software model of a capture channel, used for benchmarking the capture engine,
+              the buffer pools and the sources without hardware.
+
+              Selected with a device identifier of the form "sim" or "sim:key=value,key=value".
+              Supported keys:
+                format=N                NTV2VideoFormat of the simulated input signal. Defaults to
+                                        the format the channel is configured for.
+                realtime=0|1            Pace vertical interrupts with the wall clock (default), or
+                                        deliver frames as fast as they are consumed.
+                pattern=bars|none       Fill frames with colour bars (default), or skip filling to
+                                        only measure the engine overhead.
+                frames=N                Number of device frame buffers to circulate (default 7).
+                drop-interval=N         Let the device drop every Nth frame.
+                signal-loss-interval=N  Lose the input signal every N frames ...
+                signal-loss-duration=N  ... for N frames.
+                vpid=N                  VPID word A to report instead of one derived from the format.
+                numa-node=N             NUMA node to report the device on (default unknown).
+**/
+
+class NTV2GstSimDevice : public NTV2GstDevice
+{
+    public:
+                                NTV2GstSimDevice (const std::string & inDeviceSpecifier);
+        virtual                 ~NTV2GstSimDevice ();
+
+        virtual bool            Open (void);
+        virtual NTV2DeviceID    GetDeviceID (void)                  { return DEVICE_ID_CORVID88; }
+        virtual int             GetNUMANode (void)                  { return mNUMANode; }
+
+        virtual bool            ConfigureInput (const NTV2Channel inChannel, const NTV2VideoFormat inVideoFormat,
+                                                const NTV2FrameBufferFormat inPixelFormat, const bool inCaptureTall);
+        virtual bool            ConfigureAudio (const NTV2AudioSystem inAudioSystem, const ULWord inNumChannels);
+
+        virtual bool            AutoCirculateInitForInput (const NTV2Channel inChannel, const UWord inFrameCount,
+                                                           const NTV2AudioSystem inAudioSystem, const ULWord inOptionFlags,
+                                                           const UByte inNumChannels, const UWord inStartFrameNumber,
+                                                           const UWord inEndFrameNumber);
+        virtual bool            AutoCirculateStart (const NTV2Channel inChannel);
+        virtual bool            AutoCirculateStop (const NTV2Channel inChannel);
+        virtual bool            AutoCirculateGetStatus (const NTV2Channel inChannel, AUTOCIRCULATE_STATUS & outStatus);
+        virtual bool            AutoCirculateTransfer (const NTV2Channel inChannel, AUTOCIRCULATE_TRANSFER & inOutXferInfo);
+
+        virtual bool            SubscribeInputVerticalEvent (const NTV2Channel inChannel)     { return true; }
+        virtual bool            UnsubscribeInputVerticalEvent (const NTV2Channel inChannel)   { return true; }
+        virtual bool            WaitForInputVerticalInterrupt (const NTV2Channel inChannel, UWord inRepeatCount = 1);
+
+        virtual bool            ReadChannelStatus (const NTV2Channel inChannel, const NTV2InputSource inInputSource,
+                                                   NTV2GstChannelStatus & outStatus);
+        virtual NTV2VideoFormat GetInputVideoFormat (const NTV2InputSource inInputSource);
+        virtual NTV2VideoFormat GetSDIInputVideoFormat (const NTV2Channel inChannel);
+        virtual bool            ReadSDIInVPID (const NTV2Channel inChannel, ULWord & outValueA, ULWord & outValueB);
+        virtual bool            GetFrameGeometry (NTV2FrameGeometry & outValue, const NTV2Channel inChannel = NTV2_CHANNEL1);
+        virtual bool            ReadRegister (const ULWord inRegNum, ULWord & outValue);
+        virtual bool            GetNumberAudioChannels (ULWord & outNumChannels, const NTV2AudioSystem inAudioSystem);
+        virtual bool            SetLTCInputEnable (const bool inEnable)                       { return true; }
+
+        virtual bool            DMABufferAutoLock (const bool inEnable, const bool inMap = false,
+                                                   const ULWord64 inMaxLockSize = 0)          { return true; }
+        virtual bool            DMABufferLock (const ULWord * pInBuffer, const ULWord64 inByteCount,
+                                               bool inMap = false, bool inRDMA = false);
+        virtual bool            DMABufferUnlock (const ULWord * pInBuffer, const ULWord64 inByteCount);
+
+    private:
+        typedef struct
+        {
+            uint64_t                index;                  /// Vertical interrupt the frame was completed at
+            int64_t                 frameTime;              /// Real time of the vertical interrupt (100ns units)
+        } SimFrame;
+
+        void                    ParseOptions (const std::string & inOptions);
+        void                    RenderPattern (void);
+        int64_t                 Now (void) const;
+        int64_t                 FrameTime (uint64_t inIndex) const;
+        uint64_t                CurrentIndex (void) const;
+        bool                    InSignalLoss (uint64_t inIndex) const;
+        void                    Advance (void);
+        NTV2VideoFormat         SignalFormat (void) const;
+        ULWord                  DeriveVPID (void) const;
+        NTV2FrameGeometry       Geometry (void) const;
+        uint64_t                AudioSampleAt (uint64_t inIndex) const;
+        void                    FillAudio (ULWord * pOutBuffer, uint64_t inFirstSample, ULWord inNumSamples);
+        void                    GetTimecode (uint64_t inIndex, NTV2_RP188 & outTimecode) const;
+
+        AJALock                     mLock;                  /// Protects everything below
+        const std::string           mDeviceSpecifier;       /// The device specifier string
+
+        // Options
+        NTV2VideoFormat             mSignalFormat;          /// Format of the simulated input signal
+        bool                        mRealtime;              /// Pace with the wall clock
+        bool                        mFillFrames;            /// Render colour bars into transferred frames
+        uint32_t                    mFrameBufferOverride;   /// Device frame buffers to circulate, 0 = as requested
+        uint32_t                    mDropInterval;          /// Drop every Nth frame, 0 = never
+        uint32_t                    mSignalLossInterval;    /// Lose signal every N frames, 0 = never
+        uint32_t                    mSignalLossDuration;    /// Duration of each signal loss in frames
+        ULWord                      mVPIDOverride;          /// VPID A to report, 0 = derive from format
+        int                         mNUMANode;              /// NUMA node to report, -1 = unknown
+
+        // Channel configuration
+        NTV2VideoFormat             mVideoFormat;           /// Configured video format
+        NTV2FrameBufferFormat       mPixelFormat;           /// Configured pixel format
+        bool                        mCaptureTall;           /// Frames include VANC lines
+        uint32_t                    mNumAudioChannels;      /// Audio channels per sample
+        double                      mFrameDuration;         /// Duration of a frame in microseconds
+        NTV2FrameRate               mFrameRate;             /// Frame rate of the configured format
+        std::vector<uint8_t>        mPattern;               /// Pre-rendered frame
+
+        // AutoCirculate state
+        NTV2AutoCirculateState      mState;
+        uint32_t                    mNumFrameBuffers;       /// Device frame buffers being circulated
+        int64_t                     mStartMonotonic;        /// Monotonic time the vertical interrupts are counted from (us)
+        int64_t                     mStartReal;             /// Real time corresponding to mStartMonotonic (us)
+        int64_t                     mVirtualTime;           /// Current time if not pacing with the wall clock (us)
+        uint64_t                    mNextIndex;             /// Next vertical interrupt to account for
+        std::deque<SimFrame>        mReadyFrames;           /// Frames waiting for a transfer
+        uint32_t                    mFramesProcessed;
+        uint32_t                    mFramesDropped;
+        uint64_t                    mLockedBytes;           /// Bytes currently "DMA locked"
+};
+
+#endif  //  _GST_NTV2_DEVICE_H
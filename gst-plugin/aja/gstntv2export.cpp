@@ -0,0 +1,151 @@
+/**
+    @file        gstntv2export.cpp
+    @brief       Implementation of the memfd and udmabuf backed blocks used to share captured memory by file descriptor.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <gst/gst.h>
+
+#include "gstntv2export.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_export_debug);
+#define GST_CAT_DEFAULT gst_ntv2_export_debug
+
+// Not every libc and kernel header set of the boards we build on has these
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC                 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING           0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS                 (1024 + 9)
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK               0x0002
+#endif
+
+// From linux/udmabuf.h
+struct NTV2GstUdmabufCreate
+{
+  uint32_t memfd;
+  uint32_t flags;
+  uint64_t offset;
+  uint64_t size;
+};
+#define NTV2_UDMABUF_FLAGS_CLOEXEC  0x01
+#define NTV2_UDMABUF_CREATE         _IOW('u', 0x42, struct NTV2GstUdmabufCreate)
+
+// Opened once for the whole process, -1 if unavailable
+static int udmabuf_fd = -1;
+
+static void
+_init_ntv2_export (void)
+{
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+#ifndef GST_DISABLE_GST_DEBUG
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_export_debug, "ajantv2export", 0,
+        "AJA ntv2 memfd and DMABuf export");
+#endif
+
+    udmabuf_fd = open ("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (udmabuf_fd < 0)
+      GST_INFO ("No DMABuf export, /dev/udmabuf unavailable: %s",
+          g_strerror (errno));
+
+    g_once_init_leave (&_init, 1);
+  }
+}
+
+
+bool
+NTV2GstExportHaveDMABuf (void)
+{
+  _init_ntv2_export ();
+
+  return udmabuf_fd >= 0;
+}
+
+
+bool
+NTV2GstExportAllocBlock (size_t inSize, bool inDMABuf,
+    NTV2GstExportBlock & outBlock, int & outError)
+{
+  const size_t size = GST_ROUND_UP_N (inSize, (size_t) sysconf (_SC_PAGESIZE));
+
+  _init_ntv2_export ();
+
+  outBlock.memfd = -1;
+  outBlock.dmabuf = -1;
+  outBlock.data = NULL;
+  outBlock.size = size;
+  outError = 0;
+
+  // The syscall, memfd_create() is missing from older glibc
+  outBlock.memfd = (int) syscall (SYS_memfd_create, "ajacapture",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (outBlock.memfd < 0) {
+    outError = errno;
+    return false;
+  }
+
+  // udmabuf only takes memfds that can't shrink under the device's feet
+  if (ftruncate (outBlock.memfd, (off_t) size) != 0 ||
+      fcntl (outBlock.memfd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+    outError = errno;
+    NTV2GstExportFreeBlock (outBlock);
+    return false;
+  }
+
+  void *data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      outBlock.memfd, 0);
+  if (data == MAP_FAILED) {
+    outError = errno;
+    NTV2GstExportFreeBlock (outBlock);
+    return false;
+  }
+  outBlock.data = (uint8_t *) data;
+
+  if (inDMABuf && udmabuf_fd >= 0) {
+    struct NTV2GstUdmabufCreate create;
+
+    create.memfd = (uint32_t) outBlock.memfd;
+    create.flags = NTV2_UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = size;
+    outBlock.dmabuf = ioctl (udmabuf_fd, NTV2_UDMABUF_CREATE, &create);
+    if (outBlock.dmabuf < 0)
+      GST_WARNING ("Failed to create a DMABuf of %" G_GSIZE_FORMAT " bytes, "
+          "exporting the memfd only: %s", (gsize) size, g_strerror (errno));
+  }
+
+  GST_DEBUG ("Mapped %" G_GSIZE_FORMAT " bytes of memfd %d at %p, DMABuf %d",
+      (gsize) size, outBlock.memfd, data, outBlock.dmabuf);
+
+  return true;
+}
+
+
+void
+NTV2GstExportFreeBlock (NTV2GstExportBlock & ioBlock)
+{
+  if (ioBlock.data)
+    munmap (ioBlock.data, ioBlock.size);
+  if (ioBlock.dmabuf >= 0)
+    close (ioBlock.dmabuf);
+  if (ioBlock.memfd >= 0)
+    close (ioBlock.memfd);
+
+  ioBlock.data = NULL;
+  ioBlock.dmabuf = -1;
+  ioBlock.memfd = -1;
+}
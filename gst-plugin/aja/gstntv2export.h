@@ -0,0 +1,51 @@
+/**
+    @file        gstntv2export.h
+    @brief       Declares the memfd and udmabuf backed blocks used to share captured memory by file descriptor.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_EXPORT_H
+#define _GST_NTV2_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+    @brief    A block of shared memory: the pages of a memfd, mapped into this process for the DMA and
+              the CPU, and optionally the same pages as a DMABuf made by /dev/udmabuf. Other elements and
+              processes map or import either descriptor and see exactly the pages the device wrote.
+**/
+typedef struct
+{
+    int             memfd;          /// Descriptor of the pages, sealed against shrinking
+    int             dmabuf;         /// DMABuf of the same pages, or -1
+    uint8_t *       data;           /// Shared mapping of the memfd
+    size_t          size;           /// Size of the block, whole pages
+} NTV2GstExportBlock;
+
+/**
+    @brief    Returns true if /dev/udmabuf can be opened, so that blocks can be exported as DMABufs.
+**/
+bool        NTV2GstExportHaveDMABuf (void);
+
+/**
+    @brief    Creates a memfd of inSize rounded up to whole pages and maps it. The pages are not touched
+              yet, so that they can still be placed on a NUMA node.
+    @param[in]    inDMABuf        Also create a DMABuf of the pages with /dev/udmabuf. Leaves dmabuf at
+                                  -1 if that fails, the memfd is usable either way.
+    @param[out]   outBlock        The block, to be freed with NTV2GstExportFreeBlock.
+    @param[out]   outError        The errno value if it failed.
+    @return   True on success.
+**/
+bool        NTV2GstExportAllocBlock (size_t inSize, bool inDMABuf, NTV2GstExportBlock & outBlock,
+                                     int & outError);
+
+/**
+    @brief    Unmaps a block and closes its descriptors. Pages other processes still map or elements still
+              import stay allocated until they let go.
+**/
+void        NTV2GstExportFreeBlock (NTV2GstExportBlock & ioBlock);
+
+#endif    //    _GST_NTV2_EXPORT_H
@@ -0,0 +1,156 @@
+/**
+    @file        gstntv2lockregistry.cpp
+    @brief       Implementation of the NTV2GstLockRegistry class.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <map>
+#include <set>
+#include <utility>
+
+#include "gstntv2lockregistry.h"
+#include "gstntv2device.h"
+
+#include "ajabase/system/lock.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_lock_registry_debug);
+#define GST_CAT_DEFAULT gst_ntv2_lock_registry_debug
+
+typedef std::pair<uintptr_t, size_t> Region;
+
+// What the weak references of the memories point to. Held by the registry
+// and by every memory it watches, whichever goes last frees it.
+struct NTV2GstLockRegistry::Shared
+{
+  gint refcount;
+  AJALock lock;                             // Protects everything below
+  NTV2GstDevice *device;                    // NULL once the registry is gone
+  std::map<Region, GstMemory *> regions;
+  std::set<GstMemory *> watched;
+  bool warned;
+};
+
+static void
+_init_ntv2_lock_registry_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_lock_registry_debug, "ajantv2lockregistry",
+        0, "AJA ntv2 DMA lock registry");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+
+static void
+_shared_unref (NTV2GstLockRegistry::Shared * inShared)
+{
+  if (g_atomic_int_dec_and_test (&inShared->refcount))
+    delete inShared;
+}
+
+
+// Called while the memory is freed, before its data goes away
+static void
+_memory_freed (gpointer inUserData, GstMiniObject * inMemory)
+{
+  NTV2GstLockRegistry::Shared *shared =
+      (NTV2GstLockRegistry::Shared *) inUserData;
+
+  shared->lock.Lock ();
+  for (std::map<Region, GstMemory *>::iterator it = shared->regions.begin ();
+      it != shared->regions.end ();) {
+    if (it->second != (GstMemory *) inMemory) {
+      ++it;
+      continue;
+    }
+
+    GST_LOG ("Unlocking %" G_GSIZE_FORMAT " bytes at %p of freed memory",
+        (gsize) it->first.second, (gpointer) it->first.first);
+    if (shared->device)
+      shared->device->DMABufferUnlock ((const ULWord *) it->first.first,
+          it->first.second);
+    shared->regions.erase (it++);
+  }
+  shared->watched.erase ((GstMemory *) inMemory);
+  shared->lock.Unlock ();
+
+  _shared_unref (shared);
+}
+
+
+NTV2GstLockRegistry::NTV2GstLockRegistry (NTV2GstDevice * inDevice)
+:
+mShared (new Shared)
+{
+  _init_ntv2_lock_registry_debug ();
+
+  mShared->refcount = 1;
+  mShared->device = inDevice;
+  mShared->warned = false;
+}
+
+
+NTV2GstLockRegistry::~NTV2GstLockRegistry ()
+{
+  mShared->lock.Lock ();
+  for (std::map<Region, GstMemory *>::iterator it = mShared->regions.begin ();
+      it != mShared->regions.end (); ++it)
+    mShared->device->DMABufferUnlock ((const ULWord *) it->first.first,
+        it->first.second);
+  GST_DEBUG ("Unlocked %u regions", (guint) mShared->regions.size ());
+  mShared->regions.clear ();
+  mShared->device = NULL;
+  mShared->lock.Unlock ();
+
+  _shared_unref (mShared);
+  mShared = NULL;
+}
+
+
+bool
+NTV2GstLockRegistry::Lock (GstMemory * inMemory, const void *inData,
+    size_t inSize, bool inRDMA)
+{
+  const Region region ((uintptr_t) inData, inSize);
+  AJAAutoLock locker (&mShared->lock);
+
+  if (mShared->regions.find (region) != mShared->regions.end ())
+    return true;
+
+  // GPU memory has no host mapping for the driver to map
+  if (!mShared->device->DMABufferLock ((const ULWord *) inData, inSize, !inRDMA,
+          inRDMA)) {
+    if (!mShared->warned) {
+      mShared->warned = true;
+      GST_WARNING ("Failed to lock %" G_GSIZE_FORMAT " bytes of %s memory, "
+          "transfers into it are slower", (gsize) inSize,
+          inRDMA ? "GPU" : "downstream");
+    }
+    return false;
+  }
+
+  mShared->regions[region] = inMemory;
+  if (mShared->watched.insert (inMemory).second) {
+    g_atomic_int_inc (&mShared->refcount);
+    gst_mini_object_weak_ref (GST_MINI_OBJECT_CAST (inMemory), _memory_freed,
+        mShared);
+  }
+
+  GST_DEBUG ("Locked %" G_GSIZE_FORMAT " bytes at %p, %u regions locked",
+      (gsize) inSize, inData, (guint) mShared->regions.size ());
+
+  return true;
+}
+
+
+uint32_t
+NTV2GstLockRegistry::GetCount (void)
+{
+  AJAAutoLock locker (&mShared->lock);
+
+  return (uint32_t) mShared->regions.size ();
+}
@@ -0,0 +1,57 @@
+/**
+    @file        gstntv2lockregistry.h
+    @brief       Declares the NTV2GstLockRegistry class, keeping memory the capture doesn't own DMA locked.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_LOCK_REGISTRY_H
+#define _GST_NTV2_LOCK_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+class NTV2GstDevice;
+
+
+/**
+    @brief    DMA locks of memory that comes from other elements' buffer pools, downstream's or the
+              NVMM pool. Pools reuse their memory, so each region is locked the first time it is
+              transferred into and stays locked until the memory is freed, instead of being locked
+              and unlocked around every transfer. Regions are keyed by address and size.
+              The registry follows the memory: when a GstMemory is freed, its locks go away with it,
+              so that the driver never transfers into pages the address no longer maps.
+**/
+
+class NTV2GstLockRegistry
+{
+    public:
+                                NTV2GstLockRegistry (NTV2GstDevice * inDevice);
+
+        /**
+            @brief    Unlocks all regions. Memory freed later only forgets them.
+            @note     Must be deleted before the device handle is closed.
+        **/
+        virtual                 ~NTV2GstLockRegistry ();
+
+        /**
+            @brief    Makes sure the region of inMemory at inData is DMA locked on the device.
+            @param[in]    inRDMA      The region is GPU memory, see NTV2GstDevice::DMABufferLock.
+            @return   True if the region is locked, now or from before.
+        **/
+        virtual bool            Lock (GstMemory * inMemory, const void * inData, size_t inSize, bool inRDMA);
+
+        /**
+            @brief    Returns the number of regions locked.
+        **/
+        virtual uint32_t        GetCount (void);
+
+        struct Shared;
+
+    private:
+        Shared *                mShared;    /// Outlives me as long as a locked memory does
+};
+
+#endif    //    _GST_NTV2_LOCK_REGISTRY_H
@@ -0,0 +1,226 @@
+/**
+    @file        gstntv2realtime.cpp
+    @brief       Implementation of the real-time profile of the capture and delivery threads.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <gst/gst.h>
+
+#include "gstntv2realtime.h"
+#include "gstntv2topology.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_realtime_debug);
+#define GST_CAT_DEFAULT gst_ntv2_realtime_debug
+
+static void
+_init_ntv2_realtime_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_realtime_debug, "ajantv2realtime", 0,
+        "AJA ntv2 real-time profile");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+
+void
+NTV2GstRealtimeProfileInit (NTV2GstRealtimeProfile & outProfile)
+{
+  outProfile.policy = NTV2_REALTIME_POLICY_NONE;
+  outProfile.priority = 50;
+  outProfile.lockMemory = false;
+  outProfile.deliveryCPUCore = (uint32_t) -1;
+}
+
+
+std::string
+NTV2GstRealtimeDescribeError (int inError, bool inLockingMemory)
+{
+  std::string description (g_strerror (inError));
+
+  if (inError == EPERM && !inLockingMemory)
+    description += " (needs CAP_SYS_NICE or a high enough RLIMIT_RTPRIO)";
+  else if ((inError == EPERM || inError == ENOMEM || inError == EAGAIN)
+      && inLockingMemory)
+    description += " (needs CAP_IPC_LOCK or a high enough RLIMIT_MEMLOCK)";
+
+  return description;
+}
+
+
+int
+NTV2GstRealtimeLockMemory (void *inData, size_t inSize)
+{
+  if (mlock (inData, inSize) != 0)
+    return errno;
+
+  return 0;
+}
+
+
+void
+NTV2GstRealtimeUnlockMemory (void *inData, size_t inSize)
+{
+  munlock (inData, inSize);
+}
+
+
+// From <linux/capability.h>
+#define NTV2_CAP_IPC_LOCK       14
+
+static bool
+_has_ipc_lock_capability (void)
+{
+  gchar *status = NULL;
+  bool result = false;
+
+  if (!g_file_get_contents ("/proc/self/status", &status, NULL, NULL))
+    return false;
+
+  const gchar *line = strstr (status, "CapEff:");
+  if (line) {
+    guint64 caps = g_ascii_strtoull (line + strlen ("CapEff:"), NULL, 16);
+
+    result = (caps & (G_GUINT64_CONSTANT (1) << NTV2_CAP_IPC_LOCK)) != 0;
+  }
+  g_free (status);
+
+  return result;
+}
+
+
+size_t
+NTV2GstRealtimeGetLockLimit (void)
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_MEMLOCK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+    return SIZE_MAX;
+
+  if (_has_ipc_lock_capability ())
+    return SIZE_MAX;
+
+  return (size_t) limit.rlim_cur;
+}
+
+
+// Locks the whole stack of the calling thread, so that the capture loop never
+// takes a page fault on it
+static int
+_lock_thread_stack (size_t * outSize)
+{
+  pthread_attr_t attr;
+  void *stackAddr;
+  size_t stackSize;
+  int res;
+
+  res = pthread_getattr_np (pthread_self (), &attr);
+  if (res != 0)
+    return res;
+
+  res = pthread_attr_getstack (&attr, &stackAddr, &stackSize);
+  pthread_attr_destroy (&attr);
+  if (res != 0)
+    return res;
+
+  *outSize = stackSize;
+  return NTV2GstRealtimeLockMemory (stackAddr, stackSize);
+}
+
+
+bool
+NTV2GstRealtimeApplyThread (const NTV2GstRealtimeProfile & inProfile,
+    const char *inThreadName, uint32_t inCPUCore,
+    const std::vector<uint32_t> & inNodeCPUs, bool inRealtime)
+{
+  std::string applied, failed;
+  int res;
+
+  _init_ntv2_realtime_debug ();
+
+  if (inRealtime && inProfile.policy != NTV2_REALTIME_POLICY_NONE) {
+    const int policy =
+        inProfile.policy == NTV2_REALTIME_POLICY_RR ? SCHED_RR : SCHED_FIFO;
+    const char *policyName =
+        inProfile.policy == NTV2_REALTIME_POLICY_RR ? "SCHED_RR" : "SCHED_FIFO";
+    struct sched_param param;
+
+    param.sched_priority = CLAMP ((int) inProfile.priority,
+        sched_get_priority_min (policy), sched_get_priority_max (policy));
+
+    res = pthread_setschedparam (pthread_self (), policy, &param);
+    gchar *part = g_strdup_printf ("%s priority %d", policyName,
+        param.sched_priority);
+    if (res == 0) {
+      applied += std::string (applied.empty ()? "" : ", ") + part;
+    } else {
+      failed += std::string (failed.empty ()? "" : ", ") + part + ": " +
+          NTV2GstRealtimeDescribeError (res, false);
+    }
+    g_free (part);
+  }
+
+  if (inRealtime && inProfile.lockMemory) {
+    size_t stackSize = 0;
+
+    res = _lock_thread_stack (&stackSize);
+    gchar *part = g_strdup_printf ("stack lock (%" G_GSIZE_FORMAT " KiB)",
+        (gsize) (stackSize / 1024));
+    if (res == 0) {
+      applied += std::string (applied.empty ()? "" : ", ") + part;
+    } else {
+      failed += std::string (failed.empty ()? "" : ", ") + part + ": " +
+          NTV2GstRealtimeDescribeError (res, true);
+    }
+    g_free (part);
+  }
+
+  if (inCPUCore != (uint32_t) -1 || !inNodeCPUs.empty ()) {
+    cpu_set_t mask;
+    gchar *part;
+
+    CPU_ZERO (&mask);
+    if (inCPUCore != (uint32_t) -1) {
+      CPU_SET (inCPUCore, &mask);
+      part = g_strdup_printf ("affinity to core %u", inCPUCore);
+    } else {
+      for (size_t i = 0; i < inNodeCPUs.size (); i++)
+        CPU_SET (inNodeCPUs[i], &mask);
+      part = g_strdup_printf ("affinity to the device's NUMA node cores %s",
+          NTV2GstTopologyFormatCPUs (inNodeCPUs).c_str ());
+    }
+
+    res = pthread_setaffinity_np (pthread_self (), sizeof (mask), &mask);
+    if (res == 0) {
+      applied += std::string (applied.empty ()? "" : ", ") + part;
+    } else {
+      failed += std::string (failed.empty ()? "" : ", ") + part + ": " +
+          g_strerror (res);
+    }
+    g_free (part);
+  }
+
+  if (!failed.empty ()) {
+    GST_WARNING ("Real-time profile of %s thread only partially applied. "
+        "Applied: %s. Failed: %s", inThreadName,
+        applied.empty ()? "nothing" : applied.c_str (), failed.c_str ());
+    return false;
+  }
+
+  if (!applied.empty ())
+    GST_INFO ("Real-time profile of %s thread applied: %s", inThreadName,
+        applied.c_str ());
+
+  return true;
+}
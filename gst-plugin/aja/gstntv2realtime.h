@@ -0,0 +1,78 @@
+/**
+    @file        gstntv2realtime.h
+    @brief       Declares the real-time profile applied to the capture and delivery threads.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_REALTIME_H
+#define _GST_NTV2_REALTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+typedef enum
+{
+    NTV2_REALTIME_POLICY_NONE,              /// Keep the default AJAThread priorities
+    NTV2_REALTIME_POLICY_FIFO,              /// SCHED_FIFO
+    NTV2_REALTIME_POLICY_RR                 /// SCHED_RR
+} NTV2GstRealtimePolicy;
+
+/**
+    @brief    What a source asks for its capture (DMA) and delivery threads, on top of the capture
+              thread's affinity. Each part is applied on its own, so that a missing privilege only
+              costs that part.
+**/
+
+typedef struct
+{
+    NTV2GstRealtimePolicy   policy;                 /// Scheduling policy of the capture thread
+    uint32_t                priority;               /// Real-time priority of the capture thread (1-99)
+    bool                    lockMemory;             /// Lock the capture thread's stack and the pool memory
+    uint32_t                deliveryCPUCore;        /// Affinity of the delivery thread, -1 for any core
+} NTV2GstRealtimeProfile;
+
+/**
+    @brief    The profile that changes nothing, as used when no source asked for one.
+**/
+void        NTV2GstRealtimeProfileInit (NTV2GstRealtimeProfile & outProfile);
+
+/**
+    @brief    Applies the parts of the profile meant for the calling thread and logs in one line which
+              of them were applied and which failed, and why.
+    @param[in]    inProfile       The profile to apply.
+    @param[in]    inThreadName    Name of the calling thread in the log.
+    @param[in]    inCPUCore       Core to pin the thread to, -1 for any core.
+    @param[in]    inNodeCPUs      Cores of the device's NUMA node to pin the thread to if inCPUCore is -1.
+    @param[in]    inRealtime      Also apply the scheduling policy and lock the thread's stack.
+    @return   True if everything asked for was applied.
+**/
+bool        NTV2GstRealtimeApplyThread (const NTV2GstRealtimeProfile & inProfile, const char * inThreadName,
+                                        uint32_t inCPUCore, const std::vector<uint32_t> & inNodeCPUs,
+                                        bool inRealtime);
+
+/**
+    @brief    Locks (or unlocks) host memory into RAM so that it's never paged out under memory pressure.
+    @return   0 on success, the errno value otherwise.
+**/
+int         NTV2GstRealtimeLockMemory (void * inData, size_t inSize);
+void        NTV2GstRealtimeUnlockMemory (void * inData, size_t inSize);
+
+/**
+    @brief    Returns how many bytes the process may lock, the RLIMIT_MEMLOCK soft limit, or SIZE_MAX
+              if the limit is infinite or doesn't apply because the process has CAP_IPC_LOCK.
+**/
+size_t      NTV2GstRealtimeGetLockLimit (void);
+
+/**
+    @brief    Describes the errno of a failed call, naming the privilege or limit that is missing.
+    @param[in]    inError          The errno value.
+    @param[in]    inLockingMemory  The call locked memory, otherwise it changed the scheduling.
+**/
+std::string NTV2GstRealtimeDescribeError (int inError, bool inLockingMemory);
+
+#endif    //    _GST_NTV2_REALTIME_H
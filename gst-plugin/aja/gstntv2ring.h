@@ -0,0 +1,339 @@
+/**
+    @file        gstntv2ring.h
+    @brief       Declares the bounded single-producer/single-consumer rings used between capture threads.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_RING_H
+#define _GST_NTV2_RING_H
+
+#include <atomic>
+#include <climits>
+#include <errno.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+
+/**
+    @brief    Fixed size ring that hands items from exactly one producer thread to exactly one
+              consumer thread. Push and Pop never take a lock, the semaphore only counts queued
+              items so that an idle consumer can sleep until the producer posts the next one.
+    @note     inSize must be a power of two.
+**/
+
+template <typename T, unsigned inSize>
+class NTV2GstSpscRing
+{
+    static_assert (inSize != 0 && (inSize & (inSize - 1)) == 0, "ring size must be a power of two");
+
+    public:
+        NTV2GstSpscRing () : mHead (0), mTail (0)
+        {
+            sem_init (&mCount, 0, 0);
+        }
+
+        ~NTV2GstSpscRing ()
+        {
+            sem_destroy (&mCount);
+        }
+
+        /**
+            @brief    Queues an item. Producer thread only.
+            @return   False if the ring is full, the item is not queued then.
+        **/
+        bool Push (const T & inItem)
+        {
+            const unsigned tail = mTail.load (std::memory_order_relaxed);
+
+            if (tail - mHead.load (std::memory_order_acquire) == inSize)
+                return false;
+
+            mItems[tail & (inSize - 1)] = inItem;
+            mTail.store (tail + 1, std::memory_order_release);
+            sem_post (&mCount);
+            return true;
+        }
+
+        /**
+            @brief    Returns whether Push would fail. Producer thread only.
+        **/
+        bool IsFull (void) const
+        {
+            return mTail.load (std::memory_order_relaxed) - mHead.load (std::memory_order_acquire) == inSize;
+        }
+
+        /**
+            @brief    Dequeues the oldest item, sleeping until one is queued or Wake is called.
+                      Consumer thread only.
+            @return   False if woken up without an item.
+        **/
+        bool WaitPop (T & outItem)
+        {
+            while (sem_wait (&mCount) != 0 && errno == EINTR)
+                ;
+            return TakeItem (outItem);
+        }
+
+        /**
+            @brief    Dequeues the oldest item without sleeping. Consumer thread only.
+            @return   False if the ring is empty.
+        **/
+        bool TryPop (T & outItem)
+        {
+            if (sem_trywait (&mCount) != 0)
+                return false;
+            return TakeItem (outItem);
+        }
+
+        /**
+            @brief    Wakes up a consumer sleeping in WaitPop, e.g. to make it check for shutdown.
+        **/
+        void Wake (void)
+        {
+            sem_post (&mCount);
+        }
+
+    private:
+        bool TakeItem (T & outItem)
+        {
+            const unsigned head = mHead.load (std::memory_order_relaxed);
+
+            // A wake-up without an item
+            if (head == mTail.load (std::memory_order_acquire))
+                return false;
+
+            outItem = mItems[head & (inSize - 1)];
+            mHead.store (head + 1, std::memory_order_release);
+            return true;
+        }
+
+        T                           mItems[inSize];
+        std::atomic<unsigned>       mHead;                  /// Next item to pop, written by the consumer only
+        std::atomic<unsigned>       mTail;                  /// Next slot to push, written by the producer only
+        sem_t                       mCount;                 /// Posted once per queued item and once per Wake
+};
+
+
+/**
+    @brief    Counters of an NTV2GstLeakyRing, whatever its items. Lets code that only needs the
+              length of a ring, or to wait for room in it, work with rings of any item type.
+**/
+
+class NTV2GstLeakyRingBase
+{
+    public:
+        explicit NTV2GstLeakyRingBase (unsigned inCapacity)
+            : mHead (0), mTail (0), mWake (0), mWaiters (0), mRoom (0), mRoomWaiters (0)
+        {
+            mCapacity = 1;
+            while (mCapacity < inCapacity)
+                mCapacity <<= 1;
+        }
+
+        unsigned GetCapacity (void) const
+        {
+            return mCapacity;
+        }
+
+        /**
+            @brief    Returns the number of queued items. Exact on the producer thread, elsewhere it may
+                      count items popped meanwhile, but never less than were queued.
+        **/
+        unsigned GetLength (void) const
+        {
+            const unsigned head = mHead.load (std::memory_order_acquire);
+
+            return mTail.load (std::memory_order_acquire) - head;
+        }
+
+        /**
+            @brief    Sleeps until fewer than inLength items are queued, Wake is called or the timeout
+                      expired. Producer thread only.
+            @return   True if fewer than inLength items are queued.
+        **/
+        bool WaitLength (unsigned inLength, uint64_t inTimeoutNs)
+        {
+            struct timespec deadline, timeout;
+
+            clock_gettime (CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += (time_t) (inTimeoutNs / 1000000000);
+            deadline.tv_nsec += (long) (inTimeoutNs % 1000000000);
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+
+            for (;;) {
+                const uint32_t room = mRoom.load (std::memory_order_seq_cst);
+                const uint32_t wake = mWake.load (std::memory_order_seq_cst);
+
+                if (GetLength () < inLength)
+                    return true;
+
+                // The futex takes a relative timeout
+                clock_gettime (CLOCK_MONOTONIC, &timeout);
+                timeout.tv_sec = deadline.tv_sec - timeout.tv_sec;
+                timeout.tv_nsec = deadline.tv_nsec - timeout.tv_nsec;
+                if (timeout.tv_nsec < 0) {
+                    timeout.tv_sec--;
+                    timeout.tv_nsec += 1000000000;
+                }
+                if (timeout.tv_sec < 0)
+                    return false;
+
+                mRoomWaiters.fetch_add (1, std::memory_order_seq_cst);
+                if (mRoom.load (std::memory_order_seq_cst) == room)
+                    Futex (mRoom, FUTEX_WAIT_PRIVATE, (int) room, &timeout);
+                mRoomWaiters.fetch_sub (1, std::memory_order_seq_cst);
+
+                // Woken up by Wake, e.g. for flushing
+                if (mWake.load (std::memory_order_seq_cst) != wake)
+                    return GetLength () < inLength;
+            }
+        }
+
+        /**
+            @brief    Wakes up a consumer sleeping in WaitPop or a producer sleeping in WaitLength,
+                      e.g. to make it check for flushing.
+        **/
+        void Wake (void)
+        {
+            mWake.fetch_add (1, std::memory_order_seq_cst);
+            Futex (mWake, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+            mRoom.fetch_add (1, std::memory_order_seq_cst);
+            Futex (mRoom, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+        }
+
+    protected:
+        static void Futex (std::atomic<uint32_t> & inWord, int inOp, int inValue,
+                           const struct timespec * inTimeout)
+        {
+            syscall (SYS_futex, (uint32_t *) &inWord, inOp, inValue, inTimeout, NULL, 0);
+        }
+
+        unsigned                    mCapacity;
+        std::atomic<unsigned>       mHead;              /// Next item to pop
+        std::atomic<unsigned>       mTail;              /// Next slot to push, written by the producer only
+        std::atomic<uint32_t>       mWake;              /// Bumped by every push and Wake, the futex word
+        std::atomic<uint32_t>       mWaiters;           /// Consumers about to sleep or sleeping on mWake
+        std::atomic<uint32_t>       mRoom;              /// Bumped by every pop and Wake, the producer's futex word
+        std::atomic<uint32_t>       mRoomWaiters;       /// Producers about to sleep or sleeping on mRoom
+};
+
+
+/**
+    @brief    Ring that hands items from one producer thread to one consumer thread and lets the
+              producer drop the oldest items when the consumer falls behind. Every slot carries a
+              sequence number, so that the consumer taking an item and the producer dropping it
+              race with a compare-and-swap and never with a lock. The consumer sleeps on a futex
+              the producer only wakes while someone waits on it, and the producer can likewise sleep
+              until the consumer made room.
+    @note     The capacity is rounded up to a power of two.
+**/
+
+template <typename T>
+class NTV2GstLeakyRing : public NTV2GstLeakyRingBase
+{
+    public:
+        explicit NTV2GstLeakyRing (unsigned inCapacity)
+            : NTV2GstLeakyRingBase (inCapacity)
+        {
+            mSlots = new Slot[mCapacity];
+            for (unsigned i = 0; i < mCapacity; i++)
+                mSlots[i].sequence.store (i, std::memory_order_relaxed);
+        }
+
+        ~NTV2GstLeakyRing ()
+        {
+            delete [] mSlots;
+        }
+
+        /**
+            @brief    Queues an item and wakes the consumer. Producer thread only.
+            @return   False if the ring is full, the item is not queued then.
+        **/
+        bool Push (const T & inItem)
+        {
+            const unsigned tail = mTail.load (std::memory_order_relaxed);
+            Slot & slot = mSlots[tail & (mCapacity - 1)];
+
+            // Full, or the consumer is still copying the item out of the slot
+            if (slot.sequence.load (std::memory_order_acquire) != tail)
+                return false;
+
+            slot.item = inItem;
+            slot.sequence.store (tail + 1, std::memory_order_release);
+            mTail.store (tail + 1, std::memory_order_release);
+
+            mWake.fetch_add (1, std::memory_order_seq_cst);
+            if (mWaiters.load (std::memory_order_seq_cst) > 0)
+                Futex (mWake, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+            return true;
+        }
+
+        /**
+            @brief    Dequeues the oldest item. The consumer takes items with it, the producer drops
+                      them with it.
+            @return   False if the ring is empty.
+        **/
+        bool Pop (T & outItem)
+        {
+            unsigned head = mHead.load (std::memory_order_relaxed);
+
+            for (;;) {
+                Slot & slot = mSlots[head & (mCapacity - 1)];
+                const int diff = (int) (slot.sequence.load (std::memory_order_acquire) - (head + 1));
+
+                if (diff < 0)
+                    return false;
+                if (diff == 0 && mHead.compare_exchange_weak (head, head + 1,
+                        std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    outItem = slot.item;
+                    slot.sequence.store (head + mCapacity, std::memory_order_release);
+
+                    mRoom.fetch_add (1, std::memory_order_seq_cst);
+                    if (mRoomWaiters.load (std::memory_order_seq_cst) > 0)
+                        Futex (mRoom, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+                    return true;
+                }
+                if (diff > 0)
+                    head = mHead.load (std::memory_order_relaxed);
+            }
+        }
+
+        /**
+            @brief    Dequeues the oldest item, sleeping until one is queued or Wake is called.
+                      Consumer thread only.
+            @return   False if woken up without an item.
+        **/
+        bool WaitPop (T & outItem)
+        {
+            const uint32_t wake = mWake.load (std::memory_order_seq_cst);
+
+            if (Pop (outItem))
+                return true;
+
+            mWaiters.fetch_add (1, std::memory_order_seq_cst);
+            if (mWake.load (std::memory_order_seq_cst) == wake)
+                Futex (mWake, FUTEX_WAIT_PRIVATE, (int) wake, NULL);
+            mWaiters.fetch_sub (1, std::memory_order_seq_cst);
+
+            return Pop (outItem);
+        }
+
+    private:
+        struct Slot
+        {
+            std::atomic<unsigned>   sequence;           /// Position the slot is next pushed at, or that plus one once it holds it
+            T                       item;
+        };
+
+        Slot *                      mSlots;
+};
+
+#endif    //    _GST_NTV2_RING_H
@@ -0,0 +1,322 @@
+/**
+    @file        gstntv2scheduler.cpp
+    @brief       Implementation of the NTV2GstScheduler class.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <algorithm>
+
+#include <gst/gst.h>
+
+#include "gstntv2scheduler.h"
+#include "gstntv2.h"
+#include "ntv2utils.h"
+#include "ajabase/system/systemtime.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_scheduler_debug);
+#define GST_CAT_DEFAULT gst_ntv2_scheduler_debug
+
+static void
+_init_ntv2_scheduler_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_scheduler_debug, "ajantv2scheduler", 0,
+        "AJA ntv2 capture scheduler");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+
+NTV2GstScheduler::NTV2GstScheduler (const std::string & inDeviceSpecifier,
+    const uint32_t inNumThreads)
+:
+mDeviceSpecifier (inDeviceSpecifier),
+mQuit (false),
+mHaveProfile (false)
+{
+  _init_ntv2_scheduler_debug ();
+
+  NTV2GstRealtimeProfileInit (mProfile);
+
+  for (uint32_t i = 0; i < MAX (inNumThreads, 1); i++) {
+    Worker *worker = new Worker;
+
+    worker->scheduler = this;
+    worker->lock = new AJALock;
+    worker->applyProfile = false;
+    worker->thread = new AJAThread ();
+    worker->thread->Attach (WorkerThreadStatic, worker);
+    worker->thread->SetPriority (AJA_ThreadPriority_High);
+    worker->thread->Start ();
+
+    mWorkers.push_back (worker);
+  }
+
+  GST_DEBUG ("Started %u capture threads for device %s",
+      (guint) mWorkers.size (), mDeviceSpecifier.c_str ());
+}
+
+
+NTV2GstScheduler::~NTV2GstScheduler ()
+{
+  mQuit = true;
+
+  for (size_t i = 0; i < mWorkers.size (); i++) {
+    Worker *worker = mWorkers[i];
+
+    while (worker->thread->Active ())
+      AJATime::Sleep (10);
+
+    delete worker->thread;
+    delete worker->lock;
+    delete worker;
+  }
+  mWorkers.clear ();
+}
+
+
+void
+NTV2GstScheduler::Attach (NTV2GstAV * inChannel)
+{
+  AJAAutoLock locker (&mLock);
+  Worker *least = NULL;
+
+  for (size_t i = 0; i < mWorkers.size (); i++) {
+    if (!least || mWorkers[i]->entries.size () < least->entries.size ())
+      least = mWorkers[i];
+  }
+
+  // The threads are shared, the first channel decides how they run
+  const NTV2GstRealtimeProfile & profile = inChannel->mRealtimeProfile;
+  if (!mHaveProfile) {
+    mProfile = profile;
+    mNodeCPUs = inChannel->mNUMACPUs;
+    mHaveProfile = true;
+    for (size_t i = 0; i < mWorkers.size (); i++) {
+      AJAAutoLock workerLocker (mWorkers[i]->lock);
+      mWorkers[i]->applyProfile = true;
+    }
+  } else if (profile.policy != mProfile.policy ||
+      profile.priority != mProfile.priority ||
+      profile.lockMemory != mProfile.lockMemory) {
+    GST_WARNING ("Channel %d asks for another real-time profile than the "
+        "capture threads of device %s already run with",
+        (int) inChannel->mInputChannel, mDeviceSpecifier.c_str ());
+  }
+
+  // Due right away, until staggered with the others
+  Entry entry = { inChannel, false, 0, false };
+  {
+    AJAAutoLock workerLocker (least->lock);
+    least->entries.push_back (entry);
+  }
+  Stagger ();
+
+  GST_DEBUG ("Attached channel %d of device %s, %u channels on its thread",
+      (int) inChannel->mInputChannel, mDeviceSpecifier.c_str (),
+      (guint) least->entries.size ());
+}
+
+
+bool
+NTV2GstScheduler::Detach (NTV2GstAV * inChannel)
+{
+  AJAAutoLock locker (&mLock);
+
+  for (size_t i = 0; i < mWorkers.size (); i++) {
+    Worker *worker = mWorkers[i];
+    bool found = false;
+
+    {
+      AJAAutoLock workerLocker (worker->lock);
+      for (std::vector<Entry>::iterator it = worker->entries.begin ();
+          it != worker->entries.end (); ++it) {
+        if (it->channel == inChannel) {
+          worker->entries.erase (it);
+          found = true;
+          break;
+        }
+      }
+    }
+
+    if (!found)
+      continue;
+
+    // The next pass won't pick it up anymore, wait for the current one
+    while (true) {
+      {
+        AJAAutoLock workerLocker (worker->lock);
+        if (std::find (worker->busy.begin (), worker->busy.end (),
+                inChannel) == worker->busy.end ())
+          break;
+      }
+      AJATime::Sleep (1);
+    }
+
+    GST_DEBUG ("Detached channel %d of device %s",
+        (int) inChannel->mInputChannel, mDeviceSpecifier.c_str ());
+    Stagger ();
+    return true;
+  }
+
+  return false;
+}
+
+
+int64_t
+NTV2GstScheduler::GetPeriod (NTV2GstAV * inChannel)
+{
+  double fps = GetFramesPerSecond (GetNTV2FrameRateFromVideoFormat
+      (inChannel->mVideoFormat));
+
+  return fps > 0.0 ? (int64_t) (G_USEC_PER_SEC / fps) : G_USEC_PER_SEC / 60;
+}
+
+
+// The channels of a device share its PCIe link. Polled at once, their
+// transfers would burst onto it back to back every period; spread over the
+// period, they share it evenly. Each channel keeps its offset, since it's
+// polled once per period from then on.
+void
+NTV2GstScheduler::Stagger (void)
+{
+  int64_t base = G_MAXINT64;
+  size_t num = 0, index = 0;
+
+  for (size_t i = 0; i < mWorkers.size (); i++) {
+    AJAAutoLock workerLocker (mWorkers[i]->lock);
+
+    for (size_t j = 0; j < mWorkers[i]->entries.size (); j++) {
+      const Entry & entry = mWorkers[i]->entries[j];
+
+      if (entry.done)
+        continue;
+      base = MIN (base, entry.due);
+      num++;
+    }
+  }
+
+  if (num == 0)
+    return;
+  base = MAX (base, g_get_monotonic_time ());
+
+  for (size_t i = 0; i < mWorkers.size (); i++) {
+    AJAAutoLock workerLocker (mWorkers[i]->lock);
+
+    for (size_t j = 0; j < mWorkers[i]->entries.size (); j++) {
+      Entry & entry = mWorkers[i]->entries[j];
+
+      if (entry.done)
+        continue;
+      entry.due = base + GetPeriod (entry.channel) * (int64_t) index / (int64_t) num;
+      entry.retried = false;
+      index++;
+    }
+  }
+
+  GST_DEBUG ("Staggered %u channels of device %s", (guint) num,
+      mDeviceSpecifier.c_str ());
+}
+
+
+void
+NTV2GstScheduler::WorkerThreadStatic (AJAThread * pThread, void *pContext)
+{
+  (void) pThread;
+
+  Worker *worker (reinterpret_cast < Worker * >(pContext));
+
+  worker->scheduler->Service (worker);
+}
+
+
+void
+NTV2GstScheduler::Service (Worker * inWorker)
+{
+  while (!mQuit) {
+    NTV2GstAV *channel = NULL;
+    int64_t due = 0, now;
+    bool applyProfile;
+
+    {
+      AJAAutoLock locker (inWorker->lock);
+
+      applyProfile = inWorker->applyProfile;
+      inWorker->applyProfile = false;
+
+      for (size_t i = 0; i < inWorker->entries.size (); i++) {
+        const Entry & entry = inWorker->entries[i];
+
+        if (!entry.done && (!channel || entry.due < due)) {
+          channel = entry.channel;
+          due = entry.due;
+        }
+      }
+
+      now = g_get_monotonic_time ();
+      if (channel && due <= now)
+        inWorker->busy.assign (1, channel);
+    }
+
+    // Set once by the first channel attached, applied on this thread
+    if (applyProfile)
+      NTV2GstRealtimeApplyThread (mProfile, "scheduler", (uint32_t) -1,
+          mNodeCPUs, true);
+
+    if (!channel) {
+      AJATime::Sleep (10);
+      continue;
+    }
+
+    // Looks again at least every 10ms, for channels attached meanwhile
+    if (due > now) {
+      g_usleep (MIN (due - now, (int64_t) 10000));
+      continue;
+    }
+
+    const int64_t period = GetPeriod (channel);
+    NTV2GstAV::ACInputResult result = NTV2GstAV::AC_INPUT_IDLE;
+    bool transferred = false;
+
+    // Quitting, only waiting to be detached
+    if (!channel->mGlobalQuit) {
+      while (!mQuit) {
+        result = channel->ACInputPoll (false);
+        if (result != NTV2GstAV::AC_INPUT_AGAIN || channel->mGlobalQuit)
+          break;
+        transferred = true;
+      }
+    }
+
+    {
+      AJAAutoLock locker (inWorker->lock);
+
+      for (size_t j = 0; j < inWorker->entries.size (); j++) {
+        Entry & entry = inWorker->entries[j];
+
+        if (entry.channel != channel)
+          continue;
+
+        if (result == NTV2GstAV::AC_INPUT_DONE)
+          entry.done = true;
+
+        // The next frame completes a period after this one. Polled a little
+        // early, look again a quarter period later, but only once: without
+        // signal a channel is polled once per period, like the interrupt
+        // would wake it.
+        if (!transferred && !entry.retried) {
+          entry.due = now + period / 4;
+          entry.retried = true;
+        } else {
+          entry.due = now + period;
+          entry.retried = !transferred;
+        }
+      }
+      inWorker->busy.clear ();
+    }
+  }
+}
@@ -0,0 +1,103 @@
+/**
+    @file        gstntv2scheduler.h
+    @brief       Declares the NTV2GstScheduler class, capturing all channels of one device from a few threads.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_SCHEDULER_H
+#define _GST_NTV2_SCHEDULER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "ajabase/system/lock.h"
+#include "ajabase/system/thread.h"
+
+#include "gstntv2realtime.h"
+
+class NTV2GstAV;
+
+
+/**
+    @brief    Services the capture of all attached channels of one device from a fixed number of
+              threads instead of one AC thread per channel. Each thread polls whichever of its
+              channels is due first, and every channel is due once per period of its own frame
+              rate, a little later again if its frame wasn't complete yet. Channels of different
+              rates, or without signal, never hold each other up. The channels' polls are spread
+              evenly across the frame period, so that their transfers don't all burst onto PCIe at
+              once. The captured frames go to the channels' delivery threads as usual.
+
+              The threads run with the real-time profile of the first channel attached, pinned to
+              the cores of its NUMA node.
+**/
+
+class NTV2GstScheduler
+{
+    public:
+        /**
+            @brief    Starts inNumThreads threads that are idle until channels are attached.
+        **/
+        NTV2GstScheduler (const std::string & inDeviceSpecifier, const uint32_t inNumThreads);
+        virtual ~NTV2GstScheduler ();
+
+        /**
+            @brief    Starts capturing on the thread with the fewest channels.
+            @note     AutoCirculate must already be running, see NTV2GstAV::ACInputBegin.
+        **/
+        virtual void            Attach (NTV2GstAV * inChannel);
+
+        /**
+            @brief    Stops capturing and waits until the channel is no longer used by any thread.
+            @return   False if the channel was not attached.
+        **/
+        virtual bool            Detach (NTV2GstAV * inChannel);
+
+        virtual uint32_t        GetNumThreads (void) const          { return (uint32_t) mWorkers.size (); }
+
+    protected:
+        typedef struct
+        {
+            NTV2GstAV *             channel;
+            bool                    done;                   /// Captured its last frame, nothing to transfer anymore
+            int64_t                 due;                    /// Monotonic time of its next poll (us)
+            bool                    retried;                /// The last poll found no frame and came early
+        } Entry;
+
+        typedef struct
+        {
+            NTV2GstScheduler *      scheduler;
+            AJAThread *             thread;
+            AJALock *               lock;                   /// Protects entries and busy
+            std::vector<Entry>      entries;
+            std::vector<NTV2GstAV *> busy;                  /// Channels used by the current poll
+            bool                    applyProfile;           /// mProfile is set and not yet applied
+        } Worker;
+
+        virtual void            Service (Worker * inWorker);
+
+        /**
+            @brief    Returns the frame period of the channel (us).
+        **/
+        static int64_t          GetPeriod (NTV2GstAV * inChannel);
+
+        /**
+            @brief    Spreads the next polls of all channels evenly across their frame periods,
+                      starting with the channel due first. Called with mLock held.
+        **/
+        virtual void            Stagger (void);
+
+        static void             WorkerThreadStatic (AJAThread * pThread, void * pContext);
+
+    private:
+        const std::string           mDeviceSpecifier;
+        std::vector<Worker *>       mWorkers;
+        AJALock                     mLock;                  /// Serializes Attach and Detach
+        std::atomic<bool>           mQuit;                  /// Set "true" to stop the threads
+        bool                        mHaveProfile;           /// mProfile was taken from a channel
+        NTV2GstRealtimeProfile      mProfile;               /// Applied by all threads
+        std::vector<uint32_t>       mNodeCPUs;              /// Cores the threads are pinned to
+};
+
+#endif    //    _GST_NTV2_SCHEDULER_H
@@ -0,0 +1,640 @@
+/**
+    @file        gstntv2shm.cpp
+    @brief       Implementation of the NTV2GstShmRing class.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+
+#include <gst/gst.h>
+
+#include "gstntv2shm.h"
+#include "gstntv2device.h"
+#include "gstntv2topology.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_shm_debug);
+#define GST_CAT_DEFAULT gst_ntv2_shm_debug
+
+#define NTV2_SHM_MAGIC              0x53414a41      // "AJAS"
+#define NTV2_SHM_VERSION            1
+
+// In a slot's state while the writer fills it, the rest are references
+#define NTV2_SHM_WRITING            0x80000000U
+
+// Slot numbers are the low bits of the newest word
+#define NTV2_SHM_SLOT_BITS          16
+
+struct NTV2GstShmSlot
+{
+  std::atomic<uint32_t> state;              // NTV2_SHM_WRITING | references
+  std::atomic<uint64_t> holders;            // Readers referencing it, one bit each
+  std::atomic<uint64_t> sequence;           // Of the frame in it, 0 while written
+  NTV2GstShmFrame frame;
+};
+
+// Laid out at the start of the shared memory, the slots' data follows
+// at dataOffset. Zeroed memory is a valid empty header.
+struct NTV2GstShmRing::Header
+{
+  std::atomic<uint32_t> magic;              // Set last by the writer
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t numSlots;
+  uint64_t dataOffset;
+  uint64_t slotStride;
+  uint64_t videoSize;
+  uint64_t audioSize;
+  int32_t writerPid;
+  uint64_t instance;                        // Tells rings of the same name apart
+  std::atomic<uint32_t> closed;
+  std::atomic<uint32_t> wake;               // Futex, bumped for every frame
+  std::atomic<uint64_t> newest;             // Sequence << NTV2_SHM_SLOT_BITS | slot
+  std::atomic<uint64_t> skipped;
+  std::atomic<uint32_t> capsSerial;         // Odd while the caps are written
+  uint32_t audioChannels;
+  char videoCaps[NTV2_SHM_CAPS_SIZE];
+  std::atomic<int32_t> readers[NTV2_SHM_MAX_READERS];   // Pids, 0 if free
+  NTV2GstShmSlot slots[NTV2_SHM_MAX_SLOTS];
+};
+
+static void
+_init_ntv2_shm_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_shm_debug, "ajantv2shm", 0,
+        "AJA ntv2 shared memory publishing");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+
+// Shared between processes, so no FUTEX_PRIVATE_FLAG
+static void
+_futex_wait (std::atomic<uint32_t> * inWord, uint32_t inValue,
+    int64_t inTimeoutUs)
+{
+  struct timespec timeout;
+
+  timeout.tv_sec = (time_t) (inTimeoutUs / G_USEC_PER_SEC);
+  timeout.tv_nsec = (long) (inTimeoutUs % G_USEC_PER_SEC) * 1000;
+  syscall (SYS_futex, (uint32_t *) inWord, FUTEX_WAIT, inValue, &timeout,
+      NULL, 0);
+}
+
+
+static void
+_futex_wake (std::atomic<uint32_t> * inWord)
+{
+  syscall (SYS_futex, (uint32_t *) inWord, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+static size_t
+_page_round (size_t inSize)
+{
+  return GST_ROUND_UP_N (inSize, (size_t) sysconf (_SC_PAGESIZE));
+}
+
+
+static bool
+_process_alive (int32_t inPid)
+{
+  return kill ((pid_t) inPid, 0) == 0 || errno != ESRCH;
+}
+
+
+NTV2GstShmRing::NTV2GstShmRing ()
+:
+mRefCount (1),
+mHeader (NULL),
+mMappedSize (0),
+mIsWriter (false),
+mReader (-1),
+mNextSlot (0),
+mSequence (0),
+mDevice (NULL)
+{
+  _init_ntv2_shm_debug ();
+}
+
+
+NTV2GstShmRing::~NTV2GstShmRing ()
+{
+  if (!mHeader)
+    return;
+
+  if (mIsWriter) {
+    ReleaseDevice ();
+    Close ();
+
+    GST_INFO ("Closed ring '%s', %" G_GUINT64_FORMAT " frames published, %"
+        G_GUINT64_FORMAT " skipped", mName.c_str (), mSequence,
+        (guint64) mHeader->skipped.load ());
+  } else if (mReader >= 0) {
+    const uint64_t bit = G_GUINT64_CONSTANT (1) << mReader;
+
+    for (uint32_t i = 0; i < mHeader->numSlots; i++)
+      if (mHeader->slots[i].holders.fetch_and (~bit) & bit)
+        mHeader->slots[i].state.fetch_sub (1, std::memory_order_release);
+    mHeader->readers[mReader].store (0, std::memory_order_release);
+  }
+
+  munmap (mHeader, mMappedSize);
+}
+
+
+NTV2GstShmRing *
+NTV2GstShmRing::Create (const std::string & inName, uint32_t inNumSlots,
+    size_t inVideoSize, size_t inAudioSize, int inNUMANode, int & outError)
+{
+  const std::string path ("/" + inName);
+  int error;
+
+  _init_ntv2_shm_debug ();
+  outError = 0;
+
+  if (inNumSlots < 2 || inNumSlots > NTV2_SHM_MAX_SLOTS) {
+    outError = EINVAL;
+    return NULL;
+  }
+
+  // A ring another writer still publishes to is not mine to replace
+  NTV2GstShmRing *existing = Open (inName, error);
+  if (!existing && error == EUSERS) {
+    outError = EBUSY;
+    return NULL;
+  }
+  if (existing) {
+    const int32_t pid = existing->mHeader->writerPid;
+    const bool busy = !existing->IsClosed () && pid != (int32_t) getpid ()
+        && _process_alive (pid);
+    existing->Unref ();
+    if (busy) {
+      GST_WARNING ("Ring '%s' is published by process %d", inName.c_str (),
+          pid);
+      outError = EBUSY;
+      return NULL;
+    }
+  }
+
+  // Readers of a ring left behind keep their mapping until they see it
+  // closed and open the new one
+  shm_unlink (path.c_str ());
+  int fd = shm_open (path.c_str (), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+      0660);
+  if (fd < 0) {
+    outError = errno;
+    return NULL;
+  }
+
+  const size_t dataOffset = _page_round (sizeof (Header));
+  const size_t stride = _page_round (inVideoSize) + _page_round (inAudioSize);
+  const size_t size = dataOffset + stride * inNumSlots;
+
+  void *data = MAP_FAILED;
+  if (ftruncate (fd, (off_t) size) == 0)
+    data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    outError = errno;
+    close (fd);
+    shm_unlink (path.c_str ());
+    return NULL;
+  }
+  close (fd);
+
+  // Touching the pages places them, the DMA lock pins them there
+  NTV2GstTopologyPlaceMemory ((uint8_t *) data + dataOffset,
+      stride * inNumSlots, inNUMANode);
+
+  NTV2GstShmRing *ring = new NTV2GstShmRing;
+  ring->mName = inName;
+  ring->mHeader = (Header *) data;
+  ring->mMappedSize = size;
+  ring->mIsWriter = true;
+
+  Header *header = ring->mHeader;
+  header->version = NTV2_SHM_VERSION;
+  header->headerSize = (uint32_t) sizeof (Header);
+  header->numSlots = inNumSlots;
+  header->dataOffset = dataOffset;
+  header->slotStride = stride;
+  header->videoSize = inVideoSize;
+  header->audioSize = inAudioSize;
+  header->writerPid = (int32_t) getpid ();
+  header->instance = (uint64_t) g_get_real_time () ^ (uint64_t) g_random_int ()
+      << 32;
+  header->magic.store (NTV2_SHM_MAGIC, std::memory_order_release);
+
+  GST_INFO ("Created ring '%s' of %u slots, %" G_GSIZE_FORMAT " bytes of "
+      "video and %" G_GSIZE_FORMAT " of audio each, %" G_GSIZE_FORMAT
+      " bytes on NUMA node %d", inName.c_str (), inNumSlots,
+      (gsize) inVideoSize, (gsize) inAudioSize, (gsize) size, inNUMANode);
+
+  return ring;
+}
+
+
+NTV2GstShmRing *
+NTV2GstShmRing::Open (const std::string & inName, int & outError)
+{
+  const std::string path ("/" + inName);
+  struct stat st;
+
+  _init_ntv2_shm_debug ();
+  outError = 0;
+
+  int fd = shm_open (path.c_str (), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    outError = errno;
+    return NULL;
+  }
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < sizeof (Header)) {
+    outError = fstat (fd, &st) != 0 ? errno : EPROTO;
+    close (fd);
+    return NULL;
+  }
+
+  void *data = mmap (NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    outError = errno;
+    close (fd);
+    return NULL;
+  }
+  close (fd);
+
+  Header *header = (Header *) data;
+  if (header->magic.load (std::memory_order_acquire) != NTV2_SHM_MAGIC
+      || header->version != NTV2_SHM_VERSION
+      || header->headerSize != sizeof (Header)
+      || header->numSlots > NTV2_SHM_MAX_SLOTS
+      || header->dataOffset + header->slotStride * header->numSlots >
+      (uint64_t) st.st_size) {
+    GST_WARNING ("Ring '%s' is not one of this version", inName.c_str ());
+    munmap (data, (size_t) st.st_size);
+    outError = EPROTO;
+    return NULL;
+  }
+
+  NTV2GstShmRing *ring = new NTV2GstShmRing;
+  ring->mName = inName;
+  ring->mHeader = header;
+  ring->mMappedSize = (size_t) st.st_size;
+
+  const int32_t pid = (int32_t) getpid ();
+  for (int32_t i = 0; i < NTV2_SHM_MAX_READERS && ring->mReader < 0; i++) {
+    int32_t expected = 0;
+    if (header->readers[i].compare_exchange_strong (expected, pid))
+      ring->mReader = i;
+  }
+  if (ring->mReader < 0) {
+    GST_WARNING ("Ring '%s' has %d readers already", inName.c_str (),
+        NTV2_SHM_MAX_READERS);
+    ring->Unref ();
+    outError = EUSERS;
+    return NULL;
+  }
+
+  GST_DEBUG ("Opened ring '%s' of process %d as reader %d", inName.c_str (),
+      header->writerPid, ring->mReader);
+
+  return ring;
+}
+
+
+void
+NTV2GstShmRing::Ref (void)
+{
+  g_atomic_int_inc (&mRefCount);
+}
+
+
+void
+NTV2GstShmRing::Unref (void)
+{
+  if (g_atomic_int_dec_and_test (&mRefCount))
+    delete this;
+}
+
+
+void
+NTV2GstShmRing::LockForDMA (NTV2GstDevice * inDevice)
+{
+  const size_t size = mHeader->slotStride * mHeader->numSlots;
+
+  ReleaseDevice ();
+
+  // One lock for all slots, audio included, which the device never touches
+  if (inDevice->DMABufferLock ((const ULWord *) GetVideo (0), size, true)) {
+    mDevice = inDevice;
+    GST_DEBUG ("Locked %" G_GSIZE_FORMAT " bytes of ring '%s'", (gsize) size,
+        mName.c_str ());
+  } else {
+    GST_WARNING ("Failed to lock %" G_GSIZE_FORMAT " bytes of ring '%s', "
+        "transfers into it are slower", (gsize) size, mName.c_str ());
+  }
+}
+
+
+void
+NTV2GstShmRing::ReleaseDevice (void)
+{
+  if (!mDevice)
+    return;
+
+  mDevice->DMABufferUnlock ((const ULWord *) GetVideo (0),
+      mHeader->slotStride * mHeader->numSlots);
+  mDevice = NULL;
+}
+
+
+void
+NTV2GstShmRing::Close (void)
+{
+  if (mHeader->closed.exchange (1, std::memory_order_acq_rel))
+    return;
+
+  mHeader->wake.fetch_add (1, std::memory_order_release);
+  _futex_wake (&mHeader->wake);
+
+  // Only if the name still is mine, a new writer may have replaced it
+  const std::string path ("/" + mName);
+  int fd = shm_open (path.c_str (), O_RDONLY | O_CLOEXEC, 0);
+  if (fd >= 0) {
+    void *named = mmap (NULL, sizeof (Header), PROT_READ, MAP_SHARED, fd, 0);
+    if (named != MAP_FAILED) {
+      if (((const Header *) named)->instance == mHeader->instance)
+        shm_unlink (path.c_str ());
+      munmap (named, sizeof (Header));
+    }
+    close (fd);
+  }
+}
+
+
+int32_t
+NTV2GstShmRing::AcquireSlot (uint8_t * &outVideo)
+{
+  const uint32_t numSlots = mHeader->numSlots;
+
+  for (uint32_t i = 0; i < numSlots; i++) {
+    const uint32_t slot = (mNextSlot + i) % numSlots;
+    uint32_t expected = 0;
+
+    if (mHeader->slots[slot].state.compare_exchange_strong (expected,
+            NTV2_SHM_WRITING | 1, std::memory_order_acquire)) {
+      // Readers that claim it from now on see it is not their frame
+      mHeader->slots[slot].sequence.store (0, std::memory_order_relaxed);
+      mNextSlot = slot + 1;
+      outVideo = GetVideo ((int32_t) slot);
+      return (int32_t) slot;
+    }
+  }
+
+  mHeader->skipped.fetch_add (1, std::memory_order_relaxed);
+  ReclaimDeadReaders ();
+
+  return -1;
+}
+
+
+void
+NTV2GstShmRing::Publish (int32_t inSlot, const NTV2GstShmFrame & inFrame,
+    const void *inAudio, size_t inAudioSize)
+{
+  NTV2GstShmSlot & slot = mHeader->slots[inSlot];
+  const size_t audioSize = MIN (inAudioSize, (size_t) mHeader->audioSize);
+
+  slot.frame = inFrame;
+  slot.frame.audioSize = (uint32_t) audioSize;
+  slot.frame.capsSerial =
+      mHeader->capsSerial.load (std::memory_order_relaxed);
+  if (audioSize)
+    memcpy (GetAudio (inSlot), inAudio, audioSize);
+
+  const uint64_t sequence = ++mSequence;
+  slot.sequence.store (sequence, std::memory_order_release);
+  slot.state.fetch_and (~NTV2_SHM_WRITING, std::memory_order_release);
+
+  mHeader->newest.store ((sequence << NTV2_SHM_SLOT_BITS) | (uint64_t) inSlot,
+      std::memory_order_release);
+  mHeader->wake.fetch_add (1, std::memory_order_release);
+  _futex_wake (&mHeader->wake);
+}
+
+
+void
+NTV2GstShmRing::SetCaps (const char *inVideoCaps, uint32_t inAudioChannels)
+{
+  // Seqlock, readers retry while the serial is odd or changed under them
+  mHeader->capsSerial.fetch_add (1, std::memory_order_acq_rel);
+  g_strlcpy (mHeader->videoCaps, inVideoCaps ? inVideoCaps : "",
+      NTV2_SHM_CAPS_SIZE);
+  mHeader->audioChannels = inAudioChannels;
+  mHeader->capsSerial.fetch_add (1, std::memory_order_release);
+
+  GST_DEBUG ("Caps of ring '%s': %s, %u audio channels", mName.c_str (),
+      mHeader->videoCaps, inAudioChannels);
+}
+
+
+int32_t
+NTV2GstShmRing::WaitFrame (uint64_t inAfter, int64_t inTimeoutUs,
+    uint64_t & outSequence)
+{
+  const int64_t deadline = g_get_monotonic_time () + inTimeoutUs;
+  const uint64_t bit = G_GUINT64_CONSTANT (1) << mReader;
+
+  while (!IsClosed ()) {
+    const uint32_t wake = mHeader->wake.load (std::memory_order_acquire);
+    const uint64_t newest = mHeader->newest.load (std::memory_order_acquire);
+    const uint64_t newestSequence = newest >> NTV2_SHM_SLOT_BITS;
+
+    if (newestSequence > inAfter) {
+      uint64_t sequence = newestSequence;
+      uint32_t slot = (uint32_t) (newest & ((1 << NTV2_SHM_SLOT_BITS) - 1));
+
+      // The next frame in order, unless the writer reused its slot already
+      if (inAfter && newestSequence != inAfter + 1)
+        for (uint32_t i = 0; i < mHeader->numSlots; i++)
+          if (mHeader->slots[i].sequence.load (std::memory_order_acquire) ==
+              inAfter + 1) {
+            sequence = inAfter + 1;
+            slot = i;
+            break;
+          }
+
+      NTV2GstShmSlot & claimed = mHeader->slots[slot];
+      uint32_t state = claimed.state.load (std::memory_order_relaxed);
+      bool referenced = false;
+      while (!(state & NTV2_SHM_WRITING) && !referenced)
+        referenced = claimed.state.compare_exchange_weak (state, state + 1,
+            std::memory_order_acquire);
+
+      if (referenced) {
+        // Holding it, the writer can't take it any more; was it reused before?
+        if (claimed.sequence.load (std::memory_order_acquire) == sequence) {
+          claimed.holders.fetch_or (bit, std::memory_order_relaxed);
+          outSequence = sequence;
+          return (int32_t) slot;
+        }
+        claimed.state.fetch_sub (1, std::memory_order_release);
+      }
+
+      // Rewritten under me, a newer frame is on its way
+      if (mHeader->newest.load (std::memory_order_acquire) != newest)
+        continue;
+    }
+
+    const int64_t remaining = deadline - g_get_monotonic_time ();
+    if (remaining <= 0)
+      break;
+    _futex_wait (&mHeader->wake, wake, remaining);
+  }
+
+  return -1;
+}
+
+
+bool
+NTV2GstShmRing::IsClosed (void)
+{
+  return mHeader->closed.load (std::memory_order_acquire) != 0;
+}
+
+
+uint32_t
+NTV2GstShmRing::GetCaps (std::string & outVideoCaps,
+    uint32_t & outAudioChannels)
+{
+  char caps[NTV2_SHM_CAPS_SIZE];
+
+  for (;;) {
+    const uint32_t serial =
+        mHeader->capsSerial.load (std::memory_order_acquire);
+    if (serial & 1) {
+      g_usleep (100);
+      continue;
+    }
+
+    memcpy (caps, mHeader->videoCaps, NTV2_SHM_CAPS_SIZE);
+    caps[NTV2_SHM_CAPS_SIZE - 1] = '\0';
+    const uint32_t channels = mHeader->audioChannels;
+
+    std::atomic_thread_fence (std::memory_order_acquire);
+    if (mHeader->capsSerial.load (std::memory_order_relaxed) == serial) {
+      outVideoCaps = caps;
+      outAudioChannels = channels;
+      return serial;
+    }
+  }
+}
+
+
+void
+NTV2GstShmRing::ReleaseSlot (int32_t inSlot)
+{
+  NTV2GstShmSlot & slot = mHeader->slots[inSlot];
+
+  if (mIsWriter) {
+    // Not published if the transfer failed, it still is WRITING then
+    uint32_t state = slot.state.load (std::memory_order_relaxed);
+    while (!slot.state.compare_exchange_weak (state,
+            (state & ~NTV2_SHM_WRITING) - 1, std::memory_order_release)) {
+    }
+    return;
+  }
+
+  slot.holders.fetch_and (~(G_GUINT64_CONSTANT (1) << mReader),
+      std::memory_order_relaxed);
+  slot.state.fetch_sub (1, std::memory_order_release);
+}
+
+
+const NTV2GstShmFrame &
+NTV2GstShmRing::GetFrame (int32_t inSlot) const
+{
+  return mHeader->slots[inSlot].frame;
+}
+
+
+uint8_t *
+NTV2GstShmRing::GetVideo (int32_t inSlot) const
+{
+  return (uint8_t *) mHeader + mHeader->dataOffset +
+      mHeader->slotStride * (uint64_t) inSlot;
+}
+
+
+uint8_t *
+NTV2GstShmRing::GetAudio (int32_t inSlot) const
+{
+  return GetVideo (inSlot) + _page_round ((size_t) mHeader->videoSize);
+}
+
+
+size_t
+NTV2GstShmRing::GetVideoSize (void) const
+{
+  return (size_t) mHeader->videoSize;
+}
+
+
+size_t
+NTV2GstShmRing::GetAudioSize (void) const
+{
+  return (size_t) mHeader->audioSize;
+}
+
+
+uint32_t
+NTV2GstShmRing::GetNumSlots (void) const
+{
+  return mHeader->numSlots;
+}
+
+
+uint64_t
+NTV2GstShmRing::GetNumSkipped (void) const
+{
+  return mHeader->skipped.load (std::memory_order_relaxed);
+}
+
+
+void
+NTV2GstShmRing::ReclaimDeadReaders (void)
+{
+  for (int32_t i = 0; i < NTV2_SHM_MAX_READERS; i++) {
+    int32_t pid = mHeader->readers[i].load (std::memory_order_acquire);
+    if (pid == 0 || _process_alive (pid))
+      continue;
+
+    const uint64_t bit = G_GUINT64_CONSTANT (1) << i;
+    uint32_t reclaimed = 0;
+    for (uint32_t j = 0; j < mHeader->numSlots; j++)
+      if (mHeader->slots[j].holders.fetch_and (~bit) & bit) {
+        mHeader->slots[j].state.fetch_sub (1, std::memory_order_release);
+        reclaimed++;
+      }
+    mHeader->readers[i].compare_exchange_strong (pid, 0);
+
+    GST_WARNING ("Reader process %d of ring '%s' went away, reclaimed %u "
+        "slots", pid, mName.c_str (), reclaimed);
+  }
+}
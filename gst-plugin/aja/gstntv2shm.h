@@ -0,0 +1,187 @@
+/**
+    @file        gstntv2shm.h
+    @brief       Declares the NTV2GstShmRing class, publishing captured frames to other processes through shared memory.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_SHM_H
+#define _GST_NTV2_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+class NTV2GstDevice;
+
+#define NTV2_SHM_MAX_READERS        64
+#define NTV2_SHM_MAX_SLOTS          256
+#define NTV2_SHM_CAPS_SIZE          2048
+
+
+/**
+    @brief    What is published along with the video and audio of a frame.
+**/
+
+typedef struct
+{
+    uint64_t        frameNumber;            /// Frame number of the device, dropped frames included
+    uint64_t        captureTime;            /// CLOCK_MONOTONIC nanoseconds when the frame was transferred
+    uint64_t        deviceTime;             /// Frame time stamp of the device
+    uint64_t        framesProcessed;
+    uint64_t        framesDropped;
+    uint32_t        videoOffset;            /// Picture in the slot's video, after the VANC lines
+    uint32_t        videoSize;
+    uint32_t        audioSize;
+    uint32_t        capsSerial;             /// Caps of the video, see NTV2GstShmRing::GetCaps
+    uint32_t        timeCodeDBB;
+    uint32_t        timeCodeLow;
+    uint32_t        timeCodeHigh;
+    uint8_t         timeCodeValid;
+    uint8_t         fieldCount;
+    uint8_t         haveSignal;
+    uint8_t         transferCharacteristics;
+    uint8_t         colorimetry;
+    uint8_t         fullRange;
+} NTV2GstShmFrame;
+
+
+/**
+    @brief    A ring of frame slots in a POSIX shared memory object, written by the one process that
+              captures a channel and read by any number of processes at once. The video of a slot is
+              DMA locked in the writer, so the device transfers straight into the shared pages and
+              readers map what it wrote.
+
+              Every slot counts the references held on it: one by the writer while it captures into it
+              and its own pipeline uses it, and one by every reader that holds it. The writer only ever
+              reuses slots nobody references and skips publishing a frame if all slots are referenced,
+              so a slow reader costs itself frames but never stalls the capture. References of reader
+              processes that died are reclaimed by the writer.
+    @note     The writer and its readers must be built from the same version, the layout is checked.
+**/
+
+class NTV2GstShmRing
+{
+    public:
+        /**
+            @brief    Creates the ring for writing, replacing one of the same name that a previous writer
+                      left behind.
+            @param[in]    inName          Name of the ring, without the leading slash.
+            @param[out]   outError        The errno value if it failed.
+            @return   The ring with one reference, or NULL.
+        **/
+        static NTV2GstShmRing * Create (const std::string & inName, uint32_t inNumSlots,
+                                        size_t inVideoSize, size_t inAudioSize, int inNUMANode,
+                                        int & outError);
+
+        /**
+            @brief    Opens an existing ring for reading and registers as one of its readers.
+            @return   The ring with one reference, or NULL if there is none or all reader places are taken.
+        **/
+        static NTV2GstShmRing * Open (const std::string & inName, int & outError);
+
+        virtual void            Ref (void);
+
+        /**
+            @brief    Drops a reference. The last one closes the ring for the readers if this is the writer,
+                      or unregisters the reader, and unmaps it.
+        **/
+        virtual void            Unref (void);
+
+        //    Writer
+
+        /**
+            @brief    DMA locks the video of all slots on the device. The locks go away with
+                      ReleaseDevice, which must be called before the device is closed.
+        **/
+        virtual void            LockForDMA (NTV2GstDevice * inDevice);
+        virtual void            ReleaseDevice (void);
+
+        /**
+            @brief    Stops publishing. Readers see the ring closed and open the next one of the name.
+                      The slots stay mapped for the buffers that still wrap them.
+        **/
+        virtual void            Close (void);
+
+        /**
+            @brief    Takes a slot nobody references for the next frame, with the writer's reference.
+            @param[out]   outVideo        Where the frame's video goes.
+            @return   The slot, or -1 if all are referenced.
+        **/
+        virtual int32_t         AcquireSlot (uint8_t * & outVideo);
+
+        /**
+            @brief    Publishes the frame of a slot taken with AcquireSlot, copying the audio into it and
+                      waking the readers. The writer's reference stays until ReleaseSlot.
+        **/
+        virtual void            Publish (int32_t inSlot, const NTV2GstShmFrame & inFrame,
+                                         const void * inAudio, size_t inAudioSize);
+
+        /**
+            @brief    Sets the caps of the video published from now on, and the audio's channels.
+        **/
+        virtual void            SetCaps (const char * inVideoCaps, uint32_t inAudioChannels);
+
+        //    Reader
+
+        /**
+            @brief    Waits for a frame newer than inAfter and references it for this reader. The frame
+                      right after inAfter if it is still there, the newest one otherwise.
+            @param[in]    inAfter         Sequence number of the last frame read, 0 for none.
+            @param[out]   outSequence     Sequence number of the frame.
+            @return   The slot, or -1 if no frame came before the timeout or the writer closed the ring.
+        **/
+        virtual int32_t         WaitFrame (uint64_t inAfter, int64_t inTimeoutUs, uint64_t & outSequence);
+
+        /**
+            @brief    True once the writer closed the ring, readers should open it again by name.
+        **/
+        virtual bool            IsClosed (void);
+
+        /**
+            @brief    Copies the current video caps and the audio's channels.
+            @return   The serial number of the caps, 0 if none were set yet.
+        **/
+        virtual uint32_t        GetCaps (std::string & outVideoCaps, uint32_t & outAudioChannels);
+
+        //    Both
+
+        /**
+            @brief    Drops the reference of the writer, or of this reader, on a slot.
+        **/
+        virtual void            ReleaseSlot (int32_t inSlot);
+
+        virtual const NTV2GstShmFrame & GetFrame (int32_t inSlot) const;
+        virtual uint8_t *       GetVideo (int32_t inSlot) const;
+        virtual uint8_t *       GetAudio (int32_t inSlot) const;
+        virtual size_t          GetVideoSize (void) const;
+        virtual size_t          GetAudioSize (void) const;
+        virtual uint32_t        GetNumSlots (void) const;
+
+        /**
+            @brief    Returns the number of frames that were not published because all slots were referenced.
+        **/
+        virtual uint64_t        GetNumSkipped (void) const;
+
+        struct Header;
+
+    private:
+                                NTV2GstShmRing ();
+        virtual                 ~NTV2GstShmRing ();
+
+        void                    ReclaimDeadReaders (void);
+
+    private:
+        int                     mRefCount;
+        std::string             mName;
+        Header *                mHeader;            ///    The whole mapping, slot data after the header
+        size_t                  mMappedSize;
+        bool                    mIsWriter;
+        int32_t                 mReader;            ///    My place among the readers, -1 for the writer
+        uint32_t                mNextSlot;          ///    Where the writer looks for a free slot first
+        uint64_t                mSequence;          ///    Sequence number of the writer's last frame
+        NTV2GstDevice *         mDevice;            ///    Device the video is DMA locked on, or NULL
+};
+
+#endif    //    _GST_NTV2_SHM_H
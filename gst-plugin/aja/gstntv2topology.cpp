@@ -0,0 +1,248 @@
+/**
+    @file        gstntv2topology.cpp
+    @brief       Implementation of the NUMA topology lookups.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+
+#include <gst/gst.h>
+
+#include "gstntv2topology.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_ntv2_topology_debug);
+#define GST_CAT_DEFAULT gst_ntv2_topology_debug
+
+// PCI vendor ID of AJA Video Systems
+#define AJA_PCI_VENDOR_ID       "0xf1d0"
+// From <numaif.h>, not using libnuma for a single call
+#define NTV2_MPOL_PREFERRED     1
+#define NTV2_MAX_NUMA_NODES     1024
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+static void
+_init_ntv2_topology_debug (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static gsize _init = 0;
+
+  if (g_once_init_enter (&_init)) {
+    GST_DEBUG_CATEGORY_INIT (gst_ntv2_topology_debug, "ajantv2topology", 0,
+        "AJA ntv2 NUMA topology");
+    g_once_init_leave (&_init, 1);
+  }
+#endif
+}
+
+
+static bool
+_read_sysfs (const std::string & inPath, std::string & outValue)
+{
+  gchar *contents = NULL;
+
+  if (!g_file_get_contents (inPath.c_str (), &contents, NULL, NULL))
+    return false;
+
+  outValue = g_strstrip (contents);
+  g_free (contents);
+
+  return true;
+}
+
+
+// The driver's sysfs class device links to the PCIe device. Without it, the
+// driver numbers the boards in PCI probe order, i.e. by address.
+static std::string
+_find_pci_device (uint32_t inDeviceIndex)
+{
+  gchar *path = g_strdup_printf ("/sys/class/ajantv2/ajantv2%u/device",
+      inDeviceIndex);
+  std::string result;
+
+  if (g_file_test (path, G_FILE_TEST_IS_DIR))
+    result = path;
+  g_free (path);
+  if (!result.empty ())
+    return result;
+
+  GDir *dir = g_dir_open ("/sys/bus/pci/devices", 0, NULL);
+  if (!dir)
+    return result;
+
+  std::vector<std::string> devices;
+  const gchar *name;
+  while ((name = g_dir_read_name (dir))) {
+    std::string device = std::string ("/sys/bus/pci/devices/") + name;
+    std::string vendor;
+
+    if (_read_sysfs (device + "/vendor", vendor) && vendor == AJA_PCI_VENDOR_ID)
+      devices.push_back (device);
+  }
+  g_dir_close (dir);
+
+  std::sort (devices.begin (), devices.end ());
+  if (inDeviceIndex < devices.size ())
+    result = devices[inDeviceIndex];
+
+  return result;
+}
+
+
+int
+NTV2GstTopologyGetDeviceNode (uint32_t inDeviceIndex)
+{
+  std::string device, value;
+
+  _init_ntv2_topology_debug ();
+
+  // Nothing to choose from on a single node
+  if (!g_file_test ("/sys/devices/system/node/node1", G_FILE_TEST_IS_DIR))
+    return -1;
+
+  device = _find_pci_device (inDeviceIndex);
+  if (device.empty ()) {
+    GST_DEBUG ("No PCIe device found for device index %u", inDeviceIndex);
+    return -1;
+  }
+
+  if (!_read_sysfs (device + "/numa_node", value))
+    return -1;
+
+  GST_DEBUG ("Device index %u is %s on NUMA node %s", inDeviceIndex,
+      device.c_str (), value.c_str ());
+
+  return atoi (value.c_str ());
+}
+
+
+std::vector<uint32_t>
+NTV2GstTopologyGetNodeCPUs (int inNode)
+{
+  std::vector<uint32_t> cpus;
+  std::string list;
+
+  if (inNode < 0)
+    return cpus;
+
+  gchar *path = g_strdup_printf ("/sys/devices/system/node/node%d/cpulist",
+      inNode);
+  bool found = _read_sysfs (path, list);
+  g_free (path);
+  if (!found)
+    return cpus;
+
+  // "0-7,16-23"
+  gchar **ranges = g_strsplit (list.c_str (), ",", -1);
+  for (gchar ** range = ranges; *range; range++) {
+    guint first, last;
+
+    if (sscanf (*range, "%u-%u", &first, &last) == 2) {
+      for (guint cpu = first; cpu <= last; cpu++)
+        cpus.push_back (cpu);
+    } else if (sscanf (*range, "%u", &first) == 1) {
+      cpus.push_back (first);
+    }
+  }
+  g_strfreev (ranges);
+
+  return cpus;
+}
+
+
+std::string
+NTV2GstTopologyFormatCPUs (const std::vector<uint32_t> & inCPUs)
+{
+  std::string list;
+
+  for (size_t i = 0; i < inCPUs.size ();) {
+    size_t j = i;
+
+    while (j + 1 < inCPUs.size () && inCPUs[j + 1] == inCPUs[j] + 1)
+      j++;
+
+    gchar *range = j > i ? g_strdup_printf ("%u-%u", inCPUs[i], inCPUs[j]) :
+        g_strdup_printf ("%u", inCPUs[i]);
+    if (!list.empty ())
+      list += ",";
+    list += range;
+    g_free (range);
+
+    i = j + 1;
+  }
+
+  return list;
+}
+
+
+int
+NTV2GstTopologyPlaceMemory (void *inData, size_t inSize, int inNode)
+{
+  const size_t pageSize = (size_t) sysconf (_SC_PAGESIZE);
+  int res = 0;
+
+  if (inNode >= 0 && inNode < NTV2_MAX_NUMA_NODES) {
+    unsigned long nodeMask[NTV2_MAX_NUMA_NODES / (8 * sizeof (unsigned long))];
+
+    memset (nodeMask, 0, sizeof (nodeMask));
+    nodeMask[inNode / (8 * sizeof (unsigned long))] |=
+        1UL << (inNode % (8 * sizeof (unsigned long)));
+
+    // Preferred instead of bound, so a full node still leaves us with memory
+    if (syscall (SYS_mbind, inData, inSize, NTV2_MPOL_PREFERRED, nodeMask,
+            (unsigned long) NTV2_MAX_NUMA_NODES + 1, 0) != 0)
+      res = errno;
+  }
+
+  // Fault in every page now instead of during the first transfer
+  for (size_t offset = 0; offset < inSize; offset += pageSize)
+    ((volatile uint8_t *) inData)[offset] = 0;
+
+  return res;
+}
+
+
+void *
+NTV2GstTopologyMapHugePages (size_t inSize, size_t inMaxPageSize,
+    size_t & outSize, size_t & outPageSize, int & outError)
+{
+  const size_t sizes[] = { 1024 * 1024 * 1024, 2 * 1024 * 1024 };
+
+  _init_ntv2_topology_debug ();
+
+  outError = 0;
+  for (guint i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    const size_t pageSize = sizes[i];
+    const size_t size = GST_ROUND_UP_N (inSize, pageSize);
+    const int pageShift = g_bit_nth_msf (pageSize, -1);
+
+    if (pageSize > inMaxPageSize || (pageSize > 2 * 1024 * 1024 && inSize < pageSize))
+      continue;
+
+    void *data = mmap (NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (pageShift << MAP_HUGE_SHIFT),
+        -1, 0);
+    if (data == MAP_FAILED) {
+      outError = errno;
+      GST_DEBUG ("No %" G_GSIZE_FORMAT " MiB huge pages for %" G_GSIZE_FORMAT
+          " bytes: %s", (gsize) (pageSize >> 20), (gsize) size, g_strerror (outError));
+      continue;
+    }
+
+    outSize = size;
+    outPageSize = pageSize;
+    return data;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,54 @@
+/**
+    @file        gstntv2topology.h
+    @brief       Declares the NUMA topology lookups and memory placement used to keep buffers and threads near a device.
+    @copyright   Copyright (C) 2021 NVIDIA Corporation.  All rights reserved.
+**/
+
+
+#ifndef _GST_NTV2_TOPOLOGY_H
+#define _GST_NTV2_TOPOLOGY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+/**
+    @brief    Returns the NUMA node the PCIe device of the given NTV2 device index is attached to,
+              as reported by sysfs, or -1 if unknown or if the host has a single node.
+**/
+int         NTV2GstTopologyGetDeviceNode (uint32_t inDeviceIndex);
+
+/**
+    @brief    Returns the CPUs of a NUMA node, empty if unknown.
+**/
+std::vector<uint32_t>   NTV2GstTopologyGetNodeCPUs (int inNode);
+
+/**
+    @brief    Formats a CPU list like sysfs does, e.g. "0-7,16-23".
+**/
+std::string NTV2GstTopologyFormatCPUs (const std::vector<uint32_t> & inCPUs);
+
+/**
+    @brief    Makes the pages of a not yet touched memory range come from the given NUMA node, and
+              touches them so they are allocated there right away.
+    @return   0 on success, the errno value otherwise. The memory is usable either way.
+**/
+int         NTV2GstTopologyPlaceMemory (void * inData, size_t inSize, int inNode);
+
+/**
+    @brief    Maps anonymous memory backed by huge pages of at most inMaxPageSize. 1 GiB pages are
+              only used if the mapping fills at least one of them, and fall back to 2 MiB pages.
+    @param[in]    inSize          Bytes needed.
+    @param[in]    inMaxPageSize   Largest huge page size to use.
+    @param[out]   outSize         Size of the mapping, inSize rounded up to whole pages.
+    @param[out]   outPageSize     Huge page size of the mapping.
+    @param[out]   outError        The errno value of the last failed attempt.
+    @return   The mapping, or NULL if no huge pages were available. Unmap it with munmap().
+**/
+void *      NTV2GstTopologyMapHugePages (size_t inSize, size_t inMaxPageSize, size_t & outSize,
+                                         size_t & outPageSize, int & outError);
+
+#endif    //    _GST_NTV2_TOPOLOGY_H